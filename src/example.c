@@ -5,36 +5,20 @@ int main() {
     // Start emitting class
     emit_class_header();
         constant_pool_start();
-            constant_utf8("TestClass");                // Index 1
-            constant_utf8("java/lang/Object");         // Index 2
-            constant_utf8("Code");                     // Index 3
-            constant_utf8("()V");                      // Index 4
-            constant_utf8("([Ljava/lang/String;)V");   // Index 5
-            constant_utf8("<init>");                   // Index 6
-            constant_utf8("main");                     // Index 7
-            constant_class(1);                         // Index 8: TestClass
-            constant_class(2);                         // Index 9: java/lang/Object
-            constant_nameandtype(6, 4);                // Index 10: <init> ()V
-            constant_nameandtype(7, 5);                // Index 11: main ([Ljava/lang/String;)V
-            constant_methodref(9, 10);                 // Index 12: java/lang/Object.<init> ()V
-            constant_utf8("Hello World");              // Index 13
-            constant_utf8("java/lang/System");         // Index 14
-            constant_class(14);                        // Index 15: java/lang/System
-            constant_utf8("out");                      // Index 16
-            constant_utf8("Ljava/io/PrintStream;");    // Index 17
-
-            constant_nameandtype(16, 17);              // Index 18: System.out
-            constant_fieldref(15, 18);                 // Index 19: java/lang/System.out
-            constant_utf8("(Ljava/lang/String;)V");    // Index 20: println descriptor
-            constant_utf8("println");                  // Index 21
-            constant_nameandtype(21, 20);              // Index 22: println name and type
-
-            constant_string(13);                       // Index 23: Hello World string
-            constant_utf8("java/io/PrintStream");      // Index 24: PrintStream
-            constant_class(24);                        // Index 25: java/io/Printstream
-            constant_methodref(25, 22);                // Index 26: java/io/PrintStream.println
+            // cp_* returns the index of an existing entry instead of adding a duplicate
+            uint16_t this_class = cp_class("TestClass");
+            uint16_t super_class = cp_class("java/lang/Object");
+            uint16_t code = cp_utf8("Code");
+            uint16_t init_name = cp_utf8("<init>");
+            uint16_t init_desc = cp_utf8("()V");
+            uint16_t main_name = cp_utf8("main");
+            uint16_t main_desc = cp_utf8("([Ljava/lang/String;)V");
+            uint16_t object_init = cp_methodref("java/lang/Object", "<init>", "()V");
+            uint16_t system_out = cp_fieldref("java/lang/System", "out", "Ljava/io/PrintStream;");
+            uint16_t println = cp_methodref("java/io/PrintStream", "println", "(Ljava/lang/String;)V");
+            uint16_t hello = cp_string("Hello World");
         constant_pool_end();
-    emit_class_footer(8, ACC_PUBLIC, 9); // TestClass extends Object
+    emit_class_footer(this_class, ACC_PUBLIC, super_class); // TestClass extends Object
 
     interfaces_start();
     interfaces_end();
@@ -45,20 +29,20 @@ int main() {
     methods_start();
 
         // Constructor method
-        method_info(ACC_PUBLIC, 6, 4); // <init> ()V
-            code_attribute_start(3, 1, 1); // max_stack = 1, max_locals = 1
+        method_info(ACC_PUBLIC, init_name, init_desc); // <init> ()V
+            code_attribute_start(code, 1, 1); // max_stack = 1, max_locals = 1
             aload(0); // Load "this"
-            invokespecial(12); // Call java/lang/Object.<init>
+            invokespecial(object_init); // Call java/lang/Object.<init>
             return_inst(); // Return
             code_attribute_end();
         end_method_info();
 
         // Main method
-        method_info(ACC_PUBLIC | ACC_STATIC, 7, 5); // main ([Ljava/lang/String;)V
-            code_attribute_start(3, 2, 1); // max_stack = 2, max_locals = 1
-            getstatic(19); // Get java/lang/System.out
-            ldc(23); // Load "Hello World"
-            invokevirtual(26); // Call println
+        method_info(ACC_PUBLIC | ACC_STATIC, main_name, main_desc); // main ([Ljava/lang/String;)V
+            code_attribute_start(code, 2, 1); // max_stack = 2, max_locals = 1
+            getstatic(system_out); // Get java/lang/System.out
+            ldc(hello); // Load "Hello World"
+            invokevirtual(println); // Call println
             return_inst(); // Return
             code_attribute_end();
         end_method_info();
@@ -72,4 +56,4 @@ int main() {
     write_class("TestClass.class");
 
     return 0;
-}
\ No newline at end of file
+}
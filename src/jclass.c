@@ -7,6 +7,33 @@
 #include <stdlib.h>
 #include <string.h>
 
+#if !defined(JCLASS_NO_SIMD) && defined(__AVX2__)
+#include <immintrin.h>
+#define JCLASS_AVX2
+#elif !defined(JCLASS_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#include <emmintrin.h>
+#define JCLASS_SSE2
+#endif
+
+// strict ISO C hides fileno, so classes are read with fread there
+#if !defined(JCLASS_NO_MMAP) && (defined(__unix__) || defined(__APPLE__)) && (!defined(__STRICT_ANSI__) || defined(_POSIX_C_SOURCE))
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define JCLASS_MMAP
+#endif
+
+#if !defined(JCLASS_NO_THREADS) && defined(__STDC_VERSION__) && __STDC_VERSION__ >= 201112L && !defined(__STDC_NO_THREADS__) && !defined(__STDC_NO_ATOMICS__)
+#include <stdatomic.h>
+#include <threads.h>
+#define JCLASS_THREADS
+#endif
+
+#ifdef JCLASS_ZLIB
+// Z_SOLO keeps zconf.h from including unistd.h, whose dup and dup2 clash with the instructions
+#define Z_SOLO
+#include <zlib.h>
+#endif
+
 /** @brief Readability macro to mark where class generation starts */
 #define J_CLASS_BEGIN {}
 
@@ -78,1625 +105,8332 @@
     (uint8_t)((v) & 0xFF) \
 }
 
-/** @brief The size of the buffer for bytecode, may be overidden if needed */
-#define BUFFER_SIZE 65536
+/** @brief The starting capacity of the output buffer, it grows as needed. May be overidden if needed */
+#ifndef BUFFER_SIZE
+#define BUFFER_SIZE 1024
+#endif
 
-/** @brief Output buffer where the JVM bytecode is stored */
-static uint8_t outputBuffer[BUFFER_SIZE];
-/** @brief Current index of the output buffer */
-static size_t outputIndex = 0;
+/**
+ * @brief Error codes reported by jc_error() and the functions that return an int
+ * 
+ */
+enum {
+    JCLASS_OK = 0,
+    JCLASS_ERR_NOMEM,   // the output buffer could not be grown
+    JCLASS_ERR_RANGE,   // a patch or value was outside of what can be encoded
+    JCLASS_ERR_IO,      // the output file could not be written
+    JCLASS_ERR_STATE,   // a function was called at the wrong point of building the class
+    JCLASS_ERR_ENCODING,// a string is not valid UTF-8
+    JCLASS_ERR_FORMAT,  // a class file being read is not valid
+    JCLASS_ERR_HIERARCHY// frames need the common superclass of two classes and jc_set_common_superclass gave none
+};
 
-/** 
-* @brief Helper function. Do not use unless you know what you're doing
-* 
-*/
-static void emit_byte(uint8_t b) {
-    if (outputIndex >= BUFFER_SIZE) {
-        fprintf(stderr, "Buffer overflow\n");
-        exit(1);
-    }
-    outputBuffer[outputIndex++] = b;
-}
+/**
+ * @brief Class file major versions of some Java releases, for jc_set_version
+ * 
+ */
+enum {
+    JCLASS_JAVA_5 = 49,
+    JCLASS_JAVA_6 = 50,     // StackMapTable
+    JCLASS_JAVA_7 = 51,     // invokedynamic, frames required, no jsr/ret
+    JCLASS_JAVA_8 = 52,
+    JCLASS_JAVA_9 = 53,     // modules
+    JCLASS_JAVA_11 = 55,    // nestmates, dynamic constants
+    JCLASS_JAVA_16 = 60,    // records
+    JCLASS_JAVA_17 = 61,    // sealed classes
+    JCLASS_JAVA_21 = 65
+};
 
 /**
-    * @brief Writes a byte to the buffer
-    * @param v The value to place in the buffer
-    * 
-*/
-static void emit_u1(uint8_t v) {
-    emit_byte(v);
-}
+ * @brief Options set with jc_set_flags
+ * 
+ */
+enum {
+    JCLASS_COMPUTE_MAXS = 1 << 0,   // code_attribute_end works out max_stack and max_locals from the method's code
+    JCLASS_COMPUTE_FRAMES = 1 << 1, // code_attribute_end adds a StackMapTable to the method's code, implies JCLASS_COMPUTE_MAXS
+    JCLASS_INSTRUCTION_LIST = 1 << 2, // code_attribute_end turns the method's code into an instruction list, runs the code pass on it and writes it back
+    JCLASS_REMOVE_DEAD_CODE = 1 << 3  // code_attribute_end removes code that can never run and exception handlers that can never be used, after the code pass
+};
 
-/** 
-    * @brief Takes a uint16_t and splits it into 2 bytes (0x1024 -> { 0x10, 0x24 }), which it then writes into the buffer
-    * @param v The two values to place in the buffer
-    * 
-*/
-static void emit_u2(uint16_t v) {
-    emit_byte((v >> 8) & 0xFF);
-    emit_byte(v & 0xFF);
-}
+/**
+ * @brief Rules of the peephole pass, set with jc_set_peephole
+ * 
+ */
+enum {
+    JCLASS_PEEPHOLE_STORE_LOAD = 1 << 0,    // xstore n; xload n becomes dup; xstore n, or goes away if nothing else reads n
+    JCLASS_PEEPHOLE_PUSH_POP = 1 << 1,      // a constant or local pushed and popped straight away goes away
+    JCLASS_PEEPHOLE_JUMPS = 1 << 2,         // jumps to the next instruction go away, a conditional branch over a goto is inverted
+    JCLASS_PEEPHOLE_DUP_POP = 1 << 3,       // dup; pop and dup2; pop2 go away
+    JCLASS_PEEPHOLE_CHECKCAST = 1 << 4,     // a checkcast right after the same checkcast or aconst_null goes away
+    JCLASS_PEEPHOLE_ALL = (1 << 5) - 1
+};
+
+/** @brief Number of peephole rules */
+#define JCLASS_PEEPHOLE_RULES 5
 
 /**
-    * @brief Splits a uint32_t into 4 bytes (0x12345678 -> { 0x12, 0x34, 0x56, 0x78 }) and writes them into the buffer
-    * @param v The values to place into the buffer
-    * 
-*/
-static void emit_u4(uint32_t v) {
-    emit_byte((v >> 24) & 0xFF);
-    emit_byte((v >> 16) & 0xFF);
-    emit_byte((v >> 8) & 0xFF);
-    emit_byte(v & 0xFF);
-}
+ * @brief What the peephole pass did, see jc_get_peephole_stats
+ * 
+ */
+typedef struct jclass_peephole_stats {
+    size_t methods;                         // methods the rules ran on
+    size_t bytes_before;                    // size of their code as it was emitted
+    size_t bytes_after;                     // size of their code as it was written
+    size_t applied[JCLASS_PEEPHOLE_RULES];  // times each rule changed the code, in the order of the JCLASS_PEEPHOLE_* bits
+    size_t saved[JCLASS_PEEPHOLE_RULES];    // bytes each rule saved, not counting branches that became shorter
+} jclass_peephole_stats;
 
 /**
-    * @brief Returns the current buffer position that will be emitted to
-    * 
-*/
-static size_t current_offset() {
-    return outputIndex;
-}
+ * @brief Where a constant pool entry lives in the pool buffer
+ * 
+ */
+typedef struct jclass_cp_entry {
+    uint32_t offset;    // offset of the tag byte in cpBuffer, UINT32_MAX for unusable slots
+    uint32_t hash;      // hash of the tag and payload
+} jclass_cp_entry;
+
+/** @brief A position in a method's code that branches can target before it is known */
+typedef uint32_t jclass_label;
 
 /**
-    @brief Places 2 bytes in the given position in the buffer (0x1024 -> (0x10 -> pos) & (0x24 -> pos + 1))
-    @param pos Where in the buffer to place the bytes
-    @param v The two bytes to place
-    
-*/
-static void patch_u2(size_t pos, uint16_t v) {
-    if (pos + 1 >= BUFFER_SIZE) {
-        fprintf(stderr, "Patch position out of range\n");
-        exit(1);
-    }
-    outputBuffer[pos] = (v >> 8) & 0xFF;
-    outputBuffer[pos + 1] = v & 0xFF;
-}
+ * @brief What a fixup belongs to
+ * 
+ */
+enum {
+    JCLASS_FIXUP_BRANCH = 0,    // goto, jsr or if*, may be relaxed to a longer form
+    JCLASS_FIXUP_SWITCH,        // default offset of a switch, owns the switch's padding
+    JCLASS_FIXUP_CASE           // case offset of the switch before it
+};
 
 /**
-    @brief Places 4 bytes in the given position in the buffer (0x12345678 -> (0x12 -> pos) & (0x34 -> pos + 1) & (0x56 -> pos + 2) & (0x78 -> pos + 3))
-    @param pos The 4 bytes to place in the buffer
-    
-*/
-static void patch_u4(size_t pos, uint32_t v) {
-    if (pos + 3 >= BUFFER_SIZE) {
-        fprintf(stderr, "Patch position out of range\n");
-        exit(1);
-    }
-    outputBuffer[pos] = (v >> 24) & 0xFF;
-    outputBuffer[pos + 1] = (v >> 16) & 0xFF;
-    outputBuffer[pos + 2] = (v >> 8) & 0xFF;
-    outputBuffer[pos + 3] = v & 0xFF;
-}
+ * @brief A branch offset that is patched once the method's labels are all bound
+ * 
+ */
+typedef struct jclass_fixup {
+    uint32_t opcode_pc;     // pc of the branch instruction, offsets are relative to it
+    uint32_t field_pc;      // pc of the offset to patch
+    jclass_label label;     // the label the branch goes to
+    uint8_t width;          // size of the offset, 2 or 4 bytes
+    uint8_t kind;           // JCLASS_FIXUP_*
+    int8_t grown;           // bytes added by relaxing the branch, or padding change of a switch
+    int32_t shift;          // bytes added before the branch by relaxing earlier ones
+} jclass_fixup;
 
-// ------------------------
-// constant_pool macros
-// ------------------------
+/**
+ * @brief An exception handler of the current method, written to the exception table by code_attribute_end
+ * 
+ */
+typedef struct jclass_handler {
+    jclass_label start;     // first instruction the handler covers
+    jclass_label end;       // first instruction after the ones it covers
+    jclass_label handler;   // first instruction of the handler
+    uint16_t catch_type;    // constant pool index of the class it catches, 0 to catch everything
+    uint32_t start_pc;      // pc of start, set by bytecode_end
+    uint32_t end_pc;        // pc of end, set by bytecode_end
+    uint32_t handler_pc;    // pc of handler, set by bytecode_end
+} jclass_handler;
 
-// Global variables for constant pool state
 /**
- * @brief Do not modify
+ * @brief An instruction of the current method's instruction list, see jc_set_code_pass. The _0 to _3, wide,
+ * ldc_w, goto_w and jsr_w forms are folded into the plain instruction, the encoding is picked again when the
+ * list is written back. Exception handlers use instruction indices in place of pcs while the list exists
  * 
  */
-static size_t cp_count_offset = 0;
+typedef struct jclass_insn {
+    uint8_t opcode;     // the plain form of the instruction
+    int32_t operand;    // local, constant pool index, bipush/sipush value, newarray type, or index of the branch target (the default of a switch)
+    int32_t extra;      // iinc increment, invokeinterface count, multianewarray dimensions, or where a switch's operands start in insn_data
+} jclass_insn;
+
 /**
- * @brief Keeps track of the size of the constant pool
+ * @brief A basic block of the current method's instruction list, see jc_cfg_build
  * 
  */
-static uint16_t constant_pool_counter = 0;
+typedef struct jclass_block {
+    size_t first;           // index of the block's first instruction
+    size_t end;             // index after the block's last instruction
+    size_t successors;      // where the block's successors start in successor_list
+    size_t successor_count; // number of successors, the handlers covering the block included
+    size_t flow_count;      // number of successors that are not handlers, they come first
+    uint8_t reachable;      // whether the block can be reached from the first one
+} jclass_block;
 
 /**
-    @brief Begins the constant pool
-    
-*/
-void constant_pool_start() {
-    // u2 constant_pool_count
-    cp_count_offset = current_offset();
-    emit_u2(0); // placeholder for constant_pool_count
-    constant_pool_counter = 1;
-}
+ * @brief The basic blocks of the current method's instruction list and the edges between them
+ * 
+ */
+typedef struct jclass_cfg {
+    jclass_block *blocks;       // the blocks in the order of their instructions
+    size_t block_count;         // number of blocks
+    uint32_t *successor_list;   // block index of every successor of every block
+    size_t successor_count;     // number of entries in successor_list
+    uint32_t *block_of;         // block index of each instruction, block_count for the end of the code
+} jclass_cfg;
+
+struct jclass_ctx;
+
+/**
+ * @brief Function that looks at and changes the instruction list of a method, see jc_set_code_pass
+ * 
+ */
+typedef void (*jclass_code_pass)(struct jclass_ctx *ctx, void *user);
+
+/**
+ * @brief Function that gives the internal name of the closest superclass two classes share, see jc_set_common_superclass
+ * @return The name, which has to stay valid until the function is called again, or NULL if it is not known
+ * 
+ */
+typedef const char *(*jclass_common_superclass)(const char *a, const char *b, void *user);
+
+/**
+ * @brief What a section of the class file is
+ * 
+ */
+enum {
+    JCLASS_SECTION_INTERFACES = 0,  // u2 interfaces_count and the interfaces
+    JCLASS_SECTION_FIELDS,          // u2 fields_count and the fields
+    JCLASS_SECTION_METHODS,         // u2 methods_count and the methods
+    JCLASS_SECTION_ATTRIBUTES,      // u2 attributes_count and the attributes
+    JCLASS_SECTION_ATTRIBUTE,       // u4 attribute_length and the attribute's contents
+    JCLASS_SECTION_EXCEPTIONS,      // u2 exception_table_length and the entries
+    JCLASS_SECTION_CODE             // a Code attribute whose bytecode is still being emitted
+};
+
+/**
+ * @brief A section that has been started but not ended yet
+ * 
+ */
+typedef struct jclass_section {
+    size_t count_offset;    // offset of the count or length to patch when the section ends
+    uint16_t counter;       // entries added to the section so far
+    uint8_t kind;           // JCLASS_SECTION_*
+} jclass_section;
+
+/**
+ * @brief Holds all emitter state for one class being built
+ *
+ * Every jc_* function takes a context, so separate threads can build separate
+ * classes at the same time as long as each uses its own context. The functions
+ * without the jc_ prefix operate on a shared default context.
+ */
+typedef struct jclass_ctx {
+    /** @brief Output buffer where the JVM bytecode is stored, grown on demand */
+    uint8_t *outputBuffer;
+    /** @brief Current index of the output buffer */
+    size_t outputIndex;
+    /** @brief Allocated size of outputBuffer */
+    size_t outputCapacity;
+    /** @brief First error that happened while building, JCLASS_OK if none */
+    int error;
+    /** @brief JCLASS_* options set with jc_set_flags, kept by jc_ctx_reset */
+    uint32_t flags;
+    /** @brief Class file major version set with jc_set_version, 0 for the unchecked default of 52 (Java 8) */
+    uint16_t major_version;
+    /** @brief Class file minor version set with jc_set_version */
+    uint16_t minor_version;
+
+    /** @brief Do not modify */
+    size_t cp_count_offset;
+    /** @brief Keeps track of the size of the constant pool */
+    uint16_t constant_pool_counter;
+    /** @brief Constant pool entries, written into the output by jc_constant_pool_flush */
+    uint8_t *cpBuffer;
+    /** @brief Used size of cpBuffer */
+    size_t cpLength;
+    /** @brief Allocated size of cpBuffer */
+    size_t cpCapacity;
+    /** @brief Offset in cpBuffer of the entry being added */
+    size_t cp_entry_offset;
+    /** @brief Location and hash of every entry, indexed by constant pool index */
+    jclass_cp_entry *cp_entries;
+    /** @brief Allocated length of cp_entries */
+    size_t cp_entries_capacity;
+    /** @brief Open addressing hash table of constant pool indices, 0 is an empty slot */
+    uint16_t *cp_table;
+    /** @brief Number of slots in cp_table, always a power of 2 */
+    size_t cp_table_size;
+    /** @brief Set by constant_pool_start */
+    uint8_t cp_started;
+    /** @brief Set once the pool has been written to the output */
+    uint8_t cp_flushed;
+    /** @brief constant_pool_count as it is written, for jc_finish_slices */
+    uint8_t cp_count_bytes[2];
+    /** @brief Bytes of the class whose constant pool was copied by jc_constant_pool_copy, NULL if none was */
+    const uint8_t *cp_source;
+
+    /** @brief Sections that have been started and not ended, innermost last */
+    jclass_section *sections;
+    /** @brief Number of open sections */
+    size_t section_count;
+    /** @brief Allocated length of sections */
+    size_t sections_capacity;
+
+    /** @brief Constant pool index of the class being built, set by emit_class_footer */
+    uint16_t this_class;
+
+    /** @brief Access flags of the current method */
+    uint16_t method_access_flags;
+    /** @brief Constant pool index of the current method's name */
+    uint16_t method_name_index;
+    /** @brief Constant pool index of the current method's descriptor */
+    uint16_t method_descriptor_index;
+
+    /** @brief Do not modify */
+    size_t max_stack_offset;
+    /** @brief Do not modify */
+    size_t bytecode_length_offset;
+    /** @brief Offset of the first byte of the current method's code */
+    size_t bytecode_offset;
+
+    /** @brief pc each label of the current method is bound to, -1 if not bound yet */
+    int32_t *labels;
+    /** @brief Number of labels created in the current method */
+    size_t label_count;
+    /** @brief Allocated length of labels */
+    size_t labels_capacity;
+    /** @brief Branch offsets waiting for their label */
+    jclass_fixup *fixups;
+    /** @brief Number of entries in fixups */
+    size_t fixup_count;
+    /** @brief Allocated length of fixups */
+    size_t fixups_capacity;
+    /** @brief Set when the current method uses branches to output offsets, which can not be relaxed */
+    uint8_t raw_branches;
+    /** @brief Exception handlers of the current method, in the order they are tried */
+    jclass_handler *handlers;
+    /** @brief Number of entries in handlers */
+    size_t handler_count;
+    /** @brief Allocated length of handlers */
+    size_t handlers_capacity;
+
+    /** @brief StackMapTable entries of the current method, built by code_attribute_end */
+    uint8_t *stackmap;
+    /** @brief Used size of stackmap */
+    size_t stackmap_length;
+    /** @brief Allocated size of stackmap */
+    size_t stackmap_capacity;
+    /** @brief Number of frames in stackmap */
+    uint16_t stackmap_frames;
+    /** @brief Set when the current method has branches but no frames yet, cleared when its own StackMapTable is added */
+    int needs_stackmap;
+
+    /** @brief Instruction list of the current method, while the code pass runs */
+    jclass_insn *insns;
+    /** @brief Number of entries in insns */
+    size_t insn_count;
+    /** @brief Allocated length of insns */
+    size_t insns_capacity;
+    /** @brief Operands of the switches in insns: low, high and the targets of a tableswitch, npairs and the key and target pairs of a lookupswitch */
+    int32_t *insn_data;
+    /** @brief Used length of insn_data */
+    size_t insn_data_length;
+    /** @brief Allocated length of insn_data */
+    size_t insn_data_capacity;
+    /** @brief Function run on the instruction list of every method, set with jc_set_code_pass */
+    jclass_code_pass code_pass;
+    /** @brief Passed to code_pass */
+    void *code_pass_user;
+    /** @brief Gives the common superclass of two classes to JCLASS_COMPUTE_FRAMES, set with jc_set_common_superclass */
+    jclass_common_superclass common_superclass;
+    /** @brief Passed to common_superclass */
+    void *common_superclass_user;
+    /** @brief JCLASS_PEEPHOLE_* rules run on every method, set with jc_set_peephole */
+    uint32_t peephole;
+    /** @brief What the peephole rules did since the context was created or reset */
+    jclass_peephole_stats peephole_stats;
+
+    /** @brief Set while jc_build_ordered counts which constants ldc loads */
+    uint8_t count_ldc;
+    /** @brief What each ldc of the current method adds to ldc_uses, set with jc_set_ldc_weight */
+    uint32_t ldc_weight;
+    /** @brief Weighted ldc uses of each constant pool index */
+    uint32_t *ldc_uses;
+    /** @brief Allocated length of ldc_uses */
+    size_t ldc_uses_capacity;
+} jclass_ctx;
 
 /**
-    @brief Helper function. Do not use unless you know what you are doing
+    @brief Initializes a context. Nothing is allocated until the first byte is emitted
+    @param ctx The context to initialize
     
 */
-static void increment_cp_counter() {
-    constant_pool_counter++;
+void jc_ctx_init(jclass_ctx *ctx) {
+    memset(ctx, 0, sizeof(*ctx));
 }
 
 /**
-    @brief Converts a char* to a constant UTF-8 string
-    @param string The string to convert
+    @brief Resets a context so a new class can be built with it, keeping the allocated buffer
+    @param ctx The context to reset
     
 */
-void constant_utf8(const char *string) {
-    emit_u1(1);                      // u1 1 (tag)
-    uint16_t len = (uint16_t)strlen(string);
-    emit_u2(len);                    // u2 length
-    for (uint16_t i = 0; i < len; i++) { // ..data: db string
-        emit_u1((uint8_t)string[i]);
+void jc_ctx_reset(jclass_ctx *ctx) {
+    jclass_ctx old = *ctx;
+    memset(ctx, 0, sizeof(*ctx));
+    ctx->flags = old.flags;
+    ctx->major_version = old.major_version;
+    ctx->minor_version = old.minor_version;
+    ctx->outputBuffer = old.outputBuffer;
+    ctx->outputCapacity = old.outputCapacity;
+    ctx->cpBuffer = old.cpBuffer;
+    ctx->cpCapacity = old.cpCapacity;
+    ctx->cp_entries = old.cp_entries;
+    ctx->cp_entries_capacity = old.cp_entries_capacity;
+    ctx->cp_table = old.cp_table;
+    ctx->cp_table_size = old.cp_table_size;
+    ctx->labels = old.labels;
+    ctx->labels_capacity = old.labels_capacity;
+    ctx->fixups = old.fixups;
+    ctx->fixups_capacity = old.fixups_capacity;
+    ctx->handlers = old.handlers;
+    ctx->handlers_capacity = old.handlers_capacity;
+    ctx->stackmap = old.stackmap;
+    ctx->stackmap_capacity = old.stackmap_capacity;
+    ctx->insns = old.insns;
+    ctx->insns_capacity = old.insns_capacity;
+    ctx->insn_data = old.insn_data;
+    ctx->insn_data_capacity = old.insn_data_capacity;
+    ctx->code_pass = old.code_pass;
+    ctx->code_pass_user = old.code_pass_user;
+    ctx->peephole = old.peephole;
+    ctx->common_superclass = old.common_superclass;
+    ctx->common_superclass_user = old.common_superclass_user;
+    ctx->ldc_uses = old.ldc_uses;
+    ctx->ldc_uses_capacity = old.ldc_uses_capacity;
+    ctx->sections = old.sections;
+    ctx->sections_capacity = old.sections_capacity;
+    if (ctx->cp_table) {
+        memset(ctx->cp_table, 0, ctx->cp_table_size * sizeof(uint16_t));
     }
-    increment_cp_counter();
 }
 
 /**
-    @brief Creates a constant integer
-    @param value The integer to add to the constant pool
+    @brief Frees the memory owned by a context without freeing the context itself
+    @param ctx The context to clean up
     
 */
-void constant_integer(uint32_t value) {
-    emit_u1(3);                      // u1 3 (tag)
-    emit_u4(value);                  // u4 value
-    increment_cp_counter();
+void jc_ctx_destroy(jclass_ctx *ctx) {
+    free(ctx->outputBuffer);
+    free(ctx->cpBuffer);
+    free(ctx->cp_entries);
+    free(ctx->cp_table);
+    free(ctx->labels);
+    free(ctx->fixups);
+    free(ctx->handlers);
+    free(ctx->stackmap);
+    free(ctx->insns);
+    free(ctx->insn_data);
+    free(ctx->ldc_uses);
+    free(ctx->sections);
+    memset(ctx, 0, sizeof(*ctx));
 }
 
 /**
-    @brief Creates a constant float
-    @param value The float to add to the constant pool
+    @brief Allocates and initializes a new context
+    @return The new context, or NULL if the allocation failed
     
 */
-void constant_float(uint32_t value) {
-    emit_u1(4);                      // u1 4 (tag)
-    emit_u4(value);                  // u4 value
-    increment_cp_counter();
+jclass_ctx *jc_ctx_new() {
+    jclass_ctx *ctx = malloc(sizeof(jclass_ctx));
+    if (ctx) {
+        jc_ctx_init(ctx);
+    }
+    return ctx;
 }
 
 /**
-    @brief Creates a constant long
-    @param value The 64 bit value to add to the constant pool
+    @brief Frees a context created with jc_ctx_new
+    @param ctx The context to free
     
 */
-void constant_long(uint64_t value) {
-    emit_u1(5);                      // u1 5 (tag)
-    emit_u4((uint32_t)(value >> 32)); // u4 high part
-    emit_u4((uint32_t)(value & 0xFFFFFFFF)); // u4 low part
-    increment_cp_counter();
+void jc_ctx_free(jclass_ctx *ctx) {
+    if (ctx) {
+        jc_ctx_destroy(ctx);
+        free(ctx);
+    }
 }
 
 /**
-    @brief Creates a constant double
-    @param value The 64 bit value to add to the constant pool
+    @brief Sets the options of a context
+    @param flags JCLASS_* options or'd together, replacing the ones set before
     
 */
-void constant_double(uint64_t value) {
-    emit_u1(6);                      // u1 6 (tag)
-    emit_u4((uint32_t)(value >> 32)); // u4 high part
-    emit_u4((uint32_t)(value & 0xFFFFFFFF)); // u4 low part
-    increment_cp_counter();
+void jc_set_flags(jclass_ctx *ctx, uint32_t flags) {
+    ctx->flags = flags;
 }
 
 /**
-    @brief Creates a constant class reference
-    @param name_index The index of the UTF-8 which is the class name (java/lang/Object)
+    @brief Sets the function JCLASS_COMPUTE_FRAMES asks for the closest superclass two classes share where paths
+    with different classes join, like ASM's getCommonSuperClass. Without one such joins report JCLASS_ERR_HIERARCHY,
+    except for arrays, which merge into arrays of java/lang/Object. Kept by jc_ctx_reset
+    @param common_superclass The function, NULL for none
+    @param user Passed to common_superclass as it is
     
 */
-void constant_class(uint16_t name_index) {
-    emit_u1(7);                      // u1 7 (tag)
-    emit_u2(name_index);             // u2 name_index
-    increment_cp_counter();
+void jc_set_common_superclass(jclass_ctx *ctx, jclass_common_superclass common_superclass, void *user) {
+    ctx->common_superclass = common_superclass;
+    ctx->common_superclass_user = user;
 }
 
 /**
-    @brief Creates a constant string from a constant UTF-8
-    @param string_index Constant pool index of the UTF-8
+    @brief Returns the first error that happened while building the class
+    @return JCLASS_OK if nothing went wrong
     
 */
-void constant_string(uint16_t string_index) {
-    emit_u1(8);                      // u1 8 (tag)
-    emit_u2(string_index);           // u2 string_index
-    increment_cp_counter();
+int jc_error(jclass_ctx *ctx) {
+    return ctx->error;
 }
 
 /**
-    @brief Builds a reference to a field
-    @param class_index Constant pool index of the class from which the field is from
-    @param name_and_type_index Constant pool index of the name and type of the field
+    @brief Helper function. Records an error, only the first one is kept
     
 */
-void constant_fieldref(uint16_t class_index, uint16_t name_and_type_index) {
-    emit_u1(9);                      // u1 9 (tag)
-    emit_u2(class_index);            // u2 class_index
-    emit_u2(name_and_type_index);    // u2 name_and_type_index
-    increment_cp_counter();
+static void jc_set_error(jclass_ctx *ctx, int error) {
+    if (ctx->error == JCLASS_OK) {
+        ctx->error = error;
+    }
 }
 
 /**
-    @brief Builds a reference to a method
-    @param class_index Constant pool index of the class from which the field is from
-    @param name_and_type_index Constant pool index of the name and type of the field
+    @brief Helper function. Records JCLASS_ERR_STATE if the version set with jc_set_version does not have a feature
+    @param since First major version with the feature
+    @param until First major version without it, 0 if it was never removed
     
 */
-void constant_methodref(uint16_t class_index, uint16_t name_and_type_index) {
-    emit_u1(10);                     // u1 10 (tag)
-    emit_u2(class_index);            // u2 class_index
-    emit_u2(name_and_type_index);    // u2 name_and_type_index
-    increment_cp_counter();
+static void jc_check_version(jclass_ctx *ctx, uint16_t since, uint16_t until) {
+    if (ctx->major_version == 0) {
+        return; // classes without a version set keep the old unchecked behaviour
+    }
+    if (ctx->major_version < since || (until && ctx->major_version >= until)) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+    }
 }
 
 /**
-    @brief Builds a reference to a method from an interface
-    @param class_index Constant pool index of the class from which the field is from
-    @param name_and_type_index Constant pool index of the name and type of the field
+    @brief Sets the class file version written by emit_class_header, which has to come after this.
+    Features the version does not have record JCLASS_ERR_STATE when they are emitted
+    @param major The major version, JCLASS_JAVA_* for a release
+    @param minor The minor version, 0 or 65535 (preview features) from Java 12 on
     
 */
-void constant_interfacemethodref(uint16_t class_index, uint16_t name_and_type_index) {
-    emit_u1(11);                     // u1 11 (tag)
-    emit_u2(class_index);            // u2 class_index
-    emit_u2(name_and_type_index);    // u2 name_and_type_index
-    increment_cp_counter();
+void jc_set_version(jclass_ctx *ctx, uint16_t major, uint16_t minor) {
+    if (ctx->outputIndex != 0) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
+    }
+    if (major < 45 || (major >= 56 && minor != 0 && minor != 0xFFFF)) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    ctx->major_version = major;
+    ctx->minor_version = minor;
 }
 
 /**
-    @brief Builds a name and type
-    @param name_index Constant pool index of the name
-    @param descriptor_index Constant pool index of the descriptor, a return type and params
+    @brief Helper function. Grows an array to hold at least needed elements, doubling its size each time
+    @param data The array to grow
+    @param capacity The allocated length of the array, updated on success
+    @param needed How many elements the array has to fit
+    @param elem_size The size of one element
+    @param initial The length to start with if the array is empty
+    @return The grown array, or NULL if it could not be grown (data is left untouched)
     
 */
-void constant_nameandtype(uint16_t name_index, uint16_t descriptor_index) {
-    emit_u1(12);                     // u1 12 (tag)
-    emit_u2(name_index);             // u2 name_index
-    emit_u2(descriptor_index);       // u2 descriptor_index
-    increment_cp_counter();
+static void *jc_grow(jclass_ctx *ctx, void *data, size_t *capacity, size_t needed, size_t elem_size, size_t initial) {
+    size_t new_capacity = *capacity ? *capacity : initial;
+    while (new_capacity < needed) {
+        if (new_capacity > SIZE_MAX / 2) {
+            new_capacity = needed;
+            break;
+        }
+        new_capacity *= 2;
+    }
+    void *grown = NULL;
+    if (new_capacity <= SIZE_MAX / elem_size) {
+        grown = realloc(data, new_capacity * elem_size);
+    }
+    if (!grown) {
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return NULL;
+    }
+    *capacity = new_capacity;
+    return grown;
 }
 
 /**
-    @brief Marks the end of the constant pool
+    @brief Makes sure the output buffer can hold at least capacity bytes without growing again
+    @param capacity The total size the buffer should be able to hold
+    @return JCLASS_OK, or JCLASS_ERR_NOMEM if the buffer could not be grown
     
 */
-void constant_pool_end() {
-    // constant_pool_count = constant_pool_counter
-    patch_u2(cp_count_offset, constant_pool_counter);
-    // restruc directives are not applicable in C (purge and re-structure are no-ops)
+int jc_reserve(jclass_ctx *ctx, size_t capacity) {
+    if (capacity <= ctx->outputCapacity) {
+        return JCLASS_OK;
+    }
+    uint8_t *buffer = jc_grow(ctx, ctx->outputBuffer, &ctx->outputCapacity, capacity, 1, BUFFER_SIZE);
+    if (!buffer) {
+        return JCLASS_ERR_NOMEM;
+    }
+    ctx->outputBuffer = buffer;
+    return JCLASS_OK;
 }
 
-// ------------------------
-// interfaces macros
-// ------------------------
-
-// macro interfaces {
-/**
- * @brief Do not modify
- * 
- */
-static size_t interfaces_count_offset = 0;
-/**
- * @brief Keeps track of how many interfaces there are
- * 
- */
-static uint16_t interfaces_counter = 0;
+/** 
+* @brief Helper function. Do not use unless you know what you're doing
+* 
+*/
+static void jc_emit_byte(jclass_ctx *ctx, uint8_t b) {
+    if (ctx->outputIndex >= ctx->outputCapacity) {
+        if (ctx->error != JCLASS_OK || jc_reserve(ctx, ctx->outputIndex + 1) != JCLASS_OK) {
+            return;
+        }
+    }
+    ctx->outputBuffer[ctx->outputIndex++] = b;
+}
 
 /**
-    @brief Marks the start of the list of interfaces the class is using
-    
+    * @brief Helper function. Makes room for len bytes and advances the output index past them
+    * @param len The number of bytes that will be written
+    * @return Where to write the bytes, or NULL if the buffer could not be grown
+    * 
 */
-void interfaces_start() {
-    // u2 interfaces_count
-    interfaces_count_offset = current_offset();
-    emit_u2(0); // placeholder for interfaces_count
-    interfaces_counter = 0;
+static uint8_t *jc_emit_reserve(jclass_ctx *ctx, size_t len) {
+    if (ctx->outputCapacity - ctx->outputIndex < len) {
+        if (ctx->error != JCLASS_OK || jc_reserve(ctx, ctx->outputIndex + len) != JCLASS_OK) {
+            return NULL;
+        }
+    }
+    uint8_t *dst = ctx->outputBuffer + ctx->outputIndex;
+    ctx->outputIndex += len;
+    return dst;
 }
 
 /**
-    @brief Adds a new interface to the list
-    @param interface_val No idea
-    
+    * @brief Copies a run of bytes into the buffer with a single capacity check
+    * @param data The bytes to place in the buffer
+    * @param len How many bytes to copy
+    * 
 */
-void interface_entry(uint16_t interface_val) {
-    // interfaces_counter = interfaces_counter + 1
-    interfaces_counter++;
-    // u2 interface
-    emit_u2(interface_val);
+static void jc_emit_bytes(jclass_ctx *ctx, const void *data, size_t len) {
+    uint8_t *dst = jc_emit_reserve(ctx, len);
+    if (dst && len) {
+        memcpy(dst, data, len);
+    }
 }
 
 /**
-    @brief Marks the end of the list of interfaces
-    
+    * @brief Writes a byte to the buffer
+    * @param v The value to place in the buffer
+    * 
 */
-void interfaces_end() {
-    patch_u2(interfaces_count_offset, interfaces_counter);
-    // purge interface (no-op)
+static void jc_emit_u1(jclass_ctx *ctx, uint8_t v) {
+    jc_emit_byte(ctx, v);
 }
 
-// ------------------------
-// attributes macros
-// ------------------------
+/** 
+    * @brief Takes a uint16_t and splits it into 2 bytes (0x1024 -> { 0x10, 0x24 }), which it then writes into the buffer
+    * @param v The two values to place in the buffer
+    * 
+*/
+static void jc_emit_u2(jclass_ctx *ctx, uint16_t v) {
+    uint8_t *dst = jc_emit_reserve(ctx, 2);
+    if (dst) {
+        dst[0] = (v >> 8) & 0xFF;
+        dst[1] = v & 0xFF;
+    }
+}
 
 /**
- * @brief Do not modify
- * 
- */
-static size_t attributes_count_offset = 0;
+    * @brief Splits a uint32_t into 4 bytes (0x12345678 -> { 0x12, 0x34, 0x56, 0x78 }) and writes them into the buffer
+    * @param v The values to place into the buffer
+    * 
+*/
+static void jc_emit_u4(jclass_ctx *ctx, uint32_t v) {
+    uint8_t *dst = jc_emit_reserve(ctx, 4);
+    if (dst) {
+        dst[0] = (v >> 24) & 0xFF;
+        dst[1] = (v >> 16) & 0xFF;
+        dst[2] = (v >> 8) & 0xFF;
+        dst[3] = v & 0xFF;
+    }
+}
+
 /**
- * @brief Tracks how many attributes there are
- * 
- */
-static uint16_t attributes_counter = 0;
+    * @brief Returns the current buffer position that will be emitted to
+    * 
+*/
+static size_t jc_current_offset(jclass_ctx *ctx) {
+    return ctx->outputIndex;
+}
 
 /**
-    @brief Marks the start of the list of attributes the class has
+    @brief Places 2 bytes in the given position in the buffer (0x1024 -> (0x10 -> pos) & (0x24 -> pos + 1))
+    @param pos Where in the buffer to place the bytes
+    @param v The two bytes to place
     
 */
-void attributes_start() {
-    // u2 attributes_count
-    attributes_count_offset = current_offset();
-    emit_u2(0); // placeholder for attributes_count
-    attributes_counter = 0;
+static void jc_patch_u2(jclass_ctx *ctx, size_t pos, uint16_t v) {
+    if (pos + 1 >= ctx->outputIndex) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    ctx->outputBuffer[pos] = (v >> 8) & 0xFF;
+    ctx->outputBuffer[pos + 1] = v & 0xFF;
 }
 
-size_t attribute_start_offset = 0; // used to hold starting offset of attribute
-
 /**
-    @brief Marks the start of a new attribute
-    @param attribute_name_index Constant pool index of the name of the attribute
+    @brief Places 4 bytes in the given position in the buffer (0x12345678 -> (0x12 -> pos) & (0x34 -> pos + 1) & (0x56 -> pos + 2) & (0x78 -> pos + 3))
+    @param pos The 4 bytes to place in the buffer
     
 */
-void attribute_start(uint16_t attribute_name_index) {
-    attributes_counter++;
-    // u2 attribute_name_index
-    emit_u2(attribute_name_index);
-    // local start: record current offset for attribute_length calculation
-    attribute_start_offset = current_offset();
-    // u4 attribute_length placeholder
-    emit_u4(0);
+static void jc_patch_u4(jclass_ctx *ctx, size_t pos, uint32_t v) {
+    if (pos + 3 >= ctx->outputIndex) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    ctx->outputBuffer[pos] = (v >> 24) & 0xFF;
+    ctx->outputBuffer[pos + 1] = (v >> 16) & 0xFF;
+    ctx->outputBuffer[pos + 2] = (v >> 8) & 0xFF;
+    ctx->outputBuffer[pos + 3] = v & 0xFF;
 }
 
+// ------------------------
+// modified UTF-8
+// ------------------------
+
+#if defined(JCLASS_AVX2) || defined(JCLASS_SSE2)
 /**
-    @brief Marks the end of an attribute
+    @brief Helper function. Counts the set bits of a 32 bit mask
     
 */
-void attribute_end() {
-    size_t end_offset = current_offset();
-    uint32_t length = (uint32_t)(end_offset - attribute_start_offset - 4);
-    patch_u4(attribute_start_offset, length);
-    // restore coordinate values (no-op)
+static unsigned jc_popcount32(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_popcount(v);
+#else
+    unsigned count = 0;
+    for (; v; v &= v - 1) {
+        count++;
+    }
+    return count;
+#endif
 }
 
 /**
-    @brief Marks the start of the attributes section
+    @brief Helper function. Index of the lowest set bit of a non zero 32 bit mask
     
 */
-void attributes_end() {
-    patch_u2(attributes_count_offset, attributes_counter);
-    // restore attributes_count, attributes_counter and purge attribute (all no-ops in C)
+static unsigned jc_ctz32(uint32_t v) {
+#if defined(__GNUC__) || defined(__clang__)
+    return (unsigned)__builtin_ctz(v);
+#else
+    unsigned index = 0;
+    while (!(v & 1)) {
+        v >>= 1;
+        index++;
+    }
+    return index;
+#endif
 }
 
-// ------------------------
-// fields macros
-// ------------------------
-
-static size_t fields_count_offset = 0;
-/**
- * @brief Counts the amount of fields in the class
- * 
- */
-static uint16_t fields_counter = 0;
+#endif
 
 /**
-    @brief Marks the start of the fields section
+    @brief Returns how many bytes a standard UTF-8 string takes up once converted to the JVM's modified UTF-8.
+    NUL becomes 2 bytes and every 4 byte sequence becomes a 6 byte surrogate pair, everything else is kept
+    @param string The UTF-8 string, does not need to be NUL terminated
+    @param len The length of the string in bytes
     
 */
-void fields_start() {
-    // u2 fields_count
-    fields_count_offset = current_offset();
-    emit_u2(0); // placeholder for fields_count
-    fields_counter = 0;
+size_t jc_mutf8_length(const char *string, size_t len) {
+    const uint8_t *s = (const uint8_t *)string;
+    size_t nuls = 0, leads = 0, i = 0;
+#if defined(JCLASS_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lead = _mm256_set1_epi8((char)0xF0);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        nuls += jc_popcount32((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(v, zero)));
+        leads += jc_popcount32((uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(_mm256_max_epu8(v, lead), v)));
+    }
+#elif defined(JCLASS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lead = _mm_set1_epi8((char)0xF0);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        nuls += jc_popcount32((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(v, zero)));
+        leads += jc_popcount32((uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(_mm_max_epu8(v, lead), v)));
+    }
+#endif
+    for (; i < len; i++) {
+        nuls += s[i] == 0;
+        leads += s[i] >= 0xF0;
+    }
+    return len + nuls + 2 * leads;
 }
 
 /**
-    @brief Creates a new field and begins it's attributes section
-    @param access_flags The JVM flags for the field
-    @param name_index Constant pool index of the name of the field
-    @param descriptor_index The constant pool index of the decriptor for the field
+    @brief Helper function. Returns the index of the first byte from i on that is NUL or starts a 4 byte sequence, or len if there is none
     
 */
-void field_info(uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) {
-    fields_counter++;
-    emit_u2(access_flags);
-    emit_u2(name_index);
-    emit_u2(descriptor_index);
-    // attributes for field
-    attributes_start();
+static size_t jc_mutf8_next_special(const uint8_t *s, size_t i, size_t len) {
+#if defined(JCLASS_AVX2)
+    const __m256i zero = _mm256_setzero_si256();
+    const __m256i lead = _mm256_set1_epi8((char)0xF0);
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(s + i));
+        __m256i special = _mm256_or_si256(_mm256_cmpeq_epi8(v, zero), _mm256_cmpeq_epi8(_mm256_max_epu8(v, lead), v));
+        uint32_t mask = (uint32_t)_mm256_movemask_epi8(special);
+        if (mask) {
+            return i + jc_ctz32(mask);
+        }
+    }
+#elif defined(JCLASS_SSE2)
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i lead = _mm_set1_epi8((char)0xF0);
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(s + i));
+        __m128i special = _mm_or_si128(_mm_cmpeq_epi8(v, zero), _mm_cmpeq_epi8(_mm_max_epu8(v, lead), v));
+        uint32_t mask = (uint32_t)_mm_movemask_epi8(special);
+        if (mask) {
+            return i + jc_ctz32(mask);
+        }
+    }
+#endif
+    for (; i < len; i++) {
+        if (s[i] == 0 || s[i] >= 0xF0) {
+            return i;
+        }
+    }
+    return len;
 }
 
 /**
-    @brief Ends the current fields attributes section and the field itself
+    @brief Helper function. Writes one UTF-16 code unit as 3 bytes
     
 */
-void end_field_info() {
-    // end_attributes for field
-    attributes_end();
+static uint8_t *jc_mutf8_put_unit(uint8_t *dst, uint32_t unit) {
+    dst[0] = (uint8_t)(0xE0 | (unit >> 12));
+    dst[1] = (uint8_t)(0x80 | ((unit >> 6) & 0x3F));
+    dst[2] = (uint8_t)(0x80 | (unit & 0x3F));
+    return dst + 3;
 }
 
 /**
-    @brief Marks the end of the fields section
+    @brief Converts standard UTF-8 to the JVM's modified UTF-8
+    @param dst Where to write the result, must have room for jc_mutf8_length(string, len) bytes
+    @param string The UTF-8 string, does not need to be NUL terminated
+    @param len The length of the string in bytes
+    @return JCLASS_OK, or JCLASS_ERR_ENCODING if a 4 byte sequence is malformed
     
 */
-void fields_end() {
-    patch_u2(fields_count_offset, fields_counter);
-    // purge field_info, end_field_info (no-op)
+int jc_mutf8_encode(uint8_t *dst, const char *string, size_t len) {
+    const uint8_t *s = (const uint8_t *)string;
+    size_t i = 0;
+    while (i < len) {
+        size_t next = jc_mutf8_next_special(s, i, len);
+        memcpy(dst, s + i, next - i);
+        dst += next - i;
+        i = next;
+        if (i == len) {
+            break;
+        }
+        if (s[i] == 0) {
+            // NUL is written as the 2 byte form so the JVM never sees a 0 byte
+            dst[0] = 0xC0;
+            dst[1] = 0x80;
+            dst += 2;
+            i++;
+            continue;
+        }
+        if (len - i < 4 || (s[i + 1] & 0xC0) != 0x80 || (s[i + 2] & 0xC0) != 0x80 || (s[i + 3] & 0xC0) != 0x80) {
+            return JCLASS_ERR_ENCODING;
+        }
+        uint32_t code_point = ((uint32_t)(s[i] & 0x07) << 18) | ((uint32_t)(s[i + 1] & 0x3F) << 12)
+                            | ((uint32_t)(s[i + 2] & 0x3F) << 6) | (uint32_t)(s[i + 3] & 0x3F);
+        if (code_point < 0x10000 || code_point > 0x10FFFF) {
+            return JCLASS_ERR_ENCODING;
+        }
+        // Supplementary characters are written as a surrogate pair, 3 bytes per half
+        code_point -= 0x10000;
+        dst = jc_mutf8_put_unit(dst, 0xD800 | (code_point >> 10));
+        dst = jc_mutf8_put_unit(dst, 0xDC00 | (code_point & 0x3FF));
+        i += 4;
+    }
+    return JCLASS_OK;
 }
 
 // ------------------------
-// methods macros
+// constant_pool macros
 // ------------------------
 
-static size_t methods_count_offset = 0;
 /**
- * @brief Counts the amount of methods in the class
- * 
- */
-static uint16_t methods_counter = 0;
+    @brief Helper function. Stores 2 bytes big endian at dst
+    
+*/
+static void jc_store_u2(uint8_t *dst, uint16_t v) {
+    dst[0] = (v >> 8) & 0xFF;
+    dst[1] = v & 0xFF;
+}
 
 /**
-    @brief Marks the start of the methods section
+    @brief Helper function. Stores 4 bytes big endian at dst
     
 */
-void methods_start() {
-    // u2 methods_count
-    methods_count_offset = current_offset();
-    emit_u2(0); // placeholder for methods_count
-    methods_counter = 0;
+static void jc_store_u4(uint8_t *dst, uint32_t v) {
+    dst[0] = (v >> 24) & 0xFF;
+    dst[1] = (v >> 16) & 0xFF;
+    dst[2] = (v >> 8) & 0xFF;
+    dst[3] = v & 0xFF;
 }
 
 /**
-    @brief Creates a new method and begins it's attributes section
-    @param access_flags The JVM flags for the method
-    @param name_index Constant pool index of the name of the method
-    @param descriptor_index The constant pool index of the decriptor for the method
+    @brief Returns how many bytes the constant pool entry starting at entry takes up, including the tag
+    @param entry Pointer to the tag byte of the entry
     
 */
-void method_info(uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) {
-    methods_counter++;
-    emit_u2(access_flags);
-    emit_u2(name_index);
-    emit_u2(descriptor_index);
-    // attributes for method
-    attributes_start();
+static size_t jc_cp_entry_size(const uint8_t *entry) {
+    switch (entry[0]) {
+        case 1:  return 3 + (((size_t)entry[1] << 8) | entry[2]); // Utf8
+        case 3:  case 4:  return 5;                               // Integer, Float
+        case 5:  case 6:  return 9;                               // Long, Double
+        case 15: return 4;                                        // MethodHandle
+        case 9:  case 10: case 11: case 12: case 17: case 18: return 5;
+        default: return 3;                                        // Class, String, MethodType, Module, Package
+    }
 }
 
 /**
-    @brief Ends the current methods attributes section and the method itself
+    @brief Helper function. FNV-1a hash of a constant pool entry's tag and payload
     
 */
-void end_method_info() {
-    // end_attributes for method
-    attributes_end();
+static uint32_t jc_cp_hash(const uint8_t *data, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ data[i]) * 16777619u;
+    }
+    return hash;
 }
 
 /**
-    @brief Marks the end of the methods section
+    @brief Begins the constant pool
     
+    Entries are collected separately and written at this position by jc_constant_pool_flush, so
+    constants can still be added while fields and methods are being emitted.
 */
-void methods_end() {
-    patch_u2(methods_count_offset, methods_counter);
-    // purge method_info, end_method_info (no-op)
+void jc_constant_pool_start(jclass_ctx *ctx) {
+    // u2 constant_pool_count, written when the pool is flushed
+    ctx->cp_count_offset = jc_current_offset(ctx);
+    ctx->cp_started = 1;
+    if (ctx->constant_pool_counter == 0) {
+        ctx->constant_pool_counter = 1;
+    }
 }
 
-// ------------------------
-// bytecode macros
-// ------------------------
-
-static size_t bytecode_length_offset = 0;
-static size_t bytecode_offset = 0;
-
 /**
-    @brief Marks the start of a bytecode section
+    @brief Helper function. Makes room for a new entry of len bytes at the end of the constant pool
+    @return Where to write the entry, or NULL on error
     
 */
-void bytecode_start() {
-    // local length; bytecode_length equ length
-    bytecode_length_offset = current_offset();
-    // u4 bytecode_length placeholder
-    emit_u4(0);
-    bytecode_offset = current_offset();
-    // org 0 is ignored in C
+static uint8_t *jc_cp_append(jclass_ctx *ctx, size_t len) {
+    ctx->cp_entry_offset = ctx->cpLength;
+    if (ctx->cp_flushed) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return NULL;
+    }
+    if (ctx->cpCapacity - ctx->cpLength < len) {
+        uint8_t *buffer = jc_grow(ctx, ctx->cpBuffer, &ctx->cpCapacity, ctx->cpLength + len, 1, 256);
+        if (!buffer) {
+            return NULL;
+        }
+        ctx->cpBuffer = buffer;
+    }
+    uint8_t *dst = ctx->cpBuffer + ctx->cpLength;
+    ctx->cpLength += len;
+    return dst;
 }
 
 /**
-    @brief Marks the end of a bytecode section
+    @brief Helper function. Adds index to the hash table, growing it to stay at most half full
     
 */
-void bytecode_end() {
-    size_t end_offset = current_offset();
-    uint32_t length = (uint32_t)(end_offset - bytecode_offset);
-    patch_u4(bytecode_length_offset, length);
-    // org bytecode_offset+bytecode_length, restore bytecode_length are ignored
+static void jc_cp_table_insert(jclass_ctx *ctx, uint16_t index) {
+    if ((size_t)index * 2 >= ctx->cp_table_size) {
+        size_t size = ctx->cp_table_size ? ctx->cp_table_size * 2 : 64;
+        uint16_t *table = calloc(size, sizeof(uint16_t));
+        if (!table) {
+            jc_set_error(ctx, JCLASS_ERR_NOMEM);
+            return;
+        }
+        free(ctx->cp_table);
+        ctx->cp_table = table;
+        ctx->cp_table_size = size;
+        for (uint16_t i = 1; i < index; i++) {
+            if (ctx->cp_entries[i].offset != UINT32_MAX) {
+                jc_cp_table_insert(ctx, i);
+            }
+        }
+    }
+    size_t mask = ctx->cp_table_size - 1;
+    size_t slot = ctx->cp_entries[index].hash & mask;
+    while (ctx->cp_table[slot] != 0) {
+        slot = (slot + 1) & mask;
+    }
+    ctx->cp_table[slot] = index;
 }
 
-// ------------------------
-// exceptions macros
-// ------------------------
-
-static size_t exception_table_length_offset = 0;
-static uint16_t exception_counter = 0;
-
 /**
-    @brief Marks the start of an exceptions section
+    @brief Helper function. Looks for an existing entry with the same tag and payload
+    @return The index of the entry, or 0 if there is none
     
 */
-void exceptions_start() {
-    // local length; exception_table_length equ length
-    exception_table_length_offset = current_offset();
-    // u2 exception_table_length placeholder
-    emit_u2(0);
-    exception_counter = 0;
+static uint16_t jc_cp_find(jclass_ctx *ctx, const uint8_t *entry, size_t len, uint32_t hash) {
+    if (ctx->cp_table_size == 0) {
+        return 0;
+    }
+    size_t mask = ctx->cp_table_size - 1;
+    for (size_t slot = hash & mask; ctx->cp_table[slot] != 0; slot = (slot + 1) & mask) {
+        jclass_cp_entry *candidate = &ctx->cp_entries[ctx->cp_table[slot]];
+        const uint8_t *data = ctx->cpBuffer + candidate->offset;
+        if (candidate->hash == hash && jc_cp_entry_size(data) == len && memcmp(data, entry, len) == 0) {
+            return ctx->cp_table[slot];
+        }
+    }
+    return 0;
 }
 
-void exception_entry(uint16_t start_pc, uint16_t end_pc, uint16_t handler_pc, uint16_t catch_type) {
-    exception_counter++;
-    emit_u2(start_pc);
-    emit_u2(end_pc);
-    emit_u2(handler_pc);
-    emit_u2(catch_type);
+/**
+    @brief Helper function. Gives the entry that was just appended the next index.
+    Long and double entries take up two indices, the second one can not be used
+    @param slots 2 for long and double entries, 1 for everything else
+    @return The index of the entry
+    
+*/
+static uint16_t jc_increment_cp_counter(jclass_ctx *ctx, uint16_t slots) {
+    if (ctx->constant_pool_counter == 0) {
+        ctx->constant_pool_counter = 1;
+    }
+    uint16_t index = ctx->constant_pool_counter;
+    if ((uint32_t)index + slots > 0xFFFF) {
+        // constant_pool_count is a u2, so 65534 is the last usable index
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return 0;
+    }
+    ctx->constant_pool_counter += slots;
+    if (ctx->error != JCLASS_OK) {
+        return index;
+    }
+    if ((size_t)index + slots > ctx->cp_entries_capacity) {
+        jclass_cp_entry *entries = jc_grow(ctx, ctx->cp_entries, &ctx->cp_entries_capacity, (size_t)index + slots, sizeof(jclass_cp_entry), 64);
+        if (!entries) {
+            return index;
+        }
+        ctx->cp_entries = entries;
+    }
+    const uint8_t *entry = ctx->cpBuffer + ctx->cp_entry_offset;
+    ctx->cp_entries[index].offset = (uint32_t)ctx->cp_entry_offset;
+    ctx->cp_entries[index].hash = jc_cp_hash(entry, ctx->cpLength - ctx->cp_entry_offset);
+    if (slots == 2) {
+        ctx->cp_entries[index + 1].offset = UINT32_MAX;
+        ctx->cp_entries[index + 1].hash = 0;
+    }
+    jc_cp_table_insert(ctx, index);
+    return index;
 }
 
 /**
-    @brief Marks the end of a bytecode section
+    @brief Helper function. How many constant pool indices the entry just appended takes up
     
 */
-void exceptions_end() {
-    patch_u2(exception_table_length_offset, exception_counter);
-    // restore exception_table_length (no-op)
+static uint16_t jc_cp_slots(jclass_ctx *ctx) {
+    if (ctx->cp_entry_offset >= ctx->cpLength) {
+        return 1;
+    }
+    uint8_t tag = ctx->cpBuffer[ctx->cp_entry_offset];
+    return (tag == 5 || tag == 6) ? 2 : 1;
 }
 
-// ------------------------
-// BYTECODE constants
-// ------------------------
-
 /**
- * @brief The magic numbers for primitive types in java
- * 
- */
-enum {
-    T_BOOLEAN = 4,
-    T_CHAR    = 5,
-    T_FLOAT   = 6,
-    T_DOUBLE  = 7,
-    T_BYTE    = 8,
-    T_SHORT   = 9,
-    T_INT     = 10,
-    T_LONG    = 11
-};
-
-// ------------------------
-// Bytecode instruction macros as functions
-// ------------------------
+    @brief Returns the tag of a constant pool entry
+    @param index The constant pool index to look at
+    @return The tag, or 0 if the index is not a usable entry (including the second index of a long or double)
+    
+*/
+uint8_t jc_cp_tag(jclass_ctx *ctx, uint16_t index) {
+    if (index == 0 || index >= ctx->constant_pool_counter || (size_t)index >= ctx->cp_entries_capacity) {
+        return 0;
+    }
+    uint32_t offset = ctx->cp_entries[index].offset;
+    if (offset == UINT32_MAX || offset >= ctx->cpLength) {
+        return 0;
+    }
+    return ctx->cpBuffer[offset];
+}
 
-void aaload() {
-    // macro aaload { db 0x32 }
-    emit_u1(0x32);
+/**
+    @brief Helper function. Whether the constant pool entry at index is a UTF-8 entry holding string
+    
+*/
+static int jc_cp_utf8_equals(jclass_ctx *ctx, uint16_t index, const char *string) {
+    if (jc_cp_tag(ctx, index) != 1) {
+        return 0;
+    }
+    const uint8_t *entry = ctx->cpBuffer + ctx->cp_entries[index].offset;
+    size_t len = strlen(string);
+    return (((size_t)entry[1] << 8) | entry[2]) == len && memcmp(entry + 3, string, len) == 0;
 }
 
-void aastore() {
-    // macro aastore { db 0x53 }
-    emit_u1(0x53);
+/**
+    @brief Helper function. Records an error if a known entry can not be loaded by ldc/ldc_w (wide == 0) or ldc2_w (wide == 1)
+    
+*/
+static void jc_check_ldc_index(jclass_ctx *ctx, uint16_t index, int wide) {
+    if (index >= ctx->constant_pool_counter || ctx->cp_flushed) {
+        return; // not built with this context's pool, nothing to check against
+    }
+    uint8_t tag = jc_cp_tag(ctx, index);
+    int is_wide = tag == 5 || tag == 6;
+    if (tag == 0 || is_wide != wide) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+    }
 }
 
-void aconst_null() {
-    // macro aconst_null { db 0x01 }
-    emit_u1(0x01);
+/**
+    @brief Helper function. Adds an ldc of index to its uses while jc_build_ordered is counting them
+    
+*/
+static void jc_count_ldc(jclass_ctx *ctx, uint16_t index) {
+    if (!ctx->count_ldc) {
+        return;
+    }
+    if (index >= ctx->ldc_uses_capacity) {
+        size_t old_capacity = ctx->ldc_uses_capacity;
+        uint32_t *uses = jc_grow(ctx, ctx->ldc_uses, &ctx->ldc_uses_capacity, (size_t)index + 1, sizeof(uint32_t), 256);
+        if (!uses) {
+            return;
+        }
+        memset(uses + old_capacity, 0, (ctx->ldc_uses_capacity - old_capacity) * sizeof(uint32_t));
+        ctx->ldc_uses = uses;
+    }
+    uint32_t uses = ctx->ldc_uses[index] + ctx->ldc_weight;
+    ctx->ldc_uses[index] = uses < ctx->ldc_uses[index] ? UINT32_MAX : uses;
 }
 
-void aload(uint16_t index) {
-    // macro aload index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x2a + index);
-    } else if (index < 0x100) {
-        emit_u1(0x19);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x19);
-        emit_u2(index);
+/**
+    @brief Helper function. Returns the index of an existing entry equal to the one just appended
+    and drops the new copy, or gives the new entry the next index if there is none
+    
+*/
+static uint16_t jc_cp_intern(jclass_ctx *ctx) {
+    if (ctx->error != JCLASS_OK) {
+        return 0;
+    }
+    const uint8_t *entry = ctx->cpBuffer + ctx->cp_entry_offset;
+    size_t len = ctx->cpLength - ctx->cp_entry_offset;
+    uint16_t index = jc_cp_find(ctx, entry, len, jc_cp_hash(entry, len));
+    if (index != 0) {
+        ctx->cpLength = ctx->cp_entry_offset;
+        return index;
     }
+    return jc_increment_cp_counter(ctx, jc_cp_slots(ctx));
 }
 
-void anewarray(uint16_t class_index) {
-    // macro anewarray class { db 0xbd,(class) shr 8,(class) and 0FFh }
-    emit_u1(0xbd);
-    emit_u2(class_index);
+/**
+    @brief Helper function. Appends a UTF-8 entry without giving it an index, converting it to modified UTF-8
+    
+*/
+static void jc_cp_put_utf8(jclass_ctx *ctx, const char *string, size_t len) {
+    size_t encoded_len = jc_mutf8_length(string, len);
+    if (encoded_len > 0xFFFF) {
+        // the length is a u2, longer strings can not be stored
+        ctx->cp_entry_offset = ctx->cpLength;
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    uint8_t *dst = jc_cp_append(ctx, 3 + encoded_len);
+    if (dst) {
+        dst[0] = 1;                          // u1 1 (tag)
+        jc_store_u2(dst + 1, (uint16_t)encoded_len); // u2 length
+        if (encoded_len == len) {
+            memcpy(dst + 3, string, len);    // ..data: db string
+        } else if (jc_mutf8_encode(dst + 3, string, len) != JCLASS_OK) {
+            jc_set_error(ctx, JCLASS_ERR_ENCODING);
+        }
+    }
 }
 
-void areturn() {
-    // macro areturn { db 0xb0 }
-    emit_u1(0xb0);
+/**
+    @brief Helper function. Appends an entry made of a tag and a u4 without giving it an index
+    
+*/
+static void jc_cp_put_u4(jclass_ctx *ctx, uint8_t tag, uint32_t value) {
+    uint8_t *dst = jc_cp_append(ctx, 5);
+    if (dst) {
+        dst[0] = tag;                // u1 tag
+        jc_store_u4(dst + 1, value); // u4 value
+    }
 }
 
-void arraylength() {
-    // macro arraylength { db 0xbe }
-    emit_u1(0xbe);
+/**
+    @brief Helper function. Appends an entry made of a tag and two u4s without giving it an index
+    
+*/
+static void jc_cp_put_u8(jclass_ctx *ctx, uint8_t tag, uint64_t value) {
+    uint8_t *dst = jc_cp_append(ctx, 9);
+    if (dst) {
+        dst[0] = tag;                                        // u1 tag
+        jc_store_u4(dst + 1, (uint32_t)(value >> 32));       // u4 high part
+        jc_store_u4(dst + 5, (uint32_t)(value & 0xFFFFFFFF)); // u4 low part
+    }
 }
 
-void astore(uint16_t index) {
-    // macro astore index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x4b + index);
-    } else if (index < 0x100) {
-        emit_u1(0x3a);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x3a);
-        emit_u2(index);
+/**
+    @brief Helper function. Appends an entry made of a tag and a u2 without giving it an index
+    
+*/
+static void jc_cp_put_ref(jclass_ctx *ctx, uint8_t tag, uint16_t index) {
+    uint8_t *dst = jc_cp_append(ctx, 3);
+    if (dst) {
+        dst[0] = tag;                // u1 tag
+        jc_store_u2(dst + 1, index); // u2 index
     }
 }
 
-void athrow() {
-    // macro athrow { db 0xbf }
-    emit_u1(0xbf);
+/**
+    @brief Helper function. Appends an entry made of a tag and two u2s without giving it an index
+    
+*/
+static void jc_cp_put_ref2(jclass_ctx *ctx, uint8_t tag, uint16_t first, uint16_t second) {
+    uint8_t *dst = jc_cp_append(ctx, 5);
+    if (dst) {
+        dst[0] = tag;                 // u1 tag
+        jc_store_u2(dst + 1, first);  // u2 first index
+        jc_store_u2(dst + 3, second); // u2 second index
+    }
 }
 
-void baload() {
-    // macro baload { db 0x33 }
-    emit_u1(0x33);
+/**
+    @brief Converts a char* to a constant UTF-8 string
+    @param string The string to convert
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_utf8(jclass_ctx *ctx, const char *string) {
+    jc_cp_put_utf8(ctx, string, strlen(string));
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void bastore() {
-    // macro bastore { db 0x54 }
-    emit_u1(0x54);
+/**
+    @brief Converts a string of known length to a constant UTF-8 string, it may contain NUL characters
+    @param string The string to convert
+    @param len The length of the string in bytes
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_utf8_len(jclass_ctx *ctx, const char *string, size_t len) {
+    jc_cp_put_utf8(ctx, string, len);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void bipush(int8_t byte_val) {
-    // macro bipush byte { if byte>-1 & byte<=5 ... }
-    if (byte_val >= -1 && byte_val <= 5) {
-        emit_u1(0x03 + byte_val);
-    } else {
-        emit_u1(0x10);
-        emit_u1((uint8_t)byte_val);
-    }
+/**
+    @brief Creates a constant integer
+    @param value The integer to add to the constant pool
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_integer(jclass_ctx *ctx, uint32_t value) {
+    jc_cp_put_u4(ctx, 3, value);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void caload() {
-    // macro caload { db 0x34 }
-    emit_u1(0x34);
+/**
+    @brief Creates a constant float
+    @param value The float to add to the constant pool
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_float(jclass_ctx *ctx, uint32_t value) {
+    jc_cp_put_u4(ctx, 4, value);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void castore() {
-    // macro castore { db 0x55 }
-    emit_u1(0x55);
+/**
+    @brief Creates a constant long. It takes up two constant pool indices, load it with ldc2_w
+    @param value The 64 bit value to add to the constant pool
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_long(jclass_ctx *ctx, uint64_t value) {
+    jc_cp_put_u8(ctx, 5, value);
+    return jc_increment_cp_counter(ctx, 2);
 }
 
-void checkcast(uint16_t class_index) {
-    // macro checkcast class { db 0xc0,(class) shr 8,(class) and 0FFh }
-    emit_u1(0xc0);
-    emit_u2(class_index);
+/**
+    @brief Creates a constant double. It takes up two constant pool indices, load it with ldc2_w
+    @param value The 64 bit value to add to the constant pool
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_double(jclass_ctx *ctx, uint64_t value) {
+    jc_cp_put_u8(ctx, 6, value);
+    return jc_increment_cp_counter(ctx, 2);
 }
 
-void d2f() {
-    // macro d2f { db 0x90 }
-    emit_u1(0x90);
+/**
+    @brief Creates a constant class reference
+    @param name_index The index of the UTF-8 which is the class name (java/lang/Object)
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_class(jclass_ctx *ctx, uint16_t name_index) {
+    jc_cp_put_ref(ctx, 7, name_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void d2i() {
-    // macro d2i { db 0x8e }
-    emit_u1(0x8e);
+/**
+    @brief Creates a constant string from a constant UTF-8
+    @param string_index Constant pool index of the UTF-8
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_string(jclass_ctx *ctx, uint16_t string_index) {
+    jc_cp_put_ref(ctx, 8, string_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void d2l() {
-    // macro d2l { db 0x8f }
-    emit_u1(0x8f);
+/**
+    @brief Builds a reference to a field
+    @param class_index Constant pool index of the class from which the field is from
+    @param name_and_type_index Constant pool index of the name and type of the field
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_fieldref(jclass_ctx *ctx, uint16_t class_index, uint16_t name_and_type_index) {
+    jc_cp_put_ref2(ctx, 9, class_index, name_and_type_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dadd() {
-    // macro dadd { db 0x63 }
-    emit_u1(0x63);
+/**
+    @brief Builds a reference to a method
+    @param class_index Constant pool index of the class from which the field is from
+    @param name_and_type_index Constant pool index of the name and type of the field
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_methodref(jclass_ctx *ctx, uint16_t class_index, uint16_t name_and_type_index) {
+    jc_cp_put_ref2(ctx, 10, class_index, name_and_type_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void daload() {
-    // macro daload { db 0x31 }
-    emit_u1(0x31);
+/**
+    @brief Builds a reference to a method from an interface
+    @param class_index Constant pool index of the class from which the field is from
+    @param name_and_type_index Constant pool index of the name and type of the field
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_interfacemethodref(jclass_ctx *ctx, uint16_t class_index, uint16_t name_and_type_index) {
+    jc_cp_put_ref2(ctx, 11, class_index, name_and_type_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dastore() {
-    // macro dastore { db 0x52 }
-    emit_u1(0x52);
+/**
+    @brief Builds a name and type
+    @param name_index Constant pool index of the name
+    @param descriptor_index Constant pool index of the descriptor, a return type and params
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_nameandtype(jclass_ctx *ctx, uint16_t name_index, uint16_t descriptor_index) {
+    jc_cp_put_ref2(ctx, 12, name_index, descriptor_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dcmpg() {
-    // macro dcmpg { db 0x98 }
-    emit_u1(0x98);
+/**
+    @brief Builds a method handle, needs Java 7 (class file version 51)
+    @param reference_kind How the handle behaves, 1 (getField) to 9 (invokeInterface)
+    @param reference_index Constant pool index of the field or method reference
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_methodhandle(jclass_ctx *ctx, uint8_t reference_kind, uint16_t reference_index) {
+    jc_check_version(ctx, JCLASS_JAVA_7, 0);
+    uint8_t *dst = jc_cp_append(ctx, 4);
+    if (dst) {
+        dst[0] = 15;                           // u1 tag
+        dst[1] = reference_kind;               // u1 reference_kind
+        jc_store_u2(dst + 2, reference_index); // u2 reference_index
+    }
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dcmpl() {
-    // macro dcmpl { db 0x97 }
-    emit_u1(0x97);
+/**
+    @brief Builds a method type, needs Java 7 (class file version 51)
+    @param descriptor_index Constant pool index of the method descriptor
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_methodtype(jclass_ctx *ctx, uint16_t descriptor_index) {
+    jc_check_version(ctx, JCLASS_JAVA_7, 0);
+    jc_cp_put_ref(ctx, 16, descriptor_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dconst_0() {
-    // macro dconst_0 { db 0x0e }
-    emit_u1(0x0e);
+/**
+    @brief Builds a dynamically computed constant, needs Java 11 (class file version 55)
+    @param bootstrap_method_attr_index Index of the bootstrap method in the BootstrapMethods attribute
+    @param name_and_type_index Constant pool index of the name and field descriptor of the constant
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_dynamic(jclass_ctx *ctx, uint16_t bootstrap_method_attr_index, uint16_t name_and_type_index) {
+    jc_check_version(ctx, JCLASS_JAVA_11, 0);
+    jc_cp_put_ref2(ctx, 17, bootstrap_method_attr_index, name_and_type_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void dconst_1() {
-    // macro dconst_1 { db 0x0f }
-    emit_u1(0x0f);
+/**
+    @brief Builds a call site for invokedynamic, needs Java 7 (class file version 51)
+    @param bootstrap_method_attr_index Index of the bootstrap method in the BootstrapMethods attribute
+    @param name_and_type_index Constant pool index of the name and method descriptor of the call site
+    @return The constant pool index of the new entry
+    
+*/
+uint16_t jc_constant_invokedynamic(jclass_ctx *ctx, uint16_t bootstrap_method_attr_index, uint16_t name_and_type_index) {
+    jc_check_version(ctx, JCLASS_JAVA_7, 0);
+    jc_cp_put_ref2(ctx, 18, bootstrap_method_attr_index, name_and_type_index);
+    return jc_increment_cp_counter(ctx, 1);
 }
 
-void ddiv() {
-    // macro ddiv { db 0x6f }
-    emit_u1(0x6f);
+/**
+    @brief Returns the index of a UTF-8 constant, adding it only if it is not in the pool yet
+    @param string The string to look up
+    
+*/
+uint16_t jc_cp_utf8(jclass_ctx *ctx, const char *string) {
+    jc_cp_put_utf8(ctx, string, strlen(string));
+    return jc_cp_intern(ctx);
 }
 
-void dload(uint16_t index) {
-    // macro dload index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x26 + index);
-    } else if (index < 0x100) {
-        emit_u1(0x18);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x18);
-        emit_u2(index);
-    }
+/**
+    @brief Returns the index of a UTF-8 constant of known length, adding it only if it is not in the pool yet
+    @param string The string to look up, it may contain NUL characters
+    @param len The length of the string in bytes
+    
+*/
+uint16_t jc_cp_utf8_len(jclass_ctx *ctx, const char *string, size_t len) {
+    jc_cp_put_utf8(ctx, string, len);
+    return jc_cp_intern(ctx);
 }
 
-void dmul() {
-    // macro dmul { db 0x6b }
-    emit_u1(0x6b);
+/**
+    @brief Returns the index of an integer constant, adding it only if it is not in the pool yet
+    @param value The integer to look up
+    
+*/
+uint16_t jc_cp_integer(jclass_ctx *ctx, int32_t value) {
+    jc_cp_put_u4(ctx, 3, (uint32_t)value);
+    return jc_cp_intern(ctx);
 }
 
-void dneg() {
-    // macro dneg { db 0x77 }
-    emit_u1(0x77);
+/**
+    @brief Returns the index of a float constant, adding it only if it is not in the pool yet
+    @param value The float to look up, compared bit for bit
+    
+*/
+uint16_t jc_cp_float(jclass_ctx *ctx, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    jc_cp_put_u4(ctx, 4, bits);
+    return jc_cp_intern(ctx);
 }
 
-void j_drem() {
-    // macro drem { db 0x73 }
-    emit_u1(0x73);
+/**
+    @brief Returns the index of a long constant, adding it only if it is not in the pool yet.
+    It takes up two constant pool indices, load it with ldc2_w
+    @param value The long to look up
+    
+*/
+uint16_t jc_cp_long(jclass_ctx *ctx, int64_t value) {
+    jc_cp_put_u8(ctx, 5, (uint64_t)value);
+    return jc_cp_intern(ctx);
 }
 
-void dreturn() {
+/**
+    @brief Returns the index of a double constant, adding it only if it is not in the pool yet.
+    It takes up two constant pool indices, load it with ldc2_w
+    @param value The double to look up, compared bit for bit
+    
+*/
+uint16_t jc_cp_double(jclass_ctx *ctx, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    jc_cp_put_u8(ctx, 6, bits);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Returns the index of a class constant, adding it and its name only if they are not in the pool yet
+    @param name The internal name of the class (java/lang/Object)
+    
+*/
+uint16_t jc_cp_class(jclass_ctx *ctx, const char *name) {
+    uint16_t name_index = jc_cp_utf8(ctx, name);
+    jc_cp_put_ref(ctx, 7, name_index);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Returns the index of a string constant, adding it and its UTF-8 only if they are not in the pool yet
+    @param string The value of the string
+    
+*/
+uint16_t jc_cp_string(jclass_ctx *ctx, const char *string) {
+    uint16_t string_index = jc_cp_utf8(ctx, string);
+    jc_cp_put_ref(ctx, 8, string_index);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Returns the index of a name and type, adding it only if it is not in the pool yet
+    @param name The name of the field or method
+    @param descriptor The descriptor of the field or method
+    
+*/
+uint16_t jc_cp_nameandtype(jclass_ctx *ctx, const char *name, const char *descriptor) {
+    uint16_t name_index = jc_cp_utf8(ctx, name);
+    uint16_t descriptor_index = jc_cp_utf8(ctx, descriptor);
+    jc_cp_put_ref2(ctx, 12, name_index, descriptor_index);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Helper function. Interns a field, method or interface method reference
+    
+*/
+static uint16_t jc_cp_member_ref(jclass_ctx *ctx, uint8_t tag, const char *class_name, const char *name, const char *descriptor) {
+    uint16_t class_index = jc_cp_class(ctx, class_name);
+    uint16_t name_and_type_index = jc_cp_nameandtype(ctx, name, descriptor);
+    jc_cp_put_ref2(ctx, tag, class_index, name_and_type_index);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Returns the index of a field reference, adding it and everything it points to only if they are not in the pool yet
+    @param class_name The class the field belongs to (java/lang/System)
+    @param name The name of the field (out)
+    @param descriptor The type of the field (Ljava/io/PrintStream;)
+    
+*/
+uint16_t jc_cp_fieldref(jclass_ctx *ctx, const char *class_name, const char *name, const char *descriptor) {
+    return jc_cp_member_ref(ctx, 9, class_name, name, descriptor);
+}
+
+/**
+    @brief Returns the index of a method reference, adding it and everything it points to only if they are not in the pool yet
+    @param class_name The class the method belongs to (java/io/PrintStream)
+    @param name The name of the method (println)
+    @param descriptor The parameters and return type of the method ((Ljava/lang/String;)V)
+    
+*/
+uint16_t jc_cp_methodref(jclass_ctx *ctx, const char *class_name, const char *name, const char *descriptor) {
+    return jc_cp_member_ref(ctx, 10, class_name, name, descriptor);
+}
+
+/**
+    @brief Returns the index of an interface method reference, adding it and everything it points to only if they are not in the pool yet
+    @param class_name The interface the method belongs to
+    @param name The name of the method
+    @param descriptor The parameters and return type of the method
+    
+*/
+uint16_t jc_cp_interfacemethodref(jclass_ctx *ctx, const char *class_name, const char *name, const char *descriptor) {
+    return jc_cp_member_ref(ctx, 11, class_name, name, descriptor);
+}
+
+/**
+    @brief Marks the end of the constant pool
+    
+    Constants can still be added after this, the pool is written out by jc_constant_pool_flush.
+*/
+void jc_constant_pool_end(jclass_ctx *ctx) {
+    (void)ctx;
+}
+
+/**
+    @brief Writes the collected constant pool into the output at the position of jc_constant_pool_start.
+    Called by jc_write_class, no constants can be added afterwards
+    @return JCLASS_OK or the error that stopped the pool from being written
+    
+*/
+int jc_constant_pool_flush(jclass_ctx *ctx) {
+    if (ctx->cp_flushed || ctx->error != JCLASS_OK) {
+        return ctx->error;
+    }
+    if (!ctx->cp_started) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return ctx->error;
+    }
+    size_t pos = ctx->cp_count_offset;
+    size_t len = 2 + ctx->cpLength;
+    if (jc_reserve(ctx, ctx->outputIndex + len) != JCLASS_OK) {
+        return ctx->error;
+    }
+    memmove(ctx->outputBuffer + pos + len, ctx->outputBuffer + pos, ctx->outputIndex - pos);
+    jc_store_u2(ctx->outputBuffer + pos, ctx->constant_pool_counter); // u2 constant_pool_count
+    if (ctx->cpLength) {
+        memcpy(ctx->outputBuffer + pos + 2, ctx->cpBuffer, ctx->cpLength);
+    }
+    ctx->outputIndex += len;
+    ctx->cp_flushed = 1;
+    return JCLASS_OK;
+}
+
+// ------------------------
+// sections
+// ------------------------
+
+/**
+    @brief Helper function. Starts a section whose count or length is at count_offset
+    
+*/
+static void jc_section_push(jclass_ctx *ctx, uint8_t kind, size_t count_offset) {
+    if (ctx->section_count >= ctx->sections_capacity) {
+        jclass_section *sections = jc_grow(ctx, ctx->sections, &ctx->sections_capacity, ctx->section_count + 1, sizeof(jclass_section), 8);
+        if (!sections) {
+            return;
+        }
+        ctx->sections = sections;
+    }
+    jclass_section *section = &ctx->sections[ctx->section_count++];
+    section->count_offset = count_offset;
+    section->counter = 0;
+    section->kind = kind;
+}
+
+/**
+    @brief Helper function. Returns the innermost open section
+    @return The section, or NULL (recording JCLASS_ERR_STATE) if it is not of the kind expected
+    
+*/
+static jclass_section *jc_section_top(jclass_ctx *ctx, uint8_t kind) {
+    if (ctx->section_count == 0 || ctx->sections[ctx->section_count - 1].kind != kind) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return NULL;
+    }
+    return &ctx->sections[ctx->section_count - 1];
+}
+
+/**
+    @brief Helper function. Counts a new entry of the innermost section, which has to be of the kind given
+    
+*/
+static void jc_section_count(jclass_ctx *ctx, uint8_t kind) {
+    jclass_section *section = jc_section_top(ctx, kind);
+    if (section) {
+        if (section->counter == 0xFFFF) {
+            jc_set_error(ctx, JCLASS_ERR_RANGE); // counts are u2
+        } else {
+            section->counter++;
+        }
+    }
+}
+
+/**
+    @brief Helper function. Ends the innermost section, which has to be of the kind given
+    @return The section, valid until the next section is started, or NULL on error
+    
+*/
+static jclass_section *jc_section_pop(jclass_ctx *ctx, uint8_t kind) {
+    jclass_section *section = jc_section_top(ctx, kind);
+    if (section) {
+        ctx->section_count--;
+    }
+    return section;
+}
+
+/**
+    @brief Helper function. Ends the innermost section, patching its count
+    
+*/
+static void jc_section_end(jclass_ctx *ctx, uint8_t kind) {
+    jclass_section *section = jc_section_pop(ctx, kind);
+    if (section) {
+        jc_patch_u2(ctx, section->count_offset, section->counter);
+    }
+}
+
+// ------------------------
+// interfaces macros
+// ------------------------
+
+// macro interfaces {
+
+/**
+    @brief Marks the start of the list of interfaces the class is using
+    
+*/
+void jc_interfaces_start(jclass_ctx *ctx) {
+    // u2 interfaces_count
+    jc_section_push(ctx, JCLASS_SECTION_INTERFACES, jc_current_offset(ctx));
+    jc_emit_u2(ctx, 0); // placeholder for interfaces_count
+}
+
+/**
+    @brief Adds a new interface to the list
+    @param interface_val No idea
+    
+*/
+void jc_interface_entry(jclass_ctx *ctx, uint16_t interface_val) {
+    // interfaces_counter = interfaces_counter + 1
+    jc_section_count(ctx, JCLASS_SECTION_INTERFACES);
+    // u2 interface
+    jc_emit_u2(ctx, interface_val);
+}
+
+/**
+    @brief Marks the end of the list of interfaces
+    
+*/
+void jc_interfaces_end(jclass_ctx *ctx) {
+    jc_section_end(ctx, JCLASS_SECTION_INTERFACES);
+    // purge interface (no-op)
+}
+
+// ------------------------
+// attributes macros
+// ------------------------
+
+/**
+    @brief Marks the start of the list of attributes the class has
+    
+*/
+void jc_attributes_start(jclass_ctx *ctx) {
+    // u2 attributes_count
+    jc_section_push(ctx, JCLASS_SECTION_ATTRIBUTES, jc_current_offset(ctx));
+    jc_emit_u2(ctx, 0); // placeholder for attributes_count
+}
+
+/**
+    @brief Marks the start of a new attribute
+    @param attribute_name_index Constant pool index of the name of the attribute
+    
+*/
+void jc_attribute_start(jclass_ctx *ctx, uint16_t attribute_name_index) {
+    // attributes that older class file versions do not have
+    static const struct { const char *name; uint16_t since; } versioned[] = {
+        { "StackMapTable", JCLASS_JAVA_6 }, { "BootstrapMethods", JCLASS_JAVA_7 }, { "MethodParameters", JCLASS_JAVA_8 },
+        { "Module", JCLASS_JAVA_9 }, { "NestHost", JCLASS_JAVA_11 }, { "NestMembers", JCLASS_JAVA_11 },
+        { "Record", JCLASS_JAVA_16 }, { "PermittedSubclasses", JCLASS_JAVA_17 }
+    };
+    if (ctx->needs_stackmap && jc_cp_utf8_equals(ctx, attribute_name_index, "StackMapTable")) {
+        ctx->needs_stackmap = 0; // the caller writes the method's frames
+    }
+    if (ctx->major_version != 0) {
+        for (size_t i = 0; i < sizeof(versioned) / sizeof(versioned[0]); i++) {
+            if (jc_cp_utf8_equals(ctx, attribute_name_index, versioned[i].name)) {
+                jc_check_version(ctx, versioned[i].since, 0);
+            }
+        }
+    }
+    jc_section_count(ctx, JCLASS_SECTION_ATTRIBUTES);
+    // u2 attribute_name_index
+    jc_emit_u2(ctx, attribute_name_index);
+    // local start: record current offset for attribute_length calculation
+    jc_section_push(ctx, JCLASS_SECTION_ATTRIBUTE, jc_current_offset(ctx));
+    // u4 attribute_length placeholder
+    jc_emit_u4(ctx, 0);
+}
+
+/**
+    @brief Marks the end of an attribute
+    
+*/
+void jc_attribute_end(jclass_ctx *ctx) {
+    jclass_section *section = jc_section_pop(ctx, JCLASS_SECTION_ATTRIBUTE);
+    if (section) {
+        size_t end_offset = jc_current_offset(ctx);
+        uint32_t length = (uint32_t)(end_offset - section->count_offset - 4);
+        jc_patch_u4(ctx, section->count_offset, length);
+    }
+    // restore coordinate values (no-op)
+}
+
+/**
+    @brief Marks the start of the attributes section
+    
+*/
+void jc_attributes_end(jclass_ctx *ctx) {
+    jc_section_end(ctx, JCLASS_SECTION_ATTRIBUTES);
+    // restore attributes_count, attributes_counter and purge attribute (all no-ops in C)
+}
+
+// ------------------------
+// fields macros
+// ------------------------
+
+/**
+    @brief Marks the start of the fields section
+    
+*/
+void jc_fields_start(jclass_ctx *ctx) {
+    // u2 fields_count
+    jc_section_push(ctx, JCLASS_SECTION_FIELDS, jc_current_offset(ctx));
+    jc_emit_u2(ctx, 0); // placeholder for fields_count
+}
+
+/**
+    @brief Creates a new field and begins it's attributes section
+    @param access_flags The JVM flags for the field
+    @param name_index Constant pool index of the name of the field
+    @param descriptor_index The constant pool index of the decriptor for the field
+    
+*/
+void jc_field_info(jclass_ctx *ctx, uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) {
+    jc_section_count(ctx, JCLASS_SECTION_FIELDS);
+    jc_emit_u2(ctx, access_flags);
+    jc_emit_u2(ctx, name_index);
+    jc_emit_u2(ctx, descriptor_index);
+    // attributes for field
+    jc_attributes_start(ctx);
+}
+
+/**
+    @brief Ends the current fields attributes section and the field itself
+    
+*/
+void jc_end_field_info(jclass_ctx *ctx) {
+    // end_attributes for field
+    jc_attributes_end(ctx);
+}
+
+/**
+    @brief Marks the end of the fields section
+    
+*/
+void jc_fields_end(jclass_ctx *ctx) {
+    jc_section_end(ctx, JCLASS_SECTION_FIELDS);
+    // purge field_info, end_field_info (no-op)
+}
+
+// ------------------------
+// methods macros
+// ------------------------
+
+/**
+    @brief Marks the start of the methods section
+    
+*/
+void jc_methods_start(jclass_ctx *ctx) {
+    // u2 methods_count
+    jc_section_push(ctx, JCLASS_SECTION_METHODS, jc_current_offset(ctx));
+    jc_emit_u2(ctx, 0); // placeholder for methods_count
+}
+
+/**
+    @brief Creates a new method and begins it's attributes section
+    @param access_flags The JVM flags for the method
+    @param name_index Constant pool index of the name of the method
+    @param descriptor_index The constant pool index of the decriptor for the method
+    
+*/
+void jc_method_info(jclass_ctx *ctx, uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) {
+    jc_section_count(ctx, JCLASS_SECTION_METHODS);
+    ctx->method_access_flags = access_flags;
+    ctx->method_name_index = name_index;
+    ctx->method_descriptor_index = descriptor_index;
+    ctx->ldc_weight = 1;
+    jc_emit_u2(ctx, access_flags);
+    jc_emit_u2(ctx, name_index);
+    jc_emit_u2(ctx, descriptor_index);
+    // attributes for method
+    jc_attributes_start(ctx);
+}
+
+/**
+    @brief Ends the current methods attributes section and the method itself
+    
+*/
+void jc_end_method_info(jclass_ctx *ctx) {
+    // end_attributes for method
+    jc_attributes_end(ctx);
+}
+
+/**
+    @brief Marks the end of the methods section
+    
+*/
+void jc_methods_end(jclass_ctx *ctx) {
+    jc_section_end(ctx, JCLASS_SECTION_METHODS);
+    // purge method_info, end_method_info (no-op)
+}
+
+// ------------------------
+// labels
+// ------------------------
+
+/**
+    @brief Returns the position in the current method's code that will be emitted to (the bytecode pc)
+    
+*/
+uint32_t jc_current_pc(jclass_ctx *ctx) {
+    return (uint32_t)(jc_current_offset(ctx) - ctx->bytecode_offset);
+}
+
+/**
+    @brief Creates a new label in the current method. Labels are freed by bytecode_end
+    @return The label, which can be used by the *_label branch functions before or after it is bound
+    
+*/
+jclass_label jc_label_new(jclass_ctx *ctx) {
+    if (ctx->label_count >= ctx->labels_capacity) {
+        int32_t *labels = jc_grow(ctx, ctx->labels, &ctx->labels_capacity, ctx->label_count + 1, sizeof(int32_t), 16);
+        if (!labels) {
+            return 0;
+        }
+        ctx->labels = labels;
+    }
+    ctx->labels[ctx->label_count] = -1;
+    return (jclass_label)ctx->label_count++;
+}
+
+/**
+    @brief Binds a label to the current position in the method's code
+    @param label The label to bind, it can only be bound once
+    
+*/
+void jc_label_bind(jclass_ctx *ctx, jclass_label label) {
+    if (label >= ctx->label_count || ctx->labels[label] >= 0) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
+    }
+    ctx->labels[label] = (int32_t)jc_current_pc(ctx);
+}
+
+/**
+    @brief Helper function. Remembers that the offset at field_pc has to point at label once the method is done
+    
+*/
+static void jc_add_fixup(jclass_ctx *ctx, uint32_t opcode_pc, jclass_label label, uint8_t width, uint8_t kind) {
+    if (label >= ctx->label_count) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
+    }
+    if (ctx->fixup_count >= ctx->fixups_capacity) {
+        jclass_fixup *fixups = jc_grow(ctx, ctx->fixups, &ctx->fixups_capacity, ctx->fixup_count + 1, sizeof(jclass_fixup), 16);
+        if (!fixups) {
+            return;
+        }
+        ctx->fixups = fixups;
+    }
+    jclass_fixup *fixup = &ctx->fixups[ctx->fixup_count++];
+    fixup->opcode_pc = opcode_pc;
+    fixup->field_pc = jc_current_pc(ctx);
+    fixup->label = label;
+    fixup->width = width;
+    fixup->kind = kind;
+    fixup->grown = 0;
+    fixup->shift = 0;
+}
+
+/**
+    @brief Helper function. Emits a branch instruction whose offset is filled in by bytecode_end.
+    goto and jsr switch to goto_w and jsr_w when the label is already bound and out of reach
+    
+*/
+static void jc_branch_label(jclass_ctx *ctx, uint8_t opcode, jclass_label label) {
+    if (label >= ctx->label_count) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
+    }
+    uint32_t pc = jc_current_pc(ctx);
+    if ((opcode == 0xa7 || opcode == 0xa8) && ctx->labels[label] >= 0) {
+        int64_t offset = (int64_t)ctx->labels[label] - pc;
+        if (offset < -0x8000 || offset >= 0x8000) {
+            opcode += 0x21; // 0xa7 goto -> 0xc8 goto_w, 0xa8 jsr -> 0xc9 jsr_w
+        }
+    }
+    uint8_t width = (opcode == 0xc8 || opcode == 0xc9) ? 4 : 2;
+    jc_emit_u1(ctx, opcode);
+    jc_add_fixup(ctx, pc, label, width, JCLASS_FIXUP_BRANCH);
+    if (width == 4) {
+        jc_emit_u4(ctx, 0); // placeholder for the branch offset
+    } else {
+        jc_emit_u2(ctx, 0); // placeholder for the branch offset
+    }
+}
+
+/**
+    @brief Helper function. Number of padding bytes after a switch opcode at pc so its operands are 4 byte aligned
+    
+*/
+static uint32_t jc_switch_padding(uint32_t pc) {
+    return (3 - (pc & 3)) & 3;
+}
+
+/**
+    @brief Helper function. Emits a switch opcode, its padding and its default offset
+    @return The pc of the switch
+    
+*/
+static uint32_t jc_switch_start(jclass_ctx *ctx, uint8_t opcode, jclass_label default_label) {
+    uint32_t pc = jc_current_pc(ctx);
+    jc_emit_u1(ctx, opcode);
+    // operands start at a multiple of 4 from the start of the method's code
+    for (uint32_t i = jc_switch_padding(pc); i > 0; i--) {
+        jc_emit_u1(ctx, 0);
+    }
+    jc_add_fixup(ctx, pc, default_label, 4, JCLASS_FIXUP_SWITCH);
+    jc_emit_u4(ctx, 0); // placeholder for the default offset
+    return pc;
+}
+
+/**
+ * @brief A lookupswitch match and where it jumps to
+ * 
+ */
+typedef struct jclass_switch_case {
+    int32_t key;
+    jclass_label label;
+} jclass_switch_case;
+
+/**
+    @brief Helper function. qsort comparison of switch cases by key
+    
+*/
+static int jc_switch_case_compare(const void *a, const void *b) {
+    int32_t x = ((const jclass_switch_case *)a)->key;
+    int32_t y = ((const jclass_switch_case *)b)->key;
+    return (x > y) - (x < y);
+}
+
+/**
+    @brief Helper function. Offset from the current position to an output offset given to a raw branch function.
+    Raw branches can not be moved, so methods using them are not relaxed
+    
+*/
+static int32_t jc_raw_branch_offset(jclass_ctx *ctx, size_t branch_target) {
+    ctx->raw_branches = 1;
+    return (int32_t)((int64_t)branch_target - (int64_t)jc_current_offset(ctx));
+}
+
+/**
+    @brief Helper function. Like jc_raw_branch_offset for the 2 byte offset of if* instructions, records an error if it does not fit
+    
+*/
+static int16_t jc_raw_branch_offset16(jclass_ctx *ctx, size_t branch_target) {
+    int32_t offset = jc_raw_branch_offset(ctx, branch_target);
+    if (offset < -0x8000 || offset >= 0x8000) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+    }
+    return (int16_t)offset;
+}
+
+/**
+    @brief Helper function. The conditional branch that jumps when opcode would not
+    
+*/
+static uint8_t jc_invert_branch(uint8_t opcode) {
+    if (opcode >= 0xc6) {
+        return (uint8_t)(((opcode - 0xc6) ^ 1) + 0xc6); // ifnull <-> ifnonnull
+    }
+    if (opcode >= 0xa5) {
+        return (uint8_t)(((opcode - 0xa5) ^ 1) + 0xa5); // if_acmpeq <-> if_acmpne
+    }
+    if (opcode >= 0x9f) {
+        return (uint8_t)(((opcode - 0x9f) ^ 1) + 0x9f); // eq <-> ne, lt <-> ge, gt <-> le
+    }
+    return (uint8_t)(((opcode - 0x99) ^ 1) + 0x99);
+}
+
+/**
+    @brief Helper function. Where pc ends up once the branches before it have grown
+    
+*/
+static uint32_t jc_relaxed_pc(jclass_ctx *ctx, uint32_t pc) {
+    // first fixup at or after pc, fixups are in pc order
+    size_t lo = 0, hi = ctx->fixup_count;
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (ctx->fixups[mid].opcode_pc < pc) {
+            lo = mid + 1;
+        } else {
+            hi = mid;
+        }
+    }
+    if (lo == ctx->fixup_count) {
+        jclass_fixup *last = &ctx->fixups[lo - 1];
+        return (uint32_t)((int64_t)pc + last->shift + last->grown);
+    }
+    return (uint32_t)((int64_t)pc + ctx->fixups[lo].shift);
+}
+
+/**
+    @brief Helper function. Size of a switch's operands after the padding, read from its code
+    @param operands Pointer to the default offset of the switch
+    
+*/
+static size_t jc_switch_operands_size(uint8_t opcode, const uint8_t *operands) {
+    if (opcode == 0xaa) {
+        int32_t low = (int32_t)(((uint32_t)operands[4] << 24) | ((uint32_t)operands[5] << 16) | ((uint32_t)operands[6] << 8) | operands[7]);
+        int32_t high = (int32_t)(((uint32_t)operands[8] << 24) | ((uint32_t)operands[9] << 16) | ((uint32_t)operands[10] << 8) | operands[11]);
+        return 12 + 4 * (size_t)((int64_t)high - low + 1);
+    }
+    uint32_t npairs = ((uint32_t)operands[4] << 24) | ((uint32_t)operands[5] << 16) | ((uint32_t)operands[6] << 8) | operands[7];
+    return 8 + 8 * (size_t)npairs;
+}
+
+/**
+    @brief Helper function. Picks the shortest encoding for every label branch of the current method.
+    goto and jsr that can not reach their label become goto_w and jsr_w, conditional branches become
+    the inverted condition jumping over a goto_w. Growing one branch can push others out of reach and
+    moving a switch changes its padding, so this repeats until nothing changes, then rewrites the
+    method's code in one pass
+    
+*/
+static void jc_relax_branches(jclass_ctx *ctx) {
+    size_t n = ctx->fixup_count;
+    if (n == 0 || ctx->error != JCLASS_OK) {
+        return;
+    }
+    const uint8_t *code = ctx->outputBuffer + ctx->bytecode_offset;
+    int changed = 1, moved = 0;
+    int64_t total = 0;
+    while (changed) {
+        changed = 0;
+        total = 0;
+        for (size_t i = 0; i < n; i++) {
+            jclass_fixup *fixup = &ctx->fixups[i];
+            fixup->shift = (int32_t)total;
+            if (fixup->kind == JCLASS_FIXUP_SWITCH) {
+                uint32_t old_pad = jc_switch_padding(fixup->opcode_pc);
+                uint32_t new_pad = jc_switch_padding((uint32_t)(fixup->opcode_pc + total));
+                fixup->grown = (int8_t)((int32_t)new_pad - (int32_t)old_pad);
+            }
+            total += fixup->grown;
+        }
+        for (size_t i = 0; i < n; i++) {
+            jclass_fixup *fixup = &ctx->fixups[i];
+            if (fixup->kind != JCLASS_FIXUP_BRANCH || fixup->width != 2 || fixup->grown || ctx->labels[fixup->label] < 0) {
+                continue;
+            }
+            int64_t target = jc_relaxed_pc(ctx, (uint32_t)ctx->labels[fixup->label]);
+            int64_t offset = target - ((int64_t)fixup->opcode_pc + fixup->shift);
+            if (offset < -0x8000 || offset >= 0x8000) {
+                uint8_t opcode = code[fixup->opcode_pc];
+                fixup->grown = (opcode == 0xa7 || opcode == 0xa8) ? 2 : 5;
+                changed = 1;
+            }
+        }
+    }
+    for (size_t i = 0; i < n; i++) {
+        moved |= ctx->fixups[i].grown != 0;
+    }
+    if (!moved) {
+        return;
+    }
+    if (ctx->raw_branches) {
+        // offsets of raw branches are already written and can not be moved
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+
+    size_t old_len = jc_current_offset(ctx) - ctx->bytecode_offset;
+    size_t new_len = (size_t)((int64_t)old_len + total);
+    uint8_t *old_code = malloc(old_len);
+    if (!old_code || jc_reserve(ctx, ctx->bytecode_offset + new_len) != JCLASS_OK) {
+        free(old_code);
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return;
+    }
+    memcpy(old_code, ctx->outputBuffer + ctx->bytecode_offset, old_len);
+    for (size_t i = 0; i < ctx->label_count; i++) {
+        if (ctx->labels[i] >= 0) {
+            ctx->labels[i] = (int32_t)jc_relaxed_pc(ctx, (uint32_t)ctx->labels[i]);
+        }
+    }
+
+    uint8_t *new_code = ctx->outputBuffer + ctx->bytecode_offset;
+    size_t src = 0, dst = 0;
+    for (size_t i = 0; i < n; i++) {
+        jclass_fixup *fixup = &ctx->fixups[i];
+        memcpy(new_code + dst, old_code + src, fixup->opcode_pc - src);
+        dst += fixup->opcode_pc - src;
+        src = fixup->opcode_pc;
+        uint8_t opcode = old_code[src];
+        if (fixup->kind == JCLASS_FIXUP_SWITCH) {
+            // the operands are copied as they are, only the padding in front of them changes
+            size_t old_operands = src + 1 + jc_switch_padding((uint32_t)src);
+            size_t new_operands = dst + 1 + jc_switch_padding((uint32_t)dst);
+            size_t size = jc_switch_operands_size(opcode, old_code + old_operands);
+            new_code[dst] = opcode;
+            memset(new_code + dst + 1, 0, new_operands - dst - 1);
+            memcpy(new_code + new_operands, old_code + old_operands, size);
+            for (size_t j = i; j < n && ctx->fixups[j].opcode_pc == src && ctx->fixups[j].kind != JCLASS_FIXUP_BRANCH; j++) {
+                ctx->fixups[j].opcode_pc = (uint32_t)dst;
+                ctx->fixups[j].field_pc = (uint32_t)(ctx->fixups[j].field_pc - old_operands + new_operands);
+                ctx->fixups[j].grown = 0;
+                ctx->fixups[j].shift = 0;
+                i = j;
+            }
+            src = old_operands + size;
+            dst = new_operands + size;
+            continue;
+        }
+        if (!fixup->grown) {
+            memcpy(new_code + dst, old_code + src, 1 + (size_t)fixup->width);
+            fixup->opcode_pc = (uint32_t)dst;
+            fixup->field_pc = (uint32_t)dst + 1;
+            src += 1 + (size_t)fixup->width;
+            dst += 1 + (size_t)fixup->width;
+        } else if (opcode == 0xa7 || opcode == 0xa8) {
+            new_code[dst] = opcode + 0x21; // goto -> goto_w, jsr -> jsr_w
+            fixup->opcode_pc = (uint32_t)dst;
+            fixup->field_pc = (uint32_t)dst + 1;
+            fixup->width = 4;
+            src += 3;
+            dst += 5;
+        } else {
+            // if<!cond> +8; goto_w label
+            new_code[dst] = jc_invert_branch(opcode);
+            jc_store_u2(new_code + dst + 1, 8);
+            new_code[dst + 3] = 0xc8;
+            fixup->opcode_pc = (uint32_t)dst + 3;
+            fixup->field_pc = (uint32_t)dst + 4;
+            fixup->width = 4;
+            src += 3;
+            dst += 8;
+        }
+        fixup->grown = 0;
+        fixup->shift = 0;
+    }
+    memcpy(new_code + dst, old_code + src, old_len - src);
+    ctx->outputIndex = ctx->bytecode_offset + new_len;
+    free(old_code);
+}
+
+/**
+    @brief Helper function. Sets the pcs of the exception handlers from their labels, before the labels are freed
+    
+*/
+static void jc_resolve_handlers(jclass_ctx *ctx) {
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        jclass_handler *handler = &ctx->handlers[i];
+        int32_t start = ctx->labels[handler->start];
+        int32_t end = ctx->labels[handler->end];
+        int32_t target = ctx->labels[handler->handler];
+        if (start < 0 || end < 0 || target < 0) {
+            // handler with a label that was never bound
+            jc_set_error(ctx, JCLASS_ERR_STATE);
+            continue;
+        }
+        if (start >= end) {
+            jc_set_error(ctx, JCLASS_ERR_RANGE);
+            continue;
+        }
+        handler->start_pc = (uint32_t)start;
+        handler->end_pc = (uint32_t)end;
+        handler->handler_pc = (uint32_t)target;
+    }
+}
+
+/**
+    @brief Helper function. Patches every branch offset of the current method and frees its labels
+    
+*/
+static void jc_resolve_fixups(jclass_ctx *ctx) {
+    for (size_t i = 0; i < ctx->fixup_count; i++) {
+        jclass_fixup *fixup = &ctx->fixups[i];
+        int32_t target = ctx->labels[fixup->label];
+        if (target < 0) {
+            // branch to a label that was never bound
+            jc_set_error(ctx, JCLASS_ERR_STATE);
+            continue;
+        }
+        // offsets are relative to the branch opcode, not to the offset field
+        int64_t offset = (int64_t)target - fixup->opcode_pc;
+        size_t pos = ctx->bytecode_offset + fixup->field_pc;
+        if (fixup->width == 4) {
+            jc_patch_u4(ctx, pos, (uint32_t)(int32_t)offset);
+        } else if (offset >= -0x8000 && offset < 0x8000) {
+            jc_patch_u2(ctx, pos, (uint16_t)(int16_t)offset);
+        } else {
+            jc_set_error(ctx, JCLASS_ERR_RANGE);
+        }
+    }
+    ctx->fixup_count = 0;
+    ctx->label_count = 0;
+    ctx->raw_branches = 0;
+}
+
+// ------------------------
+// bytecode macros
+// ------------------------
+
+/**
+    @brief Marks the start of a bytecode section
+    
+*/
+void jc_bytecode_start(jclass_ctx *ctx) {
+    // local length; bytecode_length equ length
+    ctx->bytecode_length_offset = jc_current_offset(ctx);
+    // u4 bytecode_length placeholder
+    jc_emit_u4(ctx, 0);
+    ctx->bytecode_offset = jc_current_offset(ctx);
+    ctx->handler_count = 0;
+    // org 0 is ignored in C
+}
+
+/**
+    @brief Marks the end of a bytecode section, choosing the encoding of and patching all branches made with labels
+    
+*/
+void jc_bytecode_end(jclass_ctx *ctx) {
+    jc_relax_branches(ctx);
+    jc_resolve_handlers(ctx);
+    jc_resolve_fixups(ctx);
+    size_t end_offset = jc_current_offset(ctx);
+    uint32_t length = (uint32_t)(end_offset - ctx->bytecode_offset);
+    if (length > 0xFFFF) {
+        // the JVM limits a method's code to 65535 bytes
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+    }
+    jc_patch_u4(ctx, ctx->bytecode_length_offset, length);
+    // org bytecode_offset+bytecode_length, restore bytecode_length are ignored
+}
+
+// ------------------------
+// exceptions macros
+// ------------------------
+
+/**
+    @brief Marks the start of an exceptions section
+    
+*/
+void jc_exceptions_start(jclass_ctx *ctx) {
+    // local length; exception_table_length equ length
+    jc_section_push(ctx, JCLASS_SECTION_EXCEPTIONS, jc_current_offset(ctx));
+    // u2 exception_table_length placeholder
+    jc_emit_u2(ctx, 0);
+}
+
+void jc_exception_entry(jclass_ctx *ctx, uint16_t start_pc, uint16_t end_pc, uint16_t handler_pc, uint16_t catch_type) {
+    jc_section_count(ctx, JCLASS_SECTION_EXCEPTIONS);
+    jc_emit_u2(ctx, start_pc);
+    jc_emit_u2(ctx, end_pc);
+    jc_emit_u2(ctx, handler_pc);
+    jc_emit_u2(ctx, catch_type);
+}
+
+/**
+    @brief Marks the end of a bytecode section
+    
+*/
+void jc_exceptions_end(jclass_ctx *ctx) {
+    jc_section_end(ctx, JCLASS_SECTION_EXCEPTIONS);
+    // restore exception_table_length (no-op)
+}
+
+/**
+    @brief Adds an exception handler to the current method, written to the exception table by code_attribute_end.
+    Handlers are tried in the order they are added, so inner handlers go first
+    @param start Label bound to the first instruction the handler covers
+    @param end Label bound after the last instruction the handler covers
+    @param handler Label bound to the first instruction of the handler
+    @param catch_type Constant pool index of the class to catch, 0 to catch everything (finally)
+    
+*/
+void jc_exception_handler(jclass_ctx *ctx, jclass_label start, jclass_label end, jclass_label handler, uint16_t catch_type) {
+    if (start >= ctx->label_count || end >= ctx->label_count || handler >= ctx->label_count) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
+    }
+    if (ctx->handler_count >= 0xFFFF) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    if (ctx->handler_count >= ctx->handlers_capacity) {
+        jclass_handler *handlers = jc_grow(ctx, ctx->handlers, &ctx->handlers_capacity, ctx->handler_count + 1, sizeof(jclass_handler), 4);
+        if (!handlers) {
+            return;
+        }
+        ctx->handlers = handlers;
+    }
+    jclass_handler *entry = &ctx->handlers[ctx->handler_count++];
+    memset(entry, 0, sizeof(*entry));
+    entry->start = start;
+    entry->end = end;
+    entry->handler = handler;
+    entry->catch_type = catch_type;
+}
+
+// ------------------------
+// BYTECODE constants
+// ------------------------
+
+/**
+ * @brief The magic numbers for primitive types in java
+ * 
+ */
+enum {
+    T_BOOLEAN = 4,
+    T_CHAR    = 5,
+    T_FLOAT   = 6,
+    T_DOUBLE  = 7,
+    T_BYTE    = 8,
+    T_SHORT   = 9,
+    T_INT     = 10,
+    T_LONG    = 11
+};
+
+// ------------------------
+// Bytecode instruction macros as functions
+// ------------------------
+
+void jc_aaload(jclass_ctx *ctx) {
+    // macro aaload { db 0x32 }
+    jc_emit_u1(ctx, 0x32);
+}
+
+void jc_aastore(jclass_ctx *ctx) {
+    // macro aastore { db 0x53 }
+    jc_emit_u1(ctx, 0x53);
+}
+
+void jc_aconst_null(jclass_ctx *ctx) {
+    // macro aconst_null { db 0x01 }
+    jc_emit_u1(ctx, 0x01);
+}
+
+void jc_aload(jclass_ctx *ctx, uint16_t index) {
+    // macro aload index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x2a + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x19);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x19);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_anewarray(jclass_ctx *ctx, uint16_t class_index) {
+    // macro anewarray class { db 0xbd,(class) shr 8,(class) and 0FFh }
+    jc_emit_u1(ctx, 0xbd);
+    jc_emit_u2(ctx, class_index);
+}
+
+void jc_areturn(jclass_ctx *ctx) {
+    // macro areturn { db 0xb0 }
+    jc_emit_u1(ctx, 0xb0);
+}
+
+void jc_arraylength(jclass_ctx *ctx) {
+    // macro arraylength { db 0xbe }
+    jc_emit_u1(ctx, 0xbe);
+}
+
+void jc_astore(jclass_ctx *ctx, uint16_t index) {
+    // macro astore index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x4b + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x3a);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x3a);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_athrow(jclass_ctx *ctx) {
+    // macro athrow { db 0xbf }
+    jc_emit_u1(ctx, 0xbf);
+}
+
+void jc_baload(jclass_ctx *ctx) {
+    // macro baload { db 0x33 }
+    jc_emit_u1(ctx, 0x33);
+}
+
+void jc_bastore(jclass_ctx *ctx) {
+    // macro bastore { db 0x54 }
+    jc_emit_u1(ctx, 0x54);
+}
+
+void jc_bipush(jclass_ctx *ctx, int8_t byte_val) {
+    // macro bipush byte { if byte>-1 & byte<=5 ... }
+    if (byte_val >= -1 && byte_val <= 5) {
+        jc_emit_u1(ctx, 0x03 + byte_val);
+    } else {
+        jc_emit_u1(ctx, 0x10);
+        jc_emit_u1(ctx, (uint8_t)byte_val);
+    }
+}
+
+void jc_caload(jclass_ctx *ctx) {
+    // macro caload { db 0x34 }
+    jc_emit_u1(ctx, 0x34);
+}
+
+void jc_castore(jclass_ctx *ctx) {
+    // macro castore { db 0x55 }
+    jc_emit_u1(ctx, 0x55);
+}
+
+void jc_checkcast(jclass_ctx *ctx, uint16_t class_index) {
+    // macro checkcast class { db 0xc0,(class) shr 8,(class) and 0FFh }
+    jc_emit_u1(ctx, 0xc0);
+    jc_emit_u2(ctx, class_index);
+}
+
+void jc_d2f(jclass_ctx *ctx) {
+    // macro d2f { db 0x90 }
+    jc_emit_u1(ctx, 0x90);
+}
+
+void jc_d2i(jclass_ctx *ctx) {
+    // macro d2i { db 0x8e }
+    jc_emit_u1(ctx, 0x8e);
+}
+
+void jc_d2l(jclass_ctx *ctx) {
+    // macro d2l { db 0x8f }
+    jc_emit_u1(ctx, 0x8f);
+}
+
+void jc_dadd(jclass_ctx *ctx) {
+    // macro dadd { db 0x63 }
+    jc_emit_u1(ctx, 0x63);
+}
+
+void jc_daload(jclass_ctx *ctx) {
+    // macro daload { db 0x31 }
+    jc_emit_u1(ctx, 0x31);
+}
+
+void jc_dastore(jclass_ctx *ctx) {
+    // macro dastore { db 0x52 }
+    jc_emit_u1(ctx, 0x52);
+}
+
+void jc_dcmpg(jclass_ctx *ctx) {
+    // macro dcmpg { db 0x98 }
+    jc_emit_u1(ctx, 0x98);
+}
+
+void jc_dcmpl(jclass_ctx *ctx) {
+    // macro dcmpl { db 0x97 }
+    jc_emit_u1(ctx, 0x97);
+}
+
+void jc_dconst_0(jclass_ctx *ctx) {
+    // macro dconst_0 { db 0x0e }
+    jc_emit_u1(ctx, 0x0e);
+}
+
+void jc_dconst_1(jclass_ctx *ctx) {
+    // macro dconst_1 { db 0x0f }
+    jc_emit_u1(ctx, 0x0f);
+}
+
+void jc_ddiv(jclass_ctx *ctx) {
+    // macro ddiv { db 0x6f }
+    jc_emit_u1(ctx, 0x6f);
+}
+
+void jc_dload(jclass_ctx *ctx, uint16_t index) {
+    // macro dload index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x26 + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x18);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x18);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_dmul(jclass_ctx *ctx) {
+    // macro dmul { db 0x6b }
+    jc_emit_u1(ctx, 0x6b);
+}
+
+void jc_dneg(jclass_ctx *ctx) {
+    // macro dneg { db 0x77 }
+    jc_emit_u1(ctx, 0x77);
+}
+
+void jc_drem(jclass_ctx *ctx) {
+    // macro drem { db 0x73 }
+    jc_emit_u1(ctx, 0x73);
+}
+
+void jc_dreturn(jclass_ctx *ctx) {
     // macro dreturn { db 0xaf }
-    emit_u1(0xaf);
+    jc_emit_u1(ctx, 0xaf);
+}
+
+void jc_dstore(jclass_ctx *ctx, uint16_t index) {
+    // macro dstore index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x47 + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x39);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x39);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_dsub(jclass_ctx *ctx) {
+    // macro dsub { db 0x67 }
+    jc_emit_u1(ctx, 0x67);
+}
+
+void jc_dup(jclass_ctx *ctx) {
+    // macro dup { db 0x59 }
+    jc_emit_u1(ctx, 0x59);
+}
+
+void jc_dup_x1(jclass_ctx *ctx) {
+    // macro dup_x1 { db 0x5a }
+    jc_emit_u1(ctx, 0x5a);
+}
+
+void jc_dup_x2(jclass_ctx *ctx) {
+    // macro dup_x2 { db 0x5b }
+    jc_emit_u1(ctx, 0x5b);
+}
+
+void jc_dup2(jclass_ctx *ctx) {
+    // macro dup2 { db 0x5c }
+    jc_emit_u1(ctx, 0x5c);
+}
+
+void jc_dup2_x1(jclass_ctx *ctx) {
+    // macro dup2_x1 { db 0x5d }
+    jc_emit_u1(ctx, 0x5d);
+}
+
+void jc_dup2_x2(jclass_ctx *ctx) {
+    // macro dup2_x2 { db 0x5e }
+    jc_emit_u1(ctx, 0x5e);
+}
+
+void jc_f2d(jclass_ctx *ctx) {
+    // macro f2d { db 0x8d }
+    jc_emit_u1(ctx, 0x8d);
+}
+
+void jc_f2i(jclass_ctx *ctx) {
+    // macro f2i { db 0x8b }
+    jc_emit_u1(ctx, 0x8b);
+}
+
+void jc_f2l(jclass_ctx *ctx) {
+    // macro f2l { db 0x8c }
+    jc_emit_u1(ctx, 0x8c);
+}
+
+void jc_fadd(jclass_ctx *ctx) {
+    // macro fadd { db 0x62 }
+    jc_emit_u1(ctx, 0x62);
+}
+
+void jc_faload(jclass_ctx *ctx) {
+    // macro faload { db 0x30 }
+    jc_emit_u1(ctx, 0x30);
+}
+
+void jc_fastore(jclass_ctx *ctx) {
+    // macro fastore { db 0x51 }
+    jc_emit_u1(ctx, 0x51);
+}
+
+void jc_fcmpg(jclass_ctx *ctx) {
+    // macro fcmpg { db 0x96 }
+    jc_emit_u1(ctx, 0x96);
+}
+
+void jc_fcmpl(jclass_ctx *ctx) {
+    // macro fcmpl { db 0x95 }
+    jc_emit_u1(ctx, 0x95);
+}
+
+void jc_fconst_0(jclass_ctx *ctx) {
+    // macro fconst_0 { db 0x0b }
+    jc_emit_u1(ctx, 0x0b);
+}
+
+void jc_fconst_1(jclass_ctx *ctx) {
+    // macro fconst_1 { db 0x0c }
+    jc_emit_u1(ctx, 0x0c);
+}
+
+void jc_fconst_2(jclass_ctx *ctx) {
+    // macro fconst_2 { db 0x0d }
+    jc_emit_u1(ctx, 0x0d);
+}
+
+void jc_fdiv(jclass_ctx *ctx) {
+    // macro fdiv { db 0x6e }
+    jc_emit_u1(ctx, 0x6e);
+}
+
+void jc_fload(jclass_ctx *ctx, uint16_t index) {
+    // macro fload index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x22 + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x17);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x17);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_fmul(jclass_ctx *ctx) {
+    // macro fmul { db 0x6a }
+    jc_emit_u1(ctx, 0x6a);
+}
+
+void jc_fneg(jclass_ctx *ctx) {
+    // macro fneg { db 0x76 }
+    jc_emit_u1(ctx, 0x76);
+}
+
+void jc_frem(jclass_ctx *ctx) {
+    // macro frem { db 0x72 }
+    jc_emit_u1(ctx, 0x72);
+}
+
+void jc_freturn(jclass_ctx *ctx) {
+    // macro freturn { db 0xae }
+    jc_emit_u1(ctx, 0xae);
+}
+
+void jc_fstore(jclass_ctx *ctx, uint16_t index) {
+    // macro fstore index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x43 + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x38);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x38);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_fsub(jclass_ctx *ctx) {
+    // macro fsub { db 0x66 }
+    jc_emit_u1(ctx, 0x66);
+}
+
+void jc_getfield(jclass_ctx *ctx, uint16_t index) {
+    // macro getfield index { db 0xb4,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb4);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_getstatic(jclass_ctx *ctx, uint16_t index) {
+    // macro getstatic index { db 0xb2,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb2);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_goto_inst(jclass_ctx *ctx, size_t branch_target) {
+    // macro goto branch { if branch-$>=-8000h & branch-$<8000h ... }
+    int32_t offset = jc_raw_branch_offset(ctx, branch_target);
+    if (offset >= (int32_t)0xFFFF8000 && offset < 0x8000) {
+        int16_t word_offset = (int16_t)offset;
+        jc_emit_u1(ctx, 0xa7);
+        jc_emit_u2(ctx, (uint16_t)word_offset);
+    } else {
+        int32_t dword_offset = offset;
+        jc_emit_u1(ctx, 0xc8);
+        jc_emit_u4(ctx, (uint32_t)dword_offset);
+    }
+}
+
+void jc_goto_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa7, label);
+}
+
+void jc_goto_w_inst(jclass_ctx *ctx, size_t branch_target) {
+    // macro goto_w branch { offset = dword branch-$; db 0xc8, ... }
+    int32_t offset = jc_raw_branch_offset(ctx, branch_target);
+    jc_emit_u1(ctx, 0xc8);
+    jc_emit_u4(ctx, (uint32_t)offset);
+}
+
+void jc_goto_w_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xc8, label);
+}
+
+void jc_i2b(jclass_ctx *ctx) {
+    // macro i2b { db 0x91 }
+    jc_emit_u1(ctx, 0x91);
+}
+
+void jc_i2c(jclass_ctx *ctx) {
+    // macro i2c { db 0x92 }
+    jc_emit_u1(ctx, 0x92);
+}
+
+void jc_i2d(jclass_ctx *ctx) {
+    // macro i2d { db 0x87 }
+    jc_emit_u1(ctx, 0x87);
+}
+
+void jc_i2f(jclass_ctx *ctx) {
+    // macro i2f { db 0x86 }
+    jc_emit_u1(ctx, 0x86);
+}
+
+void jc_i2l(jclass_ctx *ctx) {
+    // macro i2l { db 0x85 }
+    jc_emit_u1(ctx, 0x85);
+}
+
+void jc_i2s(jclass_ctx *ctx) {
+    // macro i2s { db 0x93 }
+    jc_emit_u1(ctx, 0x93);
+}
+
+void jc_iadd(jclass_ctx *ctx) {
+    // macro iadd { db 0x60 }
+    jc_emit_u1(ctx, 0x60);
+}
+
+void jc_iaload(jclass_ctx *ctx) {
+    // macro iaload { db 0x2e }
+    jc_emit_u1(ctx, 0x2e);
+}
+
+void jc_iand(jclass_ctx *ctx) {
+    // macro iand { db 0x7e }
+    jc_emit_u1(ctx, 0x7e);
+}
+
+void jc_iastore(jclass_ctx *ctx) {
+    // macro iastore { db 0x4f }
+    jc_emit_u1(ctx, 0x4f);
+}
+
+void jc_iconst_m1(jclass_ctx *ctx) {
+    // macro iconst_m1 { db 0x02 }
+    jc_emit_u1(ctx, 0x02);
+}
+
+void jc_iconst_0(jclass_ctx *ctx) {
+    // macro iconst_0 { db 0x03 }
+    jc_emit_u1(ctx, 0x03);
+}
+
+void jc_iconst_1(jclass_ctx *ctx) {
+    // macro iconst_1 { db 0x04 }
+    jc_emit_u1(ctx, 0x04);
+}
+
+void jc_iconst_2(jclass_ctx *ctx) {
+    // macro iconst_2 { db 0x05 }
+    jc_emit_u1(ctx, 0x05);
+}
+
+void jc_iconst_3(jclass_ctx *ctx) {
+    // macro iconst_3 { db 0x06 }
+    jc_emit_u1(ctx, 0x06);
+}
+
+void jc_iconst_4(jclass_ctx *ctx) {
+    // macro iconst_4 { db 0x07 }
+    jc_emit_u1(ctx, 0x07);
+}
+
+void jc_iconst_5(jclass_ctx *ctx) {
+    // macro iconst_5 { db 0x08 }
+    jc_emit_u1(ctx, 0x08);
+}
+
+void jc_idiv(jclass_ctx *ctx) {
+    // macro idiv { db 0x6c }
+    jc_emit_u1(ctx, 0x6c);
+}
+
+void jc_if_acmpeq(jclass_ctx *ctx, size_t branch_target) {
+    // macro if_acmpeq branch { offset = word branch-$; db 0xa5, ... }
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa5);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_acmpeq_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa5, label);
+}
+
+void jc_if_acmpne(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa6);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_acmpne_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa6, label);
+}
+
+void jc_if_icmpeq(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9f);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmpeq_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9f, label);
+}
+
+void jc_if_icmpne(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa0);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmpne_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa0, label);
+}
+
+void jc_if_icmplt(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa1);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmplt_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa1, label);
+}
+
+void jc_if_icmpge(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa2);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmpge_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa2, label);
+}
+
+void jc_if_icmpgt(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa3);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmpgt_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa3, label);
+}
+
+void jc_if_icmple(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xa4);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_if_icmple_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xa4, label);
+}
+
+void jc_ifeq(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x99);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifeq_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x99, label);
+}
+
+void jc_ifne(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9a);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifne_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9a, label);
+}
+
+void jc_iflt(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9b);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_iflt_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9b, label);
+}
+
+void jc_ifge(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9c);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifge_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9c, label);
+}
+
+void jc_ifgt(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9d);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifgt_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9d, label);
+}
+
+void jc_ifle(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0x9e);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifle_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0x9e, label);
+}
+
+void jc_ifnonnull(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xc7);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifnonnull_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xc7, label);
+}
+
+void jc_ifnull(jclass_ctx *ctx, size_t branch_target) {
+    int16_t offset = jc_raw_branch_offset16(ctx, branch_target);
+    jc_emit_u1(ctx, 0xc6);
+    jc_emit_u2(ctx, (uint16_t)offset);
+}
+
+void jc_ifnull_label(jclass_ctx *ctx, jclass_label label) {
+    jc_branch_label(ctx, 0xc6, label);
+}
+
+void jc_iinc(jclass_ctx *ctx, uint16_t index, int16_t constant_val) {
+    // macro iinc index, const { if index < 100h & const < 80h & const >= -80h ... }
+    if (index < 0x100 && constant_val < 0x80 && constant_val >= -0x80) {
+        jc_emit_u1(ctx, 0x84);
+        jc_emit_u1(ctx, (uint8_t)index);
+        jc_emit_u1(ctx, (uint8_t)constant_val);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x84);
+        jc_emit_u2(ctx, index);
+        jc_emit_u2(ctx, (uint16_t)constant_val);
+    }
+}
+
+void jc_iload(jclass_ctx *ctx, uint16_t index) {
+    // macro iload index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x1a + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x15);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x15);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_imul(jclass_ctx *ctx) {
+    // macro imul { db 0x68 }
+    jc_emit_u1(ctx, 0x68);
+}
+
+void jc_ineg(jclass_ctx *ctx) {
+    // macro ineg { db 0x74 }
+    jc_emit_u1(ctx, 0x74);
+}
+
+void jc_instanceof(jclass_ctx *ctx, uint16_t index) {
+    // macro instanceof index { db 0xc1,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xc1);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_invokedynamic(jclass_ctx *ctx, uint16_t index) {
+    // macro invokedynamic index { db 0xba,(index) shr 8,(index) and 0FFh,0,0 }
+    jc_check_version(ctx, JCLASS_JAVA_7, 0);
+    jc_emit_u1(ctx, 0xba);
+    jc_emit_u2(ctx, index);
+    jc_emit_u1(ctx, 0x00);
+    jc_emit_u1(ctx, 0x00);
+}
+
+void jc_invokeinterface(jclass_ctx *ctx, uint16_t index, uint8_t count) {
+    // macro invokeinterface index,count { db 0xb9,(index) shr 8,(index) and 0FFh,count,0 }
+    jc_emit_u1(ctx, 0xb9);
+    jc_emit_u2(ctx, index);
+    jc_emit_u1(ctx, count);
+    jc_emit_u1(ctx, 0x00);
+}
+
+void jc_invokespecial(jclass_ctx *ctx, uint16_t index) {
+    // macro invokespecial index { db 0xb7,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb7);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_invokestatic(jclass_ctx *ctx, uint16_t index) {
+    // macro invokestatic index { db 0xb8,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb8);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_invokevirtual(jclass_ctx *ctx, uint16_t index) {
+    // macro invokevirtual index { db 0xb6,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb6);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_ior(jclass_ctx *ctx) {
+    // macro ior { db 0x80 }
+    jc_emit_u1(ctx, 0x80);
+}
+
+void jc_irem(jclass_ctx *ctx) {
+    // macro irem { db 0x70 }
+    jc_emit_u1(ctx, 0x70);
+}
+
+void jc_ireturn(jclass_ctx *ctx) {
+    // macro ireturn { db 0xac }
+    jc_emit_u1(ctx, 0xac);
+}
+
+void jc_ishl(jclass_ctx *ctx) {
+    // macro ishl { db 0x78 }
+    jc_emit_u1(ctx, 0x78);
+}
+
+void jc_ishr(jclass_ctx *ctx) {
+    // macro ishr { db 0x7a }
+    jc_emit_u1(ctx, 0x7a);
+}
+
+void jc_istore(jclass_ctx *ctx, uint16_t index) {
+    // macro istore index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x3b + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x36);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x36);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_isub(jclass_ctx *ctx) {
+    // macro isub { db 0x64 }
+    jc_emit_u1(ctx, 0x64);
+}
+
+void jc_iushr(jclass_ctx *ctx) {
+    // macro iushr { db 0x7c }
+    jc_emit_u1(ctx, 0x7c);
+}
+
+void jc_ixor(jclass_ctx *ctx) {
+    // macro ixor { db 0x82 }
+    jc_emit_u1(ctx, 0x82);
+}
+
+void jc_jsr_inst(jclass_ctx *ctx, size_t branch_target) {
+    // macro jsr branch { if branch-$>=-8000h & branch-$<8000h ... }
+    jc_check_version(ctx, 0, JCLASS_JAVA_7);
+    int32_t offset = jc_raw_branch_offset(ctx, branch_target);
+    if (offset >= (int32_t)0xFFFF8000 && offset < 0x8000) {
+        int16_t word_offset = (int16_t)offset;
+        jc_emit_u1(ctx, 0xa8);
+        jc_emit_u2(ctx, (uint16_t)word_offset);
+    } else {
+        int32_t dword_offset = offset;
+        jc_emit_u1(ctx, 0xc9);
+        jc_emit_u4(ctx, (uint32_t)dword_offset);
+    }
+}
+
+void jc_jsr_label(jclass_ctx *ctx, jclass_label label) {
+    jc_check_version(ctx, 0, JCLASS_JAVA_7);
+    jc_branch_label(ctx, 0xa8, label);
+}
+
+void jc_jsr_w_inst(jclass_ctx *ctx, size_t branch_target) {
+    // macro jsr_w branch { offset = dword branch-$; db 0xc9, ... }
+    jc_check_version(ctx, 0, JCLASS_JAVA_7);
+    int32_t offset = jc_raw_branch_offset(ctx, branch_target);
+    jc_emit_u1(ctx, 0xc9);
+    jc_emit_u4(ctx, (uint32_t)offset);
+}
+
+void jc_jsr_w_label(jclass_ctx *ctx, jclass_label label) {
+    jc_check_version(ctx, 0, JCLASS_JAVA_7);
+    jc_branch_label(ctx, 0xc9, label);
+}
+
+void jc_l2d(jclass_ctx *ctx) {
+    // macro l2d { db 0x8a }
+    jc_emit_u1(ctx, 0x8a);
+}
+
+void jc_l2f(jclass_ctx *ctx) {
+    // macro l2f { db 0x89 }
+    jc_emit_u1(ctx, 0x89);
+}
+
+void jc_l2i(jclass_ctx *ctx) {
+    // macro l2i { db 0x88 }
+    jc_emit_u1(ctx, 0x88);
+}
+
+void jc_ladd(jclass_ctx *ctx) {
+    // macro ladd { db 0x61 }
+    jc_emit_u1(ctx, 0x61);
+}
+
+void jc_laload(jclass_ctx *ctx) {
+    // macro laload { db 0x2f }
+    jc_emit_u1(ctx, 0x2f);
+}
+
+void jc_land(jclass_ctx *ctx) {
+    // macro land { db 0x7f }
+    jc_emit_u1(ctx, 0x7f);
+}
+
+void jc_lastore(jclass_ctx *ctx) {
+    // macro lastore { db 0x50 }
+    jc_emit_u1(ctx, 0x50);
+}
+
+void jc_lcmp(jclass_ctx *ctx) {
+    // macro lcmp { db 0x94 }
+    jc_emit_u1(ctx, 0x94);
+}
+
+void jc_lconst_0(jclass_ctx *ctx) {
+    // macro lconst_0 { db 0x09 }
+    jc_emit_u1(ctx, 0x09);
+}
+
+void jc_lconst_1(jclass_ctx *ctx) {
+    // macro lconst_1 { db 0x0a }
+    jc_emit_u1(ctx, 0x0a);
+}
+
+void jc_ldc(jclass_ctx *ctx, uint16_t index) {
+    // macro ldc index { if index<100h ... }
+    jc_check_ldc_index(ctx, index, 0);
+    jc_count_ldc(ctx, index);
+    if (index < 0x100) {
+        jc_emit_u1(ctx, 0x12);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0x13);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_ldc_w(jclass_ctx *ctx, uint16_t index) {
+    // macro ldc_w index { db 0x13,(index) shr 8,(index) and 0FFh }
+    jc_check_ldc_index(ctx, index, 0);
+    jc_count_ldc(ctx, index);
+    jc_emit_u1(ctx, 0x13);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_ldc2_w(jclass_ctx *ctx, uint16_t index) {
+    // macro ldc2_w index { db 0x14,(index) shr 8,(index) and 0FFh }
+    jc_check_ldc_index(ctx, index, 1);
+    jc_emit_u1(ctx, 0x14);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_ldiv(jclass_ctx *ctx) {
+    // macro ldiv { db 0x6d }
+    jc_emit_u1(ctx, 0x6d);
+}
+
+void jc_lload(jclass_ctx *ctx, uint16_t index) {
+    // macro lload index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x1e + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x16);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x16);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_lmul(jclass_ctx *ctx) {
+    // macro lmul { db 0x69 }
+    jc_emit_u1(ctx, 0x69);
+}
+
+void jc_lneg(jclass_ctx *ctx) {
+    // macro lneg { db 0x75 }
+    jc_emit_u1(ctx, 0x75);
+}
+
+/**
+    @brief Emits a lookupswitch, the cases are sorted by key
+    @param default_label Where to jump when no key matches
+    @param count The number of cases
+    @param keys The value of each case, they must all be different
+    @param labels Where each case jumps to
+    
+*/
+void jc_lookupswitch(jclass_ctx *ctx, jclass_label default_label, size_t count, const int32_t *keys, const jclass_label *labels) {
+    // lookupswitch needs its keys sorted so the JVM can binary search them
+    jclass_switch_case *cases = malloc((count ? count : 1) * sizeof(jclass_switch_case));
+    if (!cases) {
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) {
+        cases[i].key = keys[i];
+        cases[i].label = labels[i];
+    }
+    qsort(cases, count, sizeof(jclass_switch_case), jc_switch_case_compare);
+    uint32_t pc = jc_switch_start(ctx, 0xab, default_label);
+    jc_emit_u4(ctx, (uint32_t)count);
+    for (size_t i = 0; i < count; i++) {
+        if (i > 0 && cases[i].key == cases[i - 1].key) {
+            jc_set_error(ctx, JCLASS_ERR_RANGE); // duplicate key
+        }
+        jc_emit_u4(ctx, (uint32_t)cases[i].key);
+        jc_add_fixup(ctx, pc, cases[i].label, 4, JCLASS_FIXUP_CASE);
+        jc_emit_u4(ctx, 0);
+    }
+    free(cases);
+}
+
+void jc_lor(jclass_ctx *ctx) {
+    // macro lor { db 0x81 }
+    jc_emit_u1(ctx, 0x81);
+}
+
+void jc_lrem(jclass_ctx *ctx) {
+    // macro lrem { db 0x71 }
+    jc_emit_u1(ctx, 0x71);
+}
+
+void jc_lreturn(jclass_ctx *ctx) {
+    // macro lreturn { db 0xad }
+    jc_emit_u1(ctx, 0xad);
+}
+
+void jc_lshl(jclass_ctx *ctx) {
+    // macro lshl { db 0x79 }
+    jc_emit_u1(ctx, 0x79);
+}
+
+void jc_lshr(jclass_ctx *ctx) {
+    // macro lshr { db 0x7b }
+    jc_emit_u1(ctx, 0x7b);
+}
+
+void jc_lstore(jclass_ctx *ctx, uint16_t index) {
+    // macro lstore index { if index>=0 & index<=3 ... }
+    if (index <= 3) {
+        jc_emit_u1(ctx, 0x3f + index);
+    } else if (index < 0x100) {
+        jc_emit_u1(ctx, 0x37);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0x37);
+        jc_emit_u2(ctx, index);
+    }
+}
+
+void jc_lsub(jclass_ctx *ctx) {
+    // macro lsub { db 0x65 }
+    jc_emit_u1(ctx, 0x65);
+}
+
+void jc_lushr(jclass_ctx *ctx) {
+    // macro lushr { db 0x7d }
+    jc_emit_u1(ctx, 0x7d);
+}
+
+void jc_lxor(jclass_ctx *ctx) {
+    // macro lxor { db 0x83 }
+    jc_emit_u1(ctx, 0x83);
+}
+
+void jc_monitorenter(jclass_ctx *ctx) {
+    // macro monitorenter { db 0xc2 }
+    jc_emit_u1(ctx, 0xc2);
+}
+
+void jc_monitorexit(jclass_ctx *ctx) {
+    // macro monitorexit { db 0xc3 }
+    jc_emit_u1(ctx, 0xc3);
+}
+
+void jc_multianewarray(jclass_ctx *ctx, uint16_t index, uint8_t dimensions) {
+    // macro multianewarray index,dimensions { db 0xc5,(index) shr 8,(index) and 0FFh,dimensions }
+    jc_emit_u1(ctx, 0xc5);
+    jc_emit_u2(ctx, index);
+    jc_emit_u1(ctx, dimensions);
+}
+
+void jc_new_inst(jclass_ctx *ctx, uint16_t index) {
+    // macro new index { db 0xbb,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xbb);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_newarray(jclass_ctx *ctx, uint8_t atype) {
+    // macro newarray atype { db 0xbc,atype }
+    jc_emit_u1(ctx, 0xbc);
+    jc_emit_u1(ctx, atype);
+}
+
+void jc_nop(jclass_ctx *ctx) {
+    // macro nop { db 0x00 }
+    jc_emit_u1(ctx, 0x00);
+}
+
+void jc_pop_inst(jclass_ctx *ctx) {
+    // macro pop { db 0x57 }
+    jc_emit_u1(ctx, 0x57);
+}
+
+void jc_pop2(jclass_ctx *ctx) {
+    // macro pop2 { db 0x58 }
+    jc_emit_u1(ctx, 0x58);
+}
+
+/**
+    @brief Pushes a double with dconst_0 or dconst_1, or ldc2_w of a constant added to the pool
+    @param value The double to push, compared bit for bit so -0.0 comes from the pool
+    
+*/
+void jc_push_double(jclass_ctx *ctx, double value) {
+    uint64_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0 || bits == 0x3FF0000000000000ull) {
+        jc_emit_u1(ctx, bits == 0 ? 0x0e : 0x0f);
+    } else {
+        jc_ldc2_w(ctx, jc_cp_double(ctx, value));
+    }
+}
+
+/**
+    @brief Pushes a float with fconst_0 to fconst_2, or ldc or ldc_w of a constant added to the pool
+    @param value The float to push, compared bit for bit so -0.0f comes from the pool
+    
+*/
+void jc_push_float(jclass_ctx *ctx, float value) {
+    uint32_t bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (bits == 0 || bits == 0x3F800000u || bits == 0x40000000u) {
+        jc_emit_u1(ctx, bits == 0 ? 0x0b : bits == 0x3F800000u ? 0x0c : 0x0d);
+    } else {
+        jc_ldc(ctx, jc_cp_float(ctx, value));
+    }
+}
+
+/**
+    @brief Pushes an int with the shortest of iconst_m1 to iconst_5, bipush, sipush, or ldc or ldc_w of a
+    constant added to the pool
+    @param value The int to push
+    
+*/
+void jc_push_int(jclass_ctx *ctx, int32_t value) {
+    if (value >= -0x80 && value < 0x80) {
+        jc_bipush(ctx, (int8_t)value); // iconst_m1 to iconst_5 where they fit
+    } else if (value >= -0x8000 && value < 0x8000) {
+        jc_emit_u1(ctx, 0x11); // sipush
+        jc_emit_u2(ctx, (uint16_t)(int16_t)value);
+    } else {
+        jc_ldc(ctx, jc_cp_integer(ctx, value));
+    }
+}
+
+/**
+    @brief Pushes a long with lconst_0 or lconst_1, iconst or bipush followed by i2l for small values, which
+    is no longer than ldc2_w and needs no constant, or ldc2_w of a constant added to the pool
+    @param value The long to push
+    
+*/
+void jc_push_long(jclass_ctx *ctx, int64_t value) {
+    if (value == 0 || value == 1) {
+        jc_emit_u1(ctx, (uint8_t)(0x09 + value));
+    } else if (value >= -0x80 && value < 0x80) {
+        jc_bipush(ctx, (int8_t)value);
+        jc_i2l(ctx);
+    } else {
+        jc_ldc2_w(ctx, jc_cp_long(ctx, value));
+    }
+}
+
+void jc_putfield(jclass_ctx *ctx, uint16_t index) {
+    // macro putfield index { db 0xb5,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb5);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_putstatic(jclass_ctx *ctx, uint16_t index) {
+    // macro putstatic index { db 0xb3,(index) shr 8,(index) and 0FFh }
+    jc_emit_u1(ctx, 0xb3);
+    jc_emit_u2(ctx, index);
+}
+
+void jc_ret_inst(jclass_ctx *ctx, uint16_t index) {
+    // macro ret index { if index<100h ... }
+    jc_check_version(ctx, 0, JCLASS_JAVA_7);
+    if (index < 0x100) {
+        jc_emit_u1(ctx, 0xa9);
+        jc_emit_u1(ctx, (uint8_t)index);
+    } else {
+        jc_emit_u1(ctx, 0xc4);
+        jc_emit_u1(ctx, 0xa9);
+        jc_emit_u2(ctx, index);
+    }
 }
 
-void dstore(uint16_t index) {
-    // macro dstore index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x47 + index);
-    } else if (index < 0x100) {
-        emit_u1(0x39);
-        emit_u1((uint8_t)index);
+void jc_return_inst(jclass_ctx *ctx) {
+    // macro return { db 0xb1 }
+    jc_emit_u1(ctx, 0xb1);
+}
+
+void jc_saload(jclass_ctx *ctx) {
+    // macro saload { db 0x35 }
+    jc_emit_u1(ctx, 0x35);
+}
+
+void jc_sastore(jclass_ctx *ctx) {
+    // macro sastore { db 0x56 }
+    jc_emit_u1(ctx, 0x56);
+}
+
+void jc_sipush(jclass_ctx *ctx, uint16_t value) {
+    // macro sipush short { db 0x11,(short) shr 8,(short) and 0FFh }
+    jc_emit_u1(ctx, 0x11);
+    jc_emit_u2(ctx, value);
+}
+
+void jc_swap(jclass_ctx *ctx) {
+    // macro swap { db 0x5f }
+    jc_emit_u1(ctx, 0x5f);
+}
+
+/**
+    @brief Emits a tableswitch for the values low to high
+    @param default_label Where to jump when the value is outside of low to high
+    @param labels Where each value jumps to, high - low + 1 of them
+    
+*/
+void jc_tableswitch(jclass_ctx *ctx, int32_t low, int32_t high, jclass_label default_label, const jclass_label *labels) {
+    if (low > high) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    uint32_t pc = jc_switch_start(ctx, 0xaa, default_label);
+    jc_emit_u4(ctx, (uint32_t)low);
+    jc_emit_u4(ctx, (uint32_t)high);
+    for (int64_t i = 0; i <= (int64_t)high - low; i++) {
+        jc_add_fixup(ctx, pc, labels[i], 4, JCLASS_FIXUP_CASE);
+        jc_emit_u4(ctx, 0);
+    }
+}
+
+/**
+    @brief Emits a tableswitch or a lookupswitch, whichever suits how dense the keys are
+    @param default_label Where to jump when no key matches
+    @param count The number of cases
+    @param keys The value of each case in any order, they must all be different
+    @param labels Where each case jumps to
+    
+*/
+void jc_switch_inst(jclass_ctx *ctx, jclass_label default_label, size_t count, const int32_t *keys, const jclass_label *labels) {
+    // same cost model as javac: a table costs space for every value in the range,
+    // a lookup costs a comparison per key
+    int32_t low = 0, high = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (i == 0 || keys[i] < low) {
+            low = keys[i];
+        }
+        if (i == 0 || keys[i] > high) {
+            high = keys[i];
+        }
+    }
+    int64_t range = (int64_t)high - low + 1;
+    int64_t table_cost = 4 + range + 3 * 3;
+    int64_t lookup_cost = 3 + 2 * (int64_t)count + 3 * (int64_t)count;
+    if (count == 0 || table_cost > lookup_cost) {
+        jc_lookupswitch(ctx, default_label, count, keys, labels);
+        return;
+    }
+    // which keys were seen is kept apart from the table, a case may jump to default_label too
+    jclass_label *table = malloc((size_t)range * (sizeof(jclass_label) + 1));
+    if (!table) {
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return;
+    }
+    uint8_t *seen = (uint8_t *)(table + range);
+    memset(seen, 0, (size_t)range);
+    for (int64_t i = 0; i < range; i++) {
+        table[i] = default_label;
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (seen[keys[i] - low]) {
+            jc_set_error(ctx, JCLASS_ERR_RANGE); // duplicate key
+        }
+        seen[keys[i] - low] = 1;
+        table[keys[i] - low] = labels[i];
+    }
+    jc_tableswitch(ctx, low, high, default_label, table);
+    free(table);
+}
+
+void jc_breakpoint(jclass_ctx *ctx) {
+    // macro breakpoint { db 0xca }
+    jc_emit_u1(ctx, 0xca);
+}
+
+void jc_impdep1(jclass_ctx *ctx) {
+    // macro impdep1 { db 0xfe }
+    jc_emit_u1(ctx, 0xfe);
+}
+
+void jc_impdep2(jclass_ctx *ctx) {
+    // macro impdep2 { db 0xff }
+    jc_emit_u1(ctx, 0xff);
+}
+void jc_impdep2_dup(jclass_ctx *ctx) {
+    // duplicate definition as in original code
+    jc_emit_u1(ctx, 0xff);
+}
+
+// ------------------------
+// code analysis
+// ------------------------
+
+/** @brief Length of each instruction in bytes, 0 for wide and the switches whose length depends on their operands */
+static const uint8_t jc_insn_sizes[0xca] = {
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x00
+    2, 3, 2, 3, 3, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, 1, // 0x10
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x20
+    1, 1, 1, 1, 1, 1, 2, 2, 2, 2, 2, 1, 1, 1, 1, 1, // 0x30
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x40
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x50
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x60
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x70
+    1, 1, 1, 1, 3, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, 1, // 0x80
+    1, 1, 1, 1, 1, 1, 1, 1, 1, 3, 3, 3, 3, 3, 3, 3, // 0x90
+    3, 3, 3, 3, 3, 3, 3, 3, 3, 2, 0, 0, 1, 1, 1, 1, // 0xa0
+    1, 1, 3, 3, 3, 3, 3, 3, 3, 5, 5, 3, 2, 3, 1, 1, // 0xb0
+    3, 3, 1, 1, 0, 4, 3, 3, 5, 5, // 0xc0
+};
+
+/** @brief How many stack slots each instruction adds, 0 where it depends on the operands */
+static const int8_t jc_stack_effects[0xca] = {
+    0, 1, 1, 1, 1, 1, 1, 1, 1, 2, 2, 1, 1, 1, 2, 2, // 0x00
+    1, 1, 1, 1, 2, 1, 2, 1, 2, 1, 1, 1, 1, 1, 2, 2, // 0x10
+    2, 2, 1, 1, 1, 1, 2, 2, 2, 2, 1, 1, 1, 1, -1, 0, // 0x20
+    -1, 0, -1, -1, -1, -1, -1, -2, -1, -2, -1, -1, -1, -1, -1, -2, // 0x30
+    -2, -2, -2, -1, -1, -1, -1, -2, -2, -2, -2, -1, -1, -1, -1, -3, // 0x40
+    -4, -3, -4, -3, -3, -3, -3, -1, -2, 1, 1, 1, 2, 2, 2, 0, // 0x50
+    -1, -2, -1, -2, -1, -2, -1, -2, -1, -2, -1, -2, -1, -2, -1, -2, // 0x60
+    -1, -2, -1, -2, 0, 0, 0, 0, -1, -1, -1, -1, -1, -1, -1, -2, // 0x70
+    -1, -2, -1, -2, 0, 1, 0, 1, -1, -1, 0, 0, 1, 1, -1, 0, // 0x80
+    -1, 0, 0, 0, -3, -1, -1, -3, -3, -1, -1, -1, -1, -1, -1, -2, // 0x90
+    -2, -2, -2, -2, -2, -2, -2, 0, 1, 0, -1, -1, -1, -2, -1, -2, // 0xa0
+    -1, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0, 1, 0, 0, 0, -1, // 0xb0
+    0, 0, -1, -1, 0, 0, -1, -1, 0, 1, // 0xc0
+};
+
+/**
+    @brief Helper function. Reads a big endian u2 from code
+    
+*/
+static uint16_t jc_load_u2(const uint8_t *src) {
+    return (uint16_t)((src[0] << 8) | src[1]);
+}
+
+/**
+    @brief Helper function. Reads a big endian u4 from code
+    
+*/
+static uint32_t jc_load_u4(const uint8_t *src) {
+    return ((uint32_t)src[0] << 24) | ((uint32_t)src[1] << 16) | ((uint32_t)src[2] << 8) | src[3];
+}
+
+/**
+    @brief Returns the length of the instruction at pc
+    @param code The method's code
+    @param pc Offset of the instruction's opcode
+    @param len Length of the method's code
+    @return The length in bytes, or 0 if the opcode is unknown or the instruction runs past len
+    
+*/
+size_t jc_insn_length(const uint8_t *code, size_t pc, size_t len) {
+    uint8_t opcode = code[pc];
+    size_t size;
+    if (opcode >= sizeof(jc_insn_sizes)) {
+        return 0;
+    } else if (opcode == 0xc4) {
+        // wide
+        if (pc + 1 >= len) {
+            return 0;
+        }
+        size = code[pc + 1] == 0x84 ? 6 : 4;
+    } else if (opcode == 0xaa || opcode == 0xab) {
+        // the counts come after the default: low and high for tableswitch, npairs for lookupswitch
+        size_t operands = pc + 1 + jc_switch_padding((uint32_t)pc);
+        if (operands + (opcode == 0xaa ? 12 : 8) > len) {
+            return 0;
+        }
+        size = operands - pc + jc_switch_operands_size(opcode, code + operands);
+    } else {
+        size = jc_insn_sizes[opcode];
+    }
+    return pc + size <= len ? size : 0;
+}
+
+/**
+    @brief Helper function. Whether execution can continue with the next instruction after opcode
+    
+*/
+static int jc_insn_falls_through(uint8_t opcode) {
+    switch (opcode) {
+        case 0xa7: case 0xc8:                               // goto, goto_w
+        case 0xa9: case 0xaa: case 0xab:                    // ret, tableswitch, lookupswitch
+        case 0xac: case 0xad: case 0xae: case 0xaf: case 0xb0: case 0xb1: // *return
+        case 0xbf:                                          // athrow
+            return 0;
+        default:
+            return 1;
+    }
+}
+
+/**
+    @brief Helper function. How many branch targets the instruction at pc has (the default of a switch counts)
+    
+*/
+static size_t jc_insn_target_count(const uint8_t *code, size_t pc) {
+    uint8_t opcode = code[pc];
+    if ((opcode >= 0x99 && opcode <= 0xa8) || opcode == 0xc6 || opcode == 0xc7 || opcode == 0xc8 || opcode == 0xc9) {
+        return 1;
+    }
+    if (opcode == 0xaa || opcode == 0xab) {
+        const uint8_t *operands = code + pc + 1 + jc_switch_padding((uint32_t)pc);
+        if (opcode == 0xaa) {
+            return 1 + (size_t)((int64_t)(int32_t)jc_load_u4(operands + 8) - (int32_t)jc_load_u4(operands + 4) + 1);
+        }
+        return 1 + (size_t)jc_load_u4(operands + 4);
+    }
+    return 0;
+}
+
+/**
+    @brief Helper function. The pc that branch target k of the instruction at pc goes to, 0 being the default of a switch
+    
+*/
+static int64_t jc_insn_target(const uint8_t *code, size_t pc, size_t k) {
+    uint8_t opcode = code[pc];
+    if (opcode == 0xc8 || opcode == 0xc9) {
+        return (int64_t)pc + (int32_t)jc_load_u4(code + pc + 1);
+    }
+    if (opcode != 0xaa && opcode != 0xab) {
+        return (int64_t)pc + (int16_t)jc_load_u2(code + pc + 1);
+    }
+    const uint8_t *operands = code + pc + 1 + jc_switch_padding((uint32_t)pc);
+    if (k > 0) {
+        operands += opcode == 0xaa ? 12 + 4 * (k - 1) : 8 + 8 * (k - 1) + 4;
+    }
+    return (int64_t)pc + (int32_t)jc_load_u4(operands);
+}
+
+/**
+    @brief Helper function. Finds the local variable the instruction at pc loads, stores or increments
+    @param index Set to the local's index
+    @return How many slots the local takes up, 0 if the instruction does not use a local
+    
+*/
+static uint32_t jc_insn_local(const uint8_t *code, size_t pc, uint32_t *index) {
+    uint8_t opcode = code[pc];
+    int wide = opcode == 0xc4;
+    if (wide) {
+        opcode = code[pc + 1];
+        *index = jc_load_u2(code + pc + 2);
+    } else {
+        *index = code[pc + 1];
+    }
+    if (opcode >= 0x1a && opcode <= 0x2d) {
+        // iload_0 to aload_3
+        *index = (uint32_t)(opcode - 0x1a) % 4;
+        opcode = (uint8_t)(0x15 + (opcode - 0x1a) / 4);
+    } else if (opcode >= 0x3b && opcode <= 0x4e) {
+        // istore_0 to astore_3
+        *index = (uint32_t)(opcode - 0x3b) % 4;
+        opcode = (uint8_t)(0x36 + (opcode - 0x3b) / 4);
+    }
+    switch (opcode) {
+        case 0x16: case 0x18: case 0x37: case 0x39:    // lload, dload, lstore, dstore
+            return 2;
+        case 0x15: case 0x17: case 0x19:                // iload, fload, aload
+        case 0x36: case 0x38: case 0x3a:                // istore, fstore, astore
+        case 0x84: case 0xa9:                           // iinc, ret
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+/**
+    @brief Helper function. Returns the bytes of a constant pool entry of the current class
+    @return Pointer to the entry's tag, or NULL if the index was not added with this context
+    
+*/
+static const uint8_t *jc_cp_entry_at(jclass_ctx *ctx, uint16_t index) {
+    if (ctx->cp_flushed || jc_cp_tag(ctx, index) == 0) {
+        return NULL;
+    }
+    return ctx->cpBuffer + ctx->cp_entries[index].offset;
+}
+
+/**
+    @brief Helper function. Finds the type descriptor of a field, method or call site reference (or of a NameAndType)
+    @param len Set to the length of the descriptor
+    @return Pointer to the descriptor, or NULL if it is not known
+    
+*/
+static const uint8_t *jc_cp_descriptor(jclass_ctx *ctx, uint16_t index, size_t *len) {
+    const uint8_t *entry = jc_cp_entry_at(ctx, index);
+    if (entry && entry[0] != 12) {
+        // Fieldref, Methodref, InterfaceMethodref, Dynamic and InvokeDynamic all end with a NameAndType
+        entry = (entry[0] >= 9 && entry[0] <= 11) || entry[0] == 17 || entry[0] == 18 ? jc_cp_entry_at(ctx, jc_load_u2(entry + 3)) : NULL;
+    }
+    if (!entry || entry[0] != 12) {
+        return NULL;
+    }
+    const uint8_t *utf8 = jc_cp_entry_at(ctx, jc_load_u2(entry + 3));
+    if (!utf8 || utf8[0] != 1) {
+        return NULL;
+    }
+    *len = jc_load_u2(utf8 + 1);
+    return utf8 + 3;
+}
+
+/**
+    @brief Helper function. How many stack or local slots the field type at *pos takes up, moving pos past it
+    @return 0 for void, 1 or 2, or -1 if the descriptor is malformed
+    
+*/
+static int jc_descriptor_type_slots(const uint8_t *desc, size_t len, size_t *pos) {
+    size_t i = *pos;
+    int slots = 1;
+    while (i < len && desc[i] == '[') {
+        i++;
+    }
+    if (i >= len) {
+        return -1;
+    }
+    switch (desc[i]) {
+        case 'J': case 'D':
+            slots = i == *pos ? 2 : 1;
+            break;
+        case 'V':
+            slots = i == *pos ? 0 : -1;
+            break;
+        case 'L':
+            while (i < len && desc[i] != ';') {
+                i++;
+            }
+            if (i >= len) {
+                return -1;
+            }
+            break;
+        case 'B': case 'C': case 'F': case 'I': case 'S': case 'Z':
+            break;
+        default:
+            return -1;
+    }
+    *pos = i + 1;
+    return slots;
+}
+
+/**
+    @brief Helper function. Counts the argument and return slots of a method descriptor
+    @param return_slots Set to how many slots the return value takes up
+    @return How many slots the arguments take up, or -1 if the descriptor is malformed
+    
+*/
+static int jc_method_descriptor_slots(const uint8_t *desc, size_t len, int *return_slots) {
+    size_t pos = 1;
+    int args = 0;
+    if (len < 3 || desc[0] != '(') {
+        return -1;
+    }
+    while (pos < len && desc[pos] != ')') {
+        int slots = jc_descriptor_type_slots(desc, len, &pos);
+        if (slots <= 0) {
+            return -1;
+        }
+        args += slots;
+    }
+    pos++;
+    *return_slots = jc_descriptor_type_slots(desc, len, &pos);
+    return *return_slots < 0 || pos != len ? -1 : args;
+}
+
+/**
+    @brief Helper function. How many slots the instruction at pc adds to the operand stack, negative if it removes them
+    @return 0 on success, -1 if it depends on a constant that is not known
+    
+*/
+static int jc_insn_stack_effect(jclass_ctx *ctx, const uint8_t *code, size_t pc, int *effect) {
+    uint8_t opcode = code[pc];
+    const uint8_t *desc;
+    size_t len, pos = 0;
+    int slots, return_slots;
+    switch (opcode) {
+        case 0xb2: case 0xb3: case 0xb4: case 0xb5:
+            // getstatic, putstatic, getfield, putfield
+            desc = jc_cp_descriptor(ctx, jc_load_u2(code + pc + 1), &len);
+            if (!desc || (slots = jc_descriptor_type_slots(desc, len, &pos)) <= 0 || pos != len) {
+                return -1;
+            }
+            *effect = (opcode & 1 ? -slots : slots) - (opcode >= 0xb4 ? 1 : 0);
+            return 0;
+        case 0xb6: case 0xb7: case 0xb8: case 0xb9: case 0xba:
+            // invokevirtual, invokespecial, invokestatic, invokeinterface, invokedynamic
+            desc = jc_cp_descriptor(ctx, jc_load_u2(code + pc + 1), &len);
+            if (!desc || (slots = jc_method_descriptor_slots(desc, len, &return_slots)) < 0) {
+                return -1;
+            }
+            *effect = return_slots - slots - (opcode == 0xb8 || opcode == 0xba ? 0 : 1);
+            return 0;
+        case 0xc4:
+            // wide, the same as the instruction it widens
+            *effect = code[pc + 1] < sizeof(jc_stack_effects) ? jc_stack_effects[code[pc + 1]] : 0;
+            return 0;
+        case 0xc5:
+            // multianewarray pops one count per dimension
+            *effect = 1 - code[pc + 3];
+            return 0;
+        default:
+            *effect = jc_stack_effects[opcode];
+            return 0;
+    }
+}
+
+/**
+    @brief Helper function. Records the stack depth at target the first time it is reached
+    @return 1 if target had not been reached before, 0 if it had with the same depth, -1 if it is not an instruction or the depths differ
+    
+*/
+static int jc_merge_depth(int32_t *depths, size_t len, int64_t target, int32_t depth) {
+    if (target < 0 || target >= (int64_t)len || depths[target] == -2) {
+        return -1;
+    }
+    if (depths[target] == -1) {
+        depths[target] = depth;
+        return 1;
+    }
+    return depths[target] == depth ? 0 : -1;
+}
+
+/**
+    @brief Helper function. Works out max_stack and max_locals of the current method's code by following
+    every path through it and keeping the stack depth at the start of each instruction
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE if the code can not be analysed (an unknown
+    constant, a branch into the middle of an instruction or a stack depth that depends on the path taken)
+    
+*/
+static int jc_compute_maxs(jclass_ctx *ctx, uint16_t *max_stack, uint16_t *max_locals) {
+    const uint8_t *code = ctx->outputBuffer + ctx->bytecode_offset;
+    size_t len = jc_current_offset(ctx) - ctx->bytecode_offset;
+    const uint8_t *desc;
+    size_t desc_len;
+    int return_slots;
+    const uint8_t *utf8 = jc_cp_entry_at(ctx, ctx->method_descriptor_index);
+    desc = utf8 && utf8[0] == 1 ? utf8 + 3 : NULL;
+    desc_len = desc ? jc_load_u2(utf8 + 1) : 0;
+    int params = desc ? jc_method_descriptor_slots(desc, desc_len, &return_slots) : -1;
+    if (params < 0) {
+        return JCLASS_ERR_RANGE;
+    }
+    uint32_t locals = (uint32_t)params + (ctx->method_access_flags & ACC_STATIC ? 0 : 1);
+
+    // -2 marks the middle of an instruction, -1 an instruction that has not been reached yet
+    int32_t *depths = malloc((len ? len : 1) * sizeof(int32_t));
+    uint32_t *work = malloc((len ? len : 1) * sizeof(uint32_t));
+    if (!depths || !work) {
+        free(depths);
+        free(work);
+        return JCLASS_ERR_NOMEM;
+    }
+    int result = JCLASS_OK;
+    for (size_t pc = 0; pc < len; pc++) {
+        depths[pc] = -2;
+    }
+    // every local is counted, even in code that can not be reached
+    for (size_t pc = 0, n; pc < len && result == JCLASS_OK; pc += n) {
+        uint32_t index;
+        n = jc_insn_length(code, pc, len);
+        if (n == 0) {
+            result = JCLASS_ERR_RANGE;
+            break;
+        }
+        uint32_t slots = jc_insn_local(code, pc, &index);
+        if (slots && index + slots > locals) {
+            locals = index + slots;
+        }
+        depths[pc] = -1;
+    }
+
+    int32_t max = 0;
+    size_t top = 0;
+    if (len && result == JCLASS_OK) {
+        depths[0] = 0;
+        work[top++] = 0;
+    }
+    // handlers start with the exception on the stack
+    for (size_t i = 0; i < ctx->handler_count && result == JCLASS_OK; i++) {
+        int merged = jc_merge_depth(depths, len, ctx->handlers[i].handler_pc, 1);
+        if (merged < 0 || ctx->handlers[i].end_pc > len) {
+            result = JCLASS_ERR_RANGE;
+        } else if (merged) {
+            work[top++] = ctx->handlers[i].handler_pc;
+            max = 1;
+        }
+    }
+    while (top && result == JCLASS_OK) {
+        size_t pc = work[--top];
+        int32_t depth = depths[pc];
+        for (;;) {
+            int effect;
+            uint8_t opcode = code[pc];
+            if (jc_insn_stack_effect(ctx, code, pc, &effect) != 0) {
+                result = JCLASS_ERR_RANGE;
+                break;
+            }
+            depth += effect;
+            if (depth < 0 || depth > 0xFFFF) {
+                result = JCLASS_ERR_RANGE;
+                break;
+            }
+            if (depth > max) {
+                max = depth;
+            }
+            size_t targets = jc_insn_target_count(code, pc);
+            for (size_t k = 0; k < targets && result == JCLASS_OK; k++) {
+                int merged = jc_merge_depth(depths, len, jc_insn_target(code, pc, k), depth);
+                if (merged < 0) {
+                    result = JCLASS_ERR_RANGE;
+                } else if (merged) {
+                    work[top++] = (uint32_t)jc_insn_target(code, pc, k);
+                }
+            }
+            size_t next = pc + jc_insn_length(code, pc, len);
+            if (result != JCLASS_OK || !jc_insn_falls_through(opcode) || next >= len) {
+                break;
+            }
+            if (opcode == 0xa8 || opcode == 0xc9) {
+                depth--; // the return address pushed by jsr is only on the stack at its target
+            }
+            int merged = jc_merge_depth(depths, len, (int64_t)next, depth);
+            if (merged < 0) {
+                result = JCLASS_ERR_RANGE;
+            }
+            if (merged != 1) {
+                break;
+            }
+            pc = next;
+        }
+    }
+    free(depths);
+    free(work);
+    if (result == JCLASS_OK && locals > 0xFFFF) {
+        result = JCLASS_ERR_RANGE;
+    }
+    if (result == JCLASS_OK) {
+        *max_stack = (uint16_t)max;
+        *max_locals = (uint16_t)locals;
+    }
+    return result;
+}
+
+/**
+ * @brief A verification type of a local or stack slot. The StackMapTable tag is in the low byte,
+ * the class index of an Object or the pc of the new of an Uninitialized is above it
+ *
+ */
+typedef uint32_t jclass_vtype;
+
+/**
+ * @brief StackMapTable verification type tags
+ *
+ */
+enum {
+    JCLASS_VT_TOP = 0,
+    JCLASS_VT_INTEGER,
+    JCLASS_VT_FLOAT,
+    JCLASS_VT_DOUBLE,
+    JCLASS_VT_LONG,
+    JCLASS_VT_NULL,
+    JCLASS_VT_UNINITIALIZED_THIS,
+    JCLASS_VT_OBJECT,
+    JCLASS_VT_UNINITIALIZED
+};
+
+#define JCLASS_VT(tag, data) ((jclass_vtype)(tag) | ((jclass_vtype)(data) << 8))
+
+/**
+ * @brief What is known about a basic block while computing frames
+ *
+ */
+enum {
+    JCLASS_BLOCK_REACHED = 1,   // the block has a frame
+    JCLASS_BLOCK_QUEUED = 2,    // the block is waiting in the worklist
+    JCLASS_BLOCK_FRAME = 4      // the block needs a StackMapTable entry
+};
+
+/**
+ * @brief State of the frame computation of one method
+ *
+ */
+typedef struct jclass_frames {
+    uint8_t *code;              // the method's code
+    size_t len;                 // length of the code
+    uint32_t max_locals;        // slots in the locals of every frame
+    uint32_t max_stack;         // slots in the stack of every frame
+    uint32_t *block_of;         // block index + 1 of the block starting at each pc, 0 if none does
+    uint32_t *block_pc;         // pc each block starts at
+    uint8_t *block_flags;       // JCLASS_BLOCK_* of each block
+    uint32_t *block_stack;      // stack size at the start of each block
+    jclass_vtype *block_types;  // locals then stack at the start of each block
+    size_t block_count;         // number of blocks
+    uint32_t *work;             // blocks whose frame changed
+    size_t top;                 // number of entries in work
+    jclass_vtype *locals;       // locals while running a block
+    jclass_vtype *stack;        // stack while running a block
+    uint32_t stack_size;        // stack size while running a block
+    jclass_vtype *handler_types; // type of the exception on the stack of each handler
+} jclass_frames;
+
+/**
+    @brief Helper function. How many local or stack slots a verification type takes up
+
+*/
+static uint32_t jc_vtype_slots(jclass_vtype type) {
+    return type == JCLASS_VT_LONG || type == JCLASS_VT_DOUBLE ? 2 : 1;
+}
+
+/**
+    @brief Helper function. Returns the index of a class constant named by len bytes of the pool buffer
+    at offset, with prefix and suffix around them (to turn a class name into an array or field descriptor)
+    @return The index, or 0 on error
+
+*/
+static uint16_t jc_cp_class_from_pool(jclass_ctx *ctx, const char *prefix, size_t offset, size_t len, const char *suffix) {
+    size_t prefix_len = strlen(prefix), suffix_len = strlen(suffix);
+    if (prefix_len + len + suffix_len > 0xFFFF) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return 0;
+    }
+    uint8_t *dst = jc_cp_append(ctx, 3 + prefix_len + len + suffix_len);
+    if (!dst) {
+        return 0;
+    }
+    dst[0] = 1;                                                      // u1 1 (tag)
+    jc_store_u2(dst + 1, (uint16_t)(prefix_len + len + suffix_len)); // u2 length
+    memcpy(dst + 3, prefix, prefix_len);
+    memcpy(dst + 3 + prefix_len, ctx->cpBuffer + offset, len);     // offset is before the new entry
+    memcpy(dst + 3 + prefix_len + len, suffix, suffix_len);
+    uint16_t name_index = jc_cp_intern(ctx);
+    jc_cp_put_ref(ctx, 7, name_index);
+    return jc_cp_intern(ctx);
+}
+
+/**
+    @brief Helper function. Finds the name of a class constant
+    @param offset Set to the offset of the name in the pool buffer
+    @return The length of the name, or -1 if index is not a known class
+
+*/
+static int32_t jc_cp_class_name(jclass_ctx *ctx, uint16_t index, size_t *offset) {
+    const uint8_t *entry = jc_cp_entry_at(ctx, index);
+    const uint8_t *utf8 = entry && entry[0] == 7 ? jc_cp_entry_at(ctx, jc_load_u2(entry + 1)) : NULL;
+    if (!utf8 || utf8[0] != 1) {
+        return -1;
+    }
+    *offset = (size_t)(utf8 + 3 - ctx->cpBuffer);
+    return jc_load_u2(utf8 + 1);
+}
+
+/**
+    @brief Helper function. The verification type of the field descriptor made of len bytes of the pool buffer at offset
+    @return How many slots the type takes up, 0 for void, or -1 if the descriptor is malformed
+
+*/
+static int jc_descriptor_vtype(jclass_ctx *ctx, size_t offset, size_t len, jclass_vtype *type) {
+    if (len == 0) {
+        return -1;
+    }
+    switch (ctx->cpBuffer[offset]) {
+        case 'B': case 'C': case 'I': case 'S': case 'Z':
+            *type = JCLASS_VT_INTEGER;
+            return 1;
+        case 'F':
+            *type = JCLASS_VT_FLOAT;
+            return 1;
+        case 'J':
+            *type = JCLASS_VT_LONG;
+            return 2;
+        case 'D':
+            *type = JCLASS_VT_DOUBLE;
+            return 2;
+        case 'V':
+            return 0;
+        case 'L':
+            *type = len < 3 ? 0 : JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class_from_pool(ctx, "", offset + 1, len - 2, ""));
+            return *type ? 1 : -1;
+        case '[':
+            *type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class_from_pool(ctx, "", offset, len, ""));
+            return 1;
+        default:
+            return -1;
+    }
+}
+
+/**
+    @brief Helper function. Whether the method reference at index calls a constructor
+
+*/
+static int jc_cp_ref_is_init(jclass_ctx *ctx, uint16_t index) {
+    const uint8_t *entry = jc_cp_entry_at(ctx, index);
+    const uint8_t *nat = entry ? jc_cp_entry_at(ctx, jc_load_u2(entry + 3)) : NULL;
+    return nat && nat[0] == 12 && jc_cp_utf8_equals(ctx, jc_load_u2(nat + 1), "<init>");
+}
+
+/**
+    @brief Helper function. Pushes a value onto the stack of the block being run
+    @return 0, or -1 if the stack would grow past max_stack
+
+*/
+static int jc_frame_push(jclass_frames *fr, jclass_vtype type) {
+    uint32_t slots = jc_vtype_slots(type);
+    if (fr->stack_size + slots > fr->max_stack) {
+        return -1;
+    }
+    fr->stack[fr->stack_size++] = type;
+    if (slots == 2) {
+        fr->stack[fr->stack_size++] = JCLASS_VT_TOP;
+    }
+    return 0;
+}
+
+/**
+    @brief Helper function. Stores a value into a local of the block being run, clearing any long or double it overwrites half of
+    @return 0, or -1 if the local is past max_locals
+
+*/
+static int jc_frame_store(jclass_frames *fr, uint32_t index, jclass_vtype type) {
+    uint32_t slots = jc_vtype_slots(type);
+    if (index + slots > fr->max_locals) {
+        return -1;
+    }
+    if (index > 0 && jc_vtype_slots(fr->locals[index - 1]) == 2) {
+        fr->locals[index - 1] = JCLASS_VT_TOP;
+    }
+    fr->locals[index] = type;
+    if (slots == 2) {
+        fr->locals[index + 1] = JCLASS_VT_TOP;
+    }
+    return 0;
+}
+
+/**
+    @brief Helper function. Returns the index of a class constant for an array of dims dimensions of element,
+    or for element itself if dims is 0
+    
+*/
+static uint16_t jc_cp_array_class(jclass_ctx *ctx, size_t dims, const char *element) {
+    size_t len = strlen(element);
+    char *name = malloc(dims + len + 3);
+    if (!name) {
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return 0;
+    }
+    memset(name, '[', dims);
+    if (dims) {
+        snprintf(name + dims, len + 3, "L%s;", element);
+    } else {
+        memcpy(name, element, len + 1);
+    }
+    uint16_t index = jc_cp_class(ctx, name);
+    free(name);
+    return index;
+}
+
+/**
+    @brief Helper function. Asks the jc_set_common_superclass function for the common superclass of two classes,
+    java/lang/Object if either of them is it
+    @return The name, or NULL after recording JCLASS_ERR_HIERARCHY if it is not known
+    
+*/
+static const char *jc_ask_common_superclass(jclass_ctx *ctx, const char *a, const char *b) {
+    if (strcmp(a, "java/lang/Object") == 0 || strcmp(b, "java/lang/Object") == 0) {
+        return "java/lang/Object";
+    }
+    const char *name = ctx->common_superclass ? ctx->common_superclass(a, b, ctx->common_superclass_user) : NULL;
+    if (!name) {
+        jc_set_error(ctx, JCLASS_ERR_HIERARCHY);
+    }
+    return name;
+}
+
+/**
+    @brief Helper function. The class two different classes merge into where paths join. Arrays merge into
+    arrays of java/lang/Object as javac does, a class and an array into java/lang/Object, and two classes into
+    what the jc_set_common_superclass function gives
+    @return The index of the class, or 0 after recording an error
+    
+*/
+static uint16_t jc_common_superclass(jclass_ctx *ctx, uint16_t a, uint16_t b) {
+    size_t a_offset, b_offset;
+    int32_t a_len = jc_cp_class_name(ctx, a, &a_offset);
+    int32_t b_len = jc_cp_class_name(ctx, b, &b_offset);
+    if (a_len < 0 || b_len < 0) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE); // not a class of this context's pool
+        return 0;
+    }
+    // copied out, the pool buffer moves as classes are added
+    char *a_name = malloc((size_t)a_len + (size_t)b_len + 2);
+    if (!a_name) {
+        jc_set_error(ctx, JCLASS_ERR_NOMEM);
+        return 0;
+    }
+    char *b_name = a_name + a_len + 1;
+    memcpy(a_name, ctx->cpBuffer + a_offset, (size_t)a_len);
+    memcpy(b_name, ctx->cpBuffer + b_offset, (size_t)b_len);
+    a_name[a_len] = 0;
+    b_name[b_len] = 0;
+    size_t a_dims = strspn(a_name, "["), b_dims = strspn(b_name, "[");
+    uint16_t index = 0;
+    if (strcmp(a_name, b_name) == 0) {
+        index = a;
+    } else if (a_dims == 0 && b_dims == 0) {
+        const char *name = jc_ask_common_superclass(ctx, a_name, b_name);
+        index = name ? jc_cp_class(ctx, name) : 0;
+    } else if (a_dims == 0 || b_dims == 0) {
+        index = jc_cp_class(ctx, "java/lang/Object");
+    } else if (a_dims == b_dims && a_name[a_dims] == 'L' && b_name[b_dims] == 'L') {
+        // arrays of classes with as many dimensions, the element classes merge
+        a_name[a_len - 1] = 0;
+        b_name[b_len - 1] = 0;
+        const char *element = ctx->common_superclass ? jc_ask_common_superclass(ctx, a_name + a_dims + 1, b_name + b_dims + 1) : "java/lang/Object";
+        index = element ? jc_cp_array_class(ctx, a_dims, element) : 0;
+    } else {
+        // the arrays share the dimensions of the shallower one if its elements are objects, one less otherwise
+        size_t dims = a_dims < b_dims ? a_dims : b_dims;
+        char shallow = a_dims < b_dims ? a_name[a_dims] : b_dims < a_dims ? b_name[b_dims] : 0;
+        index = jc_cp_array_class(ctx, shallow == 'L' ? dims : dims - 1, "java/lang/Object");
+    }
+    free(a_name);
+    return index;
+}
+
+/**
+    @brief Helper function. The type two values merge into where paths join, TOP if they can not be merged
+    
+*/
+static jclass_vtype jc_vtype_merge(jclass_ctx *ctx, jclass_vtype a, jclass_vtype b) {
+    if (a == b) {
+        return a;
+    }
+    int a_ref = a == JCLASS_VT_NULL || (a & 0xFF) == JCLASS_VT_OBJECT;
+    int b_ref = b == JCLASS_VT_NULL || (b & 0xFF) == JCLASS_VT_OBJECT;
+    if (!a_ref || !b_ref) {
+        return JCLASS_VT_TOP;
+    }
+    if (a == JCLASS_VT_NULL || b == JCLASS_VT_NULL) {
+        return a == JCLASS_VT_NULL ? b : a;
+    }
+    return JCLASS_VT(JCLASS_VT_OBJECT, jc_common_superclass(ctx, (uint16_t)(a >> 8), (uint16_t)(b >> 8)));
+}
+
+/**
+    @brief Helper function. Merges the frame of the block being run into the frame at the start of block,
+    queueing block if its frame changed
+    @return 0, or -1 if the stacks can not be merged
+
+*/
+static int jc_frame_merge(jclass_ctx *ctx, jclass_frames *fr, size_t block) {
+    jclass_vtype *types = fr->block_types + block * (fr->max_locals + fr->max_stack);
+    int changed = 0;
+    if (!(fr->block_flags[block] & JCLASS_BLOCK_REACHED)) {
+        memcpy(types, fr->locals, fr->max_locals * sizeof(jclass_vtype));
+        memcpy(types + fr->max_locals, fr->stack, fr->stack_size * sizeof(jclass_vtype));
+        fr->block_stack[block] = fr->stack_size;
+        fr->block_flags[block] |= JCLASS_BLOCK_REACHED;
+        changed = 1;
     } else {
-        emit_u1(0xc4);
-        emit_u1(0x39);
-        emit_u2(index);
+        if (fr->block_stack[block] != fr->stack_size) {
+            return -1;
+        }
+        for (uint32_t i = 0; i < fr->max_locals; i++) {
+            jclass_vtype merged = jc_vtype_merge(ctx, types[i], fr->locals[i]);
+            changed |= merged != types[i];
+            types[i] = merged;
+        }
+        for (uint32_t i = 0; i < fr->stack_size; i++) {
+            jclass_vtype *slot = types + fr->max_locals + i;
+            jclass_vtype merged = jc_vtype_merge(ctx, *slot, fr->stack[i]);
+            if (merged == JCLASS_VT_TOP && (*slot != JCLASS_VT_TOP || fr->stack[i] != JCLASS_VT_TOP)) {
+                return -1;
+            }
+            changed |= merged != *slot;
+            *slot = merged;
+        }
+    }
+    if (changed && !(fr->block_flags[block] & JCLASS_BLOCK_QUEUED)) {
+        fr->block_flags[block] |= JCLASS_BLOCK_QUEUED;
+        fr->work[fr->top++] = (uint32_t)block;
     }
+    return 0;
 }
 
-void dsub() {
-    // macro dsub { db 0x67 }
-    emit_u1(0x67);
-}
+/** @brief The types of the int, long, float and double forms of an instruction, in the order the opcodes use */
+static const jclass_vtype jc_vtypes_by_kind[4] = { JCLASS_VT_INTEGER, JCLASS_VT_LONG, JCLASS_VT_FLOAT, JCLASS_VT_DOUBLE };
 
-void dup() {
-    // macro dup { db 0x59 }
-    emit_u1(0x59);
-}
+/**
+    @brief Helper function. The type simple instructions push, TOP if they push nothing or need to be handled separately
 
-void dup_x1() {
-    // macro dup_x1 { db 0x5a }
-    emit_u1(0x5a);
+*/
+static jclass_vtype jc_insn_result_vtype(uint8_t opcode) {
+    // i2l, i2f, i2d, l2i, l2f, l2d, f2i, f2l, f2d, d2i, d2l, d2f, i2b, i2c, i2s
+    static const uint8_t conversions[15] = { 1, 2, 3, 0, 2, 3, 0, 1, 3, 0, 1, 2, 0, 0, 0 };
+    if (opcode == 0x01) {
+        return JCLASS_VT_NULL;
+    } else if ((opcode >= 0x02 && opcode <= 0x08) || opcode == 0x10 || opcode == 0x11) {
+        return JCLASS_VT_INTEGER;
+    } else if (opcode >= 0x09 && opcode <= 0x0f) {
+        return opcode <= 0x0a ? JCLASS_VT_LONG : opcode <= 0x0d ? JCLASS_VT_FLOAT : JCLASS_VT_DOUBLE;
+    } else if (opcode >= 0x2e && opcode <= 0x35 && opcode != 0x32) {
+        return opcode <= 0x31 ? jc_vtypes_by_kind[opcode - 0x2e] : JCLASS_VT_INTEGER;
+    } else if (opcode >= 0x60 && opcode <= 0x77) {
+        return jc_vtypes_by_kind[(opcode - 0x60) % 4];
+    } else if (opcode >= 0x78 && opcode <= 0x83) {
+        return opcode & 1 ? JCLASS_VT_LONG : JCLASS_VT_INTEGER; // shifts and bitwise operations
+    } else if (opcode >= 0x85 && opcode <= 0x93) {
+        return jc_vtypes_by_kind[conversions[opcode - 0x85]];
+    } else if ((opcode >= 0x94 && opcode <= 0x98) || opcode == 0xbe || opcode == 0xc1) {
+        return JCLASS_VT_INTEGER; // comparisons, arraylength, instanceof
+    }
+    return JCLASS_VT_TOP;
 }
 
-void dup_x2() {
-    // macro dup_x2 { db 0x5b }
-    emit_u1(0x5b);
-}
+/**
+    @brief Helper function. Applies the instruction at pc to the frame of the block being run
+    @return 0, or -1 if the frame can not be worked out
 
-void dup2() {
-    // macro dup2 { db 0x5c }
-    emit_u1(0x5c);
-}
+*/
+static int jc_frame_execute(jclass_ctx *ctx, jclass_frames *fr, size_t pc) {
+    static const char *const array_names[8] = { "[Z", "[C", "[F", "[D", "[B", "[S", "[I", "[J" };
+    const uint8_t *code = fr->code;
+    uint8_t opcode = code[pc];
+    jclass_vtype type = JCLASS_VT_TOP;
+    jclass_vtype *s = fr->stack;
+    uint32_t index, n = fr->stack_size;
+    size_t offset;
+    int32_t len;
+    int effect;
+
+    // loads and stores, with wide and the _0 to _3 forms turned into the plain instruction
+    uint8_t base = opcode == 0xc4 ? code[pc + 1] : opcode;
+    if (base >= 0x1a && base <= 0x2d) {
+        base = (uint8_t)(0x15 + (base - 0x1a) / 4);
+    } else if (base >= 0x3b && base <= 0x4e) {
+        base = (uint8_t)(0x36 + (base - 0x3b) / 4);
+    }
+    if (jc_insn_local(code, pc, &index) && base != 0x84) {
+        if (base >= 0x15 && base <= 0x19) {
+            if (index >= fr->max_locals) {
+                return -1;
+            }
+            type = base == 0x19 ? fr->locals[index] : jc_vtypes_by_kind[base - 0x15];
+            return jc_frame_push(fr, type);
+        }
+        if (base >= 0x36 && base <= 0x3a) {
+            type = base == 0x3a ? (n ? s[n - 1] : JCLASS_VT_TOP) : jc_vtypes_by_kind[base - 0x36];
+            if (n < jc_vtype_slots(type)) {
+                return -1;
+            }
+            fr->stack_size -= jc_vtype_slots(type);
+            return jc_frame_store(fr, index, type);
+        }
+        return -1; // ret, subroutines can not be described by frames
+    }
 
-void dup2_x1() {
-    // macro dup2_x1 { db 0x5d }
-    emit_u1(0x5d);
+    switch (opcode) {
+        case 0x57: case 0x58: // pop, pop2
+            if (n < (uint32_t)(opcode - 0x56)) {
+                return -1;
+            }
+            fr->stack_size -= opcode - 0x56;
+            return 0;
+        case 0x59: case 0x5a: case 0x5b: { // dup, dup_x1, dup_x2
+            uint32_t depth = (uint32_t)(opcode - 0x59) + 1;
+            if (n < depth || n + 1 > fr->max_stack) {
+                return -1;
+            }
+            memmove(s + n - depth + 1, s + n - depth, depth * sizeof(jclass_vtype));
+            s[n - depth] = s[n];
+            fr->stack_size++;
+            return 0;
+        }
+        case 0x5c: case 0x5d: case 0x5e: { // dup2, dup2_x1, dup2_x2
+            uint32_t depth = (uint32_t)(opcode - 0x5c) + 2;
+            if (n < depth || n + 2 > fr->max_stack) {
+                return -1;
+            }
+            memmove(s + n - depth + 2, s + n - depth, depth * sizeof(jclass_vtype));
+            s[n - depth] = s[n];
+            s[n - depth + 1] = s[n + 1];
+            fr->stack_size += 2;
+            return 0;
+        }
+        case 0x5f: // swap
+            if (n < 2) {
+                return -1;
+            }
+            type = s[n - 1];
+            s[n - 1] = s[n - 2];
+            s[n - 2] = type;
+            return 0;
+        case 0x12: case 0x13: case 0x14: { // ldc, ldc_w, ldc2_w
+            uint16_t cp_index = opcode == 0x12 ? code[pc + 1] : jc_load_u2(code + pc + 1);
+            switch (jc_cp_tag(ctx, cp_index)) {
+                case 3:  return jc_frame_push(fr, JCLASS_VT_INTEGER);
+                case 4:  return jc_frame_push(fr, JCLASS_VT_FLOAT);
+                case 5:  return jc_frame_push(fr, JCLASS_VT_LONG);
+                case 6:  return jc_frame_push(fr, JCLASS_VT_DOUBLE);
+                case 7:  type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/Class")); break;
+                case 8:  type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/String")); break;
+                case 15: type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/invoke/MethodHandle")); break;
+                case 16: type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/invoke/MethodType")); break;
+                case 17: {
+                    size_t desc_len;
+                    const uint8_t *desc = jc_cp_descriptor(ctx, cp_index, &desc_len);
+                    if (!desc || jc_descriptor_vtype(ctx, (size_t)(desc - ctx->cpBuffer), desc_len, &type) <= 0) {
+                        return -1;
+                    }
+                    break;
+                }
+                default: return -1;
+            }
+            return ctx->error == JCLASS_OK ? jc_frame_push(fr, type) : -1;
+        }
+        case 0x32: // aaload
+            if (n < 2) {
+                return -1;
+            }
+            type = s[n - 2];
+            fr->stack_size -= 2;
+            if ((type & 0xFF) == JCLASS_VT_OBJECT) {
+                len = jc_cp_class_name(ctx, (uint16_t)(type >> 8), &offset);
+                if (len < 2 || ctx->cpBuffer[offset] != '[') {
+                    return -1;
+                }
+                if (jc_descriptor_vtype(ctx, offset + 1, (size_t)len - 1, &type) != 1) {
+                    return -1;
+                }
+            } else if (type != JCLASS_VT_NULL) {
+                return -1;
+            }
+            return jc_frame_push(fr, type);
+        case 0xb2: case 0xb3: case 0xb4: case 0xb5: // getstatic, putstatic, getfield, putfield
+        case 0xb6: case 0xb7: case 0xb8: case 0xb9: case 0xba: { // invoke*
+            uint16_t cp_index = jc_load_u2(code + pc + 1);
+            size_t desc_len, desc_offset;
+            const uint8_t *desc = jc_cp_descriptor(ctx, cp_index, &desc_len);
+            if (!desc || jc_insn_stack_effect(ctx, code, pc, &effect) != 0) {
+                return -1;
+            }
+            desc_offset = (size_t)(desc - ctx->cpBuffer);
+            // the type pushed is the whole descriptor of a field, or what follows the ')' of a method
+            size_t result = 0;
+            if (opcode >= 0xb6) {
+                while (desc[result] != ')') {
+                    result++;
+                }
+                result++;
+            }
+            int result_slots = 1;
+            if (opcode == 0xb3 || opcode == 0xb5 || desc[result] == 'V') {
+                result_slots = 0;
+            } else if (desc[result] == 'J' || desc[result] == 'D') {
+                result_slots = 2;
+            }
+            uint32_t popped = (uint32_t)(result_slots - effect);
+            if (n < popped) {
+                return -1;
+            }
+            if (opcode == 0xb7 && jc_cp_ref_is_init(ctx, cp_index)) {
+                // the constructor initializes every copy of its receiver
+                jclass_vtype receiver = s[n - popped];
+                jclass_vtype initialized;
+                if (receiver == JCLASS_VT_UNINITIALIZED_THIS) {
+                    initialized = JCLASS_VT(JCLASS_VT_OBJECT, ctx->this_class);
+                } else if ((receiver & 0xFF) == JCLASS_VT_UNINITIALIZED && code[receiver >> 8] == 0xbb) {
+                    initialized = JCLASS_VT(JCLASS_VT_OBJECT, jc_load_u2(code + (receiver >> 8) + 1));
+                } else {
+                    return -1;
+                }
+                for (uint32_t i = 0; i < fr->max_locals; i++) {
+                    fr->locals[i] = fr->locals[i] == receiver ? initialized : fr->locals[i];
+                }
+                for (uint32_t i = 0; i < n; i++) {
+                    s[i] = s[i] == receiver ? initialized : s[i];
+                }
+            }
+            fr->stack_size -= popped;
+            if (result_slots == 0) {
+                return 0;
+            }
+            if (jc_descriptor_vtype(ctx, desc_offset + result, desc_len - result, &type) <= 0) {
+                return -1;
+            }
+            return ctx->error == JCLASS_OK ? jc_frame_push(fr, type) : -1;
+        }
+        case 0xbb: // new
+            return jc_frame_push(fr, JCLASS_VT(JCLASS_VT_UNINITIALIZED, pc));
+        case 0xbc: // newarray
+            if (n < 1 || code[pc + 1] < 4 || code[pc + 1] > 11) {
+                return -1;
+            }
+            fr->stack_size--;
+            type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, array_names[code[pc + 1] - 4]));
+            return ctx->error == JCLASS_OK ? jc_frame_push(fr, type) : -1;
+        case 0xbd: // anewarray
+            len = jc_cp_class_name(ctx, jc_load_u2(code + pc + 1), &offset);
+            if (n < 1 || len < 1) {
+                return -1;
+            }
+            fr->stack_size--;
+            if (ctx->cpBuffer[offset] == '[') {
+                type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class_from_pool(ctx, "[", offset, (size_t)len, ""));
+            } else {
+                type = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class_from_pool(ctx, "[L", offset, (size_t)len, ";"));
+            }
+            return ctx->error == JCLASS_OK ? jc_frame_push(fr, type) : -1;
+        case 0xc0: // checkcast
+            if (n < 1) {
+                return -1;
+            }
+            s[n - 1] = JCLASS_VT(JCLASS_VT_OBJECT, jc_load_u2(code + pc + 1));
+            return 0;
+        case 0xc5: // multianewarray
+            if (n < code[pc + 3]) {
+                return -1;
+            }
+            fr->stack_size -= code[pc + 3];
+            return jc_frame_push(fr, JCLASS_VT(JCLASS_VT_OBJECT, jc_load_u2(code + pc + 1)));
+        case 0xa8: case 0xc9: // jsr, jsr_w
+            return -1;
+        default:
+            type = jc_insn_result_vtype(opcode);
+            effect = jc_stack_effects[opcode];
+            int popped = (type == JCLASS_VT_TOP ? 0 : (int)jc_vtype_slots(type)) - effect;
+            if (popped < 0 || n < (uint32_t)popped) {
+                return -1;
+            }
+            fr->stack_size -= (uint32_t)popped;
+            return type == JCLASS_VT_TOP ? 0 : jc_frame_push(fr, type);
+    }
 }
 
-void dup2_x2() {
-    // macro dup2_x2 { db 0x5e }
-    emit_u1(0x5e);
-}
+/**
+    @brief Helper function. Merges the locals at pc into every handler that covers pc, with only the exception on the stack
+    @return 0, or -1 if the frames can not be worked out
 
-void f2d() {
-    // macro f2d { db 0x8d }
-    emit_u1(0x8d);
+*/
+static int jc_frame_merge_handlers(jclass_ctx *ctx, jclass_frames *fr, size_t pc) {
+    jclass_vtype saved = fr->stack[0];
+    uint32_t saved_size = fr->stack_size;
+    int result = 0;
+    for (size_t i = 0; i < ctx->handler_count && result == 0; i++) {
+        const jclass_handler *handler = &ctx->handlers[i];
+        if (pc >= handler->start_pc && pc < handler->end_pc) {
+            fr->stack[0] = fr->handler_types[i];
+            fr->stack_size = 1;
+            result = jc_frame_merge(ctx, fr, fr->block_of[handler->handler_pc] - 1);
+        }
+    }
+    fr->stack[0] = saved;
+    fr->stack_size = saved_size;
+    return result;
 }
 
-void f2i() {
-    // macro f2i { db 0x8b }
-    emit_u1(0x8b);
-}
+/**
+    @brief Helper function. Runs a block from its frame to its end, merging into the blocks it continues to
+    @return 0, or -1 if the frames can not be worked out
 
-void f2l() {
-    // macro f2l { db 0x8c }
-    emit_u1(0x8c);
+*/
+static int jc_frame_run_block(jclass_ctx *ctx, jclass_frames *fr, size_t block) {
+    jclass_vtype *types = fr->block_types + block * (fr->max_locals + fr->max_stack);
+    memcpy(fr->locals, types, fr->max_locals * sizeof(jclass_vtype));
+    memcpy(fr->stack, types + fr->max_locals, fr->block_stack[block] * sizeof(jclass_vtype));
+    fr->stack_size = fr->block_stack[block];
+    size_t pc = fr->block_pc[block];
+    for (;;) {
+        // the locals a handler sees can be the ones before or after any instruction it covers
+        if (jc_frame_merge_handlers(ctx, fr, pc) != 0 || jc_frame_execute(ctx, fr, pc) != 0 ||
+            jc_frame_merge_handlers(ctx, fr, pc) != 0) {
+            return -1;
+        }
+        size_t targets = jc_insn_target_count(fr->code, pc);
+        for (size_t k = 0; k < targets; k++) {
+            if (jc_frame_merge(ctx, fr, fr->block_of[jc_insn_target(fr->code, pc, k)] - 1) != 0) {
+                return -1;
+            }
+        }
+        if (!jc_insn_falls_through(fr->code[pc])) {
+            return 0;
+        }
+        pc += jc_insn_length(fr->code, pc, fr->len);
+        if (pc >= fr->len) {
+            return -1; // execution would run off the end of the code
+        }
+        if (fr->block_of[pc]) {
+            return jc_frame_merge(ctx, fr, fr->block_of[pc] - 1);
+        }
+    }
 }
 
-void fadd() {
-    // macro fadd { db 0x62 }
-    emit_u1(0x62);
-}
+/**
+    @brief Helper function. Appends bytes to the StackMapTable being built
 
-void faload() {
-    // macro faload { db 0x30 }
-    emit_u1(0x30);
+*/
+static void jc_stackmap_put(jclass_ctx *ctx, const void *data, size_t len) {
+    if (ctx->stackmap_capacity - ctx->stackmap_length < len) {
+        uint8_t *buffer = jc_grow(ctx, ctx->stackmap, &ctx->stackmap_capacity, ctx->stackmap_length + len, 1, 256);
+        if (!buffer) {
+            return;
+        }
+        ctx->stackmap = buffer;
+    }
+    memcpy(ctx->stackmap + ctx->stackmap_length, data, len);
+    ctx->stackmap_length += len;
 }
 
-void fastore() {
-    // macro fastore { db 0x51 }
-    emit_u1(0x51);
-}
+/**
+    @brief Helper function. Appends a verification_type_info to the StackMapTable being built
 
-void fcmpg() {
-    // macro fcmpg { db 0x96 }
-    emit_u1(0x96);
+*/
+static void jc_stackmap_put_vtype(jclass_ctx *ctx, jclass_vtype type) {
+    uint8_t info[3] = { (uint8_t)(type & 0xFF), (uint8_t)(type >> 16), (uint8_t)(type >> 8) };
+    jc_stackmap_put(ctx, info, (type & 0xFF) >= JCLASS_VT_OBJECT ? 3 : 1);
 }
 
-void fcmpl() {
-    // macro fcmpl { db 0x95 }
-    emit_u1(0x95);
-}
+/**
+    @brief Helper function. Turns locals or a stack into the list of types a frame stores, where a long or
+    double is one entry and the Top after it is left out
+    @param trim Whether trailing Tops are dropped (for locals)
+    @return The number of entries written to out
 
-void fconst_0() {
-    // macro fconst_0 { db 0x0b }
-    emit_u1(0x0b);
+*/
+static uint32_t jc_frame_compact(const jclass_vtype *types, uint32_t count, int trim, jclass_vtype *out) {
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < count; i += jc_vtype_slots(types[i])) {
+        out[n++] = types[i];
+    }
+    while (trim && n > 0 && out[n - 1] == JCLASS_VT_TOP) {
+        n--;
+    }
+    return n;
 }
 
-void fconst_1() {
-    // macro fconst_1 { db 0x0c }
-    emit_u1(0x0c);
-}
+/**
+    @brief Helper function. Appends the smallest stack_map_frame that describes locals and stack, given the locals of the previous frame
 
-void fconst_2() {
-    // macro fconst_2 { db 0x0d }
-    emit_u1(0x0d);
+*/
+static void jc_stackmap_put_frame(jclass_ctx *ctx, uint32_t delta, const jclass_vtype *previous, uint32_t previous_count,
+                                  const jclass_vtype *locals, uint32_t local_count, const jclass_vtype *stack, uint32_t stack_count) {
+    uint8_t header[3];
+    uint32_t common = 0;
+    while (common < previous_count && common < local_count && previous[common] == locals[common]) {
+        common++;
+    }
+    int same_locals = common == previous_count && common == local_count;
+    if (same_locals && stack_count == 0) {
+        if (delta < 64) {
+            header[0] = (uint8_t)delta;                 // same_frame
+            jc_stackmap_put(ctx, header, 1);
+        } else {
+            header[0] = 251;                            // same_frame_extended
+            jc_store_u2(header + 1, (uint16_t)delta);
+            jc_stackmap_put(ctx, header, 3);
+        }
+    } else if (same_locals && stack_count == 1) {
+        if (delta < 64) {
+            header[0] = (uint8_t)(64 + delta);          // same_locals_1_stack_item_frame
+            jc_stackmap_put(ctx, header, 1);
+        } else {
+            header[0] = 247;                            // same_locals_1_stack_item_frame_extended
+            jc_store_u2(header + 1, (uint16_t)delta);
+            jc_stackmap_put(ctx, header, 3);
+        }
+        jc_stackmap_put_vtype(ctx, stack[0]);
+    } else if (stack_count == 0 && common == local_count && previous_count - local_count <= 3) {
+        header[0] = (uint8_t)(251 - (previous_count - local_count)); // chop_frame
+        jc_store_u2(header + 1, (uint16_t)delta);
+        jc_stackmap_put(ctx, header, 3);
+    } else if (stack_count == 0 && common == previous_count && local_count - previous_count <= 3) {
+        header[0] = (uint8_t)(251 + (local_count - previous_count)); // append_frame
+        jc_store_u2(header + 1, (uint16_t)delta);
+        jc_stackmap_put(ctx, header, 3);
+        for (uint32_t i = previous_count; i < local_count; i++) {
+            jc_stackmap_put_vtype(ctx, locals[i]);
+        }
+    } else {
+        header[0] = 255;                                // full_frame
+        jc_store_u2(header + 1, (uint16_t)delta);
+        jc_stackmap_put(ctx, header, 3);
+        jc_store_u2(header, (uint16_t)local_count);
+        jc_stackmap_put(ctx, header, 2);
+        for (uint32_t i = 0; i < local_count; i++) {
+            jc_stackmap_put_vtype(ctx, locals[i]);
+        }
+        jc_store_u2(header, (uint16_t)stack_count);
+        jc_stackmap_put(ctx, header, 2);
+        for (uint32_t i = 0; i < stack_count; i++) {
+            jc_stackmap_put_vtype(ctx, stack[i]);
+        }
+    }
+    ctx->stackmap_frames++;
 }
 
-void fdiv() {
-    // macro fdiv { db 0x6e }
-    emit_u1(0x6e);
+/**
+    @brief Helper function. Takes the code from start to end out of the ranges of the exception handlers,
+    splitting a range that goes around it in two
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE if there are too many handlers
+
+*/
+static int jc_handlers_remove_range(jclass_ctx *ctx, uint32_t start, uint32_t end) {
+    size_t i = 0;
+    while (i < ctx->handler_count) {
+        jclass_handler *handler = &ctx->handlers[i];
+        if (handler->end_pc <= start || handler->start_pc >= end) {
+            i++;
+        } else if (handler->start_pc < start && handler->end_pc > end) {
+            if (ctx->handler_count >= 0xFFFF) {
+                return JCLASS_ERR_RANGE;
+            }
+            if (ctx->handler_count >= ctx->handlers_capacity) {
+                jclass_handler *handlers = jc_grow(ctx, ctx->handlers, &ctx->handlers_capacity, ctx->handler_count + 1, sizeof(jclass_handler), 4);
+                if (!handlers) {
+                    return JCLASS_ERR_NOMEM;
+                }
+                ctx->handlers = handlers;
+            }
+            // the second half goes right after the first so the order handlers are tried in stays the same
+            memmove(&ctx->handlers[i + 1], &ctx->handlers[i], (ctx->handler_count - i) * sizeof(jclass_handler));
+            ctx->handler_count++;
+            ctx->handlers[i].end_pc = start;
+            ctx->handlers[i + 1].start_pc = end;
+            i += 2;
+        } else if (handler->start_pc < start) {
+            handler->end_pc = start;
+            i++;
+        } else if (handler->end_pc > end) {
+            handler->start_pc = end;
+            i++;
+        } else {
+            memmove(&ctx->handlers[i], &ctx->handlers[i + 1], (ctx->handler_count - i - 1) * sizeof(jclass_handler));
+            ctx->handler_count--;
+        }
+    }
+    return JCLASS_OK;
 }
 
-void fload(uint16_t index) {
-    // macro fload index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x22 + index);
-    } else if (index < 0x100) {
-        emit_u1(0x17);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x17);
-        emit_u2(index);
+/**
+    @brief Helper function. Works out the types in the locals and on the stack at the start of every basic
+    block of the current method and builds its StackMapTable into ctx->stackmap. Code that can not be
+    reached is replaced by nops ending in athrow, which is what its frame describes, and taken out of the
+    ranges of the exception handlers
+    @param max_stack The method's max_stack, raised to 1 if unreachable code was replaced
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE if the frames can not be worked out (a
+    subroutine, an unknown constant or values that do not fit together where paths join)
+
+*/
+static int jc_compute_frames(jclass_ctx *ctx, uint16_t *max_stack, uint16_t max_locals) {
+    jclass_frames fr;
+    memset(&fr, 0, sizeof(fr));
+    fr.code = ctx->outputBuffer + ctx->bytecode_offset;
+    fr.len = jc_current_offset(ctx) - ctx->bytecode_offset;
+    fr.max_locals = max_locals;
+    fr.max_stack = *max_stack ? *max_stack : 1; // room for the Throwable of unreachable code
+    ctx->stackmap_length = 0;
+    ctx->stackmap_frames = 0;
+    if (fr.len == 0) {
+        return JCLASS_OK;
+    }
+
+    // basic blocks start at the first instruction, at branch targets and after branches
+    int result = JCLASS_ERR_NOMEM;
+    fr.block_of = calloc(fr.len + 1, sizeof(uint32_t));
+    fr.block_flags = calloc(fr.len, 1);
+    if (!fr.block_of || !fr.block_flags) {
+        goto done;
+    }
+    // indexed by pc until the blocks are numbered, 2 marks the start of an instruction and 1 a pc that needs a frame
+    uint8_t *needs_frame = fr.block_flags;
+    for (size_t pc = 0; pc < fr.len; pc += jc_insn_length(fr.code, pc, fr.len)) {
+        needs_frame[pc] = 2;
+    }
+    result = JCLASS_ERR_RANGE;
+    fr.block_of[0] = 1;
+    size_t frames_needed = 0;
+    for (size_t pc = 0; pc < fr.len; pc += jc_insn_length(fr.code, pc, fr.len)) {
+        size_t targets = jc_insn_target_count(fr.code, pc);
+        for (size_t k = 0; k < targets; k++) {
+            int64_t target = jc_insn_target(fr.code, pc, k);
+            if (target < 0 || target >= (int64_t)fr.len || !(needs_frame[target] & 2)) {
+                goto done;
+            }
+            fr.block_of[target] = 1;
+            needs_frame[target] |= 1;
+            frames_needed++;
+        }
+        size_t next = pc + jc_insn_length(fr.code, pc, fr.len);
+        if (next < fr.len && (targets || !jc_insn_falls_through(fr.code[pc]))) {
+            fr.block_of[next] = 1;
+            needs_frame[next] |= !jc_insn_falls_through(fr.code[pc]);
+            frames_needed += !jc_insn_falls_through(fr.code[pc]);
+        }
+    }
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        const jclass_handler *handler = &ctx->handlers[i];
+        if (handler->handler_pc >= fr.len || !(needs_frame[handler->handler_pc] & 2) || handler->end_pc > fr.len) {
+            goto done;
+        }
+        fr.block_of[handler->handler_pc] = 1;
+        needs_frame[handler->handler_pc] |= 1;
+        frames_needed++;
+    }
+    if (frames_needed == 0) {
+        // straight line code needs no frames, so no constants are added for them
+        result = JCLASS_OK;
+        goto done;
+    }
+    for (size_t pc = 0; pc < fr.len; pc++) {
+        fr.block_count += fr.block_of[pc];
+    }
+    size_t frame_size = (size_t)fr.max_locals + fr.max_stack;
+    fr.block_pc = malloc(fr.block_count * sizeof(uint32_t));
+    fr.block_stack = calloc(fr.block_count, sizeof(uint32_t));
+    fr.work = malloc(fr.block_count * sizeof(uint32_t));
+    fr.block_types = malloc((fr.block_count * frame_size + 2 * frame_size + 1) * sizeof(jclass_vtype));
+    uint8_t *flags = calloc(fr.block_count, 1);
+    if (!fr.block_pc || !fr.block_stack || !fr.work || !fr.block_types || !flags) {
+        free(flags);
+        result = JCLASS_ERR_NOMEM;
+        goto done;
+    }
+    for (size_t pc = 0, block = 0; pc < fr.len; pc++) {
+        if (fr.block_of[pc]) {
+            flags[block] = needs_frame[pc] & 1 ? JCLASS_BLOCK_FRAME : 0;
+            fr.block_pc[block] = (uint32_t)pc;
+            fr.block_of[pc] = (uint32_t)++block;
+        }
+    }
+    free(fr.block_flags);
+    fr.block_flags = flags;
+    fr.locals = fr.block_types + fr.block_count * frame_size;
+    fr.stack = fr.locals + fr.max_locals;
+
+    // entries that catch everything give a Throwable
+    jclass_vtype throwable = 0;
+    if (ctx->handler_count) {
+        fr.handler_types = malloc(ctx->handler_count * sizeof(jclass_vtype));
+        if (!fr.handler_types) {
+            result = JCLASS_ERR_NOMEM;
+            goto done;
+        }
     }
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        // a handler shared by several entries gets the common superclass of what they catch
+        jclass_vtype type = JCLASS_VT_TOP;
+        for (size_t j = 0; j < ctx->handler_count; j++) {
+            if (ctx->handlers[j].handler_pc == ctx->handlers[i].handler_pc) {
+                uint16_t catch_type = ctx->handlers[j].catch_type;
+                if (catch_type == 0 && throwable == 0) {
+                    throwable = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/Throwable"));
+                }
+                jclass_vtype caught = catch_type ? JCLASS_VT(JCLASS_VT_OBJECT, catch_type) : throwable;
+                type = type == JCLASS_VT_TOP ? caught : jc_vtype_merge(ctx, type, caught);
+            }
+        }
+        fr.handler_types[i] = type;
+    }
+    if (ctx->error != JCLASS_OK) {
+        goto done;
+    }
+
+    // the frame on entry comes from the method's descriptor
+    for (uint32_t i = 0; i < fr.max_locals; i++) {
+        fr.locals[i] = JCLASS_VT_TOP;
+    }
+    uint32_t slot = 0;
+    if (!(ctx->method_access_flags & ACC_STATIC)) {
+        int is_init = jc_cp_utf8_equals(ctx, ctx->method_name_index, "<init>");
+        if (ctx->this_class == 0 || fr.max_locals == 0) {
+            goto done;
+        }
+        fr.locals[slot++] = is_init ? JCLASS_VT_UNINITIALIZED_THIS : JCLASS_VT(JCLASS_VT_OBJECT, ctx->this_class);
+    }
+    const uint8_t *desc = jc_cp_entry_at(ctx, ctx->method_descriptor_index);
+    if (!desc || desc[0] != 1) {
+        goto done;
+    }
+    size_t desc_offset = (size_t)(desc + 3 - ctx->cpBuffer), desc_len = jc_load_u2(desc + 1);
+    for (size_t pos = 1; pos < desc_len && ctx->cpBuffer[desc_offset + pos] != ')';) {
+        size_t start = pos;
+        jclass_vtype type;
+        if (jc_descriptor_type_slots(ctx->cpBuffer + desc_offset, desc_len, &pos) <= 0 ||
+            jc_descriptor_vtype(ctx, desc_offset + start, pos - start, &type) <= 0 ||
+            jc_frame_store(&fr, slot, type) != 0) {
+            goto done;
+        }
+        slot += jc_vtype_slots(type);
+    }
+    jclass_vtype *initial = fr.block_types + fr.block_count * frame_size + frame_size;
+    uint32_t initial_count = jc_frame_compact(fr.locals, fr.max_locals, 1, initial);
+
+    // run blocks until no frame changes
+    fr.stack_size = 0;
+    if (jc_frame_merge(ctx, &fr, 0) != 0) {
+        goto done;
+    }
+    while (fr.top) {
+        size_t block = fr.work[--fr.top];
+        fr.block_flags[block] &= (uint8_t)~JCLASS_BLOCK_QUEUED;
+        if (jc_frame_run_block(ctx, &fr, block) != 0 || ctx->error != JCLASS_OK) {
+            goto done;
+        }
+    }
+
+    // write the frames, compared against the frame before them
+    jclass_vtype *previous = initial, *locals = fr.locals, *stack = fr.stack;
+    uint32_t previous_count = initial_count;
+    int64_t previous_pc = -1;
+    for (size_t block = 0; block < fr.block_count; block++) {
+        uint32_t pc = fr.block_pc[block];
+        jclass_vtype *types = fr.block_types + block * frame_size;
+        uint32_t local_count, stack_count;
+        if (!(fr.block_flags[block] & JCLASS_BLOCK_REACHED)) {
+            // replace the unreachable code up to the next reached block
+            size_t end = block + 1;
+            while (end < fr.block_count && !(fr.block_flags[end] & JCLASS_BLOCK_REACHED)) {
+                end++;
+            }
+            size_t end_pc = end < fr.block_count ? fr.block_pc[end] : fr.len;
+            memset(fr.code + pc, 0x00, end_pc - pc - 1);
+            fr.code[end_pc - 1] = 0xbf;
+            result = jc_handlers_remove_range(ctx, pc, (uint32_t)end_pc);
+            if (result != JCLASS_OK) {
+                goto done;
+            }
+            if (throwable == 0) {
+                throwable = JCLASS_VT(JCLASS_VT_OBJECT, jc_cp_class(ctx, "java/lang/Throwable"));
+            }
+            local_count = 0;
+            stack[0] = throwable;
+            stack_count = 1;
+            if (*max_stack < 1) {
+                *max_stack = 1;
+            }
+            block = end - 1;
+        } else if (fr.block_flags[block] & JCLASS_BLOCK_FRAME) {
+            local_count = jc_frame_compact(types, fr.max_locals, 1, locals);
+            stack_count = jc_frame_compact(types + fr.max_locals, fr.block_stack[block], 0, stack);
+        } else {
+            continue;
+        }
+        jc_stackmap_put_frame(ctx, (uint32_t)(pc - previous_pc - 1), previous, previous_count, locals, local_count, stack, stack_count);
+        // the frame just written becomes the previous one, swapping buffers so it is not overwritten
+        jclass_vtype *swap = previous;
+        previous = locals;
+        locals = swap;
+        previous_count = local_count;
+        previous_pc = pc;
+    }
+    result = ctx->error == JCLASS_OK ? JCLASS_OK : ctx->error;
+
+done:
+    free(fr.block_of);
+    free(fr.block_flags);
+    free(fr.block_pc);
+    free(fr.block_stack);
+    free(fr.work);
+    free(fr.block_types);
+    free(fr.handler_types);
+    if (result != JCLASS_OK) {
+        ctx->stackmap_length = 0;
+        ctx->stackmap_frames = 0;
+    }
+    return result;
 }
 
-void fmul() {
-    // macro fmul { db 0x6a }
-    emit_u1(0x6a);
+// ------------------------
+// instruction list
+// ------------------------
+
+/**
+    @brief Helper function. Whether an instruction of the list branches to the instruction in its operand
+    
+*/
+static int jc_insn_is_branch(uint8_t opcode) {
+    return (opcode >= 0x99 && opcode <= 0xa8) || opcode == 0xc6 || opcode == 0xc7;
 }
 
-void fneg() {
-    // macro fneg { db 0x76 }
-    emit_u1(0x76);
+/**
+    @brief Helper function. Makes room for count more entries in ctx->insn_data
+    @return Where the entries go, or NULL on error
+    
+*/
+static int32_t *jc_insn_data_append(jclass_ctx *ctx, size_t count) {
+    if (ctx->insn_data_length + count > ctx->insn_data_capacity) {
+        int32_t *data = jc_grow(ctx, ctx->insn_data, &ctx->insn_data_capacity, ctx->insn_data_length + count, sizeof(int32_t), 64);
+        if (!data) {
+            return NULL;
+        }
+        ctx->insn_data = data;
+    }
+    int32_t *entries = ctx->insn_data + ctx->insn_data_length;
+    ctx->insn_data_length += count;
+    return entries;
 }
 
-void frem() {
-    // macro frem { db 0x72 }
-    emit_u1(0x72);
+/**
+    @brief Helper function. Turns the current method's code into ctx->insns, with branch targets and the
+    ranges of the exception handlers as instruction indices
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE if the code can not be decoded
+    
+*/
+static int jc_code_to_list(jclass_ctx *ctx) {
+    const uint8_t *code = ctx->outputBuffer + ctx->bytecode_offset;
+    size_t len = jc_current_offset(ctx) - ctx->bytecode_offset;
+    ctx->insn_count = 0;
+    ctx->insn_data_length = 0;
+    // index + 1 of the instruction starting at each pc, the end of the code included
+    uint32_t *index_of = calloc(len + 1, sizeof(uint32_t));
+    if (!index_of) {
+        return JCLASS_ERR_NOMEM;
+    }
+    size_t count = 0;
+    for (size_t pc = 0, n; pc < len; pc += n) {
+        n = jc_insn_length(code, pc, len);
+        if (n == 0) {
+            free(index_of);
+            return JCLASS_ERR_RANGE;
+        }
+        index_of[pc] = (uint32_t)++count;
+    }
+    index_of[len] = (uint32_t)count + 1;
+    if (count > ctx->insns_capacity) {
+        jclass_insn *insns = jc_grow(ctx, ctx->insns, &ctx->insns_capacity, count, sizeof(jclass_insn), 64);
+        if (!insns) {
+            free(index_of);
+            return JCLASS_ERR_NOMEM;
+        }
+        ctx->insns = insns;
+    }
+    int result = JCLASS_OK;
+    for (size_t pc = 0; pc < len && result == JCLASS_OK; pc += jc_insn_length(code, pc, len)) {
+        jclass_insn *insn = &ctx->insns[ctx->insn_count++];
+        uint8_t opcode = code[pc];
+        uint32_t local;
+        insn->opcode = opcode;
+        insn->operand = 0;
+        insn->extra = 0;
+        if (jc_insn_local(code, pc, &local)) {
+            // loads, stores, iinc and ret, with the _0 to _3 and wide forms folded together
+            uint8_t base = opcode == 0xc4 ? code[pc + 1] : opcode;
+            if (base >= 0x1a && base <= 0x2d) {
+                base = (uint8_t)(0x15 + (base - 0x1a) / 4);
+            } else if (base >= 0x3b && base <= 0x4e) {
+                base = (uint8_t)(0x36 + (base - 0x3b) / 4);
+            }
+            insn->opcode = base;
+            insn->operand = (int32_t)local;
+            if (base == 0x84) {
+                insn->extra = opcode == 0xc4 ? (int16_t)jc_load_u2(code + pc + 4) : (int8_t)code[pc + 2];
+            }
+        } else if (opcode == 0xaa || opcode == 0xab) {
+            // the default goes in the operand, the rest in insn_data
+            size_t targets = jc_insn_target_count(code, pc);
+            const uint8_t *operands = code + pc + 1 + jc_switch_padding((uint32_t)pc);
+            int32_t *data = jc_insn_data_append(ctx, opcode == 0xaa ? 2 + targets - 1 : 1 + 2 * (targets - 1));
+            if (!data) {
+                result = JCLASS_ERR_NOMEM;
+                break;
+            }
+            insn->extra = (int32_t)(data - ctx->insn_data);
+            for (size_t k = 0; k < targets; k++) {
+                int64_t target = jc_insn_target(code, pc, k);
+                if (target < 0 || target >= (int64_t)len || index_of[target] == 0) {
+                    result = JCLASS_ERR_RANGE;
+                    break;
+                }
+                int32_t index = (int32_t)index_of[target] - 1;
+                if (k == 0) {
+                    insn->operand = index;
+                } else if (opcode == 0xaa) {
+                    data[1 + k] = index;
+                } else {
+                    data[1 + 2 * (k - 1)] = (int32_t)jc_load_u4(operands + 8 + 8 * (k - 1));
+                    data[2 + 2 * (k - 1)] = index;
+                }
+            }
+            if (opcode == 0xaa) {
+                data[0] = (int32_t)jc_load_u4(operands + 4); // low
+                data[1] = (int32_t)jc_load_u4(operands + 8); // high
+            } else {
+                data[0] = (int32_t)(targets - 1);            // npairs
+            }
+        } else if (jc_insn_target_count(code, pc)) {
+            // goto_w and jsr_w become goto and jsr, the width is picked again when the list is written
+            int64_t target = jc_insn_target(code, pc, 0);
+            if (target < 0 || target >= (int64_t)len || index_of[target] == 0) {
+                result = JCLASS_ERR_RANGE;
+                break;
+            }
+            insn->opcode = opcode == 0xc8 ? 0xa7 : opcode == 0xc9 ? 0xa8 : opcode;
+            insn->operand = (int32_t)index_of[target] - 1;
+        } else {
+            switch (opcode) {
+                case 0x10: // bipush
+                case 0xbc: // newarray
+                    insn->operand = opcode == 0x10 ? (int8_t)code[pc + 1] : code[pc + 1];
+                    break;
+                case 0x11: // sipush
+                    insn->operand = (int16_t)jc_load_u2(code + pc + 1);
+                    break;
+                case 0x12: // ldc, ldc_w becomes ldc and is picked again when the list is written
+                    insn->operand = code[pc + 1];
+                    break;
+                case 0x13:
+                    insn->opcode = 0x12;
+                    insn->operand = jc_load_u2(code + pc + 1);
+                    break;
+                case 0x14: case 0xb2: case 0xb3: case 0xb4: case 0xb5: case 0xb6: case 0xb7: case 0xb8:
+                case 0xba: case 0xbb: case 0xbd: case 0xc0: case 0xc1:
+                    insn->operand = jc_load_u2(code + pc + 1);
+                    break;
+                case 0xb9: // invokeinterface
+                case 0xc5: // multianewarray
+                    insn->operand = jc_load_u2(code + pc + 1);
+                    insn->extra = code[pc + 3];
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    // handler pcs become instruction indices too, once they are all known to start instructions
+    for (size_t i = 0; i < ctx->handler_count && result == JCLASS_OK; i++) {
+        const jclass_handler *handler = &ctx->handlers[i];
+        if (handler->start_pc > len || handler->end_pc > len || handler->handler_pc >= len ||
+            !index_of[handler->start_pc] || !index_of[handler->end_pc] || !index_of[handler->handler_pc]) {
+            result = JCLASS_ERR_RANGE;
+        }
+    }
+    for (size_t i = 0; i < ctx->handler_count && result == JCLASS_OK; i++) {
+        jclass_handler *handler = &ctx->handlers[i];
+        handler->start_pc = index_of[handler->start_pc] - 1;
+        handler->end_pc = index_of[handler->end_pc] - 1;
+        handler->handler_pc = index_of[handler->handler_pc] - 1;
+    }
+    free(index_of);
+    return result;
 }
 
-void freturn() {
-    // macro freturn { db 0xae }
-    emit_u1(0xae);
+/**
+    @brief Helper function. Size of an instruction of the list at pc
+    @param long_branch Whether a branch needs a 4 byte offset
+    
+*/
+static uint32_t jc_list_insn_size(const jclass_ctx *ctx, const jclass_insn *insn, uint32_t pc, int long_branch) {
+    uint8_t opcode = insn->opcode;
+    uint32_t operand = (uint32_t)insn->operand;
+    if ((opcode >= 0x15 && opcode <= 0x19) || (opcode >= 0x36 && opcode <= 0x3a)) {
+        return operand <= 3 ? 1 : operand < 0x100 ? 2 : 4;
+    }
+    if (opcode == 0xa9) {
+        return operand < 0x100 ? 2 : 4;
+    }
+    if (opcode == 0x84) {
+        return operand < 0x100 && insn->extra >= -0x80 && insn->extra < 0x80 ? 3 : 6;
+    }
+    if (opcode == 0x12) {
+        return operand < 0x100 ? 2 : 3;
+    }
+    if (jc_insn_is_branch(opcode)) {
+        // a conditional branch that can not reach jumps over a goto_w with the inverted condition
+        return !long_branch ? 3 : (opcode == 0xa7 || opcode == 0xa8) ? 5 : 8;
+    }
+    if (opcode == 0xaa || opcode == 0xab) {
+        const int32_t *data = ctx->insn_data + insn->extra;
+        uint32_t entries = opcode == 0xaa ? (uint32_t)((int64_t)data[1] - data[0] + 1) : 2 * (uint32_t)data[0];
+        return 1 + jc_switch_padding(pc) + (opcode == 0xaa ? 12 : 8) + 4 * entries;
+    }
+    return jc_insn_sizes[opcode];
 }
 
-void fstore(uint16_t index) {
-    // macro fstore index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x43 + index);
-    } else if (index < 0x100) {
-        emit_u1(0x38);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x38);
-        emit_u2(index);
+/**
+    @brief Helper function. Writes ctx->insns back as the current method's code, picking the shortest
+    encoding of every instruction and branch, and turns the ranges of the exception handlers back into pcs
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE if the code is too long
+    
+*/
+static int jc_list_to_code(jclass_ctx *ctx) {
+    size_t count = ctx->insn_count;
+    uint32_t *pcs = malloc((count + 1) * sizeof(uint32_t));
+    uint8_t *long_branch = calloc(count ? count : 1, 1);
+    if (!pcs || !long_branch) {
+        free(pcs);
+        free(long_branch);
+        return JCLASS_ERR_NOMEM;
+    }
+    // lay out the code, widening branches that can not reach until none change
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        uint32_t pc = 0;
+        for (size_t i = 0; i < count; i++) {
+            pcs[i] = pc;
+            pc += jc_list_insn_size(ctx, &ctx->insns[i], pc, long_branch[i]);
+        }
+        pcs[count] = pc;
+        for (size_t i = 0; i < count; i++) {
+            const jclass_insn *insn = &ctx->insns[i];
+            if (jc_insn_is_branch(insn->opcode) && !long_branch[i]) {
+                int64_t offset = (int64_t)pcs[insn->operand] - pcs[i];
+                if (offset < -0x8000 || offset >= 0x8000) {
+                    long_branch[i] = 1;
+                    changed = 1;
+                }
+            }
+        }
+    }
+    size_t length = pcs[count];
+    ctx->outputIndex = ctx->bytecode_offset;
+    if (jc_reserve(ctx, ctx->bytecode_offset + length) != JCLASS_OK) {
+        free(pcs);
+        free(long_branch);
+        return JCLASS_ERR_NOMEM;
+    }
+    for (size_t i = 0; i < count; i++) {
+        const jclass_insn *insn = &ctx->insns[i];
+        uint8_t opcode = insn->opcode;
+        uint32_t operand = (uint32_t)insn->operand;
+        uint32_t pc = pcs[i];
+        if ((opcode >= 0x15 && opcode <= 0x19) || (opcode >= 0x36 && opcode <= 0x3a) || opcode == 0xa9) {
+            if (operand <= 3 && opcode != 0xa9) {
+                jc_emit_u1(ctx, (uint8_t)(opcode < 0x36 ? 0x1a + (opcode - 0x15) * 4 + operand : 0x3b + (opcode - 0x36) * 4 + operand));
+            } else if (operand < 0x100) {
+                jc_emit_u1(ctx, opcode);
+                jc_emit_u1(ctx, (uint8_t)operand);
+            } else {
+                jc_emit_u1(ctx, 0xc4);
+                jc_emit_u1(ctx, opcode);
+                jc_emit_u2(ctx, (uint16_t)operand);
+            }
+        } else if (opcode == 0x84) {
+            if (jc_list_insn_size(ctx, insn, pc, 0) == 3) {
+                jc_emit_u1(ctx, 0x84);
+                jc_emit_u1(ctx, (uint8_t)operand);
+                jc_emit_u1(ctx, (uint8_t)insn->extra);
+            } else {
+                jc_emit_u1(ctx, 0xc4);
+                jc_emit_u1(ctx, 0x84);
+                jc_emit_u2(ctx, (uint16_t)operand);
+                jc_emit_u2(ctx, (uint16_t)insn->extra);
+            }
+        } else if (jc_insn_is_branch(opcode)) {
+            int64_t offset = (int64_t)pcs[operand] - pc;
+            if (!long_branch[i]) {
+                jc_emit_u1(ctx, opcode);
+                jc_emit_u2(ctx, (uint16_t)(int16_t)offset);
+            } else if (opcode == 0xa7 || opcode == 0xa8) {
+                jc_emit_u1(ctx, (uint8_t)(opcode + 0x21)); // goto_w, jsr_w
+                jc_emit_u4(ctx, (uint32_t)(int32_t)offset);
+            } else {
+                jc_emit_u1(ctx, jc_invert_branch(opcode));
+                jc_emit_u2(ctx, 8);
+                jc_emit_u1(ctx, 0xc8);
+                jc_emit_u4(ctx, (uint32_t)(int32_t)(offset - 3));
+            }
+        } else if (opcode == 0xaa || opcode == 0xab) {
+            const int32_t *data = ctx->insn_data + insn->extra;
+            jc_emit_u1(ctx, opcode);
+            for (uint32_t pad = jc_switch_padding(pc); pad > 0; pad--) {
+                jc_emit_u1(ctx, 0);
+            }
+            jc_emit_u4(ctx, (uint32_t)(pcs[operand] - pc));
+            if (opcode == 0xaa) {
+                jc_emit_u4(ctx, (uint32_t)data[0]);
+                jc_emit_u4(ctx, (uint32_t)data[1]);
+                for (int64_t k = 0; k < (int64_t)data[1] - data[0] + 1; k++) {
+                    jc_emit_u4(ctx, (uint32_t)(pcs[data[2 + k]] - pc));
+                }
+            } else {
+                jc_emit_u4(ctx, (uint32_t)data[0]);
+                for (int32_t k = 0; k < data[0]; k++) {
+                    jc_emit_u4(ctx, (uint32_t)data[1 + 2 * k]);
+                    jc_emit_u4(ctx, (uint32_t)(pcs[data[2 + 2 * k]] - pc));
+                }
+            }
+        } else {
+            jc_emit_u1(ctx, opcode == 0x12 && operand >= 0x100 ? 0x13 : opcode);
+            switch (jc_list_insn_size(ctx, insn, pc, 0)) {
+                case 2:
+                    jc_emit_u1(ctx, (uint8_t)operand);
+                    break;
+                case 3:
+                    jc_emit_u2(ctx, (uint16_t)operand);
+                    break;
+                case 4: // multianewarray
+                    jc_emit_u2(ctx, (uint16_t)operand);
+                    jc_emit_u1(ctx, (uint8_t)insn->extra);
+                    break;
+                case 5: // invokeinterface, invokedynamic
+                    jc_emit_u2(ctx, (uint16_t)operand);
+                    jc_emit_u1(ctx, (uint8_t)insn->extra);
+                    jc_emit_u1(ctx, 0);
+                    break;
+                default:
+                    break;
+            }
+        }
+    }
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        jclass_handler *handler = &ctx->handlers[i];
+        handler->start_pc = pcs[handler->start_pc];
+        handler->end_pc = pcs[handler->end_pc];
+        handler->handler_pc = pcs[handler->handler_pc];
     }
+    free(pcs);
+    free(long_branch);
+    if (length > 0xFFFF) {
+        return JCLASS_ERR_RANGE;
+    }
+    jc_patch_u4(ctx, ctx->bytecode_length_offset, (uint32_t)length);
+    return ctx->error;
 }
 
-void fsub() {
-    // macro fsub { db 0x66 }
-    emit_u1(0x66);
+/**
+    @brief Helper function. Where an instruction index goes when count instructions from first are removed,
+    the ones removed going to the instruction after them
+    
+*/
+static int32_t jc_insn_remap(int32_t index, size_t first, size_t count) {
+    if ((size_t)index >= first + count) {
+        return index - (int32_t)count;
+    }
+    return (size_t)index >= first ? (int32_t)first : index;
 }
 
-void getfield(uint16_t index) {
-    // macro getfield index { db 0xb4,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb4);
-    emit_u2(index);
+/**
+    @brief Removes instructions from the current method's instruction list, for use in a code pass.
+    Branches and exception handlers that went to a removed instruction go to the one after it, and
+    handlers left covering nothing are removed
+    @param first Index of the first instruction to remove
+    @param count Number of instructions to remove
+    
+*/
+void jc_insn_remove(jclass_ctx *ctx, size_t first, size_t count) {
+    if (first > ctx->insn_count || count > ctx->insn_count - first) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    if (count == 0) {
+        return;
+    }
+    memmove(&ctx->insns[first], &ctx->insns[first + count], (ctx->insn_count - first - count) * sizeof(jclass_insn));
+    ctx->insn_count -= count;
+    for (size_t i = 0; i < ctx->insn_count; i++) {
+        jclass_insn *insn = &ctx->insns[i];
+        if (jc_insn_is_branch(insn->opcode) || insn->opcode == 0xaa || insn->opcode == 0xab) {
+            insn->operand = jc_insn_remap(insn->operand, first, count);
+        }
+        if (insn->opcode == 0xaa || insn->opcode == 0xab) {
+            int32_t *data = ctx->insn_data + insn->extra;
+            int64_t targets = insn->opcode == 0xaa ? (int64_t)data[1] - data[0] + 1 : data[0];
+            for (int64_t k = 0; k < targets; k++) {
+                int32_t *target = insn->opcode == 0xaa ? &data[2 + k] : &data[2 + 2 * k];
+                *target = jc_insn_remap(*target, first, count);
+            }
+        }
+    }
+    size_t kept = 0;
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        jclass_handler handler = ctx->handlers[i];
+        handler.start_pc = (uint32_t)jc_insn_remap((int32_t)handler.start_pc, first, count);
+        handler.end_pc = (uint32_t)jc_insn_remap((int32_t)handler.end_pc, first, count);
+        handler.handler_pc = (uint32_t)jc_insn_remap((int32_t)handler.handler_pc, first, count);
+        if (handler.start_pc < handler.end_pc) {
+            ctx->handlers[kept++] = handler;
+        }
+    }
+    ctx->handler_count = kept;
 }
 
-void getstatic(uint16_t index) {
-    // macro getstatic index { db 0xb2,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb2);
-    emit_u2(index);
+/**
+    @brief Sets a function that code_attribute_end calls with the method's instruction list in ctx->insns
+    when JCLASS_INSTRUCTION_LIST is set, before it is written back. Kept by jc_ctx_reset
+    @param pass The function, NULL for none
+    @param user Passed to pass as it is
+    
+*/
+void jc_set_code_pass(jclass_ctx *ctx, jclass_code_pass pass, void *user) {
+    ctx->code_pass = pass;
+    ctx->code_pass_user = user;
 }
 
-void goto_inst(size_t branch_target) {
-    // macro goto branch { if branch-$>=-8000h & branch-$<8000h ... }
-    int32_t offset = (int32_t)(branch_target - current_offset());
-    if (offset >= (int32_t)0xFFFF8000 && offset < 0x8000) {
-        int16_t word_offset = (int16_t)offset;
-        emit_u1(0xa7);
-        emit_u2((uint16_t)word_offset);
-    } else {
-        int32_t dword_offset = offset;
-        emit_u1(0xc8);
-        emit_u4((uint32_t)dword_offset);
+// ------------------------
+// peephole optimizer
+// ------------------------
+
+/**
+ * @brief State of the peephole pass over one method's instruction list
+ *
+ */
+typedef struct jclass_peephole {
+    uint8_t *targeted;      // whether each instruction is a branch target or the start of a handler
+    uint32_t *reads;        // loads, iincs and rets of each local slot
+    uint32_t slots;         // number of entries in reads
+} jclass_peephole;
+
+/**
+    @brief Helper function. Slots a load or store of the instruction list takes up, 0 if it is not one
+    
+*/
+static uint32_t jc_peephole_slots(uint8_t opcode) {
+    switch (opcode) {
+        case 0x16: case 0x18: case 0x37: case 0x39:    // lload, dload, lstore, dstore
+            return 2;
+        case 0x15: case 0x17: case 0x19:                // iload, fload, aload
+        case 0x36: case 0x38: case 0x3a:                // istore, fstore, astore
+            return 1;
+        default:
+            return 0;
     }
 }
 
-void goto_w_inst(size_t branch_target) {
-    // macro goto_w branch { offset = dword branch-$; db 0xc8, ... }
-    int32_t offset = (int32_t)(branch_target - current_offset());
-    emit_u1(0xc8);
-    emit_u4((uint32_t)offset);
+/**
+    @brief Helper function. Slots an instruction of the list pushes without doing anything else
+    @return 1 or 2, 0 if the instruction does more than push a value
+    
+*/
+static uint32_t jc_peephole_pure_push(jclass_ctx *ctx, const jclass_insn *insn) {
+    uint8_t opcode = insn->opcode;
+    if ((opcode >= 0x01 && opcode <= 0x08) || (opcode >= 0x0b && opcode <= 0x0d) || opcode == 0x10 || opcode == 0x11 ||
+        opcode == 0x15 || opcode == 0x17 || opcode == 0x19 || opcode == 0x59) {
+        return 1;
+    }
+    if (opcode == 0x09 || opcode == 0x0a || opcode == 0x0e || opcode == 0x0f || opcode == 0x14 ||
+        opcode == 0x16 || opcode == 0x18 || opcode == 0x5c) {
+        return 2;
+    }
+    if (opcode == 0x12) {
+        // ldc of a class, method type or dynamic constant can throw, of an int, float or string it can not
+        uint8_t tag = insn->operand <= 0xFFFF ? jc_cp_tag(ctx, (uint16_t)insn->operand) : 0;
+        return tag == 3 || tag == 4 || tag == 8;
+    }
+    return 0;
 }
 
-void i2b() {
-    // macro i2b { db 0x91 }
-    emit_u1(0x91);
+/**
+    @brief Helper function. Adds a change made by rule to the peephole statistics
+    @param saved Bytes the change saves
+    
+*/
+static void jc_peephole_count(jclass_ctx *ctx, uint32_t rule, size_t saved) {
+    for (uint32_t bit = 0; bit < JCLASS_PEEPHOLE_RULES; bit++) {
+        if (rule == 1u << bit) {
+            ctx->peephole_stats.applied[bit]++;
+            ctx->peephole_stats.saved[bit] += saved;
+        }
+    }
 }
 
-void i2c() {
-    // macro i2c { db 0x92 }
-    emit_u1(0x92);
+/**
+    @brief Helper function. Removes count instructions at first for rule, keeping the peephole state in step
+    @param saved Bytes the change saves
+    
+*/
+static void jc_peephole_remove(jclass_ctx *ctx, jclass_peephole *p, size_t first, size_t count, uint32_t rule, size_t saved) {
+    size_t next = first + count;
+    for (size_t i = first; i < next; i++) {
+        if (next < ctx->insn_count) {
+            p->targeted[next] |= p->targeted[i];
+        }
+    }
+    memmove(&p->targeted[first], &p->targeted[next], ctx->insn_count - next);
+    jc_insn_remove(ctx, first, count);
+    jc_peephole_count(ctx, rule, saved);
 }
 
-void i2d() {
-    // macro i2d { db 0x87 }
-    emit_u1(0x87);
+/**
+    @brief Helper function. Runs the rules set with jc_set_peephole over the current method's instruction list
+    until none of them apply
+    @return JCLASS_OK or JCLASS_ERR_NOMEM
+    
+*/
+static int jc_peephole_run(jclass_ctx *ctx) {
+    jclass_peephole p = {0};
+    uint32_t rules = ctx->peephole;
+    for (size_t i = 0; i < ctx->insn_count; i++) {
+        uint8_t opcode = ctx->insns[i].opcode;
+        if (jc_peephole_slots(opcode) || opcode == 0x84 || opcode == 0xa9) {
+            uint32_t slots = (uint32_t)ctx->insns[i].operand + 2;
+            p.slots = slots > p.slots ? slots : p.slots;
+        }
+    }
+    p.targeted = calloc(ctx->insn_count ? ctx->insn_count : 1, 1);
+    p.reads = calloc(p.slots ? p.slots : 1, sizeof(uint32_t));
+    if (!p.targeted || !p.reads) {
+        free(p.targeted);
+        free(p.reads);
+        return JCLASS_ERR_NOMEM;
+    }
+    for (size_t i = 0; i < ctx->insn_count; i++) {
+        const jclass_insn *insn = &ctx->insns[i];
+        if (jc_insn_is_branch(insn->opcode) || insn->opcode == 0xaa || insn->opcode == 0xab) {
+            p.targeted[insn->operand] = 1;
+        }
+        if (insn->opcode == 0xaa || insn->opcode == 0xab) {
+            const int32_t *data = ctx->insn_data + insn->extra;
+            int64_t targets = insn->opcode == 0xaa ? (int64_t)data[1] - data[0] + 1 : data[0];
+            for (int64_t k = 0; k < targets; k++) {
+                p.targeted[insn->opcode == 0xaa ? data[2 + k] : data[2 + 2 * k]] = 1;
+            }
+        }
+        if ((insn->opcode >= 0x15 && insn->opcode <= 0x19) || insn->opcode == 0x84 || insn->opcode == 0xa9) {
+            uint32_t slots = insn->opcode == 0x16 || insn->opcode == 0x18 ? 2 : 1;
+            for (uint32_t s = 0; s < slots; s++) {
+                p.reads[insn->operand + s]++;
+            }
+        }
+    }
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        p.targeted[ctx->handlers[i].handler_pc] = 1;
+    }
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        for (size_t i = 0; i + 1 < ctx->insn_count; i++) {
+            jclass_insn *insn = &ctx->insns[i];
+            jclass_insn *next = &ctx->insns[i + 1];
+            size_t size = jc_list_insn_size(ctx, insn, 0, 0);
+            size_t next_size = jc_list_insn_size(ctx, next, 0, 0);
+            uint32_t slots = jc_peephole_slots(insn->opcode);
+            if ((rules & JCLASS_PEEPHOLE_STORE_LOAD) && insn->opcode >= 0x36 && slots && !p.targeted[i + 1] &&
+                next->opcode == insn->opcode - 0x21 && next->operand == insn->operand) {
+                // xstore n; xload n
+                uint32_t local = (uint32_t)insn->operand;
+                if (p.reads[local] == 1 && (slots == 1 || p.reads[local + 1] == 1)) {
+                    // the value never leaves the stack if nothing else reads the local
+                    for (uint32_t s = 0; s < slots; s++) {
+                        p.reads[local + s] = 0;
+                    }
+                    jc_peephole_remove(ctx, &p, i, 2, JCLASS_PEEPHOLE_STORE_LOAD, size + next_size);
+                    changed = 1;
+                } else if (local > 3) {
+                    // dup; xstore n
+                    *next = *insn;
+                    insn->opcode = slots == 2 ? 0x5c : 0x59;
+                    insn->operand = 0;
+                    for (uint32_t s = 0; s < slots; s++) {
+                        p.reads[local + s]--;
+                    }
+                    jc_peephole_count(ctx, JCLASS_PEEPHOLE_STORE_LOAD, next_size - 1);
+                    changed = 1;
+                }
+            } else if ((rules & JCLASS_PEEPHOLE_PUSH_POP) && !p.targeted[i + 1] && (next->opcode == 0x57 || next->opcode == 0x58) &&
+                       insn->opcode != 0x59 && insn->opcode != 0x5c && jc_peephole_pure_push(ctx, insn) == (uint32_t)(next->opcode - 0x56)) {
+                // a value pushed and popped straight away
+                for (uint32_t s = 0; s < slots; s++) {
+                    p.reads[insn->operand + s]--;
+                }
+                jc_peephole_remove(ctx, &p, i, 2, JCLASS_PEEPHOLE_PUSH_POP, size + next_size);
+                changed = 1;
+            } else if ((rules & JCLASS_PEEPHOLE_DUP_POP) && !p.targeted[i + 1] &&
+                       ((insn->opcode == 0x59 && next->opcode == 0x57) || (insn->opcode == 0x5c && next->opcode == 0x58))) {
+                jc_peephole_remove(ctx, &p, i, 2, JCLASS_PEEPHOLE_DUP_POP, size + next_size);
+                changed = 1;
+            } else if ((rules & JCLASS_PEEPHOLE_CHECKCAST) && next->opcode == 0xc0 && !p.targeted[i + 1] &&
+                       ((insn->opcode == 0xc0 && insn->operand == next->operand) || insn->opcode == 0x01)) {
+                // casting again to the same class, or casting null, always passes
+                jc_peephole_remove(ctx, &p, i + 1, 1, JCLASS_PEEPHOLE_CHECKCAST, next_size);
+                changed = 1;
+            } else if ((rules & JCLASS_PEEPHOLE_JUMPS) && jc_insn_is_branch(insn->opcode) && insn->opcode != 0xa8 &&
+                       insn->operand == (int32_t)i + 1) {
+                // a jump to the next instruction, a conditional one still pops its operands
+                if (insn->opcode == 0xa7) {
+                    jc_peephole_remove(ctx, &p, i, 1, JCLASS_PEEPHOLE_JUMPS, size);
+                } else {
+                    insn->opcode = (insn->opcode >= 0x9f && insn->opcode <= 0xa6) ? 0x58 : 0x57;
+                    insn->operand = 0;
+                    jc_peephole_count(ctx, JCLASS_PEEPHOLE_JUMPS, size - 1);
+                }
+                changed = 1;
+            } else if ((rules & JCLASS_PEEPHOLE_JUMPS) && jc_insn_is_branch(insn->opcode) && insn->opcode != 0xa7 &&
+                       insn->opcode != 0xa8 && insn->operand == (int32_t)i + 2 && next->opcode == 0xa7 &&
+                       !p.targeted[i + 1] && next->operand != (int32_t)i + 1) {
+                // ifeq over; goto target; over: becomes ifne target
+                insn->opcode = jc_invert_branch(insn->opcode);
+                insn->operand = next->operand;
+                jc_peephole_remove(ctx, &p, i + 1, 1, JCLASS_PEEPHOLE_JUMPS, next_size);
+                changed = 1;
+            }
+        }
+    }
+    free(p.targeted);
+    free(p.reads);
+    return JCLASS_OK;
 }
 
-void i2f() {
-    // macro i2f { db 0x86 }
-    emit_u1(0x86);
+/**
+    @brief Sets which peephole rules code_attribute_end runs over every method's instruction list, after the
+    code pass if there is one. Kept by jc_ctx_reset
+    @param rules JCLASS_PEEPHOLE_* rules or'd together, 0 for none
+    
+*/
+void jc_set_peephole(jclass_ctx *ctx, uint32_t rules) {
+    ctx->peephole = rules;
 }
 
-void i2l() {
-    // macro i2l { db 0x85 }
-    emit_u1(0x85);
+/**
+    @brief Gives the statistics of the peephole rules since the context was created or last reset
+    @param stats Set to the statistics
+    
+*/
+void jc_get_peephole_stats(jclass_ctx *ctx, jclass_peephole_stats *stats) {
+    *stats = ctx->peephole_stats;
 }
 
-void i2s() {
-    // macro i2s { db 0x93 }
-    emit_u1(0x93);
-}
+// ------------------------
+// control flow graph
+// ------------------------
 
-void iadd() {
-    // macro iadd { db 0x60 }
-    emit_u1(0x60);
+/**
+    @brief Helper function. Whether control can go from an instruction of the list on to the next one,
+    which for jsr is where the subroutine comes back to
+    
+*/
+static int jc_list_falls_through(uint8_t opcode) {
+    return !((opcode >= 0xac && opcode <= 0xb1) || opcode == 0xbf || opcode == 0xa7 || opcode == 0xa9 ||
+             opcode == 0xaa || opcode == 0xab);
 }
 
-void iaload() {
-    // macro iaload { db 0x2e }
-    emit_u1(0x2e);
+/**
+    @brief Helper function. Whether an instruction of the list can throw. The ones that never do are constants
+    other than ldc, locals, the stack, arithmetic other than integer division, conversions, compares and jumps
+    
+*/
+static int jc_list_can_throw(uint8_t opcode) {
+    if (opcode == 0x6c || opcode == 0x6d || opcode == 0x70 || opcode == 0x71) {
+        return 1; // idiv, ldiv, irem, lrem
+    }
+    return !(opcode <= 0x11 || (opcode >= 0x15 && opcode <= 0x19) || (opcode >= 0x36 && opcode <= 0x3a) ||
+             (opcode >= 0x57 && opcode <= 0xa7));
 }
 
-void iand() {
-    // macro iand { db 0x7e }
-    emit_u1(0x7e);
+/**
+    @brief Helper function. Adds the block starting at instruction index to a list of successors
+    @param out The list, NULL to only count
+    
+*/
+static void jc_cfg_edge(const jclass_cfg *cfg, uint32_t *out, size_t *count, int32_t index) {
+    if (cfg->block_of[index] >= cfg->block_count) {
+        return; // past the last instruction
+    }
+    if (out) {
+        out[*count] = cfg->block_of[index];
+    }
+    (*count)++;
 }
 
-void iastore() {
-    // macro iastore { db 0x4f }
-    emit_u1(0x4f);
+/**
+    @brief Helper function. Lists the successors of a block: branch targets, the next block if control falls
+    through, then the handlers covering the block
+    @param out Where the block indices go, NULL to only count them
+    @param flow Set to the number of successors before the handlers
+    @return The number of successors
+    
+*/
+static size_t jc_cfg_successors(const jclass_ctx *ctx, const jclass_cfg *cfg, const jclass_block *block, uint32_t *out, size_t *flow) {
+    size_t count = 0;
+    const jclass_insn *insn = &ctx->insns[block->end - 1];
+    if (jc_insn_is_branch(insn->opcode) || insn->opcode == 0xaa || insn->opcode == 0xab) {
+        jc_cfg_edge(cfg, out, &count, insn->operand);
+    }
+    if (insn->opcode == 0xaa || insn->opcode == 0xab) {
+        const int32_t *data = ctx->insn_data + insn->extra;
+        int64_t targets = insn->opcode == 0xaa ? (int64_t)data[1] - data[0] + 1 : data[0];
+        for (int64_t k = 0; k < targets; k++) {
+            jc_cfg_edge(cfg, out, &count, insn->opcode == 0xaa ? data[2 + k] : data[2 + 2 * k]);
+        }
+    }
+    if (jc_list_falls_through(insn->opcode) && block->end < ctx->insn_count) {
+        jc_cfg_edge(cfg, out, &count, (int32_t)block->end);
+    }
+    *flow = count;
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        const jclass_handler *handler = &ctx->handlers[i];
+        if (block->first >= handler->start_pc && block->first < handler->end_pc) {
+            jc_cfg_edge(cfg, out, &count, (int32_t)handler->handler_pc);
+        }
+    }
+    return count;
 }
 
-void iconst_m1() {
-    // macro iconst_m1 { db 0x02 }
-    emit_u1(0x02);
+/**
+    @brief Frees what jc_cfg_build allocated
+    
+*/
+void jc_cfg_free(jclass_cfg *cfg) {
+    free(cfg->blocks);
+    free(cfg->successor_list);
+    free(cfg->block_of);
+    memset(cfg, 0, sizeof(*cfg));
 }
 
-void iconst_0() {
-    // macro iconst_0 { db 0x03 }
-    emit_u1(0x03);
+/**
+    @brief Splits the current method's instruction list into basic blocks, for use in a code pass. A block
+    starts at the first instruction, at every branch target, after every branch, return and throw, and where
+    an exception handler's range starts or ends, so each block is covered by the same handlers throughout
+    @param cfg Filled in with the blocks, their successors and which blocks can be reached from the first one.
+    Free it with jc_cfg_free
+    @return JCLASS_OK or JCLASS_ERR_NOMEM
+    
+*/
+int jc_cfg_build(jclass_ctx *ctx, jclass_cfg *cfg) {
+    size_t count = ctx->insn_count;
+    memset(cfg, 0, sizeof(*cfg));
+    cfg->block_of = calloc(count + 1, sizeof(uint32_t));
+    if (!cfg->block_of) {
+        return JCLASS_ERR_NOMEM;
+    }
+    // mark where blocks start, with 1 in block_of for now
+    uint32_t *starts = cfg->block_of;
+    starts[0] = 1;
+    for (size_t i = 0; i < count; i++) {
+        const jclass_insn *insn = &ctx->insns[i];
+        if (jc_insn_is_branch(insn->opcode) || insn->opcode == 0xaa || insn->opcode == 0xab) {
+            starts[insn->operand] = 1;
+            starts[i + 1] = 1;
+        }
+        if (insn->opcode == 0xaa || insn->opcode == 0xab) {
+            const int32_t *data = ctx->insn_data + insn->extra;
+            int64_t targets = insn->opcode == 0xaa ? (int64_t)data[1] - data[0] + 1 : data[0];
+            for (int64_t k = 0; k < targets; k++) {
+                starts[insn->opcode == 0xaa ? data[2 + k] : data[2 + 2 * k]] = 1;
+            }
+        }
+        if (!jc_list_falls_through(insn->opcode)) {
+            starts[i + 1] = 1;
+        }
+    }
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        starts[ctx->handlers[i].start_pc] = 1;
+        starts[ctx->handlers[i].end_pc] = 1;
+        starts[ctx->handlers[i].handler_pc] = 1;
+    }
+    size_t blocks = 0;
+    for (size_t i = 0; i < count; i++) {
+        blocks += starts[i];
+    }
+    cfg->blocks = calloc(blocks ? blocks : 1, sizeof(jclass_block));
+    if (!cfg->blocks) {
+        jc_cfg_free(cfg);
+        return JCLASS_ERR_NOMEM;
+    }
+    for (size_t i = 0, block = 0; i < count; i++) {
+        if (starts[i]) {
+            cfg->blocks[block].first = i;
+            if (block > 0) {
+                cfg->blocks[block - 1].end = i;
+            }
+            block++;
+        }
+        cfg->block_of[i] = (uint32_t)(block - 1);
+    }
+    cfg->block_of[count] = (uint32_t)blocks;
+    if (blocks) {
+        cfg->blocks[blocks - 1].end = count;
+    }
+    cfg->block_count = blocks;
+    for (size_t b = 0; b < blocks; b++) {
+        size_t flow;
+        cfg->blocks[b].successors = cfg->successor_count;
+        cfg->blocks[b].successor_count = jc_cfg_successors(ctx, cfg, &cfg->blocks[b], NULL, &flow);
+        cfg->successor_count += cfg->blocks[b].successor_count;
+    }
+    cfg->successor_list = malloc((cfg->successor_count ? cfg->successor_count : 1) * sizeof(uint32_t));
+    uint32_t *work = malloc((blocks ? blocks : 1) * sizeof(uint32_t));
+    if (!cfg->successor_list || !work) {
+        free(work);
+        jc_cfg_free(cfg);
+        return JCLASS_ERR_NOMEM;
+    }
+    for (size_t b = 0; b < blocks; b++) {
+        jclass_block *block = &cfg->blocks[b];
+        jc_cfg_successors(ctx, cfg, block, cfg->successor_list + block->successors, &block->flow_count);
+    }
+    // everything the first block leads to, handlers included
+    size_t top = 0;
+    if (blocks) {
+        cfg->blocks[0].reachable = 1;
+        work[top++] = 0;
+    }
+    while (top > 0) {
+        const jclass_block *block = &cfg->blocks[work[--top]];
+        for (size_t k = 0; k < block->successor_count; k++) {
+            jclass_block *next = &cfg->blocks[cfg->successor_list[block->successors + k]];
+            if (!next->reachable) {
+                next->reachable = 1;
+                work[top++] = (uint32_t)(next - cfg->blocks);
+            }
+        }
+    }
+    free(work);
+    return JCLASS_OK;
 }
 
-void iconst_1() {
-    // macro iconst_1 { db 0x04 }
-    emit_u1(0x04);
+/**
+    @brief Helper function. Removes the exception handlers that can never be used and the blocks that can never
+    run from the current method's instruction list, until there are none left
+    @return JCLASS_OK or JCLASS_ERR_NOMEM
+    
+*/
+static int jc_remove_dead_code(jclass_ctx *ctx) {
+    int changed = 1;
+    while (changed) {
+        changed = 0;
+        jclass_cfg cfg;
+        if (jc_cfg_build(ctx, &cfg) != JCLASS_OK) {
+            return JCLASS_ERR_NOMEM;
+        }
+        // a handler is only used if something it covers can run and throw
+        size_t kept = 0;
+        for (size_t i = 0; i < ctx->handler_count; i++) {
+            const jclass_handler *handler = &ctx->handlers[i];
+            int used = 0;
+            for (size_t k = handler->start_pc; k < handler->end_pc && !used; k++) {
+                used = cfg.blocks[cfg.block_of[k]].reachable && jc_list_can_throw(ctx->insns[k].opcode);
+            }
+            if (used) {
+                ctx->handlers[kept++] = *handler;
+            }
+        }
+        if (kept != ctx->handler_count) {
+            // handler code may have become unreachable, so the graph is built again
+            ctx->handler_count = kept;
+            jc_cfg_free(&cfg);
+            changed = 1;
+            continue;
+        }
+        // from the last block back, so the indices of the blocks still to look at stay the same
+        for (size_t b = cfg.block_count; b > 0; b--) {
+            const jclass_block *block = &cfg.blocks[b - 1];
+            if (!block->reachable) {
+                jc_insn_remove(ctx, block->first, block->end - block->first);
+            }
+        }
+        jc_cfg_free(&cfg);
+    }
+    return JCLASS_OK;
 }
 
-void iconst_2() {
-    // macro iconst_2 { db 0x05 }
-    emit_u1(0x05);
+void jc_emit_class_header(jclass_ctx *ctx) {
+    // Magic number
+    jc_emit_u4(ctx, 0xCAFEBABE);
+    
+    // Version: Java 8 unless set with jc_set_version
+    jc_emit_u2(ctx, ctx->minor_version); // minor_version
+    jc_emit_u2(ctx, ctx->major_version ? ctx->major_version : JCLASS_JAVA_8); // major_version
 }
 
-void iconst_3() {
-    // macro iconst_3 { db 0x06 }
-    emit_u1(0x06);
+void jc_emit_class_footer(jclass_ctx *ctx, uint16_t this_class, uint8_t this_class_flags, uint16_t super_class) {
+    ctx->this_class = this_class;
+    jc_emit_u2(ctx, this_class_flags);
+    
+    // Class references
+    jc_emit_u2(ctx, this_class); // this_class
+    jc_emit_u2(ctx, super_class); // super_class
 }
 
-void iconst_4() {
-    // macro iconst_4 { db 0x07 }
-    emit_u1(0x07);
+// Enhanced Code attribute handling
+void jc_code_attribute_start(jclass_ctx *ctx, uint16_t name_index, uint16_t max_stack, uint16_t max_locals) {
+    jc_attribute_start(ctx, name_index);
+    ctx->max_stack_offset = jc_current_offset(ctx);
+    jc_emit_u2(ctx, max_stack);
+    jc_emit_u2(ctx, max_locals);
+    jc_section_push(ctx, JCLASS_SECTION_CODE, ctx->max_stack_offset);
+    jc_bytecode_start(ctx); // Starts code emission
 }
 
-void iconst_5() {
-    // macro iconst_5 { db 0x08 }
-    emit_u1(0x08);
+/**
+    @brief Ends the bytecode of the current Code attribute and starts the Code attribute's own attributes,
+    so ones like LineNumberTable can be added with attribute_start/attribute_end before code_attribute_end.
+    The computed StackMapTable, if there is one, comes first
+    
+*/
+void jc_code_attributes_start(jclass_ctx *ctx) {
+    if (!jc_section_pop(ctx, JCLASS_SECTION_CODE)) {
+        return;
+    }
+    int has_branches = ctx->fixup_count != 0 || ctx->raw_branches || ctx->handler_count != 0;
+    jc_bytecode_end(ctx); // Patches code length
+    if (((ctx->flags & (JCLASS_INSTRUCTION_LIST | JCLASS_REMOVE_DEAD_CODE)) || ctx->peephole) && ctx->error == JCLASS_OK) {
+        // code that can not be decoded is kept as it is
+        size_t before = jc_current_offset(ctx) - ctx->bytecode_offset;
+        int result = jc_code_to_list(ctx);
+        if (result == JCLASS_OK) {
+            if (ctx->code_pass && (ctx->flags & JCLASS_INSTRUCTION_LIST)) {
+                ctx->code_pass(ctx, ctx->code_pass_user);
+            }
+            if ((ctx->flags & JCLASS_REMOVE_DEAD_CODE) && ctx->error == JCLASS_OK) {
+                jc_set_error(ctx, jc_remove_dead_code(ctx));
+            }
+            if (ctx->peephole && ctx->error == JCLASS_OK) {
+                jc_set_error(ctx, jc_peephole_run(ctx));
+            }
+            jc_set_error(ctx, jc_list_to_code(ctx));
+            if (ctx->peephole) {
+                ctx->peephole_stats.methods++;
+                ctx->peephole_stats.bytes_before += before;
+                ctx->peephole_stats.bytes_after += jc_current_offset(ctx) - ctx->bytecode_offset;
+            }
+        } else if (result == JCLASS_ERR_NOMEM) {
+            jc_set_error(ctx, result);
+        }
+        ctx->insn_count = 0;
+    }
+    ctx->stackmap_frames = 0;
+    int frames = (ctx->flags & JCLASS_COMPUTE_FRAMES) && (ctx->major_version == 0 || ctx->major_version >= JCLASS_JAVA_6);
+    // the type checking verifier needs frames at every branch target from Java 7 on,
+    // checked by code_attribute_end as the caller may still add a StackMapTable
+    ctx->needs_stackmap = has_branches && !frames && ctx->major_version >= JCLASS_JAVA_7;
+    if ((ctx->flags & (JCLASS_COMPUTE_MAXS | JCLASS_COMPUTE_FRAMES)) && ctx->error == JCLASS_OK) {
+        // code that can not be analysed reports JCLASS_ERR_RANGE rather than keeping values that may be wrong
+        uint16_t max_stack = 0, max_locals = 0;
+        int result = jc_compute_maxs(ctx, &max_stack, &max_locals);
+        if (result == JCLASS_OK && frames) {
+            result = jc_compute_frames(ctx, &max_stack, max_locals);
+        }
+        if (result == JCLASS_OK) {
+            jc_patch_u2(ctx, ctx->max_stack_offset, max_stack);
+            jc_patch_u2(ctx, ctx->max_stack_offset + 2, max_locals);
+        } else {
+            jc_set_error(ctx, result);
+        }
+    }
+    // Add exception table and attributes (the StackMapTable if there is one)
+    jc_exceptions_start(ctx);
+    for (size_t i = 0; i < ctx->handler_count; i++) {
+        jclass_handler *handler = &ctx->handlers[i];
+        jc_exception_entry(ctx, (uint16_t)handler->start_pc, (uint16_t)handler->end_pc, (uint16_t)handler->handler_pc, handler->catch_type);
+    }
+    jc_exceptions_end(ctx);
+    ctx->handler_count = 0;
+    jc_attributes_start(ctx);
+    if (ctx->stackmap_frames) {
+        jc_attribute_start(ctx, jc_cp_utf8(ctx, "StackMapTable"));
+        jc_emit_u2(ctx, ctx->stackmap_frames);
+        jc_emit_bytes(ctx, ctx->stackmap, ctx->stackmap_length);
+        jc_attribute_end(ctx);
+    }
 }
 
-void idiv() {
-    // macro idiv { db 0x6c }
-    emit_u1(0x6c);
+void jc_code_attribute_end(jclass_ctx *ctx) {
+    if (ctx->section_count && ctx->sections[ctx->section_count - 1].kind == JCLASS_SECTION_CODE) {
+        jc_code_attributes_start(ctx);
+    }
+    if (ctx->needs_stackmap) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        ctx->needs_stackmap = 0;
+    }
+    jc_attributes_end(ctx);
+    jc_attribute_end(ctx);
 }
 
-void if_acmpeq(size_t branch_target) {
-    // macro if_acmpeq branch { offset = word branch-$; db 0xa5, ... }
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa5);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Helper function. Checks the class is complete and writes its constant pool, so outputBuffer holds the class file
+    @return JCLASS_OK or the error that happened while building the class
+    
+*/
+static int jc_finish_class(jclass_ctx *ctx) {
+    if (ctx->section_count != 0) {
+        jc_set_error(ctx, JCLASS_ERR_STATE); // a section was started but never ended
+    }
+    return jc_constant_pool_flush(ctx);
 }
 
-void if_acmpne(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa6);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Finishes the class and gives a view of the class file, without writing it anywhere
+    @param data Set to the class file, which belongs to the context and stays valid until it is reset or destroyed
+    @param length Set to the size of the class file
+    @return JCLASS_OK or the error that happened while building the class
+    
+*/
+int jc_finish(jclass_ctx *ctx, const uint8_t **data, size_t *length) {
+    int result = jc_finish_class(ctx);
+    *data = result == JCLASS_OK ? ctx->outputBuffer : NULL;
+    *length = result == JCLASS_OK ? ctx->outputIndex : 0;
+    return result;
 }
 
-void if_icmpeq(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9f);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Finishes the class and hands its buffer over to the caller, who has to free() it.
+    The context has to be reset before it builds another class
+    @param data Set to the class file
+    @param length Set to the size of the class file
+    @return JCLASS_OK or the error that happened while building the class
+    
+*/
+int jc_finish_take(jclass_ctx *ctx, uint8_t **data, size_t *length) {
+    int result = jc_finish_class(ctx);
+    *data = result == JCLASS_OK ? ctx->outputBuffer : NULL;
+    *length = result == JCLASS_OK ? ctx->outputIndex : 0;
+    if (result == JCLASS_OK) {
+        ctx->outputBuffer = NULL;
+        ctx->outputCapacity = 0;
+        ctx->outputIndex = 0;
+    }
+    return result;
 }
 
-void if_icmpne(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa0);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief Part of a class file, laid out like struct iovec's base and length
+ * 
+ */
+typedef struct jclass_slice {
+    const uint8_t *data;    // start of the part
+    size_t length;          // size of the part
+} jclass_slice;
 
-void if_icmplt(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa1);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Gives the class file as up to 4 slices to be written one after the other (with writev for example).
+    Unlike jc_finish the constant pool is not moved into the output, so nothing is copied. The slices
+    stay valid until the context is changed
+    @param slices Filled with the parts of the class file
+    @param count Set to the number of slices used
+    @return JCLASS_OK or the error that happened while building the class
+    
+*/
+int jc_finish_slices(jclass_ctx *ctx, jclass_slice slices[4], size_t *count) {
+    *count = 0;
+    if (ctx->section_count != 0) {
+        jc_set_error(ctx, JCLASS_ERR_STATE); // a section was started but never ended
+    }
+    if (!ctx->cp_flushed && !ctx->cp_started) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+    }
+    if (ctx->error != JCLASS_OK) {
+        return ctx->error;
+    }
+    if (ctx->cp_flushed) {
+        slices[(*count)++] = (jclass_slice){ ctx->outputBuffer, ctx->outputIndex };
+        return JCLASS_OK;
+    }
+    // the pool goes between the header and the rest, as jc_constant_pool_flush would put it
+    jc_store_u2(ctx->cp_count_bytes, ctx->constant_pool_counter);
+    slices[(*count)++] = (jclass_slice){ ctx->outputBuffer, ctx->cp_count_offset };
+    slices[(*count)++] = (jclass_slice){ ctx->cp_count_bytes, 2 };
+    if (ctx->cpLength) {
+        slices[(*count)++] = (jclass_slice){ ctx->cpBuffer, ctx->cpLength };
+    }
+    slices[(*count)++] = (jclass_slice){ ctx->outputBuffer + ctx->cp_count_offset, ctx->outputIndex - ctx->cp_count_offset };
+    return JCLASS_OK;
 }
 
-void if_icmpge(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa2);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief Receives the parts of a class file from jc_write_sink, returns nonzero to stop
+ * 
+ */
+typedef int (*jclass_sink)(void *user, const uint8_t *data, size_t length);
 
-void if_icmpgt(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa3);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Passes the class file to sink in order, in as many calls as jc_finish_slices has slices
+    @param user Passed to sink as it is
+    @return JCLASS_OK, the error that happened while building the class, or JCLASS_ERR_IO if sink stopped
+    
+*/
+int jc_write_sink(jclass_ctx *ctx, jclass_sink sink, void *user) {
+    jclass_slice slices[4];
+    size_t count;
+    int result = jc_finish_slices(ctx, slices, &count);
+    for (size_t i = 0; i < count && result == JCLASS_OK; i++) {
+        if (sink(user, slices[i].data, slices[i].length) != 0) {
+            result = JCLASS_ERR_IO;
+        }
+    }
+    return result;
 }
 
-void if_icmple(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xa4);
-    emit_u2((uint16_t)offset);
+int jc_write_class(jclass_ctx *ctx, char* outputName) {
+    if (jc_finish_class(ctx) != JCLASS_OK) {
+        fprintf(stderr, "Class was not built correctly (error %d)\n", ctx->error);
+        return ctx->error;
+    }
+    FILE *file = fopen(outputName, "wb");
+    if (file) {
+        size_t written = fwrite(ctx->outputBuffer, 1, ctx->outputIndex, file);
+        if (fclose(file) != 0 || written != ctx->outputIndex) {
+            fprintf(stderr, "Failed to write output file\n");
+            return JCLASS_ERR_IO;
+        }
+    } else {
+        fprintf(stderr, "Failed to open output file\n");
+        return JCLASS_ERR_IO;
+    }
+    return JCLASS_OK;
 }
 
-void ifeq(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x99);
-    emit_u2((uint16_t)offset);
-}
+// ------------------------
+// class reader
+// ------------------------
 
-void ifne(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9a);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief A class file being read in place
+ *
+ * Opening a class only records where each constant, field and method starts. Nothing is copied out of
+ * the class file's bytes, the jc_reader_* functions decode the parts that are asked for from them.
+ */
+typedef struct jclass_reader {
+    /** @brief The class file's bytes */
+    const uint8_t *data;
+    /** @brief Size of data */
+    size_t length;
+    /** @brief 1 if data was mapped by jc_reader_open, 2 if it was allocated, 0 if it belongs to the caller */
+    uint8_t owned;
+    /** @brief minor_version of the class file */
+    uint16_t minor_version;
+    /** @brief major_version of the class file */
+    uint16_t major_version;
+    /** @brief constant_pool_count, one more than the highest index */
+    uint16_t cp_count;
+    /** @brief Offset of each constant's tag, 0 for index 0 and the slot after a long or double */
+    uint32_t *cp_offsets;
+    /** @brief Access flags of the class */
+    uint16_t access_flags;
+    /** @brief Constant pool index of the class */
+    uint16_t this_class;
+    /** @brief Constant pool index of the super class, 0 for java/lang/Object */
+    uint16_t super_class;
+    /** @brief Number of interfaces */
+    uint16_t interfaces_count;
+    /** @brief Offset of the first interface index */
+    size_t interfaces_offset;
+    /** @brief Number of fields */
+    uint16_t fields_count;
+    /** @brief Offset of each field_info */
+    uint32_t *field_offsets;
+    /** @brief Number of methods */
+    uint16_t methods_count;
+    /** @brief Offset of each method_info */
+    uint32_t *method_offsets;
+    /** @brief Number of attributes of the class */
+    uint16_t attributes_count;
+    /** @brief Offset of the class's first attribute */
+    size_t attributes_offset;
+} jclass_reader;
 
-void iflt(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9b);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief A field or method of a class being read
+ * 
+ */
+typedef struct jclass_member {
+    size_t offset;              // offset of the field_info or method_info
+    size_t length;              // its size, attributes included
+    uint16_t access_flags;      // ACC_* flags
+    uint16_t name_index;        // constant pool index of the name
+    uint16_t descriptor_index;  // constant pool index of the descriptor
+    uint16_t attributes_count;  // number of attributes
+    size_t attributes_offset;   // offset of the first attribute
+} jclass_member;
 
-void ifge(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9c);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief An attribute of a class being read
+ * 
+ */
+typedef struct jclass_attribute {
+    size_t offset;          // offset of the attribute_info
+    uint16_t name_index;    // constant pool index of the name
+    uint32_t length;        // size of the contents
+    const uint8_t *data;    // the contents
+} jclass_attribute;
 
-void ifgt(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9d);
-    emit_u2((uint16_t)offset);
-}
+/**
+ * @brief The contents of a Code attribute of a class being read
+ * 
+ */
+typedef struct jclass_code {
+    uint16_t max_stack;                 // max_stack of the method
+    uint16_t max_locals;                // max_locals of the method
+    const uint8_t *code;                // the bytecode
+    uint32_t code_length;               // size of the bytecode
+    const uint8_t *exception_table;     // the exception table, 8 bytes per entry
+    uint16_t exception_table_length;    // number of entries in the exception table
+    uint16_t attributes_count;          // number of attributes of the Code attribute
+    size_t attributes_offset;           // offset of its first attribute
+} jclass_code;
 
-void ifle(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0x9e);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Helper function. Checks count attributes starting at pos fit in the class
+    @return The offset after the attributes, 0 if they do not fit
+    
+*/
+static size_t jc_reader_skip_attributes(const uint8_t *data, size_t length, size_t pos, uint16_t count) {
+    for (uint16_t i = 0; i < count; i++) {
+        if (length - pos < 6) {
+            return 0;
+        }
+        uint32_t size = jc_load_u4(data + pos + 2);
+        if (length - pos - 6 < size) {
+            return 0;
+        }
+        pos += 6 + (size_t)size;
+    }
+    return pos;
 }
 
-void ifnonnull(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xc7);
-    emit_u2((uint16_t)offset);
+/**
+    @brief Helper function. Records the offset of count fields or methods starting at *pos
+    @return JCLASS_OK, JCLASS_ERR_NOMEM or JCLASS_ERR_FORMAT
+    
+*/
+static int jc_reader_members(jclass_reader *reader, size_t *pos, uint16_t *count, uint32_t **offsets) {
+    if (reader->length - *pos < 2) {
+        return JCLASS_ERR_FORMAT;
+    }
+    *count = jc_load_u2(reader->data + *pos);
+    *pos += 2;
+    *offsets = malloc((*count ? *count : 1) * sizeof(uint32_t));
+    if (!*offsets) {
+        return JCLASS_ERR_NOMEM;
+    }
+    for (uint16_t i = 0; i < *count; i++) {
+        if (reader->length - *pos < 8) {
+            return JCLASS_ERR_FORMAT;
+        }
+        (*offsets)[i] = (uint32_t)*pos;
+        *pos = jc_reader_skip_attributes(reader->data, reader->length, *pos + 8, jc_load_u2(reader->data + *pos + 6));
+        if (*pos == 0) {
+            return JCLASS_ERR_FORMAT;
+        }
+    }
+    return JCLASS_OK;
 }
 
-void ifnull(size_t branch_target) {
-    int16_t offset = (int16_t)(branch_target - current_offset());
-    emit_u1(0xc6);
-    emit_u2((uint16_t)offset);
-}
+void jc_reader_close(jclass_reader *reader);
 
-void iinc(uint16_t index, int16_t constant_val) {
-    // macro iinc index, const { if index < 100h & const < 80h & const >= -80h ... }
-    if (index < 0x100 && constant_val < 0x80 && constant_val >= -0x80) {
-        emit_u1(0x84);
-        emit_u1((uint8_t)index);
-        emit_u1((uint8_t)constant_val);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x84);
-        emit_u2(index);
-        emit_u2((uint16_t)constant_val);
+/**
+    @brief Reads a class file that is already in memory. The bytes are not copied, so they have to stay
+    valid and unchanged until jc_reader_close
+    @param reader The reader to set up
+    @param data The class file
+    @param length Size of the class file
+    @return JCLASS_OK, JCLASS_ERR_NOMEM, or JCLASS_ERR_FORMAT if it is not a valid class file
+    
+*/
+int jc_reader_open_memory(jclass_reader *reader, const uint8_t *data, size_t length) {
+    memset(reader, 0, sizeof(*reader));
+    reader->data = data;
+    reader->length = length;
+    if (length < 10 || length > 0xFFFFFFFFu || jc_load_u4(data) != 0xCAFEBABE) {
+        return JCLASS_ERR_FORMAT;
+    }
+    reader->minor_version = jc_load_u2(data + 4);
+    reader->major_version = jc_load_u2(data + 6);
+    reader->cp_count = jc_load_u2(data + 8);
+    reader->cp_offsets = calloc(reader->cp_count ? reader->cp_count : 1, sizeof(uint32_t));
+    if (!reader->cp_offsets) {
+        return JCLASS_ERR_NOMEM;
+    }
+    int result = JCLASS_ERR_FORMAT;
+    size_t pos = 10;
+    for (uint32_t index = 1; index < reader->cp_count; index++) {
+        if (pos >= length) {
+            goto fail;
+        }
+        size_t size;
+        uint8_t tag = data[pos];
+        switch (tag) {
+            case 1: // Utf8
+                if (length - pos < 3) {
+                    goto fail;
+                }
+                size = 3 + (size_t)jc_load_u2(data + pos + 1);
+                break;
+            case 7: case 8: case 16: case 19: case 20: // Class, String, MethodType, Module, Package
+                size = 3;
+                break;
+            case 15: // MethodHandle
+                size = 4;
+                break;
+            case 3: case 4: case 9: case 10: case 11: case 12: case 17: case 18:
+                size = 5;
+                break;
+            case 5: case 6: // Long and Double take two indices
+                size = 9;
+                break;
+            default:
+                goto fail;
+        }
+        if (length - pos < size) {
+            goto fail;
+        }
+        reader->cp_offsets[index] = (uint32_t)pos;
+        pos += size;
+        if (tag == 5 || tag == 6) {
+            index++;
+        }
     }
+    if (length - pos < 8) {
+        goto fail;
+    }
+    reader->access_flags = jc_load_u2(data + pos);
+    reader->this_class = jc_load_u2(data + pos + 2);
+    reader->super_class = jc_load_u2(data + pos + 4);
+    reader->interfaces_count = jc_load_u2(data + pos + 6);
+    reader->interfaces_offset = pos + 8;
+    pos += 8;
+    if ((length - pos) / 2 < reader->interfaces_count) {
+        goto fail;
+    }
+    pos += 2 * (size_t)reader->interfaces_count;
+    result = jc_reader_members(reader, &pos, &reader->fields_count, &reader->field_offsets);
+    if (result == JCLASS_OK) {
+        result = jc_reader_members(reader, &pos, &reader->methods_count, &reader->method_offsets);
+    }
+    if (result != JCLASS_OK) {
+        goto fail;
+    }
+    result = JCLASS_ERR_FORMAT;
+    if (length - pos < 2) {
+        goto fail;
+    }
+    reader->attributes_count = jc_load_u2(data + pos);
+    reader->attributes_offset = pos + 2;
+    pos = jc_reader_skip_attributes(data, length, pos + 2, reader->attributes_count);
+    if (pos != length) {
+        goto fail; // attributes that do not fit, or bytes after the end of the class
+    }
+    return JCLASS_OK;
+
+fail:
+    jc_reader_close(reader);
+    return result;
 }
 
-void iload(uint16_t index) {
-    // macro iload index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x1a + index);
-    } else if (index < 0x100) {
-        emit_u1(0x15);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x15);
-        emit_u2(index);
+/**
+    @brief Opens a class file for reading. The file is mapped into memory where the system allows it,
+    and read into a buffer otherwise
+    @param reader The reader to set up
+    @param path The class file
+    @return JCLASS_OK, JCLASS_ERR_IO, JCLASS_ERR_NOMEM or JCLASS_ERR_FORMAT
+    
+*/
+int jc_reader_open(jclass_reader *reader, const char *path) {
+    memset(reader, 0, sizeof(*reader));
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return JCLASS_ERR_IO;
+    }
+#ifdef JCLASS_MMAP
+    // unistd.h is left out since its dup and dup2 clash with the instructions
+    struct stat info;
+    void *map = MAP_FAILED;
+    if (fstat(fileno(file), &info) == 0 && info.st_size > 0) {
+        map = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fileno(file), 0);
+    }
+    if (map != MAP_FAILED) {
+        fclose(file);
+        int result = jc_reader_open_memory(reader, map, (size_t)info.st_size);
+        if (result != JCLASS_OK) {
+            munmap(map, (size_t)info.st_size);
+            return result;
+        }
+        reader->owned = 1;
+        return JCLASS_OK;
+    }
+#endif
+    long size = -1;
+    if (fseek(file, 0, SEEK_END) == 0) {
+        size = ftell(file);
+    }
+    if (size < 0 || fseek(file, 0, SEEK_SET) != 0) {
+        fclose(file);
+        return JCLASS_ERR_IO;
+    }
+    uint8_t *data = malloc(size ? (size_t)size : 1);
+    if (!data) {
+        fclose(file);
+        return JCLASS_ERR_NOMEM;
+    }
+    size_t read = fread(data, 1, (size_t)size, file);
+    fclose(file);
+    if (read != (size_t)size) {
+        free(data);
+        return JCLASS_ERR_IO;
+    }
+    int result = jc_reader_open_memory(reader, data, (size_t)size);
+    if (result != JCLASS_OK) {
+        free(data);
+        return result;
     }
+    reader->owned = 2;
+    return JCLASS_OK;
 }
 
-void imul() {
-    // macro imul { db 0x68 }
-    emit_u1(0x68);
+/**
+    @brief Frees what a reader allocated, and the class file if jc_reader_open loaded it.
+    Views returned by the reader can not be used afterwards
+    
+*/
+void jc_reader_close(jclass_reader *reader) {
+#ifdef JCLASS_MMAP
+    if (reader->owned == 1) {
+        munmap((void *)reader->data, reader->length);
+    }
+#endif
+    if (reader->owned == 2) {
+        free((void *)reader->data);
+    }
+    free(reader->cp_offsets);
+    free(reader->field_offsets);
+    free(reader->method_offsets);
+    memset(reader, 0, sizeof(*reader));
 }
 
-void ineg() {
-    // macro ineg { db 0x74 }
-    emit_u1(0x74);
+/**
+    @brief Finds a constant of a class being read
+    @return The constant's tag followed by its contents, NULL if index is not a constant
+    
+*/
+const uint8_t *jc_reader_cp_entry(const jclass_reader *reader, uint16_t index) {
+    if (index >= reader->cp_count || reader->cp_offsets[index] == 0) {
+        return NULL;
+    }
+    return reader->data + reader->cp_offsets[index];
 }
 
-void instanceof(uint16_t index) {
-    // macro instanceof index { db 0xc1,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xc1);
-    emit_u2(index);
+/**
+    @brief Gets the tag of a constant of a class being read
+    @return The CONSTANT_* tag, 0 if index is not a constant
+    
+*/
+uint8_t jc_reader_cp_tag(const jclass_reader *reader, uint16_t index) {
+    const uint8_t *entry = jc_reader_cp_entry(reader, index);
+    return entry ? entry[0] : 0;
 }
 
-void invokedynamic(uint16_t index) {
-    // macro invokedynamic index { db 0xba,(index) shr 8,(index) and 0FFh,0,0 }
-    emit_u1(0xba);
-    emit_u2(index);
-    emit_u1(0x00);
-    emit_u1(0x00);
+/**
+    @brief Gets the string of a Utf8 constant of a class being read, without copying it
+    @param length Set to the size of the string in bytes
+    @return The modified UTF-8 bytes, which are not NUL terminated, or NULL if index is not a Utf8 constant
+    
+*/
+const uint8_t *jc_reader_utf8(const jclass_reader *reader, uint16_t index, uint16_t *length) {
+    const uint8_t *entry = jc_reader_cp_entry(reader, index);
+    if (!entry || entry[0] != 1) {
+        return NULL;
+    }
+    *length = jc_load_u2(entry + 1);
+    return entry + 3;
 }
 
-void invokeinterface(uint16_t index, uint8_t count) {
-    // macro invokeinterface index,count { db 0xb9,(index) shr 8,(index) and 0FFh,count }
-    emit_u1(0xb9);
-    emit_u2(index);
-    emit_u1(count);
+/**
+    @brief Gets the name of a Class constant of a class being read, like java/lang/Object
+    @return The name, which is not NUL terminated, or NULL if index is not a Class constant
+    
+*/
+const uint8_t *jc_reader_class_name(const jclass_reader *reader, uint16_t index, uint16_t *length) {
+    const uint8_t *entry = jc_reader_cp_entry(reader, index);
+    if (!entry || entry[0] != 7) {
+        return NULL;
+    }
+    return jc_reader_utf8(reader, jc_load_u2(entry + 1), length);
 }
 
-void invokespecial(uint16_t index) {
-    // macro invokespecial index { db 0xb7,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb7);
-    emit_u2(index);
+/**
+    @brief Gets an interface of a class being read
+    @return Constant pool index of the interface, 0 if i is past the last one
+    
+*/
+uint16_t jc_reader_interface(const jclass_reader *reader, uint16_t i) {
+    if (i >= reader->interfaces_count) {
+        return 0;
+    }
+    return jc_load_u2(reader->data + reader->interfaces_offset + 2 * (size_t)i);
 }
 
-void invokestatic(uint16_t index) {
-    // macro invokestatic index { db 0xb8,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb8);
-    emit_u2(index);
+/**
+    @brief Helper function. Decodes the field_info or method_info at offset
+    
+*/
+static void jc_reader_member(const jclass_reader *reader, size_t offset, jclass_member *member) {
+    const uint8_t *data = reader->data + offset;
+    member->offset = offset;
+    member->access_flags = jc_load_u2(data);
+    member->name_index = jc_load_u2(data + 2);
+    member->descriptor_index = jc_load_u2(data + 4);
+    member->attributes_count = jc_load_u2(data + 6);
+    member->attributes_offset = offset + 8;
+    member->length = jc_reader_skip_attributes(reader->data, reader->length, offset + 8, member->attributes_count) - offset;
 }
 
-void invokevirtual(uint16_t index) {
-    // macro invokevirtual index { db 0xb6,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb6);
-    emit_u2(index);
+/**
+    @brief Gets a field of a class being read
+    @return JCLASS_OK, or JCLASS_ERR_RANGE if i is past the last field
+    
+*/
+int jc_reader_field(const jclass_reader *reader, uint16_t i, jclass_member *field) {
+    if (i >= reader->fields_count) {
+        return JCLASS_ERR_RANGE;
+    }
+    jc_reader_member(reader, reader->field_offsets[i], field);
+    return JCLASS_OK;
 }
 
-void ior() {
-    // macro ior { db 0x80 }
-    emit_u1(0x80);
+/**
+    @brief Gets a method of a class being read
+    @return JCLASS_OK, or JCLASS_ERR_RANGE if i is past the last method
+    
+*/
+int jc_reader_method(const jclass_reader *reader, uint16_t i, jclass_member *method) {
+    if (i >= reader->methods_count) {
+        return JCLASS_ERR_RANGE;
+    }
+    jc_reader_member(reader, reader->method_offsets[i], method);
+    return JCLASS_OK;
 }
 
-void irem() {
-    // macro irem { db 0x70 }
-    emit_u1(0x70);
+/**
+    @brief Gets the attribute at offset, which has to be the attributes_offset of a class, member or Code
+    attribute or the value returned for the attribute before it
+    @return Offset of the next attribute
+    
+*/
+size_t jc_reader_attribute(const jclass_reader *reader, size_t offset, jclass_attribute *attribute) {
+    const uint8_t *data = reader->data + offset;
+    attribute->offset = offset;
+    attribute->name_index = jc_load_u2(data);
+    attribute->length = jc_load_u4(data + 2);
+    attribute->data = data + 6;
+    return offset + 6 + (size_t)attribute->length;
 }
 
-void ireturn() {
-    // macro ireturn { db 0xac }
-    emit_u1(0xac);
+/**
+    @brief Looks for an attribute by name
+    @param offset Offset of the first attribute, like jclass_member.attributes_offset
+    @param count Number of attributes there
+    @param name Name of the attribute, like "Code"
+    @return 1 if the attribute was found, 0 if not
+    
+*/
+int jc_reader_find_attribute(const jclass_reader *reader, size_t offset, uint16_t count, const char *name, jclass_attribute *attribute) {
+    size_t name_length = strlen(name);
+    for (uint16_t i = 0; i < count; i++) {
+        uint16_t length;
+        offset = jc_reader_attribute(reader, offset, attribute);
+        const uint8_t *utf8 = jc_reader_utf8(reader, attribute->name_index, &length);
+        if (utf8 && length == name_length && memcmp(utf8, name, name_length) == 0) {
+            return 1;
+        }
+    }
+    return 0;
 }
 
-void ishl() {
-    // macro ishl { db 0x78 }
-    emit_u1(0x78);
+/**
+    @brief Decodes a Code attribute
+    @return JCLASS_OK, or JCLASS_ERR_FORMAT if its parts do not fit in it
+    
+*/
+int jc_reader_code(const jclass_reader *reader, const jclass_attribute *attribute, jclass_code *code) {
+    const uint8_t *data = attribute->data;
+    size_t length = attribute->length;
+    memset(code, 0, sizeof(*code));
+    if (length < 8) {
+        return JCLASS_ERR_FORMAT;
+    }
+    code->max_stack = jc_load_u2(data);
+    code->max_locals = jc_load_u2(data + 2);
+    code->code_length = jc_load_u4(data + 4);
+    code->code = data + 8;
+    size_t pos = 8;
+    if (length - pos < code->code_length || length - pos - code->code_length < 2) {
+        return JCLASS_ERR_FORMAT;
+    }
+    pos += code->code_length;
+    code->exception_table_length = jc_load_u2(data + pos);
+    code->exception_table = data + pos + 2;
+    pos += 2;
+    if ((length - pos) / 8 < code->exception_table_length || length - pos - 8 * (size_t)code->exception_table_length < 2) {
+        return JCLASS_ERR_FORMAT;
+    }
+    pos += 8 * (size_t)code->exception_table_length;
+    code->attributes_count = jc_load_u2(data + pos);
+    code->attributes_offset = (size_t)(data - reader->data) + pos + 2;
+    if (jc_reader_skip_attributes(data, length, pos + 2, code->attributes_count) != length) {
+        return JCLASS_ERR_FORMAT;
+    }
+    return JCLASS_OK;
 }
 
-void ishr() {
-    // macro ishr { db 0x7a }
-    emit_u1(0x7a);
-}
+// ------------------------
+// pass-through copying
+// ------------------------
 
-void istore(uint16_t index) {
-    // macro istore index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x3b + index);
-    } else if (index < 0x100) {
-        emit_u1(0x36);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x36);
-        emit_u2(index);
+/**
+    @brief Makes the constant pool of a class being read the start of this class's pool, keeping every index.
+    Has to be called right after constant_pool_start, before any constant is added. The cp_* functions
+    return the copied entries instead of adding duplicates, and jc_field_copy, jc_method_copy and
+    jc_attribute_copy can copy parts of the class that read it without changing them
+    @param reader The class the pool is copied from, which has to stay open until the copies are done
+    
+*/
+void jc_constant_pool_copy(jclass_ctx *ctx, const jclass_reader *reader) {
+    if (!ctx->cp_started || ctx->cp_flushed || ctx->constant_pool_counter > 1 || ctx->cpLength != 0) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return;
     }
+    // the pool runs from after constant_pool_count to access_flags, 8 bytes before the interfaces
+    size_t len = reader->interfaces_offset - 8 - 10;
+    uint8_t *dst = jc_cp_append(ctx, len);
+    if (!dst || reader->cp_count == 0) {
+        return;
+    }
+    memcpy(dst, reader->data + 10, len);
+    if (reader->cp_count > ctx->cp_entries_capacity) {
+        jclass_cp_entry *entries = jc_grow(ctx, ctx->cp_entries, &ctx->cp_entries_capacity, reader->cp_count, sizeof(jclass_cp_entry), 64);
+        if (!entries) {
+            return;
+        }
+        ctx->cp_entries = entries;
+    }
+    for (uint16_t index = 1; index < reader->cp_count; index++) {
+        uint32_t offset = reader->cp_offsets[index];
+        if (offset == 0) {
+            ctx->cp_entries[index].offset = UINT32_MAX;
+            ctx->cp_entries[index].hash = 0;
+            continue;
+        }
+        const uint8_t *entry = ctx->cpBuffer + (offset - 10);
+        ctx->cp_entries[index].offset = offset - 10;
+        ctx->cp_entries[index].hash = jc_cp_hash(entry, jc_cp_entry_size(entry));
+        jc_cp_table_insert(ctx, index);
+    }
+    ctx->constant_pool_counter = reader->cp_count;
+    ctx->cp_entry_offset = ctx->cpLength;
+    ctx->cp_source = reader->data;
 }
 
-void isub() {
-    // macro isub { db 0x64 }
-    emit_u1(0x64);
+/**
+    @brief Helper function. Records JCLASS_ERR_STATE unless the constant pool was copied from reader
+    @return 1 if it was
+    
+*/
+static int jc_check_cp_source(jclass_ctx *ctx, const jclass_reader *reader) {
+    if (ctx->cp_source == NULL || ctx->cp_source != reader->data) {
+        jc_set_error(ctx, JCLASS_ERR_STATE);
+        return 0;
+    }
+    return 1;
 }
 
-void iushr() {
-    // macro iushr { db 0x7c }
-    emit_u1(0x7c);
+/**
+    @brief Copies a field of a class being read, attributes included, without decoding it.
+    The constant pool has to have been copied from the same class with jc_constant_pool_copy
+    @param i Index of the field in the class being read
+    
+*/
+void jc_field_copy(jclass_ctx *ctx, const jclass_reader *reader, uint16_t i) {
+    jclass_member field;
+    if (!jc_check_cp_source(ctx, reader)) {
+        return;
+    }
+    if (jc_reader_field(reader, i, &field) != JCLASS_OK) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    jc_section_count(ctx, JCLASS_SECTION_FIELDS);
+    jc_emit_bytes(ctx, reader->data + field.offset, field.length);
 }
 
-void ixor() {
-    // macro ixor { db 0x82 }
-    emit_u1(0x82);
+/**
+    @brief Copies a method of a class being read, attributes and code included, without decoding it.
+    The constant pool has to have been copied from the same class with jc_constant_pool_copy
+    @param i Index of the method in the class being read
+    
+*/
+void jc_method_copy(jclass_ctx *ctx, const jclass_reader *reader, uint16_t i) {
+    jclass_member method;
+    if (!jc_check_cp_source(ctx, reader)) {
+        return;
+    }
+    if (jc_reader_method(reader, i, &method) != JCLASS_OK) {
+        jc_set_error(ctx, JCLASS_ERR_RANGE);
+        return;
+    }
+    jc_section_count(ctx, JCLASS_SECTION_METHODS);
+    jc_emit_bytes(ctx, reader->data + method.offset, method.length);
 }
 
-void jsr_inst(size_t branch_target) {
-    // macro jsr branch { if branch-$>=-8000h & branch-$<8000h ... }
-    int32_t offset = (int32_t)(branch_target - current_offset());
-    if (offset >= (int32_t)0xFFFF8000 && offset < 0x8000) {
-        int16_t word_offset = (int16_t)offset;
-        emit_u1(0xa8);
-        emit_u2((uint16_t)word_offset);
-    } else {
-        int32_t dword_offset = offset;
-        emit_u1(0xc9);
-        emit_u4((uint32_t)dword_offset);
+/**
+    @brief Copies an attribute of a class being read into the open list of attributes, without decoding it.
+    The constant pool has to have been copied from the same class with jc_constant_pool_copy
+    @param attribute The attribute, from jc_reader_attribute or jc_reader_find_attribute
+    
+*/
+void jc_attribute_copy(jclass_ctx *ctx, const jclass_reader *reader, const jclass_attribute *attribute) {
+    if (!jc_check_cp_source(ctx, reader)) {
+        return;
     }
+    jc_section_count(ctx, JCLASS_SECTION_ATTRIBUTES);
+    jc_emit_bytes(ctx, reader->data + attribute->offset, 6 + (size_t)attribute->length);
 }
 
-void jsr_w_inst(size_t branch_target) {
-    // macro jsr_w branch { offset = dword branch-$; db 0xc9, ... }
-    int32_t offset = (int32_t)(branch_target - current_offset());
-    emit_u1(0xc9);
-    emit_u4((uint32_t)offset);
+// ------------------------
+// jar output
+// ------------------------
+
+/**
+ * @brief How the entries of a jar are stored
+ * 
+ */
+enum {
+    JCLASS_JAR_STORED = 0,  // entries are stored as they are
+    JCLASS_JAR_DEFLATED = 8 // entries are compressed, or stored when that does not make them smaller
+};
+
+/**
+ * @brief A jar (zip) file being written one entry at a time
+ *
+ * Each entry is written as soon as it is added, only the central directory is kept in memory until
+ * jc_jar_close. Archives are limited to 65535 entries and 4 GiB, as zip64 is not written.
+ */
+typedef struct jclass_jar {
+    /** @brief The file being written */
+    FILE *file;
+    /** @brief First error that happened while writing, JCLASS_OK if none */
+    int error;
+    /** @brief JCLASS_JAR_STORED or JCLASS_JAR_DEFLATED */
+    int method;
+    /** @brief Bytes written to the file so far */
+    size_t offset;
+    /** @brief Number of entries written */
+    size_t entries;
+    /** @brief Central directory, written by jc_jar_close */
+    uint8_t *central;
+    /** @brief Used size of central */
+    size_t central_length;
+    /** @brief Allocated size of central */
+    size_t central_capacity;
+    /** @brief Compressed data of the entry being added */
+    uint8_t *deflated;
+    /** @brief Allocated size of deflated */
+    size_t deflated_capacity;
+    /** @brief Table for the CRC-32 of the entries */
+    uint32_t crc_table[256];
+#ifdef JCLASS_ZLIB
+    /** @brief zlib stream, reset for every entry */
+    z_stream stream;
+#else
+    /** @brief Latest position of each 3 byte hash, positions below match_base belong to earlier entries */
+    uint32_t *match_head;
+    /** @brief Position before each one in the last 32 KiB with the same hash */
+    uint32_t *match_prev;
+    /** @brief Position of the first byte of the entry being compressed */
+    uint32_t match_base;
+#endif
+} jclass_jar;
+
+/**
+    @brief Helper function. Stores a 2 byte little endian value, as zip files use
+    
+*/
+static void jc_store_le16(uint8_t *dst, uint16_t v) {
+    dst[0] = v & 0xFF;
+    dst[1] = (v >> 8) & 0xFF;
 }
 
-void l2d() {
-    // macro l2d { db 0x8a }
-    emit_u1(0x8a);
+/**
+    @brief Helper function. Stores a 4 byte little endian value, as zip files use
+    
+*/
+static void jc_store_le32(uint8_t *dst, uint32_t v) {
+    dst[0] = v & 0xFF;
+    dst[1] = (v >> 8) & 0xFF;
+    dst[2] = (v >> 16) & 0xFF;
+    dst[3] = (v >> 24) & 0xFF;
 }
 
-void l2f() {
-    // macro l2f { db 0x89 }
-    emit_u1(0x89);
+/**
+    @brief Helper function. Records the first error of a jar
+    @return The jar's error
+    
+*/
+static int jc_jar_set_error(jclass_jar *jar, int error) {
+    if (jar->error == JCLASS_OK) {
+        jar->error = error;
+    }
+    return jar->error;
 }
 
-void l2i() {
-    // macro l2i { db 0x88 }
-    emit_u1(0x88);
+/**
+    @brief Helper function. Grows a buffer of the jar to at least needed bytes
+    @return The buffer, or NULL if it could not be grown
+    
+*/
+static uint8_t *jc_jar_grow(jclass_jar *jar, uint8_t **data, size_t *capacity, size_t needed) {
+    if (needed > *capacity) {
+        size_t new_capacity = *capacity ? *capacity : 4096;
+        while (new_capacity < needed && new_capacity <= SIZE_MAX / 2) {
+            new_capacity *= 2;
+        }
+        if (new_capacity < needed) {
+            new_capacity = needed;
+        }
+        uint8_t *grown = realloc(*data, new_capacity);
+        if (!grown) {
+            jc_jar_set_error(jar, JCLASS_ERR_NOMEM);
+            return NULL;
+        }
+        *data = grown;
+        *capacity = new_capacity;
+    }
+    return *data;
 }
 
-void ladd() {
-    // macro ladd { db 0x61 }
-    emit_u1(0x61);
+/**
+    @brief Helper function. CRC-32 of an entry, as zip files use
+    
+*/
+static uint32_t jc_jar_crc32(const jclass_jar *jar, const uint8_t *data, size_t length) {
+    uint32_t crc = 0xFFFFFFFFu;
+    for (size_t i = 0; i < length; i++) {
+        crc = jar->crc_table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    }
+    return crc ^ 0xFFFFFFFFu;
 }
 
-void laload() {
-    // macro laload { db 0x2f }
-    emit_u1(0x2f);
-}
+#ifndef JCLASS_ZLIB
 
-void land() {
-    // macro land { db 0x7f }
-    emit_u1(0x7f);
-}
+/** @brief Size of the deflate window */
+#define JCLASS_DEFLATE_WINDOW 32768
 
-void lastore() {
-    // macro lastore { db 0x50 }
-    emit_u1(0x50);
-}
+/** @brief Number of bits of the hashes used to find matches */
+#define JCLASS_DEFLATE_HASH_BITS 15
 
-void lcmp() {
-    // macro lcmp { db 0x94 }
-    emit_u1(0x94);
-}
+/** @brief How many earlier positions with the same hash are tried for a match */
+#define JCLASS_DEFLATE_CHAIN 32
 
-void lconst_0() {
-    // macro lconst_0 { db 0x09 }
-    emit_u1(0x09);
+/**
+ * @brief Bits being written to a deflate stream, least significant bit first
+ * 
+ */
+typedef struct jclass_bits {
+    uint8_t *out;       // where the stream is written
+    size_t capacity;    // size of out
+    size_t length;      // bytes written to out
+    uint64_t bits;      // bits not written yet
+    uint32_t count;     // number of bits in bits
+} jclass_bits;
+
+/**
+    @brief Helper function. Adds the count low bits of value to the stream
+    
+*/
+static void jc_bits_put(jclass_bits *stream, uint32_t value, uint32_t count) {
+    stream->bits |= (uint64_t)value << stream->count;
+    stream->count += count;
+    while (stream->count >= 8) {
+        if (stream->length < stream->capacity) {
+            stream->out[stream->length] = (uint8_t)stream->bits;
+        }
+        stream->length++;
+        stream->bits >>= 8;
+        stream->count -= 8;
+    }
 }
 
-void lconst_1() {
-    // macro lconst_1 { db 0x0a }
-    emit_u1(0x0a);
+/**
+    @brief Helper function. Adds a Huffman code, which deflate stores most significant bit first
+    
+*/
+static void jc_bits_put_code(jclass_bits *stream, uint32_t code, uint32_t count) {
+    uint32_t reversed = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        reversed = (reversed << 1) | ((code >> i) & 1);
+    }
+    jc_bits_put(stream, reversed, count);
 }
 
-void ldc(uint16_t index) {
-    // macro ldc index { if index<100h ... }
-    if (index < 0x100) {
-        emit_u1(0x12);
-        emit_u1((uint8_t)index);
+/**
+    @brief Helper function. Adds a literal or length symbol with the fixed Huffman codes of deflate
+    
+*/
+static void jc_deflate_symbol(jclass_bits *stream, uint32_t symbol) {
+    if (symbol < 144) {
+        jc_bits_put_code(stream, 0x30 + symbol, 8);
+    } else if (symbol < 256) {
+        jc_bits_put_code(stream, 0x190 + symbol - 144, 9);
+    } else if (symbol < 280) {
+        jc_bits_put_code(stream, symbol - 256, 7);
     } else {
-        emit_u1(0x13);
-        emit_u2(index);
+        jc_bits_put_code(stream, 0xC0 + symbol - 280, 8);
     }
 }
 
-void ldc_w(uint16_t index) {
-    // macro ldc_w index { db 0x13,(index) shr 8,(index) and 0FFh }
-    emit_u1(0x13);
-    emit_u2(index);
+/**
+    @brief Helper function. Adds a match of length bytes distance bytes back
+    
+*/
+static void jc_deflate_match(jclass_bits *stream, uint32_t length, uint32_t distance) {
+    static const uint16_t length_base[29] = {
+        3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258
+    };
+    static const uint8_t length_extra[29] = {
+        0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0
+    };
+    static const uint16_t distance_base[30] = {
+        1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073,
+        4097, 6145, 8193, 12289, 16385, 24577
+    };
+    uint32_t code = 28;
+    while (length < length_base[code]) {
+        code--;
+    }
+    jc_deflate_symbol(stream, 257 + code);
+    jc_bits_put(stream, length - length_base[code], length_extra[code]);
+    code = 29;
+    while (distance < distance_base[code]) {
+        code--;
+    }
+    jc_bits_put_code(stream, code, 5);
+    // distance codes 4 and up have (code - 2) / 2 extra bits
+    jc_bits_put(stream, distance - distance_base[code], code < 4 ? 0 : (code - 2) / 2);
 }
 
-void ldc2_w(uint16_t index) {
-    // macro ldc2_w index { db 0x14,(index) shr 8,(index) and 0FFh }
-    emit_u1(0x14);
-    emit_u2(index);
+/**
+    @brief Helper function. Compresses an entry into one deflate block with the fixed Huffman codes,
+    finding matches with hash chains
+    @return Size of the compressed data, or 0 if it does not fit in capacity bytes
+    
+*/
+static size_t jc_jar_deflate(jclass_jar *jar, const uint8_t *data, size_t length, uint8_t *out, size_t capacity) {
+    if (jar->match_base > UINT32_MAX - length - 1) {
+        // positions would wrap around, forget every earlier one
+        memset(jar->match_head, 0, ((size_t)1 << JCLASS_DEFLATE_HASH_BITS) * sizeof(uint32_t));
+        jar->match_base = 1;
+    }
+    uint32_t base = jar->match_base;
+    jclass_bits stream = { out, capacity, 0, 0, 0 };
+    jc_bits_put(&stream, 1, 1); // BFINAL
+    jc_bits_put(&stream, 1, 2); // BTYPE 01, fixed Huffman codes
+    size_t i = 0;
+    while (i < length && stream.length <= capacity) {
+        size_t best_length = 0, best_distance = 0;
+        size_t max_length = length - i < 258 ? length - i : 258;
+        if (max_length >= 3) {
+            uint32_t hash = ((uint32_t)data[i] << 16 | (uint32_t)data[i + 1] << 8 | data[i + 2]) * 2654435761u >> (32 - JCLASS_DEFLATE_HASH_BITS);
+            uint32_t position = base + (uint32_t)i;
+            uint32_t candidate = jar->match_head[hash];
+            jar->match_head[hash] = position;
+            jar->match_prev[position & (JCLASS_DEFLATE_WINDOW - 1)] = candidate;
+            for (int depth = 0; depth < JCLASS_DEFLATE_CHAIN && candidate >= base && candidate < position &&
+                 position - candidate <= JCLASS_DEFLATE_WINDOW; depth++) {
+                const uint8_t *match = data + (candidate - base);
+                if (match[best_length] == data[i + best_length]) {
+                    size_t n = 0;
+                    while (n < max_length && match[n] == data[i + n]) {
+                        n++;
+                    }
+                    if (n > best_length) {
+                        best_length = n;
+                        best_distance = position - candidate;
+                        if (n == max_length) {
+                            break;
+                        }
+                    }
+                }
+                candidate = jar->match_prev[candidate & (JCLASS_DEFLATE_WINDOW - 1)];
+            }
+        }
+        if (best_length >= 3) {
+            jc_deflate_match(&stream, (uint32_t)best_length, (uint32_t)best_distance);
+            // the bytes inside the match can still start later matches
+            for (size_t k = 1; k < best_length && i + k + 3 <= length; k++) {
+                const uint8_t *p = data + i + k;
+                uint32_t hash = ((uint32_t)p[0] << 16 | (uint32_t)p[1] << 8 | p[2]) * 2654435761u >> (32 - JCLASS_DEFLATE_HASH_BITS);
+                uint32_t position = base + (uint32_t)(i + k);
+                jar->match_prev[position & (JCLASS_DEFLATE_WINDOW - 1)] = jar->match_head[hash];
+                jar->match_head[hash] = position;
+            }
+            i += best_length;
+        } else {
+            jc_deflate_symbol(&stream, data[i]);
+            i++;
+        }
+    }
+    jc_deflate_symbol(&stream, 256); // end of block
+    jc_bits_put(&stream, 0, 7);      // pad to a whole byte
+    jar->match_base = base + (uint32_t)length + 1;
+    return stream.length <= capacity ? stream.length : 0;
 }
 
-void j_ldiv() {
-    // macro ldiv { db 0x6d }
-    emit_u1(0x6d);
+#endif
+
+/**
+    @brief Creates a jar file to add entries to
+    @param path The file to write
+    @param method JCLASS_JAR_STORED or JCLASS_JAR_DEFLATED
+    @return JCLASS_OK, JCLASS_ERR_IO, JCLASS_ERR_NOMEM, or JCLASS_ERR_RANGE for an unknown method
+    
+*/
+int jc_jar_open(jclass_jar *jar, const char *path, int method) {
+    memset(jar, 0, sizeof(*jar));
+    if (method != JCLASS_JAR_STORED && method != JCLASS_JAR_DEFLATED) {
+        return jar->error = JCLASS_ERR_RANGE;
+    }
+    jar->method = method;
+    for (uint32_t i = 0; i < 256; i++) {
+        uint32_t crc = i;
+        for (int k = 0; k < 8; k++) {
+            crc = crc & 1 ? (crc >> 1) ^ 0xEDB88320u : crc >> 1;
+        }
+        jar->crc_table[i] = crc;
+    }
+    if (method == JCLASS_JAR_DEFLATED) {
+#ifdef JCLASS_ZLIB
+        // negative window bits give raw deflate data, which is what zip entries hold
+        if (deflateInit2(&jar->stream, Z_BEST_COMPRESSION, Z_DEFLATED, -15, 9, Z_DEFAULT_STRATEGY) != Z_OK) {
+            return jar->error = JCLASS_ERR_NOMEM;
+        }
+#else
+        jar->match_head = calloc((size_t)1 << JCLASS_DEFLATE_HASH_BITS, sizeof(uint32_t));
+        jar->match_prev = malloc(JCLASS_DEFLATE_WINDOW * sizeof(uint32_t));
+        jar->match_base = 1;
+        if (!jar->match_head || !jar->match_prev) {
+            free(jar->match_head);
+            free(jar->match_prev);
+            return jar->error = JCLASS_ERR_NOMEM;
+        }
+#endif
+    }
+    jar->file = fopen(path, "wb");
+    if (!jar->file) {
+#ifdef JCLASS_ZLIB
+        if (method == JCLASS_JAR_DEFLATED) {
+            deflateEnd(&jar->stream);
+        }
+#else
+        free(jar->match_head);
+        free(jar->match_prev);
+#endif
+        return jar->error = JCLASS_ERR_IO;
+    }
+    return JCLASS_OK;
 }
 
-void lload(uint16_t index) {
-    // macro lload index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x1e + index);
-    } else if (index < 0x100) {
-        emit_u1(0x16);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x16);
-        emit_u2(index);
+/**
+    @brief Adds a file to a jar, compressing it if the jar was opened with JCLASS_JAR_DEFLATED
+    @param name Path of the entry in the jar, like "com/example/Main.class" or "META-INF/MANIFEST.MF"
+    @param data Contents of the entry
+    @param length Size of data
+    @return JCLASS_OK, or the first error of the jar
+    
+*/
+int jc_jar_add(jclass_jar *jar, const char *name, const uint8_t *data, size_t length) {
+    size_t name_length = strlen(name);
+    if (jar->error != JCLASS_OK || !jar->file) {
+        return jc_jar_set_error(jar, JCLASS_ERR_STATE);
+    }
+    if (jar->entries >= 0xFFFF || name_length > 0xFFFF || length > 0xFFFFFFFFu) {
+        return jc_jar_set_error(jar, JCLASS_ERR_RANGE);
+    }
+    uint32_t crc = jc_jar_crc32(jar, data, length);
+    uint16_t method = JCLASS_JAR_STORED;
+    const uint8_t *contents = data;
+    size_t stored_length = length;
+    if (jar->method == JCLASS_JAR_DEFLATED && length > 0) {
+#ifdef JCLASS_ZLIB
+        size_t bound = deflateBound(&jar->stream, (uLong)length);
+#else
+        size_t bound = length + length / 8 + 64;
+#endif
+        if (!jc_jar_grow(jar, &jar->deflated, &jar->deflated_capacity, bound)) {
+            return jar->error;
+        }
+#ifdef JCLASS_ZLIB
+        deflateReset(&jar->stream);
+        jar->stream.next_in = (Bytef *)data;
+        jar->stream.avail_in = (uInt)length;
+        jar->stream.next_out = jar->deflated;
+        jar->stream.avail_out = (uInt)bound;
+        size_t deflated_length = deflate(&jar->stream, Z_FINISH) == Z_STREAM_END ? (size_t)jar->stream.total_out : 0;
+#else
+        // entries that do not get smaller are stored instead
+        size_t deflated_length = jc_jar_deflate(jar, data, length, jar->deflated, length - 1);
+#endif
+        if (deflated_length != 0 && deflated_length < length) {
+            method = JCLASS_JAR_DEFLATED;
+            contents = jar->deflated;
+            stored_length = deflated_length;
+        }
+    }
+    if (jar->offset + 30 + name_length + stored_length > 0xFFFFFFFFu) {
+        return jc_jar_set_error(jar, JCLASS_ERR_RANGE);
+    }
+
+    // local file header, the date is always 1980-01-01 so builds are reproducible
+    uint8_t header[30];
+    jc_store_le32(header, 0x04034b50);
+    jc_store_le16(header + 4, method == JCLASS_JAR_DEFLATED ? 20 : 10); // version needed to extract
+    jc_store_le16(header + 6, 0x0800);                                  // names are UTF-8
+    jc_store_le16(header + 8, method);
+    jc_store_le16(header + 10, 0);                                      // time
+    jc_store_le16(header + 12, 0x0021);                                 // date
+    jc_store_le32(header + 14, crc);
+    jc_store_le32(header + 18, (uint32_t)stored_length);
+    jc_store_le32(header + 22, (uint32_t)length);
+    jc_store_le16(header + 26, (uint16_t)name_length);
+    jc_store_le16(header + 28, 0);                                      // extra field length
+    if (fwrite(header, 1, 30, jar->file) != 30 || fwrite(name, 1, name_length, jar->file) != name_length ||
+        fwrite(contents, 1, stored_length, jar->file) != stored_length) {
+        return jc_jar_set_error(jar, JCLASS_ERR_IO);
+    }
+
+    // central directory header, the same fields with the offset of the local one
+    if (!jc_jar_grow(jar, &jar->central, &jar->central_capacity, jar->central_length + 46 + name_length)) {
+        return jar->error;
     }
+    uint8_t *entry = jar->central + jar->central_length;
+    jc_store_le32(entry, 0x02014b50);
+    jc_store_le16(entry + 4, 20);                                       // version made by
+    memcpy(entry + 6, header + 4, 26);                                  // version needed to name length
+    jc_store_le16(entry + 32, 0);                                       // file comment length
+    jc_store_le16(entry + 34, 0);                                       // disk number
+    jc_store_le16(entry + 36, 0);                                       // internal attributes
+    jc_store_le32(entry + 38, 0);                                       // external attributes
+    jc_store_le32(entry + 42, (uint32_t)jar->offset);
+    memcpy(entry + 46, name, name_length);
+    jar->central_length += 46 + name_length;
+    jar->offset += 30 + name_length + stored_length;
+    jar->entries++;
+    return JCLASS_OK;
 }
 
-void lmul() {
-    // macro lmul { db 0x69 }
-    emit_u1(0x69);
+/**
+    @brief Adds the class built with a context to a jar, writing its constant pool first like jc_write_class
+    @param name Path of the entry in the jar, NULL to use the name of the class followed by .class
+    @return JCLASS_OK, the error of the context, or the first error of the jar
+    
+*/
+int jc_jar_add_class(jclass_jar *jar, jclass_ctx *ctx, const char *name) {
+    char *generated = NULL;
+    if (name == NULL) {
+        size_t offset;
+        int32_t length = jc_cp_class_name(ctx, ctx->this_class, &offset);
+        if (length < 0 || !(generated = malloc((size_t)length + 7))) {
+            return jc_jar_set_error(jar, length < 0 ? JCLASS_ERR_STATE : JCLASS_ERR_NOMEM);
+        }
+        memcpy(generated, ctx->cpBuffer + offset, (size_t)length);
+        memcpy(generated + length, ".class", 7);
+        name = generated;
+    }
+    int result = jc_finish_class(ctx);
+    if (result == JCLASS_OK) {
+        result = jc_jar_add(jar, name, ctx->outputBuffer, ctx->outputIndex);
+    }
+    free(generated);
+    return result;
 }
 
-void lneg() {
-    // macro lneg { db 0x75 }
-    emit_u1(0x75);
+/**
+    @brief Writes the central directory of a jar and closes it
+    @return JCLASS_OK, or the first error of the jar
+    
+*/
+int jc_jar_close(jclass_jar *jar) {
+    if (jar->file) {
+        uint8_t end[22];
+        jc_store_le32(end, 0x06054b50);
+        jc_store_le16(end + 4, 0);                              // number of this disk
+        jc_store_le16(end + 6, 0);                              // disk the central directory starts on
+        jc_store_le16(end + 8, (uint16_t)jar->entries);         // entries on this disk
+        jc_store_le16(end + 10, (uint16_t)jar->entries);        // entries
+        jc_store_le32(end + 12, (uint32_t)jar->central_length);
+        jc_store_le32(end + 16, (uint32_t)jar->offset);
+        jc_store_le16(end + 20, 0);                             // comment length
+        if (jar->offset + jar->central_length > 0xFFFFFFFFu) {
+            jc_jar_set_error(jar, JCLASS_ERR_RANGE);
+        } else if ((jar->central_length && fwrite(jar->central, 1, jar->central_length, jar->file) != jar->central_length) ||
+                   fwrite(end, 1, sizeof(end), jar->file) != sizeof(end)) {
+            jc_jar_set_error(jar, JCLASS_ERR_IO);
+        }
+        if (fclose(jar->file) != 0) {
+            jc_jar_set_error(jar, JCLASS_ERR_IO);
+        }
+        jar->file = NULL;
+#ifdef JCLASS_ZLIB
+        if (jar->method == JCLASS_JAR_DEFLATED) {
+            deflateEnd(&jar->stream);
+        }
+#endif
+    }
+#ifndef JCLASS_ZLIB
+    free(jar->match_head);
+    free(jar->match_prev);
+    jar->match_head = NULL;
+    jar->match_prev = NULL;
+#endif
+    free(jar->central);
+    free(jar->deflated);
+    jar->central = NULL;
+    jar->deflated = NULL;
+    return jar->error;
 }
 
-// macro lookupswitch is commented out
+// ------------------------
+// batched file output
+// ------------------------
 
-void lor() {
-    // macro lor { db 0x81 }
-    emit_u1(0x81);
-}
+/**
+ * @brief A class file waiting to be written by a jclass_writer
+ * 
+ */
+typedef struct jclass_write_job {
+    char *path;         // file to write, owned by the job
+    uint8_t *data;      // contents, owned by the job
+    size_t length;      // size of data
+    size_t ticket;      // number given by jc_writer_submit
+    int result;         // JCLASS_OK or JCLASS_ERR_IO once written
+} jclass_write_job;
 
-void lrem() {
-    // macro lrem { db 0x71 }
-    emit_u1(0x71);
-}
+/**
+ * @brief Writes class files in batches on a thread of its own, so the threads building classes do not wait
+ * for the file system
+ *
+ * Without C11 threads (or with JCLASS_NO_THREADS defined) files are written right away by jc_writer_submit,
+ * with the same results.
+ */
+typedef struct jclass_writer {
+#ifdef JCLASS_THREADS
+    /** @brief Guards everything below */
+    mtx_t lock;
+    /** @brief Signalled when files are queued or the writer is closing */
+    cnd_t queued;
+    /** @brief Signalled when a batch has been written */
+    cnd_t written;
+    /** @brief The writing thread */
+    thrd_t thread;
+#endif
+    /** @brief Files waiting to be written */
+    jclass_write_job *jobs;
+    /** @brief Number of entries in jobs */
+    size_t job_count;
+    /** @brief Allocated length of jobs */
+    size_t jobs_capacity;
+    /** @brief Bytes waiting to be written */
+    size_t queued_bytes;
+    /** @brief jc_writer_submit waits while more than this many bytes are waiting, 0 for no limit */
+    size_t max_queued_bytes;
+    /** @brief JCLASS_OK, JCLASS_ERR_IO or JCLASS_WRITE_PENDING for each file, indexed by ticket */
+    uint8_t *results;
+    /** @brief Allocated length of results */
+    size_t results_capacity;
+    /** @brief Number of files submitted */
+    size_t submitted;
+    /** @brief Number of files written or failed */
+    size_t completed;
+    /** @brief First error of a file since the last jc_writer_flush */
+    int error;
+    /** @brief Set by jc_writer_close to stop the thread */
+    int closing;
+} jclass_writer;
+
+/** @brief Result of a file that has not been written yet */
+#define JCLASS_WRITE_PENDING 0xFF
 
-void lreturn() {
-    // macro lreturn { db 0xad }
-    emit_u1(0xad);
+/**
+    @brief Helper function. Writes the files of a batch and frees their contents
+    
+*/
+static void jc_writer_write_batch(jclass_write_job *jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        FILE *file = fopen(jobs[i].path, "wb");
+        jobs[i].result = JCLASS_ERR_IO;
+        if (file) {
+            size_t written = fwrite(jobs[i].data, 1, jobs[i].length, file);
+            if (fclose(file) == 0 && written == jobs[i].length) {
+                jobs[i].result = JCLASS_OK;
+            }
+        }
+        free(jobs[i].path);
+        free(jobs[i].data);
+    }
 }
 
-void lshl() {
-    // macro lshl { db 0x79 }
-    emit_u1(0x79);
+/**
+    @brief Helper function. Records the results of a written batch. The lock has to be held
+    
+*/
+static void jc_writer_complete(jclass_writer *writer, const jclass_write_job *jobs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        writer->results[jobs[i].ticket] = (uint8_t)jobs[i].result;
+        if (jobs[i].result != JCLASS_OK && writer->error == JCLASS_OK) {
+            writer->error = jobs[i].result;
+        }
+        writer->queued_bytes -= jobs[i].length;
+    }
+    writer->completed += count;
 }
 
-void lshr() {
-    // macro lshr { db 0x7b }
-    emit_u1(0x7b);
-}
+#ifdef JCLASS_THREADS
 
-void lstore(uint16_t index) {
-    // macro lstore index { if index>=0 & index<=3 ... }
-    if (index <= 3) {
-        emit_u1(0x3f + index);
-    } else if (index < 0x100) {
-        emit_u1(0x37);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0x37);
-        emit_u2(index);
+/**
+    @brief Helper function. The writing thread, takes every queued file at once and writes them without holding the lock
+    
+*/
+static int jc_writer_thread(void *arg) {
+    jclass_writer *writer = arg;
+    jclass_write_job *batch = NULL;
+    size_t batch_capacity = 0;
+    mtx_lock(&writer->lock);
+    for (;;) {
+        while (writer->job_count == 0 && !writer->closing) {
+            cnd_wait(&writer->queued, &writer->lock);
+        }
+        if (writer->job_count == 0) {
+            break;
+        }
+        // swap the queue with the empty batch so files can be queued while these are written
+        jclass_write_job *jobs = writer->jobs;
+        size_t count = writer->job_count, capacity = writer->jobs_capacity;
+        writer->jobs = batch;
+        writer->jobs_capacity = batch_capacity;
+        writer->job_count = 0;
+        batch = jobs;
+        batch_capacity = capacity;
+        mtx_unlock(&writer->lock);
+        jc_writer_write_batch(batch, count);
+        mtx_lock(&writer->lock);
+        jc_writer_complete(writer, batch, count);
+        cnd_broadcast(&writer->written);
     }
+    mtx_unlock(&writer->lock);
+    free(batch);
+    return 0;
 }
 
-void lsub() {
-    // macro lsub { db 0x65 }
-    emit_u1(0x65);
-}
+#endif
 
-void lushr() {
-    // macro lushr { db 0x7d }
-    emit_u1(0x7d);
+/**
+    @brief Starts a writer
+    @param max_queued_bytes jc_writer_submit waits while more than this many bytes are waiting to be written, 0 for no limit
+    @return JCLASS_OK, or JCLASS_ERR_NOMEM if the thread could not be started
+    
+*/
+int jc_writer_open(jclass_writer *writer, size_t max_queued_bytes) {
+    memset(writer, 0, sizeof(*writer));
+    writer->max_queued_bytes = max_queued_bytes;
+#ifdef JCLASS_THREADS
+    if (mtx_init(&writer->lock, mtx_plain) != thrd_success) {
+        return JCLASS_ERR_NOMEM;
+    }
+    if (cnd_init(&writer->queued) != thrd_success) {
+        mtx_destroy(&writer->lock);
+        return JCLASS_ERR_NOMEM;
+    }
+    if (cnd_init(&writer->written) != thrd_success) {
+        cnd_destroy(&writer->queued);
+        mtx_destroy(&writer->lock);
+        return JCLASS_ERR_NOMEM;
+    }
+    if (thrd_create(&writer->thread, jc_writer_thread, writer) != thrd_success) {
+        cnd_destroy(&writer->written);
+        cnd_destroy(&writer->queued);
+        mtx_destroy(&writer->lock);
+        return JCLASS_ERR_NOMEM;
+    }
+#endif
+    return JCLASS_OK;
 }
 
-void lxor() {
-    // macro lxor { db 0x83 }
-    emit_u1(0x83);
+/**
+    @brief Queues a file to be written. The writer takes over data, which has to come from malloc
+    (jc_finish_take gives such a buffer), and frees it once it is written
+    @param path File to write, copied
+    @param data Contents of the file
+    @param length Size of data
+    @param ticket Set to the number to pass to jc_writer_result for this file, can be NULL
+    @return JCLASS_OK or JCLASS_ERR_NOMEM, in which case data is freed
+    
+*/
+int jc_writer_submit(jclass_writer *writer, const char *path, uint8_t *data, size_t length, size_t *ticket) {
+    size_t path_length = strlen(path) + 1;
+    char *copy = malloc(path_length);
+    if (!copy) {
+        free(data);
+        return JCLASS_ERR_NOMEM;
+    }
+    memcpy(copy, path, path_length);
+#ifdef JCLASS_THREADS
+    mtx_lock(&writer->lock);
+    while (writer->max_queued_bytes && writer->queued_bytes && writer->queued_bytes + length > writer->max_queued_bytes) {
+        cnd_wait(&writer->written, &writer->lock);
+    }
+#endif
+    int result = JCLASS_OK;
+    if (writer->submitted >= writer->results_capacity) {
+        size_t capacity = writer->results_capacity ? writer->results_capacity * 2 : 64;
+        uint8_t *results = realloc(writer->results, capacity);
+        if (results) {
+            writer->results = results;
+            writer->results_capacity = capacity;
+        } else {
+            result = JCLASS_ERR_NOMEM;
+        }
+    }
+    if (result == JCLASS_OK && writer->job_count >= writer->jobs_capacity) {
+        size_t capacity = writer->jobs_capacity ? writer->jobs_capacity * 2 : 16;
+        jclass_write_job *jobs = realloc(writer->jobs, capacity * sizeof(jclass_write_job));
+        if (jobs) {
+            writer->jobs = jobs;
+            writer->jobs_capacity = capacity;
+        } else {
+            result = JCLASS_ERR_NOMEM;
+        }
+    }
+    if (result != JCLASS_OK) {
+#ifdef JCLASS_THREADS
+        mtx_unlock(&writer->lock);
+#endif
+        free(copy);
+        free(data);
+        return result;
+    }
+    jclass_write_job *job = &writer->jobs[writer->job_count++];
+    job->path = copy;
+    job->data = data;
+    job->length = length;
+    job->ticket = writer->submitted;
+    job->result = JCLASS_WRITE_PENDING;
+    writer->results[writer->submitted] = JCLASS_WRITE_PENDING;
+    if (ticket) {
+        *ticket = writer->submitted;
+    }
+    writer->submitted++;
+    writer->queued_bytes += length;
+#ifdef JCLASS_THREADS
+    cnd_signal(&writer->queued);
+    mtx_unlock(&writer->lock);
+#else
+    jc_writer_write_batch(writer->jobs, writer->job_count);
+    jc_writer_complete(writer, writer->jobs, writer->job_count);
+    writer->job_count = 0;
+#endif
+    return JCLASS_OK;
 }
 
-void monitorenter() {
-    // macro monitorenter { db 0xc2 }
-    emit_u1(0xc2);
+/**
+    @brief Finishes the class built with a context and queues it to be written. The context's buffer is
+    handed to the writer, so the context has to be reset before it builds another class
+    @param path File to write
+    @param ticket Set to the number to pass to jc_writer_result for this file, can be NULL
+    @return JCLASS_OK, the error that happened while building the class, or JCLASS_ERR_NOMEM
+    
+*/
+int jc_writer_submit_class(jclass_writer *writer, jclass_ctx *ctx, const char *path, size_t *ticket) {
+    uint8_t *data;
+    size_t length;
+    int result = jc_finish_take(ctx, &data, &length);
+    if (result != JCLASS_OK) {
+        return result;
+    }
+    return jc_writer_submit(writer, path, data, length, ticket);
 }
 
-void monitorexit() {
-    // macro monitorexit { db 0xc3 }
-    emit_u1(0xc3);
+/**
+    @brief Waits until every file submitted so far has been written
+    @return JCLASS_OK, or the first error of a file since the last flush
+    
+*/
+int jc_writer_flush(jclass_writer *writer) {
+#ifdef JCLASS_THREADS
+    mtx_lock(&writer->lock);
+    while (writer->completed != writer->submitted) {
+        cnd_wait(&writer->written, &writer->lock);
+    }
+#endif
+    int result = writer->error;
+    writer->error = JCLASS_OK;
+#ifdef JCLASS_THREADS
+    mtx_unlock(&writer->lock);
+#endif
+    return result;
 }
 
-void multianewarray(uint16_t index, uint8_t dimensions) {
-    // macro multianewarray index,dimensions { db 0xc5,(index) shr 8,(index) and 0FFh,dimensions }
-    emit_u1(0xc5);
-    emit_u2(index);
-    emit_u1(dimensions);
+/**
+    @brief Gets the result of one file
+    @param ticket The number jc_writer_submit gave the file
+    @return JCLASS_OK, JCLASS_ERR_IO if it could not be written, JCLASS_WRITE_PENDING if it has not been written yet,
+    or JCLASS_ERR_RANGE if no file was given that ticket
+    
+*/
+int jc_writer_result(jclass_writer *writer, size_t ticket) {
+    int result = JCLASS_ERR_RANGE;
+#ifdef JCLASS_THREADS
+    mtx_lock(&writer->lock);
+#endif
+    if (ticket < writer->submitted) {
+        result = writer->results[ticket];
+    }
+#ifdef JCLASS_THREADS
+    mtx_unlock(&writer->lock);
+#endif
+    return result;
 }
 
-void new_inst(uint16_t index) {
-    // macro new index { db 0xbb,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xbb);
-    emit_u2(index);
+/**
+    @brief Writes every submitted file, stops the writer and frees it
+    @return JCLASS_OK, or the first error of a file since the last flush
+    
+*/
+int jc_writer_close(jclass_writer *writer) {
+    int result = jc_writer_flush(writer);
+#ifdef JCLASS_THREADS
+    mtx_lock(&writer->lock);
+    writer->closing = 1;
+    cnd_signal(&writer->queued);
+    mtx_unlock(&writer->lock);
+    thrd_join(writer->thread, NULL);
+    cnd_destroy(&writer->written);
+    cnd_destroy(&writer->queued);
+    mtx_destroy(&writer->lock);
+#endif
+    free(writer->jobs);
+    free(writer->results);
+    writer->jobs = NULL;
+    writer->results = NULL;
+    return result;
 }
 
-void newarray(uint8_t atype) {
-    // macro newarray atype { db 0xbc,atype }
-    emit_u1(0xbc);
-    emit_u1(atype);
-}
+// ------------------------
+// parallel generation
+// ------------------------
 
-void nop() {
-    // macro nop { db 0x00 }
-    emit_u1(0x00);
-}
+/**
+ * @brief Builds one class with the context it is given, returns JCLASS_OK or an error code
+ * 
+ */
+typedef int (*jclass_generator)(jclass_ctx *ctx, void *user);
 
-void pop_inst() {
-    // macro pop { db 0x57 }
-    emit_u1(0x57);
-}
+/**
+ * @brief A class to build with jc_generate
+ * 
+ */
+typedef struct jclass_job {
+    jclass_generator generate;  // called with a reset context
+    void *user;                 // passed to generate as it is
+} jclass_job;
 
-void pop2() {
-    // macro pop2 { db 0x58 }
-    emit_u1(0x58);
-}
+/**
+ * @brief A class built by jc_generate
+ * 
+ */
+typedef struct jclass_output {
+    uint8_t *data;      // the class file, to be freed with free(), NULL if it could not be built
+    size_t length;      // size of data
+    int error;          // JCLASS_OK, or what the generator or the context reported
+} jclass_output;
 
-void putfield(uint16_t index) {
-    // macro putfield index { db 0xb5,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb5);
-    emit_u2(index);
-}
+/**
+ * @brief Jobs a worker of jc_generate has left, stolen from the back by the other workers
+ * 
+ */
+typedef struct jclass_worker {
+#ifdef JCLASS_THREADS
+    _Atomic uint64_t range;             // first job in the high 32 bits, one past the last in the low 32 bits
+    char padding[64 - sizeof(uint64_t)];// keeps workers on separate cache lines
+    struct jclass_pool *pool;           // what the worker belongs to
+    thrd_t thread;                      // the worker's thread, unused for the calling thread
+#else
+    uint64_t range;
+    struct jclass_pool *pool;
+#endif
+} jclass_worker;
 
-void putstatic(uint16_t index) {
-    // macro putstatic index { db 0xb3,(index) shr 8,(index) and 0FFh }
-    emit_u1(0xb3);
-    emit_u2(index);
-}
+/**
+ * @brief The state shared by the workers of jc_generate
+ * 
+ */
+typedef struct jclass_pool {
+    const jclass_job *jobs;     // classes to build
+    jclass_output *outputs;     // their results, in the same order
+    jclass_worker *workers;     // one per thread
+    size_t worker_count;        // number of workers
+} jclass_pool;
 
-void ret_inst(uint16_t index) {
-    // macro ret index { if index<100h ... }
-    if (index < 0x100) {
-        emit_u1(0xa9);
-        emit_u1((uint8_t)index);
-    } else {
-        emit_u1(0xc4);
-        emit_u1(0xa9);
-        emit_u2(index);
+/**
+    @brief Helper function. Builds one class with a worker's context and copies it out, so the
+    context keeps its buffers for the next class
+    
+*/
+static void jc_generate_one(jclass_ctx *ctx, const jclass_job *job, jclass_output *output) {
+    jc_ctx_reset(ctx);
+    // nothing carries over from the class before
+    ctx->flags = 0;
+    ctx->major_version = 0;
+    ctx->minor_version = 0;
+    ctx->code_pass = NULL;
+    ctx->code_pass_user = NULL;
+    ctx->peephole = 0;
+    ctx->common_superclass = NULL;
+    ctx->common_superclass_user = NULL;
+    const uint8_t *data;
+    size_t length;
+    int result = job->generate(ctx, job->user);
+    if (result == JCLASS_OK) {
+        result = jc_finish(ctx, &data, &length);
     }
+    output->data = NULL;
+    output->length = 0;
+    if (result == JCLASS_OK) {
+        output->data = malloc(length ? length : 1);
+        if (output->data) {
+            memcpy(output->data, data, length);
+            output->length = length;
+        } else {
+            result = JCLASS_ERR_NOMEM;
+        }
+    }
+    output->error = result;
 }
 
-void return_inst() {
-    // macro return { db 0xb1 }
-    emit_u1(0xb1);
-}
+#ifdef JCLASS_THREADS
 
-void saload() {
-    // macro saload { db 0x35 }
-    emit_u1(0x35);
+/**
+    @brief Helper function. Takes the next job of a worker's own range
+    @return 1 and the job in *job, or 0 if the range is empty
+    
+*/
+static int jc_worker_pop(jclass_worker *worker, uint32_t *job) {
+    uint64_t range = atomic_load(&worker->range);
+    for (;;) {
+        uint32_t begin = (uint32_t)(range >> 32), end = (uint32_t)range;
+        if (begin >= end) {
+            return 0;
+        }
+        if (atomic_compare_exchange_weak(&worker->range, &range, ((uint64_t)(begin + 1) << 32) | end)) {
+            *job = begin;
+            return 1;
+        }
+    }
 }
 
-void sastore() {
-    // macro sastore { db 0x56 }
-    emit_u1(0x56);
+/**
+    @brief Helper function. Moves the back half of another worker's range to this one
+    @return 1 if jobs were stolen, 0 if every other worker is out of jobs
+    
+*/
+static int jc_worker_steal(jclass_worker *worker) {
+    jclass_pool *pool = worker->pool;
+    size_t self = (size_t)(worker - pool->workers);
+    for (size_t k = 1; k < pool->worker_count; k++) {
+        jclass_worker *victim = &pool->workers[(self + k) % pool->worker_count];
+        uint64_t range = atomic_load(&victim->range);
+        for (;;) {
+            uint32_t begin = (uint32_t)(range >> 32), end = (uint32_t)range;
+            if (begin >= end) {
+                break;
+            }
+            uint32_t middle = end - (end - begin + 1) / 2;
+            if (atomic_compare_exchange_weak(&victim->range, &range, ((uint64_t)begin << 32) | middle)) {
+                atomic_store(&worker->range, ((uint64_t)middle << 32) | end);
+                return 1;
+            }
+        }
+    }
+    return 0;
 }
 
-void sipush(uint16_t value) {
-    // macro sipush short { db 0x11,(short) shr 8,(short) and 0FFh }
-    emit_u1(0x11);
-    emit_u2(value);
-}
+/**
+    @brief Helper function. Runs a worker until no worker has jobs left
+    
+*/
+static int jc_worker_run(void *arg) {
+    jclass_worker *worker = arg;
+    jclass_pool *pool = worker->pool;
+    jclass_ctx ctx;
+    jc_ctx_init(&ctx);
+    uint32_t job;
+    do {
+        while (jc_worker_pop(worker, &job)) {
+            jc_generate_one(&ctx, &pool->jobs[job], &pool->outputs[job]);
+        }
+    } while (jc_worker_steal(worker));
+    jc_ctx_destroy(&ctx);
+    return 0;
+}
+
+#endif
 
-void swap() {
-    // macro swap { db 0x5f }
-    emit_u1(0x5f);
+/**
+    @brief Builds many classes on several threads. Every thread reuses one context, reset between classes
+    and with no flags and the default version at the start of each, and idle threads take jobs from busy ones
+    @param jobs The classes to build
+    @param count Number of jobs
+    @param threads Number of threads to use, including the calling one. Without C11 threads every class is
+    built on the calling thread
+    @param outputs Filled with the class files, in the same order as jobs
+    @return JCLASS_OK, or the error of the first job that failed
+    
+*/
+int jc_generate(const jclass_job *jobs, size_t count, unsigned threads, jclass_output *outputs) {
+    if (count > UINT32_MAX) {
+        return JCLASS_ERR_RANGE;
+    }
+#ifdef JCLASS_THREADS
+    if (threads > count) {
+        threads = (unsigned)count;
+    }
+    if (threads > 1) {
+        jclass_pool pool = { jobs, outputs, calloc(threads, sizeof(jclass_worker)), threads };
+        if (pool.workers) {
+            // every worker starts with an equal share of the jobs
+            for (size_t i = 0; i < threads; i++) {
+                uint64_t begin = count * i / threads, end = count * (i + 1) / threads;
+                atomic_init(&pool.workers[i].range, (begin << 32) | end);
+                pool.workers[i].pool = &pool;
+            }
+            size_t started = 1;
+            while (started < threads && thrd_create(&pool.workers[started].thread, jc_worker_run, &pool.workers[started]) == thrd_success) {
+                started++;
+            }
+            // the calling thread is worker 0, and steals the jobs of any thread that did not start
+            jc_worker_run(&pool.workers[0]);
+            for (size_t i = 1; i < started; i++) {
+                thrd_join(pool.workers[i].thread, NULL);
+            }
+            free(pool.workers);
+            goto done;
+        }
+    }
+#else
+    (void)threads;
+#endif
+    {
+        jclass_ctx ctx;
+        jc_ctx_init(&ctx);
+        for (size_t i = 0; i < count; i++) {
+            jc_generate_one(&ctx, &jobs[i], &outputs[i]);
+        }
+        jc_ctx_destroy(&ctx);
+    }
+#ifdef JCLASS_THREADS
+done:
+#endif
+    for (size_t i = 0; i < count; i++) {
+        if (outputs[i].error != JCLASS_OK) {
+            return outputs[i].error;
+        }
+    }
+    return JCLASS_OK;
 }
 
-// macro tableswitch is commented out
+// ------------------------
+// hot constants
+// ------------------------
 
-void breakpoint() {
-    // macro breakpoint { db 0xca }
-    emit_u1(0xca);
-}
+/**
+ * @brief A constant that ldc loads in the first build of jc_build_ordered
+ *
+ */
+typedef struct jclass_hot_constant {
+    uint16_t index;     // index in the first build
+    uint8_t tag;        // Integer, Float, Class, String or MethodType
+    uint32_t uses;      // weighted ldc uses
+    size_t offset;      // where its bytes were saved, the UTF-8 entry it refers to for Class, String and MethodType
+    size_t length;      // number of bytes saved
+    uint16_t utf8;      // index its UTF-8 entry gets in the second build
+} jclass_hot_constant;
 
-void impdep1() {
-    // macro impdep1 { db 0xfe }
-    emit_u1(0xfe);
+/**
+    @brief Helper function. Orders constants by uses, most used first, then by their index
+    
+*/
+static int jc_hot_constant_compare(const void *a, const void *b) {
+    const jclass_hot_constant *x = a, *y = b;
+    if (x->uses != y->uses) {
+        return x->uses > y->uses ? -1 : 1;
+    }
+    return x->index < y->index ? -1 : x->index > y->index;
 }
 
-void impdep2() {
-    // macro impdep2 { db 0xff }
-    emit_u1(0xff);
-}
-void impdep2_dup() {
-    // duplicate definition as in original code
-    emit_u1(0xff);
+/**
+    @brief Helper function. Appends a copy of an entry and gives it the next index, even if the pool has it already
+    
+*/
+static void jc_cp_append_entry(jclass_ctx *ctx, const uint8_t *entry, size_t length) {
+    uint8_t *dst = jc_cp_append(ctx, length);
+    if (dst) {
+        memcpy(dst, entry, length);
+        jc_increment_cp_counter(ctx, 1);
+    }
 }
 
-static void emit_class_header() {
-    // Magic number
-    emit_u4(0xCAFEBABE);
+/**
+    @brief Builds a class twice so the constants ldc loads most get the indices below 256 that ldc reaches,
+    sparing each load the extra byte of ldc_w. The first build counts the ldc uses of every constant, and if
+    any loaded constant ended up past 255, the second build starts with the most used Integer, Float, Class,
+    String and MethodType constants at indices 1 to 255 and their UTF-8 entries after them. Classes that
+    copy a read class's constant pool keep its order
+    @param generate Builds the class with ctx, and has to add the same constants both times. The context is
+    reset before each build, and the class is finished by the caller
+    @param user Passed to generate as it is
+    @return JCLASS_OK, the error generate returned, or the error that happened while building the class
     
-    // Version: Java 8
-    emit_u2(0);     // minor_version
-    emit_u2(52);    // major_version
+*/
+int jc_build_ordered(jclass_ctx *ctx, jclass_generator generate, void *user) {
+    jc_ctx_reset(ctx);
+    if (ctx->ldc_uses) {
+        memset(ctx->ldc_uses, 0, ctx->ldc_uses_capacity * sizeof(uint32_t));
+    }
+    ctx->count_ldc = 1;
+    int result = generate(ctx, user);
+    ctx->count_ldc = 0;
+    if (result == JCLASS_OK) {
+        result = ctx->error;
+    }
+    if (result != JCLASS_OK || ctx->cp_source) {
+        return result;
+    }
+    size_t end = ctx->constant_pool_counter < ctx->ldc_uses_capacity ? ctx->constant_pool_counter : ctx->ldc_uses_capacity;
+    size_t count = 0, far = 0, bytes = 0;
+    jclass_hot_constant *hot = malloc((end ? end : 1) * sizeof(jclass_hot_constant));
+    if (!hot) {
+        return JCLASS_ERR_NOMEM;
+    }
+    for (size_t index = 1; index < end; index++) {
+        uint8_t tag = jc_cp_tag(ctx, (uint16_t)index);
+        if (ctx->ldc_uses[index] && (tag == 3 || tag == 4 || tag == 7 || tag == 8 || tag == 16)) {
+            const uint8_t *entry = ctx->cpBuffer + ctx->cp_entries[index].offset;
+            jclass_hot_constant *constant = &hot[count++];
+            constant->index = (uint16_t)index;
+            constant->tag = tag;
+            constant->uses = ctx->ldc_uses[index];
+            if (tag == 3 || tag == 4) {
+                constant->offset = ctx->cp_entries[index].offset;
+            } else {
+                constant->offset = ctx->cp_entries[jc_load_u2(entry + 1)].offset;
+            }
+            constant->length = jc_cp_entry_size(ctx->cpBuffer + constant->offset);
+            far += index > 0xFF;
+        }
+    }
+    if (far == 0) {
+        // every ldc already reaches its constant, the first build is kept
+        free(hot);
+        return JCLASS_OK;
+    }
+    qsort(hot, count, sizeof(jclass_hot_constant), jc_hot_constant_compare);
+    count = count < 0xFF ? count : 0xFF;
+    for (size_t i = 0; i < count; i++) {
+        bytes += hot[i].length;
+    }
+    // the pool is rebuilt from scratch, so the bytes are saved before the reset
+    uint8_t *saved = malloc(bytes ? bytes : 1);
+    if (!saved) {
+        free(hot);
+        return JCLASS_ERR_NOMEM;
+    }
+    uint16_t next_utf8 = (uint16_t)(count + 1);
+    for (size_t i = 0, at = 0; i < count; i++) {
+        memcpy(saved + at, ctx->cpBuffer + hot[i].offset, hot[i].length);
+        hot[i].offset = at;
+        at += hot[i].length;
+        hot[i].utf8 = 0;
+        if (hot[i].tag == 3 || hot[i].tag == 4) {
+            continue;
+        }
+        // a class and a string of the same name share their UTF-8 entry
+        for (size_t j = 0; j < i && hot[i].utf8 == 0; j++) {
+            if (hot[j].utf8 && hot[j].length == hot[i].length && memcmp(saved + hot[j].offset, saved + hot[i].offset, hot[i].length) == 0) {
+                hot[i].utf8 = hot[j].utf8;
+            }
+        }
+        if (hot[i].utf8 == 0) {
+            hot[i].utf8 = next_utf8++;
+        }
+    }
+    jc_ctx_reset(ctx);
+    for (size_t i = 0; i < count; i++) {
+        if (hot[i].utf8 == 0) {
+            jc_cp_append_entry(ctx, saved + hot[i].offset, hot[i].length);
+        } else {
+            uint8_t entry[3] = {hot[i].tag, (uint8_t)(hot[i].utf8 >> 8), (uint8_t)hot[i].utf8};
+            jc_cp_append_entry(ctx, entry, sizeof(entry));
+        }
+    }
+    for (size_t i = 0; i < count; i++) {
+        if (hot[i].utf8 == ctx->constant_pool_counter) {
+            jc_cp_append_entry(ctx, saved + hot[i].offset, hot[i].length);
+        }
+    }
+    free(saved);
+    free(hot);
+    result = generate(ctx, user);
+    return result == JCLASS_OK ? ctx->error : result;
 }
 
-static void emit_class_footer(uint16_t this_class, uint8_t this_class_flags, uint16_t super_class) {
-    emit_u2(this_class_flags);
+/**
+    @brief Sets how much each ldc of the current method counts for jc_build_ordered, so constants of methods
+    a profile shows to be hot get the low indices first. method_info sets it back to 1
+    @param weight What each ldc adds to its constant's uses, 0 to not count the method
     
-    // Class references
-    emit_u2(this_class);     // this_class
-    emit_u2(super_class);    // super_class
+*/
+void jc_set_ldc_weight(jclass_ctx *ctx, uint32_t weight) {
+    ctx->ldc_weight = weight;
 }
 
-// Enhanced Code attribute handling
-void code_attribute_start(uint16_t name_index, uint16_t max_stack, uint16_t max_locals) {
-    attribute_start(name_index);
-    emit_u2(max_stack);
-    emit_u2(max_locals);
-    bytecode_start();  // Starts code emission
-}
+#ifndef JCLASS_NO_GLOBAL_API
 
-void code_attribute_end() {
-    bytecode_end();     // Patches code length
-    // Add exception table (empty) and attributes (none)
-    emit_u2(0);        // exception_table_length
-    emit_u2(0);        // attributes_count
-    attribute_end();
-}
+// ------------------------
+// default context API
+// ------------------------
 
-void write_class(char* outputName){
-    FILE *file = fopen(outputName, "wb");
-    if (file) {
-        fwrite(outputBuffer, 1, outputIndex, file);
-        fclose(file);
-    } else {
-        fprintf(stderr, "Failed to open output file\n");
-        return;
-    }
-}
\ No newline at end of file
+/** @brief Context used by the functions without the jc_ prefix */
+static jclass_ctx jclass_default_ctx;
+
+static inline void emit_byte(uint8_t b) { jc_emit_byte(&jclass_default_ctx, b); }
+static inline void emit_bytes(const void *data, size_t len) { jc_emit_bytes(&jclass_default_ctx, data, len); }
+static inline void emit_u1(uint8_t v) { jc_emit_u1(&jclass_default_ctx, v); }
+static inline void emit_u2(uint16_t v) { jc_emit_u2(&jclass_default_ctx, v); }
+static inline void emit_u4(uint32_t v) { jc_emit_u4(&jclass_default_ctx, v); }
+static inline size_t current_offset() { return jc_current_offset(&jclass_default_ctx); }
+static inline void patch_u2(size_t pos, uint16_t v) { jc_patch_u2(&jclass_default_ctx, pos, v); }
+static inline void patch_u4(size_t pos, uint32_t v) { jc_patch_u4(&jclass_default_ctx, pos, v); }
+void constant_pool_start() { jc_constant_pool_start(&jclass_default_ctx); }
+static inline uint16_t increment_cp_counter(uint16_t slots) { return jc_increment_cp_counter(&jclass_default_ctx, slots); }
+uint16_t constant_utf8(const char *string) { return jc_constant_utf8(&jclass_default_ctx, string); }
+uint16_t constant_utf8_len(const char *string, size_t len) { return jc_constant_utf8_len(&jclass_default_ctx, string, len); }
+uint16_t constant_integer(uint32_t value) { return jc_constant_integer(&jclass_default_ctx, value); }
+uint16_t constant_float(uint32_t value) { return jc_constant_float(&jclass_default_ctx, value); }
+uint16_t constant_long(uint64_t value) { return jc_constant_long(&jclass_default_ctx, value); }
+uint16_t constant_double(uint64_t value) { return jc_constant_double(&jclass_default_ctx, value); }
+uint16_t constant_class(uint16_t name_index) { return jc_constant_class(&jclass_default_ctx, name_index); }
+uint16_t constant_string(uint16_t string_index) { return jc_constant_string(&jclass_default_ctx, string_index); }
+uint16_t constant_fieldref(uint16_t class_index, uint16_t name_and_type_index) { return jc_constant_fieldref(&jclass_default_ctx, class_index, name_and_type_index); }
+uint16_t constant_methodref(uint16_t class_index, uint16_t name_and_type_index) { return jc_constant_methodref(&jclass_default_ctx, class_index, name_and_type_index); }
+uint16_t constant_interfacemethodref(uint16_t class_index, uint16_t name_and_type_index) { return jc_constant_interfacemethodref(&jclass_default_ctx, class_index, name_and_type_index); }
+uint16_t constant_nameandtype(uint16_t name_index, uint16_t descriptor_index) { return jc_constant_nameandtype(&jclass_default_ctx, name_index, descriptor_index); }
+uint16_t constant_methodhandle(uint8_t reference_kind, uint16_t reference_index) { return jc_constant_methodhandle(&jclass_default_ctx, reference_kind, reference_index); }
+uint16_t constant_methodtype(uint16_t descriptor_index) { return jc_constant_methodtype(&jclass_default_ctx, descriptor_index); }
+uint16_t constant_dynamic(uint16_t bootstrap_method_attr_index, uint16_t name_and_type_index) { return jc_constant_dynamic(&jclass_default_ctx, bootstrap_method_attr_index, name_and_type_index); }
+uint16_t constant_invokedynamic(uint16_t bootstrap_method_attr_index, uint16_t name_and_type_index) { return jc_constant_invokedynamic(&jclass_default_ctx, bootstrap_method_attr_index, name_and_type_index); }
+uint8_t cp_tag(uint16_t index) { return jc_cp_tag(&jclass_default_ctx, index); }
+uint16_t cp_utf8(const char *string) { return jc_cp_utf8(&jclass_default_ctx, string); }
+uint16_t cp_utf8_len(const char *string, size_t len) { return jc_cp_utf8_len(&jclass_default_ctx, string, len); }
+uint16_t cp_integer(int32_t value) { return jc_cp_integer(&jclass_default_ctx, value); }
+uint16_t cp_float(float value) { return jc_cp_float(&jclass_default_ctx, value); }
+uint16_t cp_long(int64_t value) { return jc_cp_long(&jclass_default_ctx, value); }
+uint16_t cp_double(double value) { return jc_cp_double(&jclass_default_ctx, value); }
+uint16_t cp_class(const char *name) { return jc_cp_class(&jclass_default_ctx, name); }
+uint16_t cp_string(const char *string) { return jc_cp_string(&jclass_default_ctx, string); }
+uint16_t cp_nameandtype(const char *name, const char *descriptor) { return jc_cp_nameandtype(&jclass_default_ctx, name, descriptor); }
+uint16_t cp_fieldref(const char *class_name, const char *name, const char *descriptor) { return jc_cp_fieldref(&jclass_default_ctx, class_name, name, descriptor); }
+uint16_t cp_methodref(const char *class_name, const char *name, const char *descriptor) { return jc_cp_methodref(&jclass_default_ctx, class_name, name, descriptor); }
+uint16_t cp_interfacemethodref(const char *class_name, const char *name, const char *descriptor) { return jc_cp_interfacemethodref(&jclass_default_ctx, class_name, name, descriptor); }
+void constant_pool_end() { jc_constant_pool_end(&jclass_default_ctx); }
+int constant_pool_flush() { return jc_constant_pool_flush(&jclass_default_ctx); }
+void interfaces_start() { jc_interfaces_start(&jclass_default_ctx); }
+void interface_entry(uint16_t interface_val) { jc_interface_entry(&jclass_default_ctx, interface_val); }
+void interfaces_end() { jc_interfaces_end(&jclass_default_ctx); }
+void attributes_start() { jc_attributes_start(&jclass_default_ctx); }
+void attribute_start(uint16_t attribute_name_index) { jc_attribute_start(&jclass_default_ctx, attribute_name_index); }
+void attribute_end() { jc_attribute_end(&jclass_default_ctx); }
+void attributes_end() { jc_attributes_end(&jclass_default_ctx); }
+void fields_start() { jc_fields_start(&jclass_default_ctx); }
+void field_info(uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) { jc_field_info(&jclass_default_ctx, access_flags, name_index, descriptor_index); }
+void end_field_info() { jc_end_field_info(&jclass_default_ctx); }
+void fields_end() { jc_fields_end(&jclass_default_ctx); }
+void methods_start() { jc_methods_start(&jclass_default_ctx); }
+void method_info(uint16_t access_flags, uint16_t name_index, uint16_t descriptor_index) { jc_method_info(&jclass_default_ctx, access_flags, name_index, descriptor_index); }
+void end_method_info() { jc_end_method_info(&jclass_default_ctx); }
+void methods_end() { jc_methods_end(&jclass_default_ctx); }
+void bytecode_start() { jc_bytecode_start(&jclass_default_ctx); }
+void bytecode_end() { jc_bytecode_end(&jclass_default_ctx); }
+void exceptions_start() { jc_exceptions_start(&jclass_default_ctx); }
+void exception_entry(uint16_t start_pc, uint16_t end_pc, uint16_t handler_pc, uint16_t catch_type) { jc_exception_entry(&jclass_default_ctx, start_pc, end_pc, handler_pc, catch_type); }
+void exceptions_end() { jc_exceptions_end(&jclass_default_ctx); }
+void exception_handler(jclass_label start, jclass_label end, jclass_label handler, uint16_t catch_type) { jc_exception_handler(&jclass_default_ctx, start, end, handler, catch_type); }
+void insn_remove(size_t first, size_t count) { jc_insn_remove(&jclass_default_ctx, first, count); }
+int cfg_build(jclass_cfg *cfg) { return jc_cfg_build(&jclass_default_ctx, cfg); }
+void aaload() { jc_aaload(&jclass_default_ctx); }
+void aastore() { jc_aastore(&jclass_default_ctx); }
+void aconst_null() { jc_aconst_null(&jclass_default_ctx); }
+void aload(uint16_t index) { jc_aload(&jclass_default_ctx, index); }
+void anewarray(uint16_t class_index) { jc_anewarray(&jclass_default_ctx, class_index); }
+void areturn() { jc_areturn(&jclass_default_ctx); }
+void arraylength() { jc_arraylength(&jclass_default_ctx); }
+void astore(uint16_t index) { jc_astore(&jclass_default_ctx, index); }
+void athrow() { jc_athrow(&jclass_default_ctx); }
+void baload() { jc_baload(&jclass_default_ctx); }
+void bastore() { jc_bastore(&jclass_default_ctx); }
+void bipush(int8_t byte_val) { jc_bipush(&jclass_default_ctx, byte_val); }
+void caload() { jc_caload(&jclass_default_ctx); }
+void castore() { jc_castore(&jclass_default_ctx); }
+void checkcast(uint16_t class_index) { jc_checkcast(&jclass_default_ctx, class_index); }
+void d2f() { jc_d2f(&jclass_default_ctx); }
+void d2i() { jc_d2i(&jclass_default_ctx); }
+void d2l() { jc_d2l(&jclass_default_ctx); }
+void dadd() { jc_dadd(&jclass_default_ctx); }
+void daload() { jc_daload(&jclass_default_ctx); }
+void dastore() { jc_dastore(&jclass_default_ctx); }
+void dcmpg() { jc_dcmpg(&jclass_default_ctx); }
+void dcmpl() { jc_dcmpl(&jclass_default_ctx); }
+void dconst_0() { jc_dconst_0(&jclass_default_ctx); }
+void dconst_1() { jc_dconst_1(&jclass_default_ctx); }
+void ddiv() { jc_ddiv(&jclass_default_ctx); }
+void dload(uint16_t index) { jc_dload(&jclass_default_ctx, index); }
+void dmul() { jc_dmul(&jclass_default_ctx); }
+void dneg() { jc_dneg(&jclass_default_ctx); }
+void j_drem() { jc_drem(&jclass_default_ctx); }
+void dreturn() { jc_dreturn(&jclass_default_ctx); }
+void dstore(uint16_t index) { jc_dstore(&jclass_default_ctx, index); }
+void dsub() { jc_dsub(&jclass_default_ctx); }
+void dup() { jc_dup(&jclass_default_ctx); }
+void dup_x1() { jc_dup_x1(&jclass_default_ctx); }
+void dup_x2() { jc_dup_x2(&jclass_default_ctx); }
+void dup2() { jc_dup2(&jclass_default_ctx); }
+void dup2_x1() { jc_dup2_x1(&jclass_default_ctx); }
+void dup2_x2() { jc_dup2_x2(&jclass_default_ctx); }
+void f2d() { jc_f2d(&jclass_default_ctx); }
+void f2i() { jc_f2i(&jclass_default_ctx); }
+void f2l() { jc_f2l(&jclass_default_ctx); }
+void fadd() { jc_fadd(&jclass_default_ctx); }
+void faload() { jc_faload(&jclass_default_ctx); }
+void fastore() { jc_fastore(&jclass_default_ctx); }
+void fcmpg() { jc_fcmpg(&jclass_default_ctx); }
+void fcmpl() { jc_fcmpl(&jclass_default_ctx); }
+void fconst_0() { jc_fconst_0(&jclass_default_ctx); }
+void fconst_1() { jc_fconst_1(&jclass_default_ctx); }
+void fconst_2() { jc_fconst_2(&jclass_default_ctx); }
+void fdiv() { jc_fdiv(&jclass_default_ctx); }
+void fload(uint16_t index) { jc_fload(&jclass_default_ctx, index); }
+void fmul() { jc_fmul(&jclass_default_ctx); }
+void fneg() { jc_fneg(&jclass_default_ctx); }
+void frem() { jc_frem(&jclass_default_ctx); }
+void freturn() { jc_freturn(&jclass_default_ctx); }
+void fstore(uint16_t index) { jc_fstore(&jclass_default_ctx, index); }
+void fsub() { jc_fsub(&jclass_default_ctx); }
+void getfield(uint16_t index) { jc_getfield(&jclass_default_ctx, index); }
+void getstatic(uint16_t index) { jc_getstatic(&jclass_default_ctx, index); }
+void goto_inst(size_t branch_target) { jc_goto_inst(&jclass_default_ctx, branch_target); }
+void goto_w_inst(size_t branch_target) { jc_goto_w_inst(&jclass_default_ctx, branch_target); }
+void i2b() { jc_i2b(&jclass_default_ctx); }
+void i2c() { jc_i2c(&jclass_default_ctx); }
+void i2d() { jc_i2d(&jclass_default_ctx); }
+void i2f() { jc_i2f(&jclass_default_ctx); }
+void i2l() { jc_i2l(&jclass_default_ctx); }
+void i2s() { jc_i2s(&jclass_default_ctx); }
+void iadd() { jc_iadd(&jclass_default_ctx); }
+void iaload() { jc_iaload(&jclass_default_ctx); }
+void iand() { jc_iand(&jclass_default_ctx); }
+void iastore() { jc_iastore(&jclass_default_ctx); }
+void iconst_m1() { jc_iconst_m1(&jclass_default_ctx); }
+void iconst_0() { jc_iconst_0(&jclass_default_ctx); }
+void iconst_1() { jc_iconst_1(&jclass_default_ctx); }
+void iconst_2() { jc_iconst_2(&jclass_default_ctx); }
+void iconst_3() { jc_iconst_3(&jclass_default_ctx); }
+void iconst_4() { jc_iconst_4(&jclass_default_ctx); }
+void iconst_5() { jc_iconst_5(&jclass_default_ctx); }
+void idiv() { jc_idiv(&jclass_default_ctx); }
+void if_acmpeq(size_t branch_target) { jc_if_acmpeq(&jclass_default_ctx, branch_target); }
+void if_acmpne(size_t branch_target) { jc_if_acmpne(&jclass_default_ctx, branch_target); }
+void if_icmpeq(size_t branch_target) { jc_if_icmpeq(&jclass_default_ctx, branch_target); }
+void if_icmpne(size_t branch_target) { jc_if_icmpne(&jclass_default_ctx, branch_target); }
+void if_icmplt(size_t branch_target) { jc_if_icmplt(&jclass_default_ctx, branch_target); }
+void if_icmpge(size_t branch_target) { jc_if_icmpge(&jclass_default_ctx, branch_target); }
+void if_icmpgt(size_t branch_target) { jc_if_icmpgt(&jclass_default_ctx, branch_target); }
+void if_icmple(size_t branch_target) { jc_if_icmple(&jclass_default_ctx, branch_target); }
+void ifeq(size_t branch_target) { jc_ifeq(&jclass_default_ctx, branch_target); }
+void ifne(size_t branch_target) { jc_ifne(&jclass_default_ctx, branch_target); }
+void iflt(size_t branch_target) { jc_iflt(&jclass_default_ctx, branch_target); }
+void ifge(size_t branch_target) { jc_ifge(&jclass_default_ctx, branch_target); }
+void ifgt(size_t branch_target) { jc_ifgt(&jclass_default_ctx, branch_target); }
+void ifle(size_t branch_target) { jc_ifle(&jclass_default_ctx, branch_target); }
+void ifnonnull(size_t branch_target) { jc_ifnonnull(&jclass_default_ctx, branch_target); }
+void ifnull(size_t branch_target) { jc_ifnull(&jclass_default_ctx, branch_target); }
+void iinc(uint16_t index, int16_t constant_val) { jc_iinc(&jclass_default_ctx, index, constant_val); }
+void iload(uint16_t index) { jc_iload(&jclass_default_ctx, index); }
+void imul() { jc_imul(&jclass_default_ctx); }
+void ineg() { jc_ineg(&jclass_default_ctx); }
+void instanceof(uint16_t index) { jc_instanceof(&jclass_default_ctx, index); }
+void invokedynamic(uint16_t index) { jc_invokedynamic(&jclass_default_ctx, index); }
+void invokeinterface(uint16_t index, uint8_t count) { jc_invokeinterface(&jclass_default_ctx, index, count); }
+void invokespecial(uint16_t index) { jc_invokespecial(&jclass_default_ctx, index); }
+void invokestatic(uint16_t index) { jc_invokestatic(&jclass_default_ctx, index); }
+void invokevirtual(uint16_t index) { jc_invokevirtual(&jclass_default_ctx, index); }
+void ior() { jc_ior(&jclass_default_ctx); }
+void irem() { jc_irem(&jclass_default_ctx); }
+void ireturn() { jc_ireturn(&jclass_default_ctx); }
+void ishl() { jc_ishl(&jclass_default_ctx); }
+void ishr() { jc_ishr(&jclass_default_ctx); }
+void istore(uint16_t index) { jc_istore(&jclass_default_ctx, index); }
+void isub() { jc_isub(&jclass_default_ctx); }
+void iushr() { jc_iushr(&jclass_default_ctx); }
+void ixor() { jc_ixor(&jclass_default_ctx); }
+void jsr_inst(size_t branch_target) { jc_jsr_inst(&jclass_default_ctx, branch_target); }
+void jsr_w_inst(size_t branch_target) { jc_jsr_w_inst(&jclass_default_ctx, branch_target); }
+void l2d() { jc_l2d(&jclass_default_ctx); }
+void l2f() { jc_l2f(&jclass_default_ctx); }
+void l2i() { jc_l2i(&jclass_default_ctx); }
+void ladd() { jc_ladd(&jclass_default_ctx); }
+void laload() { jc_laload(&jclass_default_ctx); }
+void land() { jc_land(&jclass_default_ctx); }
+void lastore() { jc_lastore(&jclass_default_ctx); }
+void lcmp() { jc_lcmp(&jclass_default_ctx); }
+void lconst_0() { jc_lconst_0(&jclass_default_ctx); }
+void lconst_1() { jc_lconst_1(&jclass_default_ctx); }
+void ldc(uint16_t index) { jc_ldc(&jclass_default_ctx, index); }
+void ldc_w(uint16_t index) { jc_ldc_w(&jclass_default_ctx, index); }
+void ldc2_w(uint16_t index) { jc_ldc2_w(&jclass_default_ctx, index); }
+void j_ldiv() { jc_ldiv(&jclass_default_ctx); }
+void lload(uint16_t index) { jc_lload(&jclass_default_ctx, index); }
+void lmul() { jc_lmul(&jclass_default_ctx); }
+void lneg() { jc_lneg(&jclass_default_ctx); }
+void lor() { jc_lor(&jclass_default_ctx); }
+void lrem() { jc_lrem(&jclass_default_ctx); }
+void lreturn() { jc_lreturn(&jclass_default_ctx); }
+void lshl() { jc_lshl(&jclass_default_ctx); }
+void lshr() { jc_lshr(&jclass_default_ctx); }
+void lstore(uint16_t index) { jc_lstore(&jclass_default_ctx, index); }
+void lsub() { jc_lsub(&jclass_default_ctx); }
+void lushr() { jc_lushr(&jclass_default_ctx); }
+void lxor() { jc_lxor(&jclass_default_ctx); }
+void monitorenter() { jc_monitorenter(&jclass_default_ctx); }
+void monitorexit() { jc_monitorexit(&jclass_default_ctx); }
+void multianewarray(uint16_t index, uint8_t dimensions) { jc_multianewarray(&jclass_default_ctx, index, dimensions); }
+void new_inst(uint16_t index) { jc_new_inst(&jclass_default_ctx, index); }
+void newarray(uint8_t atype) { jc_newarray(&jclass_default_ctx, atype); }
+void nop() { jc_nop(&jclass_default_ctx); }
+void pop_inst() { jc_pop_inst(&jclass_default_ctx); }
+void pop2() { jc_pop2(&jclass_default_ctx); }
+void push_double(double value) { jc_push_double(&jclass_default_ctx, value); }
+void push_float(float value) { jc_push_float(&jclass_default_ctx, value); }
+void push_int(int32_t value) { jc_push_int(&jclass_default_ctx, value); }
+void push_long(int64_t value) { jc_push_long(&jclass_default_ctx, value); }
+void putfield(uint16_t index) { jc_putfield(&jclass_default_ctx, index); }
+void putstatic(uint16_t index) { jc_putstatic(&jclass_default_ctx, index); }
+void ret_inst(uint16_t index) { jc_ret_inst(&jclass_default_ctx, index); }
+void return_inst() { jc_return_inst(&jclass_default_ctx); }
+void saload() { jc_saload(&jclass_default_ctx); }
+void sastore() { jc_sastore(&jclass_default_ctx); }
+void sipush(uint16_t value) { jc_sipush(&jclass_default_ctx, value); }
+void swap() { jc_swap(&jclass_default_ctx); }
+void breakpoint() { jc_breakpoint(&jclass_default_ctx); }
+void impdep1() { jc_impdep1(&jclass_default_ctx); }
+void impdep2() { jc_impdep2(&jclass_default_ctx); }
+void impdep2_dup() { jc_impdep2_dup(&jclass_default_ctx); }
+void emit_class_header() { jc_emit_class_header(&jclass_default_ctx); }
+void emit_class_footer(uint16_t this_class, uint8_t this_class_flags, uint16_t super_class) { jc_emit_class_footer(&jclass_default_ctx, this_class, this_class_flags, super_class); }
+void code_attribute_start(uint16_t name_index, uint16_t max_stack, uint16_t max_locals) { jc_code_attribute_start(&jclass_default_ctx, name_index, max_stack, max_locals); }
+void code_attributes_start() { jc_code_attributes_start(&jclass_default_ctx); }
+void code_attribute_end() { jc_code_attribute_end(&jclass_default_ctx); }
+void lookupswitch(jclass_label default_label, size_t count, const int32_t *keys, const jclass_label *labels) { jc_lookupswitch(&jclass_default_ctx, default_label, count, keys, labels); }
+void tableswitch(int32_t low, int32_t high, jclass_label default_label, const jclass_label *labels) { jc_tableswitch(&jclass_default_ctx, low, high, default_label, labels); }
+void switch_inst(jclass_label default_label, size_t count, const int32_t *keys, const jclass_label *labels) { jc_switch_inst(&jclass_default_ctx, default_label, count, keys, labels); }
+uint32_t current_pc() { return jc_current_pc(&jclass_default_ctx); }
+jclass_label label_new() { return jc_label_new(&jclass_default_ctx); }
+void label_bind(jclass_label label) { jc_label_bind(&jclass_default_ctx, label); }
+void goto_label(jclass_label label) { jc_goto_label(&jclass_default_ctx, label); }
+void goto_w_label(jclass_label label) { jc_goto_w_label(&jclass_default_ctx, label); }
+void jsr_label(jclass_label label) { jc_jsr_label(&jclass_default_ctx, label); }
+void jsr_w_label(jclass_label label) { jc_jsr_w_label(&jclass_default_ctx, label); }
+void if_acmpeq_label(jclass_label label) { jc_if_acmpeq_label(&jclass_default_ctx, label); }
+void if_acmpne_label(jclass_label label) { jc_if_acmpne_label(&jclass_default_ctx, label); }
+void if_icmpeq_label(jclass_label label) { jc_if_icmpeq_label(&jclass_default_ctx, label); }
+void if_icmpne_label(jclass_label label) { jc_if_icmpne_label(&jclass_default_ctx, label); }
+void if_icmplt_label(jclass_label label) { jc_if_icmplt_label(&jclass_default_ctx, label); }
+void if_icmpge_label(jclass_label label) { jc_if_icmpge_label(&jclass_default_ctx, label); }
+void if_icmpgt_label(jclass_label label) { jc_if_icmpgt_label(&jclass_default_ctx, label); }
+void if_icmple_label(jclass_label label) { jc_if_icmple_label(&jclass_default_ctx, label); }
+void ifeq_label(jclass_label label) { jc_ifeq_label(&jclass_default_ctx, label); }
+void ifne_label(jclass_label label) { jc_ifne_label(&jclass_default_ctx, label); }
+void iflt_label(jclass_label label) { jc_iflt_label(&jclass_default_ctx, label); }
+void ifge_label(jclass_label label) { jc_ifge_label(&jclass_default_ctx, label); }
+void ifgt_label(jclass_label label) { jc_ifgt_label(&jclass_default_ctx, label); }
+void ifle_label(jclass_label label) { jc_ifle_label(&jclass_default_ctx, label); }
+void ifnonnull_label(jclass_label label) { jc_ifnonnull_label(&jclass_default_ctx, label); }
+void ifnull_label(jclass_label label) { jc_ifnull_label(&jclass_default_ctx, label); }
+int write_class(char* outputName) { return jc_write_class(&jclass_default_ctx, outputName); }
+void constant_pool_copy(const jclass_reader *reader) { jc_constant_pool_copy(&jclass_default_ctx, reader); }
+void field_copy(const jclass_reader *reader, uint16_t i) { jc_field_copy(&jclass_default_ctx, reader, i); }
+void method_copy(const jclass_reader *reader, uint16_t i) { jc_method_copy(&jclass_default_ctx, reader, i); }
+void attribute_copy(const jclass_reader *reader, const jclass_attribute *attribute) { jc_attribute_copy(&jclass_default_ctx, reader, attribute); }
+int jar_add_class(jclass_jar *jar, const char *name) { return jc_jar_add_class(jar, &jclass_default_ctx, name); }
+int writer_submit_class(jclass_writer *writer, const char *path, size_t *ticket) { return jc_writer_submit_class(writer, &jclass_default_ctx, path, ticket); }
+int jclass_error() { return jc_error(&jclass_default_ctx); }
+int jclass_finish(const uint8_t **data, size_t *length) { return jc_finish(&jclass_default_ctx, data, length); }
+int jclass_finish_take(uint8_t **data, size_t *length) { return jc_finish_take(&jclass_default_ctx, data, length); }
+int jclass_finish_slices(jclass_slice slices[4], size_t *count) { return jc_finish_slices(&jclass_default_ctx, slices, count); }
+int jclass_write_sink(jclass_sink sink, void *user) { return jc_write_sink(&jclass_default_ctx, sink, user); }
+void jclass_set_common_superclass(jclass_common_superclass common_superclass, void *user) { jc_set_common_superclass(&jclass_default_ctx, common_superclass, user); }
+void jclass_set_flags(uint32_t flags) { jc_set_flags(&jclass_default_ctx, flags); }
+void jclass_set_code_pass(jclass_code_pass pass, void *user) { jc_set_code_pass(&jclass_default_ctx, pass, user); }
+void jclass_set_peephole(uint32_t rules) { jc_set_peephole(&jclass_default_ctx, rules); }
+void jclass_get_peephole_stats(jclass_peephole_stats *stats) { jc_get_peephole_stats(&jclass_default_ctx, stats); }
+int jclass_build_ordered(jclass_generator generate, void *user) { return jc_build_ordered(&jclass_default_ctx, generate, user); }
+void jclass_set_ldc_weight(uint32_t weight) { jc_set_ldc_weight(&jclass_default_ctx, weight); }
+void jclass_set_version(uint16_t major, uint16_t minor) { jc_set_version(&jclass_default_ctx, major, minor); }
+int jclass_reserve(size_t capacity) { return jc_reserve(&jclass_default_ctx, capacity); }
+
+#endif // JCLASS_NO_GLOBAL_API
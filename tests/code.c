@@ -0,0 +1,360 @@
+/**
+    @brief Builds methods with computed maxs and frames, reads them back with jc_reader_* and checks the exact
+    bytes, max_stack, max_locals and StackMapTable
+
+*/
+#include "test.h"
+
+/**
+    @brief Checks the last verification type of the StackMapTable of a method is the class name
+
+*/
+static void check_stackmap_class(const test_method *m, const char *name) {
+    CHECK(m->has_stackmap && m->stackmap.length >= 3);
+    if (!m->has_stackmap || m->stackmap.length < 3) {
+        return;
+    }
+    const uint8_t *type = m->stackmap.data + m->stackmap.length - 3;
+    uint16_t length = 0;
+    const uint8_t *class_name = jc_reader_class_name(&m->reader, jc_load_u2(type + 1), &length);
+    CHECK_INT(type[0], JCLASS_VT_OBJECT);
+    CHECK(class_name && length == strlen(name) && memcmp(class_name, name, length) == 0);
+}
+
+// ------------------------
+// frames
+// ------------------------
+
+static void emit_same(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label l = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, l);
+    jc_iinc(ctx, 0, 1);
+    jc_label_bind(ctx, l);
+    jc_iload(ctx, 0);
+    jc_ireturn(ctx);
+}
+
+static void emit_same_locals_1_stack_item(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label zero = jc_label_new(ctx), done = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, zero);
+    jc_iconst_1(ctx);
+    jc_goto_label(ctx, done);
+    jc_label_bind(ctx, zero);
+    jc_iconst_0(ctx);
+    jc_label_bind(ctx, done);
+    jc_ireturn(ctx);
+}
+
+static void emit_append_chop(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label skip = jc_label_new(ctx), zero = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, zero);
+    jc_iconst_0(ctx);
+    jc_istore(ctx, 1);
+    jc_iload(ctx, 1);
+    jc_ifeq_label(ctx, skip);
+    jc_iinc(ctx, 1, 1);
+    jc_label_bind(ctx, skip);
+    jc_iload(ctx, 1);
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, zero);
+    jc_iconst_0(ctx);
+    jc_ireturn(ctx);
+}
+
+static void emit_full(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label zero = jc_label_new(ctx), add = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, zero);
+    jc_iconst_1(ctx);
+    jc_goto_label(ctx, add);
+    jc_label_bind(ctx, zero);
+    jc_iconst_0(ctx);
+    jc_label_bind(ctx, add);
+    jc_iadd(ctx);
+    jc_ireturn(ctx);
+}
+
+static void test_frames(void) {
+    test_method m;
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)I", emit_same, NULL), JCLASS_OK);
+    check_code("same code", &m, 1, 1, (const uint8_t[]){ 0x1a, 0x99, 0x00, 0x06, 0x84, 0x00, 0x01, 0x1a, 0xac }, 9);
+    check_stackmap("same", &m, (const uint8_t[]){ 0x00, 0x01, 0x07 }, 3);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)I", emit_same_locals_1_stack_item, NULL), JCLASS_OK);
+    check_code("same_locals_1_stack_item code", &m, 1, 1, (const uint8_t[]){
+        0x1a, 0x99, 0x00, 0x07, 0x04, 0xa7, 0x00, 0x04, 0x03, 0xac
+    }, 10);
+    check_stackmap("same_locals_1_stack_item", &m, (const uint8_t[]){
+        0x00, 0x02,
+        0x08,                           // same_frame at 8
+        0x40, JCLASS_VT_INTEGER         // same_locals_1_stack_item_frame at 9 with an int
+    }, 5);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)I", emit_append_chop, NULL), JCLASS_OK);
+    check_code("append and chop code", &m, 1, 2, (const uint8_t[]){
+        0x1a, 0x99, 0x00, 0x0e, 0x03, 0x3c, 0x1b, 0x99, 0x00, 0x06, 0x84, 0x01, 0x01, 0x1b, 0xac, 0x03, 0xac
+    }, 17);
+    check_stackmap("append and chop", &m, (const uint8_t[]){
+        0x00, 0x02,
+        0xfc, 0x00, 0x0d, JCLASS_VT_INTEGER, // append_frame at 13 adding an int
+        0xfa, 0x00, 0x01                // chop_frame at 15 taking it away
+    }, 9);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)I", emit_full, NULL), JCLASS_OK);
+    check_code("full code", &m, 2, 1, (const uint8_t[]){
+        0x1a, 0x1a, 0x99, 0x00, 0x07, 0x04, 0xa7, 0x00, 0x04, 0x03, 0x60, 0xac
+    }, 12);
+    check_stackmap("full", &m, (const uint8_t[]){
+        0x00, 0x02,
+        0x49, JCLASS_VT_INTEGER,        // same_locals_1_stack_item_frame at 9
+        0xff, 0x00, 0x00,               // full_frame at 10
+        0x00, 0x01, JCLASS_VT_INTEGER,
+        0x00, 0x02, JCLASS_VT_INTEGER, JCLASS_VT_INTEGER
+    }, 14);
+    test_free(&m);
+}
+
+// ------------------------
+// merging classes
+// ------------------------
+
+static const char *number_superclass(const char *a, const char *b, void *user) {
+    (void)user;
+    if ((strcmp(a, "java/lang/Integer") == 0 && strcmp(b, "java/lang/Long") == 0) ||
+        (strcmp(a, "java/lang/Long") == 0 && strcmp(b, "java/lang/Integer") == 0)) {
+        return "java/lang/Number";
+    }
+    return NULL;
+}
+
+// Object[] a = c ? new String[1] : new Integer[1]; return a.length;
+static void emit_arrays(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label other = jc_label_new(ctx), done = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, other);
+    jc_iconst_1(ctx);
+    jc_anewarray(ctx, jc_cp_class(ctx, "java/lang/String"));
+    jc_goto_label(ctx, done);
+    jc_label_bind(ctx, other);
+    jc_iconst_1(ctx);
+    jc_anewarray(ctx, jc_cp_class(ctx, "java/lang/Integer"));
+    jc_label_bind(ctx, done);
+    jc_arraylength(ctx);
+    jc_ireturn(ctx);
+}
+
+// Number n = c ? Integer.valueOf(1) : Long.valueOf(1); return n.intValue();
+static void emit_numbers(jclass_ctx *ctx, void *user) {
+    if (user) {
+        jc_set_common_superclass(ctx, number_superclass, NULL);
+    }
+    jclass_label other = jc_label_new(ctx), done = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, other);
+    jc_iconst_1(ctx);
+    jc_invokestatic(ctx, jc_cp_methodref(ctx, "java/lang/Integer", "valueOf", "(I)Ljava/lang/Integer;"));
+    jc_goto_label(ctx, done);
+    jc_label_bind(ctx, other);
+    jc_lconst_1(ctx);
+    jc_invokestatic(ctx, jc_cp_methodref(ctx, "java/lang/Long", "valueOf", "(J)Ljava/lang/Long;"));
+    jc_label_bind(ctx, done);
+    jc_invokevirtual(ctx, jc_cp_methodref(ctx, "java/lang/Number", "intValue", "()I"));
+    jc_ireturn(ctx);
+}
+
+static void test_merge(void) {
+    test_method m;
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(Z)I", emit_arrays, NULL), JCLASS_OK);
+    CHECK_INT(m.code.max_stack, 1);
+    CHECK(m.has_stackmap && m.stackmap.length == 7);
+    check_bytes("arrays frames", m.has_stackmap ? m.stackmap.data : NULL, m.has_stackmap ? 4 : 0, (const uint8_t[]){ 0x00, 0x02, 0x0b, 0x43 }, 4);
+    check_stackmap_class(&m, "[Ljava/lang/Object;");
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(Z)I", emit_numbers, "callback"), JCLASS_OK);
+    CHECK_INT(m.code.max_stack, 2);
+    check_stackmap_class(&m, "java/lang/Number");
+    test_free(&m);
+
+    // without the class hierarchy no frame is made up
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(Z)I", emit_numbers, NULL), JCLASS_ERR_HIERARCHY);
+    test_free(&m);
+}
+
+// ------------------------
+// checks of the method's code
+// ------------------------
+
+static void emit_duplicate_key(jclass_ctx *ctx, void *user) {
+    jclass_label fallback = jc_label_new(ctx), one = jc_label_new(ctx);
+    int32_t keys[3] = { 1, user ? 100000 : 2, 1 };
+    jclass_label labels[3] = { fallback, one, fallback };
+    jc_iload(ctx, 0);
+    jc_switch_inst(ctx, fallback, 3, keys, labels);
+    jc_label_bind(ctx, one);
+    jc_label_bind(ctx, fallback);
+    jc_return_inst(ctx);
+}
+
+// goto S; d: return; S: iload_0; lookupswitch with no keys, the last instruction of the method
+static void emit_empty_lookupswitch(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label fallback = jc_label_new(ctx), start = jc_label_new(ctx);
+    jc_goto_label(ctx, start);
+    jc_label_bind(ctx, fallback);
+    jc_return_inst(ctx);
+    jc_label_bind(ctx, start);
+    jc_iload(ctx, 0);
+    jc_lookupswitch(ctx, fallback, 0, NULL, NULL);
+}
+
+static void emit_foreign_constant(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_invokestatic(ctx, 999);
+    jc_return_inst(ctx);
+}
+
+static void test_checks(void) {
+    test_method m;
+
+    // a key repeated with the default label, in a tableswitch and a lookupswitch
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_6, "(I)V", emit_duplicate_key, NULL), JCLASS_ERR_RANGE);
+    test_free(&m);
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_6, "(I)V", emit_duplicate_key, "sparse"), JCLASS_ERR_RANGE);
+    test_free(&m);
+
+    // a lookupswitch without keys only has its default and npairs after the padding
+    static const uint8_t empty_lookupswitch[] = {
+        0xa7, 0x00, 0x04, 0xb1, 0x1a,   // goto +4; return; iload_0
+        0xab, 0x00, 0x00,               // lookupswitch, padded to 8
+        0xff, 0xff, 0xff, 0xfe,         // default -2, to the return
+        0x00, 0x00, 0x00, 0x00          // npairs
+    };
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(I)V", emit_empty_lookupswitch, NULL), JCLASS_OK);
+    check_code("empty lookupswitch", &m, 1, 1, empty_lookupswitch, sizeof(empty_lookupswitch));
+    test_free(&m);
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)V", emit_empty_lookupswitch, NULL), JCLASS_OK);
+    check_code("empty lookupswitch with frames", &m, 1, 1, empty_lookupswitch, sizeof(empty_lookupswitch));
+    check_stackmap("empty lookupswitch frames", &m, (const uint8_t[]){ 0x00, 0x02, 0x03, 0x00 }, 4);
+    test_free(&m);
+    // and the list passes decode it rather than keep the code as it is
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS | JCLASS_REMOVE_DEAD_CODE, 0, "(I)V", emit_empty_lookupswitch, NULL), JCLASS_OK);
+    check_code("empty lookupswitch without dead code", &m, 1, 1, empty_lookupswitch, sizeof(empty_lookupswitch));
+    test_free(&m);
+
+    // maxs that can not be computed are not left at what code_attribute_start was given
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "()V", emit_foreign_constant, NULL), JCLASS_ERR_RANGE);
+    test_free(&m);
+}
+
+// ------------------------
+// constant pushes
+// ------------------------
+
+/**
+ * @brief A value pushed with jc_push_int, jc_push_long, jc_push_float or jc_push_double
+ *
+ */
+typedef struct push_case {
+    char type;              // I, J, F or D, for the push used
+    int64_t value;          // the int or long pushed
+    double real;            // the float or double pushed
+    uint8_t code[3];        // the code expected, an ldc or ldc2_w with its index left 0
+    size_t length;          // size of code
+    uint8_t entry[9];       // the constant an ldc or ldc2_w loads
+    size_t entry_length;    // size of entry, 0 when nothing is loaded
+} push_case;
+
+static const push_case push_cases[] = {
+    { 'I', -1, 0, { 0x02 }, 1, { 0 }, 0 },                      // iconst_m1
+    { 'I', 5, 0, { 0x08 }, 1, { 0 }, 0 },                       // iconst_5
+    { 'I', 6, 0, { 0x10, 0x06 }, 2, { 0 }, 0 },                 // bipush
+    { 'I', -2, 0, { 0x10, 0xfe }, 2, { 0 }, 0 },
+    { 'I', -128, 0, { 0x10, 0x80 }, 2, { 0 }, 0 },
+    { 'I', 127, 0, { 0x10, 0x7f }, 2, { 0 }, 0 },
+    { 'I', -129, 0, { 0x11, 0xff, 0x7f }, 3, { 0 }, 0 },        // sipush
+    { 'I', 128, 0, { 0x11, 0x00, 0x80 }, 3, { 0 }, 0 },
+    { 'I', -32768, 0, { 0x11, 0x80, 0x00 }, 3, { 0 }, 0 },
+    { 'I', 32767, 0, { 0x11, 0x7f, 0xff }, 3, { 0 }, 0 },
+    { 'I', -32769, 0, { 0x12 }, 2, { 3, 0xff, 0xff, 0x7f, 0xff }, 5 },  // ldc
+    { 'I', 32768, 0, { 0x12 }, 2, { 3, 0x00, 0x00, 0x80, 0x00 }, 5 },
+    { 'J', 0, 0, { 0x09 }, 1, { 0 }, 0 },                       // lconst_0
+    { 'J', 1, 0, { 0x0a }, 1, { 0 }, 0 },
+    { 'J', 2, 0, { 0x05, 0x85 }, 2, { 0 }, 0 },                 // iconst_2; i2l
+    { 'J', -1, 0, { 0x02, 0x85 }, 2, { 0 }, 0 },
+    { 'J', 127, 0, { 0x10, 0x7f, 0x85 }, 3, { 0 }, 0 },         // bipush; i2l
+    { 'J', 128, 0, { 0x14 }, 3, { 5, 0, 0, 0, 0, 0, 0, 0, 0x80 }, 9 },     // ldc2_w
+    { 'J', -129, 0, { 0x14 }, 3, { 5, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0x7f }, 9 },
+    { 'F', 0, 0.0, { 0x0b }, 1, { 0 }, 0 },                     // fconst_0
+    { 'F', 0, 1.0, { 0x0c }, 1, { 0 }, 0 },
+    { 'F', 0, 2.0, { 0x0d }, 1, { 0 }, 0 },
+    { 'F', 0, -0.0, { 0x12 }, 2, { 4, 0x80, 0x00, 0x00, 0x00 }, 5 },    // not fconst_0
+    { 'F', 0, 3.0, { 0x12 }, 2, { 4, 0x40, 0x40, 0x00, 0x00 }, 5 },
+    { 'D', 0, 0.0, { 0x0e }, 1, { 0 }, 0 },                     // dconst_0
+    { 'D', 0, 1.0, { 0x0f }, 1, { 0 }, 0 },
+    { 'D', 0, -0.0, { 0x14 }, 3, { 6, 0x80, 0, 0, 0, 0, 0, 0, 0 }, 9 },  // not dconst_0
+    { 'D', 0, 2.0, { 0x14 }, 3, { 6, 0x40, 0, 0, 0, 0, 0, 0, 0 }, 9 }
+};
+
+static void emit_push(jclass_ctx *ctx, void *user) {
+    const push_case *push = user;
+    switch (push->type) {
+        case 'I':
+            jc_push_int(ctx, (int32_t)push->value);
+            break;
+        case 'J':
+            jc_push_long(ctx, push->value);
+            break;
+        case 'F':
+            jc_push_float(ctx, (float)push->real);
+            break;
+        default:
+            jc_push_double(ctx, push->real);
+            break;
+    }
+    jc_return_inst(ctx);
+}
+
+static void test_push(void) {
+    for (size_t i = 0; i < sizeof(push_cases) / sizeof(push_cases[0]); i++) {
+        const push_case *push = &push_cases[i];
+        test_method m;
+        char what[64];
+        snprintf(what, sizeof(what), "push %c %lld %g", push->type, (long long)push->value, push->real);
+        CHECK_INT(test_build(&m, 0, 0, "()V", emit_push, (void *)push), JCLASS_OK);
+        uint8_t code[4];
+        memcpy(code, push->code, push->length);
+        code[push->length] = 0xb1;
+        if (push->entry_length && m.code.code_length == push->length + 1) {
+            // the index is whatever the pool gave, the constant there has to be the one pushed
+            uint16_t index = push->length == 2 ? m.code.code[1] : jc_load_u2(m.code.code + 1);
+            memcpy(code + 1, m.code.code + 1, push->length - 1);
+            const uint8_t *entry = jc_reader_cp_entry(&m.reader, index);
+            check_bytes(what, entry, entry ? push->entry_length : 0, push->entry, push->entry_length);
+        }
+        check_bytes(what, m.code.code, m.code.code_length, code, push->length + 1);
+        test_free(&m);
+    }
+}
+
+int main(void) {
+    test_frames();
+    test_merge();
+    test_checks();
+    test_push();
+    return test_result("code");
+}
@@ -0,0 +1,94 @@
+/**
+    @brief Builds methods with unreachable code and exception handlers, removes the dead code and checks
+    the code, exception table and frames that are left
+
+*/
+#include "test.h"
+
+// the handler covers code that can not throw, so it and its code go away
+static void emit_unused_handler(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label start = jc_label_new(ctx), end = jc_label_new(ctx), handler = jc_label_new(ctx);
+    jc_exception_handler(ctx, start, end, handler, jc_cp_class(ctx, "java/lang/Exception"));
+    jc_label_bind(ctx, start);
+    jc_iconst_1(ctx);
+    jc_istore(ctx, 1);
+    jc_label_bind(ctx, end);
+    jc_iload(ctx, 1);
+    jc_ireturn(ctx);
+    jc_iconst_5(ctx); // after a return
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, handler);
+    jc_pop_inst(ctx);
+    jc_iconst_m1(ctx);
+    jc_ireturn(ctx);
+}
+
+/**
+ * @brief Constant pool indices emit_used_handler uses
+ *
+ */
+typedef struct used_handler {
+    uint16_t exception;     // the class the handler catches
+    uint16_t call;          // the method called in its range
+} used_handler;
+
+// the handler covers a call, so it stays and its range follows the code that moved
+static void emit_used_handler(jclass_ctx *ctx, void *user) {
+    used_handler *indices = user;
+    indices->exception = jc_cp_class(ctx, "java/lang/Exception");
+    indices->call = jc_cp_methodref(ctx, "T", "f", "(I)I");
+    jclass_label start = jc_label_new(ctx), end = jc_label_new(ctx), handler = jc_label_new(ctx);
+    jclass_label skip = jc_label_new(ctx);
+    jc_goto_label(ctx, skip);
+    jc_iconst_5(ctx); // jumped over
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, skip);
+    jc_exception_handler(ctx, start, end, handler, indices->exception);
+    jc_label_bind(ctx, start);
+    jc_iload(ctx, 0);
+    jc_invokestatic(ctx, indices->call);
+    jc_label_bind(ctx, end);
+    jc_ireturn(ctx);
+    jc_iconst_5(ctx); // after a return
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, handler);
+    jc_pop_inst(ctx);
+    jc_iconst_m1(ctx);
+    jc_ireturn(ctx);
+}
+
+static void test_dead_code(void) {
+    test_method m;
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS | JCLASS_REMOVE_DEAD_CODE, 0, "(I)I", emit_unused_handler, NULL), JCLASS_OK);
+    check_code("unused handler", &m, 1, 2, (const uint8_t[]){ 0x04, 0x3c, 0x1b, 0xac }, 4);
+    CHECK_INT(m.code.exception_table_length, 0);
+    test_free(&m);
+
+    // the goto over the removed code now goes to the next instruction
+    used_handler indices;
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES | JCLASS_REMOVE_DEAD_CODE, 0, "(I)I", emit_used_handler, &indices), JCLASS_OK);
+    check_code("used handler", &m, 1, 1, (const uint8_t[]){
+        0xa7, 0x00, 0x03,                                               // goto +3
+        0x1a, 0xb8, (uint8_t)(indices.call >> 8), (uint8_t)indices.call,// iload_0; invokestatic
+        0xac,                                                           // ireturn
+        0x57, 0x02, 0xac                                                // pop; iconst_m1; ireturn
+    }, 11);
+    CHECK_INT(m.code.exception_table_length, 1);
+    check_bytes("used handler range", m.code.exception_table, 8, (const uint8_t[]){
+        0x00, 0x03, 0x00, 0x07, 0x00, 0x08, (uint8_t)(indices.exception >> 8), (uint8_t)indices.exception
+    }, 8);
+    check_stackmap("used handler frames", &m, (const uint8_t[]){
+        0x00, 0x02,
+        0x03,                           // same_frame at 3
+        0x44, JCLASS_VT_OBJECT,         // same_locals_1_stack_item_frame at 8 with the exception
+        (uint8_t)(indices.exception >> 8), (uint8_t)indices.exception
+    }, 7);
+    test_free(&m);
+}
+
+int main(void) {
+    test_dead_code();
+    return test_result("dead_code");
+}
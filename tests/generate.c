@@ -0,0 +1,153 @@
+/**
+    @brief Builds many classes with jc_generate on several threads and checks the outputs match the ones
+    built on one thread, in the same order. Some jobs set flags and a version, which must not carry over
+    to the next job of the same thread, and some fail
+
+*/
+#include "test.h"
+
+/** @brief Number of jobs of the main runs */
+#define JOBS 500
+
+static void emit_code(jclass_ctx *ctx, void *user) {
+    const unsigned *nm = user;
+    char string[32];
+    snprintf(string, sizeof(string), "%u.%u", nm[0], nm[1]);
+    jc_ldc(ctx, jc_cp_string(ctx, string));
+    jc_pop_inst(ctx);
+    if (nm[0] % 3 == 0) {
+        // branches need frames from Java 7 on
+        jclass_label done = jc_label_new(ctx);
+        jc_iload(ctx, 0);
+        jc_ifeq_label(ctx, done);
+        jc_iinc(ctx, 0, (int16_t)nm[1]);
+        jc_label_bind(ctx, done);
+    }
+    jc_iload(ctx, 0);
+    jc_ireturn(ctx);
+}
+
+// a field_info that is never ended, so the fields section can not end either
+static void emit_open_field(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_field_info(ctx, ACC_PUBLIC, jc_cp_utf8(ctx, "f"), jc_cp_utf8(ctx, "I"));
+}
+
+static void emit_methods(jclass_ctx *ctx, void *user) {
+    unsigned n = *(const unsigned *)user;
+    for (unsigned m = 0; m < n % 8; m++) {
+        unsigned nm[2] = { n, m };
+        char method[32];
+        snprintf(method, sizeof(method), "m%u", m);
+        test_code_method(ctx, method, "(I)I", 1, 1, emit_code, nm);
+    }
+}
+
+/**
+    @brief Builds the class G<n>, whose size and flags depend on n. Jobs with n % 11 == 7 fail in the
+    generator, and the ones with n % 11 == 9 leave a field open so jc_finish fails
+
+*/
+static int build_numbered(jclass_ctx *ctx, void *user) {
+    unsigned n = *(const unsigned *)user;
+    if (n % 11 == 7) {
+        return JCLASS_ERR_RANGE;
+    }
+    if (n % 3 == 0) {
+        jc_set_flags(ctx, JCLASS_COMPUTE_FRAMES);
+        jc_set_peephole(ctx, JCLASS_PEEPHOLE_ALL);
+    }
+    if (n % 5 == 0) {
+        jc_set_version(ctx, JCLASS_JAVA_6, 0);
+    }
+    char name[32];
+    snprintf(name, sizeof(name), "G%u", n);
+    test_parts parts = { NULL, NULL, n % 11 == 9 ? emit_open_field : NULL, emit_methods, NULL, user };
+    test_class(ctx, name, &parts);
+    return JCLASS_OK;
+}
+
+/**
+    @brief Checks outputs match the ones built on one thread
+
+*/
+static void check_outputs(unsigned threads, const jclass_output *outputs, const jclass_output *expected, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        if (outputs[i].error != expected[i].error || outputs[i].length != expected[i].length ||
+            (outputs[i].data == NULL) != (expected[i].data == NULL) ||
+            (outputs[i].data && memcmp(outputs[i].data, expected[i].data, outputs[i].length) != 0)) {
+            fprintf(stderr, "%u threads: job %zu differs from the one built on one thread\n", threads, i);
+            test_failures++;
+            return;
+        }
+    }
+}
+
+static void free_outputs(jclass_output *outputs, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        free(outputs[i].data);
+    }
+}
+
+/**
+    @brief Checks the classes built on one thread are G<n>, and the failing jobs failed
+
+*/
+static void check_expected(const jclass_output *outputs, const unsigned *numbers, size_t count) {
+    for (size_t i = 0; i < count; i++) {
+        unsigned n = numbers[i];
+        int error = n % 11 == 7 ? JCLASS_ERR_RANGE : n % 11 == 9 ? JCLASS_ERR_STATE : JCLASS_OK;
+        CHECK_INT(outputs[i].error, error);
+        CHECK((outputs[i].data != NULL) == (error == JCLASS_OK));
+        if (!outputs[i].data) {
+            continue;
+        }
+        jclass_reader reader;
+        char name[32];
+        uint16_t length = 0;
+        snprintf(name, sizeof(name), "G%u", n);
+        CHECK_INT(jc_reader_open_memory(&reader, outputs[i].data, outputs[i].length), JCLASS_OK);
+        const uint8_t *class_name = jc_reader_class_name(&reader, reader.this_class, &length);
+        CHECK(class_name && length == strlen(name) && memcmp(class_name, name, length) == 0);
+        CHECK_INT(reader.methods_count, n % 8);
+        CHECK_INT(reader.major_version, n % 5 == 0 ? JCLASS_JAVA_6 : JCLASS_JAVA_8);
+        jc_reader_close(&reader);
+    }
+}
+
+int main(void) {
+    static unsigned numbers[JOBS];
+    static jclass_job jobs[JOBS];
+    static jclass_output expected[JOBS], outputs[JOBS];
+    for (unsigned i = 0; i < JOBS; i++) {
+        numbers[i] = i;
+        jobs[i] = (jclass_job){ build_numbered, &numbers[i] };
+    }
+
+    // one thread, every job in order on one context
+    int first_error = jc_generate(jobs, JOBS, 1, expected);
+    CHECK_INT(first_error, JCLASS_ERR_RANGE); // job 7
+    check_expected(expected, numbers, JOBS);
+
+    // more threads, up to more threads than jobs
+    static const unsigned thread_counts[] = { 2, 3, 8, JOBS + 5 };
+    for (size_t t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        memset(outputs, 0, sizeof(outputs));
+        CHECK_INT(jc_generate(jobs, JOBS, thread_counts[t], outputs), first_error);
+        check_outputs(thread_counts[t], outputs, expected, JOBS);
+        free_outputs(outputs, JOBS);
+    }
+
+    // a few jobs on many threads, and no jobs at all
+    memset(outputs, 0, sizeof(outputs));
+    CHECK_INT(jc_generate(jobs, 3, 16, outputs), JCLASS_OK);
+    check_outputs(16, outputs, expected, 3);
+    free_outputs(outputs, 3);
+    CHECK_INT(jc_generate(jobs + 9, 1, 4, outputs), JCLASS_ERR_STATE);
+    check_outputs(4, outputs, expected + 9, 1);
+    free_outputs(outputs, 1);
+    CHECK_INT(jc_generate(jobs, 0, 4, outputs), JCLASS_OK);
+
+    free_outputs(expected, JOBS);
+    return test_result("generate");
+}
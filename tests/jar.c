@@ -0,0 +1,225 @@
+/**
+    @brief Writes stored and deflated jars, then reads every entry back and inflates it with zlib to check
+    it matches what was added. Built once with the built-in deflate and once with JCLASS_ZLIB
+
+*/
+#include "test.h"
+// as in jclass.c, keeps unistd.h and its dup out
+#ifndef Z_SOLO
+#define Z_SOLO
+#endif
+#include <zlib.h>
+
+/**
+ * @brief An entry added to the jars
+ *
+ */
+typedef struct test_entry {
+    const char *name;   // path in the jar
+    uint8_t *data;      // contents
+    size_t length;      // size of data
+    int compresses;     // 1 if deflating makes it smaller
+} test_entry;
+
+/**
+    @brief Fills data with words picked by a linear congruential generator, with copies of earlier parts
+    right at the edge of the 32 KiB window and past it
+
+*/
+static void fill_text(uint8_t *data, size_t length) {
+    static const char *words[] = { "class ", "static ", "void ", "int ", "return ", "new ", "{ ", "} ", "; ", "\n" };
+    uint32_t seed = 1;
+    size_t pos = 0;
+    while (pos < length) {
+        seed = seed * 1103515245u + 12345u;
+        if (pos >= 40000 && (seed >> 16) % 16 == 0) {
+            // a run from exactly 32768 bytes back, or from too far back to be matched
+            size_t distance = (seed >> 20) % 2 ? 32768 : 40000;
+            for (size_t i = 0; i < 300 && pos < length; i++, pos++) {
+                data[pos] = data[pos - distance];
+            }
+            continue;
+        }
+        const char *word = words[(seed >> 16) % 10];
+        for (size_t i = 0; word[i] && pos < length; i++) {
+            data[pos++] = (uint8_t)word[i];
+        }
+    }
+}
+
+/**
+    @brief Fills data with bytes that do not compress
+
+*/
+static void fill_random(uint8_t *data, size_t length) {
+    uint32_t seed = 7;
+    for (size_t i = 0; i < length; i++) {
+        seed = seed * 1103515245u + 12345u;
+        data[i] = (uint8_t)(seed >> 23);
+    }
+}
+
+/**
+    @brief Builds a small class and adds it as T.class
+
+*/
+static int add_class(jclass_jar *jar) {
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "T", NULL);
+    int result = jc_jar_add_class(jar, ctx, NULL);
+    jc_ctx_free(ctx);
+    return result;
+}
+
+/**
+    @brief Reads a whole file
+    @return The contents to be freed with free(), NULL if it could not be read
+
+*/
+static uint8_t *read_file(const char *path, size_t *length) {
+    FILE *file = fopen(path, "rb");
+    if (!file) {
+        return NULL;
+    }
+    fseek(file, 0, SEEK_END);
+    long size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+    uint8_t *data = size > 0 ? malloc((size_t)size) : NULL;
+    if (data && fread(data, 1, (size_t)size, file) != (size_t)size) {
+        free(data);
+        data = NULL;
+    }
+    fclose(file);
+    *length = data ? (size_t)size : 0;
+    return data;
+}
+
+static uint32_t load_le16(const uint8_t *p) {
+    return (uint32_t)p[0] | (uint32_t)p[1] << 8;
+}
+
+static uint32_t load_le32(const uint8_t *p) {
+    return load_le16(p) | load_le16(p + 2) << 16;
+}
+
+/**
+    @brief Checks the contents of one entry, inflating it if it was deflated
+
+*/
+static void check_entry(const char *path, const test_entry *entry, uint32_t method, uint32_t crc, const uint8_t *stored, size_t stored_length, size_t length) {
+    CHECK_INT(length, entry->length);
+    CHECK_INT(crc, crc32(0, entry->data, (uInt)entry->length));
+    uint8_t *data = malloc(entry->length + 1);
+    if (!data) {
+        CHECK(!"out of memory");
+        return;
+    }
+    size_t got = 0;
+    if (method == JCLASS_JAR_STORED) {
+        got = stored_length;
+        memcpy(data, stored, stored_length <= entry->length ? stored_length : entry->length);
+    } else {
+        // raw deflate data, without a zlib header
+        z_stream stream;
+        memset(&stream, 0, sizeof(stream));
+        CHECK_INT(inflateInit2(&stream, -15), Z_OK);
+        stream.next_in = (Bytef *)stored;
+        stream.avail_in = (uInt)stored_length;
+        stream.next_out = data;
+        stream.avail_out = (uInt)entry->length + 1;
+        CHECK_INT(inflate(&stream, Z_FINISH), Z_STREAM_END);
+        CHECK_INT(stream.avail_in, 0);
+        got = stream.total_out;
+        inflateEnd(&stream);
+    }
+    char what[256];
+    snprintf(what, sizeof(what), "%s %s", path, entry->name);
+    check_bytes(what, data, got, entry->data, entry->length);
+    free(data);
+}
+
+/**
+    @brief Writes a jar of the entries and checks every entry through its central directory record
+
+*/
+static void test_jar(const char *path, int method, const test_entry *entries, size_t count) {
+    jclass_jar jar;
+    CHECK_INT(jc_jar_open(&jar, path, method), JCLASS_OK);
+    CHECK_INT(add_class(&jar), JCLASS_OK);
+    for (size_t i = 0; i < count; i++) {
+        CHECK_INT(jc_jar_add(&jar, entries[i].name, entries[i].data, entries[i].length), JCLASS_OK);
+    }
+    CHECK_INT(jc_jar_close(&jar), JCLASS_OK);
+
+    size_t length;
+    uint8_t *zip = read_file(path, &length);
+    CHECK(zip && length >= 22);
+    if (!zip || length < 22) {
+        free(zip);
+        return;
+    }
+    const uint8_t *end = zip + length - 22;
+    CHECK_INT(load_le32(end), 0x06054b50);
+    CHECK_INT(load_le16(end + 10), count + 1);
+    size_t pos = load_le32(end + 16);
+    for (size_t i = 0; i < count + 1 && pos + 46 <= length; i++) {
+        const uint8_t *central = zip + pos;
+        CHECK_INT(load_le32(central), 0x02014b50);
+        uint32_t entry_method = load_le16(central + 10);
+        uint32_t crc = load_le32(central + 16);
+        size_t stored_length = load_le32(central + 20), entry_length = load_le32(central + 24);
+        size_t name_length = load_le16(central + 28);
+        size_t local = load_le32(central + 42);
+        pos += 46 + name_length + load_le16(central + 30) + load_le16(central + 32);
+        CHECK(local + 30 <= length && load_le32(zip + local) == 0x04034b50);
+        if (local + 30 > length) {
+            continue;
+        }
+        size_t data_offset = local + 30 + load_le16(zip + local + 26) + load_le16(zip + local + 28);
+        CHECK(data_offset + stored_length <= length);
+        if (data_offset + stored_length > length) {
+            continue;
+        }
+        if (i == 0) {
+            CHECK(name_length == 7 && memcmp(central + 46, "T.class", 7) == 0);
+            if (entry_method == JCLASS_JAR_STORED) {
+                CHECK_INT(stored_length >= 4 ? load_le32(zip + data_offset) : 0, 0xbebafeca); // little endian CAFEBABE
+            }
+            continue;
+        }
+        const test_entry *entry = &entries[i - 1];
+        CHECK(name_length == strlen(entry->name) && memcmp(central + 46, entry->name, name_length) == 0);
+        CHECK_INT(entry_method, method == JCLASS_JAR_DEFLATED && entry->compresses ? JCLASS_JAR_DEFLATED : JCLASS_JAR_STORED);
+        check_entry(path, entry, entry_method, crc, zip + data_offset, stored_length, entry_length);
+    }
+    free(zip);
+}
+
+int main(void) {
+    static const char manifest[] = "Manifest-Version: 1.0\r\nCreated-By: jclass\r\n\r\n";
+    size_t text_length = 150000, random_length = 50000;
+    uint8_t *text = malloc(text_length), *random = malloc(random_length);
+    if (!text || !random) {
+        return 1;
+    }
+    fill_text(text, text_length);
+    fill_random(random, random_length);
+    test_entry entries[] = {
+        { "META-INF/MANIFEST.MF", (uint8_t *)manifest, sizeof(manifest) - 1, 0 }, // too short to get smaller
+        { "empty", (uint8_t *)"", 0, 0 },
+        { "text", text, text_length, 1 },          // longer than the 32 KiB window
+        { "random", random, random_length, 0 }
+    };
+    size_t count = sizeof(entries) / sizeof(entries[0]);
+    test_jar("test_stored.jar", JCLASS_JAR_STORED, entries, count);
+    test_jar("test_deflated.jar", JCLASS_JAR_DEFLATED, entries, count);
+    remove("test_stored.jar");
+    remove("test_deflated.jar");
+    free(text);
+    free(random);
+#ifdef JCLASS_ZLIB
+    return test_result("jar with zlib");
+#else
+    return test_result("jar");
+#endif
+}
@@ -0,0 +1,191 @@
+/**
+    @brief Builds classes with jc_build_ordered and checks the constants ldc loads most get the indices ldc
+    reaches, weighted with jc_set_ldc_weight, and that classes needing one build are built once
+
+*/
+#include "test.h"
+
+/** @brief Number of UTF-8 constants added before the loaded ones, so those land past index 255 */
+#define FILLER 300
+
+/**
+ * @brief How build_hot builds its class
+ *
+ */
+typedef struct hot_class {
+    int builds;                     // number of times build_hot ran
+    size_t filler;                  // number of UTF-8 constants added first
+    const jclass_reader *source;    // class whose pool and first method are copied, NULL for none
+} hot_class;
+
+static void emit_filler(jclass_ctx *ctx, void *user) {
+    const hot_class *hot = user;
+    if (hot->source) {
+        jc_constant_pool_copy(ctx, hot->source);
+        return;
+    }
+    for (size_t i = 0; i < hot->filler; i++) {
+        char name[32];
+        snprintf(name, sizeof(name), "u%zu", i);
+        jc_cp_utf8(ctx, name);
+    }
+}
+
+// a method ten times as hot as the others
+static void emit_warm(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_set_ldc_weight(ctx, 10);
+    jc_ldc(ctx, jc_cp_float(ctx, 1.5f));
+    jc_pop_inst(ctx);
+    jc_return_inst(ctx);
+}
+
+static void emit_loads(jclass_ctx *ctx, void *user) {
+    (void)user;
+    for (int i = 0; i < 3; i++) {
+        jc_ldc(ctx, jc_cp_string(ctx, "hot"));
+        jc_pop_inst(ctx);
+    }
+    for (int i = 0; i < 2; i++) {
+        jc_ldc(ctx, jc_cp_class(ctx, "hot"));
+        jc_pop_inst(ctx);
+    }
+    jc_ldc(ctx, jc_cp_integer(ctx, 100000));
+    jc_pop_inst(ctx);
+    jc_return_inst(ctx);
+}
+
+// a method whose loads do not count
+static void emit_cold(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_set_ldc_weight(ctx, 0);
+    for (int i = 0; i < 20; i++) {
+        jc_ldc(ctx, jc_cp_integer(ctx, 7777777));
+        jc_pop_inst(ctx);
+    }
+    jc_return_inst(ctx);
+}
+
+static void emit_methods(jclass_ctx *ctx, void *user) {
+    const hot_class *hot = user;
+    if (hot->source) {
+        jc_method_copy(ctx, hot->source, 0);
+    } else {
+        test_code_method(ctx, "warm", "()V", 1, 0, emit_warm, NULL);
+    }
+    test_code_method(ctx, "loads", "()V", 1, 0, emit_loads, NULL);
+    test_code_method(ctx, "cold", "()V", 1, 0, emit_cold, NULL);
+}
+
+static int build_hot(jclass_ctx *ctx, void *user) {
+    hot_class *hot = user;
+    test_parts parts = { emit_filler, NULL, NULL, emit_methods, NULL, hot };
+    hot->builds++;
+    test_class(ctx, "T", &parts);
+    return JCLASS_OK;
+}
+
+/**
+    @brief Builds the class of hot with jc_build_ordered, or once if ordered is 0
+    @return The class file to be freed with free(), NULL if it could not be built
+
+*/
+static uint8_t *build(hot_class *hot, int ordered, size_t *length) {
+    jclass_ctx *ctx = jc_ctx_new();
+    uint8_t *data = NULL;
+    hot->builds = 0;
+    int result = ordered ? jc_build_ordered(ctx, build_hot, hot) : build_hot(ctx, hot);
+    CHECK_INT(result, JCLASS_OK);
+    CHECK_INT(jc_finish_take(ctx, &data, length), JCLASS_OK);
+    jc_ctx_free(ctx);
+    return data;
+}
+
+/**
+    @brief Checks the constant at index of a class being read
+    @param entry The tag and contents the constant has to have
+
+*/
+static void check_constant(const jclass_reader *reader, uint16_t index, const uint8_t *entry, size_t length) {
+    const uint8_t *got = jc_reader_cp_entry(reader, index);
+    char what[32];
+    snprintf(what, sizeof(what), "constant %u", index);
+    check_bytes(what, got, got ? length : 0, entry, length);
+}
+
+static void test_ordered(void) {
+    hot_class hot = { 0, FILLER, NULL };
+    size_t length;
+    uint8_t *data = build(&hot, 1, &length);
+    CHECK_INT(hot.builds, 2);
+    jclass_reader reader;
+    jclass_code code;
+    if (!data || jc_reader_open_memory(&reader, data, length) != JCLASS_OK) {
+        CHECK(!"ordered class");
+        free(data);
+        return;
+    }
+    // most used first, the String and the Class sharing their UTF-8 entry after them
+    check_constant(&reader, 1, (const uint8_t[]){ 4, 0x3f, 0xc0, 0x00, 0x00 }, 5);
+    check_constant(&reader, 2, (const uint8_t[]){ 8, 0x00, 0x05 }, 3);
+    check_constant(&reader, 3, (const uint8_t[]){ 7, 0x00, 0x05 }, 3);
+    check_constant(&reader, 4, (const uint8_t[]){ 3, 0x00, 0x01, 0x86, 0xa0 }, 5);
+    check_constant(&reader, 5, (const uint8_t[]){ 1, 0x00, 0x03, 'h', 'o', 't' }, 6);
+
+    if (test_read_code(&reader, 0, &code) == JCLASS_OK) {
+        check_bytes("warm", code.code, code.code_length, (const uint8_t[]){ 0x12, 0x01, 0x57, 0xb1 }, 4);
+    }
+    if (test_read_code(&reader, 1, &code) == JCLASS_OK) {
+        check_bytes("loads", code.code, code.code_length, (const uint8_t[]){
+            0x12, 0x02, 0x57, 0x12, 0x02, 0x57, 0x12, 0x02, 0x57,
+            0x12, 0x03, 0x57, 0x12, 0x03, 0x57,
+            0x12, 0x04, 0x57, 0xb1
+        }, 19);
+    }
+    // a weight of 0 leaves its constant where it was added, past the reach of ldc
+    if (test_read_code(&reader, 2, &code) == JCLASS_OK) {
+        CHECK_INT(code.code_length, 20 * 4 + 1);
+        CHECK_INT(code.code[0], 0x13);
+        CHECK(jc_load_u2(code.code + 1) > 0xFF);
+        CHECK_INT(jc_reader_cp_tag(&reader, jc_load_u2(code.code + 1)), 3);
+    }
+    jc_reader_close(&reader);
+    free(data);
+}
+
+static void test_one_build(void) {
+    // every constant ldc loads is reached already, so the first build is kept
+    hot_class hot = { 0, 0, NULL };
+    size_t once_length, ordered_length;
+    uint8_t *once = build(&hot, 0, &once_length);
+    uint8_t *ordered = build(&hot, 1, &ordered_length);
+    CHECK_INT(hot.builds, 1);
+    check_bytes("class built once", ordered, ordered ? ordered_length : 0, once, once ? once_length : 0);
+    free(ordered);
+
+    // a class that copies a read pool keeps its order, even with its loads past 255
+    hot.filler = FILLER;
+    uint8_t *far = build(&hot, 0, &once_length);
+    jclass_reader reader;
+    if (!far || jc_reader_open_memory(&reader, far, once_length) != JCLASS_OK) {
+        CHECK(!"class to copy");
+        free(far);
+        free(once);
+        return;
+    }
+    hot.source = &reader;
+    ordered = build(&hot, 1, &ordered_length);
+    CHECK_INT(hot.builds, 1);
+    check_bytes("copied pool", ordered, ordered ? ordered_length : 0, far, once_length);
+    hot.source = NULL;
+    jc_reader_close(&reader);
+    free(ordered);
+    free(far);
+    free(once);
+}
+
+int main(void) {
+    test_ordered();
+    test_one_build();
+    return test_result("ldc");
+}
@@ -0,0 +1,173 @@
+/**
+    @brief Runs code passes on the instruction list of methods and checks what the list holds, that code
+    written back without changes keeps its bytes, and that removing instructions moves branches and
+    exception handlers
+
+*/
+#include "test.h"
+
+// every kind of operand, in its shortest encoding
+static void emit_forms(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label one = jc_label_new(ctx), two = jc_label_new(ctx), other = jc_label_new(ctx), done = jc_label_new(ctx);
+    jc_iload(ctx, 1);
+    jc_istore(ctx, 4);
+    jc_iload(ctx, 300);
+    jc_iinc(ctx, 1, 1);
+    jc_iinc(ctx, 300, 1000);
+    jc_bipush(ctx, -5);
+    jc_sipush(ctx, 1000);
+    jc_ldc(ctx, jc_cp_string(ctx, "s"));
+    jc_aload(ctx, 0);
+    jc_invokeinterface(ctx, jc_cp_interfacemethodref(ctx, "java/lang/Runnable", "run", "()V"), 1);
+    jc_iconst_1(ctx);
+    jc_iconst_2(ctx);
+    jc_multianewarray(ctx, jc_cp_class(ctx, "[[I"), 2);
+    jc_pop_inst(ctx);
+    jc_iload(ctx, 1);
+    jc_tableswitch(ctx, 1, 2, other, (const jclass_label[]){ one, two });
+    jc_label_bind(ctx, one);
+    jc_iload(ctx, 1);
+    jc_lookupswitch(ctx, other, 2, (const int32_t[]){ 1000, -1000 }, (const jclass_label[]){ two, done });
+    jc_label_bind(ctx, two);
+    jc_goto_label(ctx, done);
+    jc_label_bind(ctx, other);
+    jc_iinc(ctx, 1, -1);
+    jc_label_bind(ctx, done);
+    jc_iload(ctx, 1);
+    jc_ireturn(ctx);
+}
+
+/**
+ * @brief What record_pass saw
+ *
+ */
+typedef struct recorded {
+    jclass_insn insns[16];  // the first instructions
+    size_t count;           // number of instructions in the list
+} recorded;
+
+static void record_pass(jclass_ctx *ctx, void *user) {
+    recorded *seen = user;
+    seen->count = ctx->insn_count;
+    memcpy(seen->insns, ctx->insns, (ctx->insn_count < 16 ? ctx->insn_count : 16) * sizeof(jclass_insn));
+}
+
+static void drop_nops(jclass_ctx *ctx, void *user) {
+    (void)user;
+    for (size_t i = 0; i < ctx->insn_count;) {
+        if (ctx->insns[i].opcode == 0x00) {
+            jc_insn_remove(ctx, i, 1);
+        } else {
+            i++;
+        }
+    }
+}
+
+static void emit_with_pass(jclass_ctx *ctx, void *user) {
+    const test_emit *parts = user;
+    jc_set_code_pass(ctx, parts[0], ctx);
+    parts[1](ctx, NULL);
+}
+
+// wide and _w forms the list folds, with the shorter encoding picked when it is written back
+static void emit_long_forms(jclass_ctx *ctx, void *user) {
+    jclass_label done = jc_label_new(ctx);
+    jc_set_code_pass(ctx, record_pass, user);
+    jc_ldc_w(ctx, jc_cp_string(ctx, "s"));
+    jc_pop_inst(ctx);
+    jc_emit_u1(ctx, 0xc4); // wide iload 1
+    jc_emit_u1(ctx, 0x15);
+    jc_emit_u2(ctx, 1);
+    jc_goto_w_label(ctx, done);
+    jc_iconst_0(ctx);
+    jc_label_bind(ctx, done);
+    jc_ireturn(ctx);
+}
+
+// nops at a branch target, at the start of a handler and as all a handler covers
+static void emit_nops(jclass_ctx *ctx, void *user) {
+    jclass_label target = jc_label_new(ctx), start = jc_label_new(ctx), end = jc_label_new(ctx);
+    jclass_label only_nop = jc_label_new(ctx), handler = jc_label_new(ctx);
+    uint16_t exception = jc_cp_class(ctx, "java/lang/Exception");
+    *(uint16_t *)user = exception;
+    jc_set_code_pass(ctx, drop_nops, NULL);
+    jc_exception_handler(ctx, start, end, handler, exception);
+    jc_exception_handler(ctx, only_nop, target, handler, exception);
+    jc_label_bind(ctx, start);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, target);
+    jc_label_bind(ctx, end);
+    jc_label_bind(ctx, only_nop);
+    jc_nop(ctx);
+    jc_label_bind(ctx, target);
+    jc_nop(ctx);
+    jc_iconst_1(ctx);
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, handler);
+    jc_nop(ctx);
+    jc_pop_inst(ctx);
+    jc_iconst_0(ctx);
+    jc_ireturn(ctx);
+}
+
+static void test_unchanged(void) {
+    test_method plain, listed;
+    CHECK_INT(test_build(&plain, 0, 0, "(Ljava/lang/Runnable;I)I", emit_forms, NULL), JCLASS_OK);
+    CHECK_INT(test_build(&listed, JCLASS_INSTRUCTION_LIST, 0, "(Ljava/lang/Runnable;I)I", emit_forms, NULL), JCLASS_OK);
+    check_bytes("unchanged class", listed.data, listed.length, plain.data, plain.length);
+    test_free(&listed);
+
+    // a pass that drops nothing keeps the bytes too
+    test_emit parts[2] = { drop_nops, emit_forms };
+    CHECK_INT(test_build(&listed, JCLASS_INSTRUCTION_LIST, 0, "(Ljava/lang/Runnable;I)I", emit_with_pass, parts), JCLASS_OK);
+    check_bytes("class after a pass", listed.data, listed.length, plain.data, plain.length);
+    test_free(&listed);
+    test_free(&plain);
+}
+
+static void test_folded(void) {
+    test_method m;
+    recorded seen;
+    memset(&seen, 0, sizeof(seen));
+    CHECK_INT(test_build(&m, JCLASS_INSTRUCTION_LIST, 0, "(I)I", emit_long_forms, &seen), JCLASS_OK);
+    CHECK_INT(seen.count, 6);
+    CHECK_INT(seen.insns[0].opcode, 0x12);     // ldc_w is ldc
+    CHECK_INT(seen.insns[2].opcode, 0x15);     // wide iload 1 is iload
+    CHECK_INT(seen.insns[2].operand, 1);
+    CHECK_INT(seen.insns[3].opcode, 0xa7);     // goto_w is goto
+    CHECK_INT(seen.insns[3].operand, 5);       // to the ireturn
+    uint16_t s = (uint16_t)seen.insns[0].operand;
+    CHECK(s != 0 && s < 0x100);
+    check_code("shortest forms", &m, 0, 0, (const uint8_t[]){
+        0x12, (uint8_t)s, 0x57,         // ldc; pop
+        0x1b,                           // iload_1
+        0xa7, 0x00, 0x04,               // goto +4
+        0x03, 0xac                      // iconst_0; ireturn
+    }, 9);
+    test_free(&m);
+}
+
+static void test_remove(void) {
+    test_method m;
+    uint16_t exception = 0;
+    CHECK_INT(test_build(&m, JCLASS_INSTRUCTION_LIST, 0, "(I)I", emit_nops, &exception), JCLASS_OK);
+    check_code("nops removed", &m, 0, 0, (const uint8_t[]){
+        0x1a, 0x99, 0x00, 0x03,         // iload_0; ifeq +3, to the iconst_1 after the removed nops
+        0x04, 0xac,                     // iconst_1; ireturn
+        0x57, 0x03, 0xac                // pop; iconst_0; ireturn
+    }, 9);
+    // the handler of the nop alone is gone, the other one starts at the pop
+    CHECK_INT(m.code.exception_table_length, 1);
+    check_bytes("handler", m.code.exception_table, 8, (const uint8_t[]){
+        0x00, 0x00, 0x00, 0x04, 0x00, 0x06, (uint8_t)(exception >> 8), (uint8_t)exception
+    }, 8);
+    test_free(&m);
+}
+
+int main(void) {
+    test_unchanged();
+    test_folded();
+    test_remove();
+    return test_result("list");
+}
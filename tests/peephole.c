@@ -0,0 +1,100 @@
+/**
+    @brief Builds methods with each peephole rule on, reads them back with jc_reader_* and checks the rule
+    rewrote the code it matches and the maxs and frames follow
+
+*/
+#include "test.h"
+
+static void emit_store_load(jclass_ctx *ctx, void *user) {
+    jc_set_peephole(ctx, JCLASS_PEEPHOLE_STORE_LOAD);
+    jc_iload(ctx, 0);
+    jc_istore(ctx, 5);
+    jc_iload(ctx, 5);
+    if (user) {
+        jc_iload(ctx, 5);
+        jc_iadd(ctx);
+    }
+    jc_ireturn(ctx);
+}
+
+static void emit_push_pop(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_set_peephole(ctx, JCLASS_PEEPHOLE_PUSH_POP);
+    jc_iconst_3(ctx);
+    jc_pop_inst(ctx);
+    jc_lload(ctx, 0);
+    jc_pop2(ctx);
+    jc_return_inst(ctx);
+}
+
+static void emit_jumps(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label next = jc_label_new(ctx), over = jc_label_new(ctx), target = jc_label_new(ctx);
+    jc_set_peephole(ctx, JCLASS_PEEPHOLE_JUMPS);
+    jc_goto_label(ctx, next);
+    jc_label_bind(ctx, next);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, over);
+    jc_goto_label(ctx, target);
+    jc_label_bind(ctx, over);
+    jc_iconst_0(ctx);
+    jc_ireturn(ctx);
+    jc_label_bind(ctx, target);
+    jc_iconst_1(ctx);
+    jc_ireturn(ctx);
+}
+
+static void emit_dup_pop(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_set_peephole(ctx, JCLASS_PEEPHOLE_DUP_POP);
+    jc_iload(ctx, 0);
+    jc_dup(ctx);
+    jc_pop_inst(ctx);
+    jc_ireturn(ctx);
+}
+
+static void emit_checkcast(jclass_ctx *ctx, void *user) {
+    *(uint16_t *)user = jc_cp_class(ctx, "java/lang/String");
+    jc_set_peephole(ctx, JCLASS_PEEPHOLE_CHECKCAST);
+    jc_aload(ctx, 0);
+    jc_checkcast(ctx, *(uint16_t *)user);
+    jc_checkcast(ctx, *(uint16_t *)user);
+    jc_areturn(ctx);
+}
+
+static void test_peephole(void) {
+    test_method m;
+
+    // local 5 is not read anywhere else, so the store and load go away
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(I)I", emit_store_load, NULL), JCLASS_OK);
+    check_code("store load", &m, 1, 1, (const uint8_t[]){ 0x1a, 0xac }, 2);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(I)I", emit_store_load, "read again"), JCLASS_OK);
+    // dup; istore 5; iload 5 first, then the store and the second load go away as well
+    check_code("store load read again", &m, 2, 1, (const uint8_t[]){ 0x1a, 0x59, 0x60, 0xac }, 4);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(J)V", emit_push_pop, NULL), JCLASS_OK);
+    check_code("push pop", &m, 0, 2, (const uint8_t[]){ 0xb1 }, 1);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)I", emit_jumps, NULL), JCLASS_OK);
+    check_code("jumps", &m, 1, 1, (const uint8_t[]){ 0x1a, 0x9a, 0x00, 0x05, 0x03, 0xac, 0x04, 0xac }, 8);
+    check_stackmap("jumps frames", &m, (const uint8_t[]){ 0x00, 0x01, 0x06 }, 3);
+    test_free(&m);
+
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(I)I", emit_dup_pop, NULL), JCLASS_OK);
+    check_code("dup pop", &m, 1, 1, (const uint8_t[]){ 0x1a, 0xac }, 2);
+    test_free(&m);
+
+    uint16_t string = 0;
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, 0, "(Ljava/lang/Object;)Ljava/lang/Object;", emit_checkcast, &string), JCLASS_OK);
+    check_code("checkcast", &m, 1, 1, (const uint8_t[]){ 0x2a, 0xc0, (uint8_t)(string >> 8), (uint8_t)string, 0xb0 }, 5);
+    test_free(&m);
+}
+
+int main(void) {
+    test_peephole();
+    return test_result("peephole");
+}
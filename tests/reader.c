@@ -0,0 +1,325 @@
+/**
+    @brief Feeds jc_reader_open_memory truncated and corrupted copies of a class. Each copy is allocated
+    with its exact size, so AddressSanitizer reports any read past its end. Also copies the class through
+    jc_constant_pool_copy and the member copies, which have to give it back unchanged
+
+*/
+#include "test.h"
+
+static void emit_interfaces(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_interface_entry(ctx, jc_cp_class(ctx, "java/io/Serializable"));
+}
+
+static void emit_fields(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_field_info(ctx, ACC_STATIC | ACC_FINAL, jc_cp_utf8(ctx, "X"), jc_cp_utf8(ctx, "J"));
+    jc_attribute_start(ctx, jc_cp_utf8(ctx, "ConstantValue"));
+    jc_emit_u2(ctx, jc_cp_long(ctx, 1234567890123LL));
+    jc_attribute_end(ctx);
+    jc_end_field_info(ctx);
+}
+
+static void emit_code(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_ldc(ctx, jc_cp_string(ctx, "text"));
+    jc_areturn(ctx);
+}
+
+static void emit_methods(jclass_ctx *ctx, void *user) {
+    test_code_method(ctx, "m", "()Ljava/lang/String;", 1, 0, emit_code, user);
+}
+
+static void emit_attributes(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_attribute_start(ctx, jc_cp_utf8(ctx, "SourceFile"));
+    jc_emit_u2(ctx, jc_cp_utf8(ctx, "R.java"));
+    jc_attribute_end(ctx);
+}
+
+/** @brief A class R with an interface, a constant field, a method with code and a SourceFile attribute */
+static const test_parts parts = { NULL, emit_interfaces, emit_fields, emit_methods, emit_attributes, NULL };
+
+/**
+    @brief Builds the class R of parts
+    @return The class file to be freed with free(), NULL if it could not be built
+
+*/
+static uint8_t *build_class(size_t *length) {
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "R", &parts);
+    uint8_t *data = NULL;
+    if (jc_finish_take(ctx, &data, length) != JCLASS_OK) {
+        data = NULL;
+    }
+    jc_ctx_free(ctx);
+    return data;
+}
+
+/**
+    @brief Reads everything a reader can give, which must stay inside the class
+
+*/
+static void walk(const jclass_reader *reader) {
+    volatile uint8_t sink = 0;
+    uint16_t length;
+    for (uint16_t i = 1; i < reader->cp_count; i++) {
+        const uint8_t *utf8 = jc_reader_utf8(reader, i, &length);
+        for (uint16_t j = 0; utf8 && j < length; j++) {
+            sink ^= utf8[j];
+        }
+        jc_reader_class_name(reader, i, &length);
+    }
+    for (uint16_t i = 0; i < reader->interfaces_count; i++) {
+        sink ^= (uint8_t)jc_reader_interface(reader, i);
+    }
+    for (uint16_t i = 0; i < reader->fields_count + reader->methods_count; i++) {
+        jclass_member member;
+        jclass_attribute attribute;
+        jclass_code code;
+        if (i < reader->fields_count) {
+            jc_reader_field(reader, i, &member);
+        } else {
+            jc_reader_method(reader, (uint16_t)(i - reader->fields_count), &member);
+        }
+        size_t offset = member.attributes_offset;
+        for (uint16_t a = 0; a < member.attributes_count; a++) {
+            offset = jc_reader_attribute(reader, offset, &attribute);
+            for (uint32_t j = 0; j < attribute.length; j++) {
+                sink ^= attribute.data[j];
+            }
+        }
+        if (jc_reader_find_attribute(reader, member.attributes_offset, member.attributes_count, "Code", &attribute) &&
+            jc_reader_code(reader, &attribute, &code) == JCLASS_OK) {
+            for (uint32_t j = 0; j < code.code_length; j++) {
+                sink ^= code.code[j];
+            }
+            jc_reader_find_attribute(reader, code.attributes_offset, code.attributes_count, "StackMapTable", &attribute);
+        }
+    }
+    jclass_attribute attribute;
+    jc_reader_find_attribute(reader, reader->attributes_offset, reader->attributes_count, "SourceFile", &attribute);
+    (void)sink;
+}
+
+/**
+    @brief Opens a copy of the first length bytes of data, patched at offset if patch_length is not 0
+    @return What jc_reader_open_memory returned
+
+*/
+static int open_copy(const uint8_t *data, size_t length, size_t offset, const uint8_t *patch, size_t patch_length) {
+    uint8_t *copy = malloc(length ? length : 1);
+    if (!copy) {
+        return JCLASS_ERR_NOMEM;
+    }
+    memcpy(copy, data, length);
+    if (patch_length) {
+        memcpy(copy + offset, patch, patch_length);
+    }
+    jclass_reader reader;
+    int result = jc_reader_open_memory(&reader, copy, length);
+    if (result == JCLASS_OK) {
+        walk(&reader);
+        jc_reader_close(&reader);
+    }
+    free(copy);
+    return result;
+}
+
+/**
+ * @brief What the copy parts copy
+ *
+ */
+typedef struct copy_source {
+    const jclass_reader *pool;      // class whose pool is copied
+    const jclass_reader *members;   // class whose interfaces, members and attributes are copied
+    int add_first;                  // 1 to add a constant before copying the pool
+} copy_source;
+
+static void copy_pool(jclass_ctx *ctx, void *user) {
+    const copy_source *source = user;
+    if (source->add_first) {
+        jc_cp_utf8(ctx, "added");
+    }
+    jc_constant_pool_copy(ctx, source->pool);
+}
+
+static void copy_interfaces(jclass_ctx *ctx, void *user) {
+    const copy_source *source = user;
+    for (uint16_t i = 0; i < source->members->interfaces_count; i++) {
+        jc_interface_entry(ctx, jc_reader_interface(source->members, i));
+    }
+}
+
+static void copy_fields(jclass_ctx *ctx, void *user) {
+    const copy_source *source = user;
+    for (uint16_t i = 0; i < source->members->fields_count; i++) {
+        jc_field_copy(ctx, source->members, i);
+    }
+}
+
+static void copy_methods(jclass_ctx *ctx, void *user) {
+    const copy_source *source = user;
+    for (uint16_t i = 0; i < source->members->methods_count; i++) {
+        jc_method_copy(ctx, source->members, i);
+    }
+}
+
+static void copy_attributes(jclass_ctx *ctx, void *user) {
+    const copy_source *source = user;
+    size_t offset = source->members->attributes_offset;
+    for (uint16_t i = 0; i < source->members->attributes_count; i++) {
+        jclass_attribute attribute;
+        offset = jc_reader_attribute(source->members, offset, &attribute);
+        jc_attribute_copy(ctx, source->members, &attribute);
+    }
+}
+
+/**
+    @brief Builds the class R again from its copied pool and parts
+    @return What jc_finish returned, with the class in data and length
+
+*/
+static int copy_class(const copy_source *source, uint8_t **data, size_t *length) {
+    test_parts parts = { copy_pool, copy_interfaces, copy_fields, copy_methods, copy_attributes, (void *)source };
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "R", &parts);
+    int result = jc_finish_take(ctx, data, length);
+    jc_ctx_free(ctx);
+    return result;
+}
+
+static void test_copy(const uint8_t *data, size_t length) {
+    jclass_reader reader, other;
+    CHECK_INT(jc_reader_open_memory(&reader, data, length), JCLASS_OK);
+    uint8_t *copy = NULL;
+    size_t copy_length = 0;
+
+    // the pool, field, method and attribute copied as they are give the same class
+    copy_source source = { &reader, &reader, 0 };
+    CHECK_INT(copy_class(&source, &copy, &copy_length), JCLASS_OK);
+    check_bytes("copied class", copy, copy_length, data, length);
+    free(copy);
+
+    // a constant added before the pool is copied
+    source.add_first = 1;
+    CHECK_INT(copy_class(&source, &copy, &copy_length), JCLASS_ERR_STATE);
+    source.add_first = 0;
+
+    // members of another class than the one the pool came from, even with the same bytes
+    uint8_t *same = malloc(length);
+    if (same) {
+        memcpy(same, data, length);
+        CHECK_INT(jc_reader_open_memory(&other, same, length), JCLASS_OK);
+        source.members = &other;
+        CHECK_INT(copy_class(&source, &copy, &copy_length), JCLASS_ERR_STATE);
+        jc_reader_close(&other);
+        free(same);
+    }
+
+    // members copied without a copied pool, and a method the class does not have
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "R", NULL);
+    jc_method_copy(ctx, &reader, 0);
+    CHECK_INT(jc_error(ctx), JCLASS_ERR_STATE);
+    jc_ctx_free(ctx);
+    ctx = jc_ctx_new();
+    jc_emit_class_header(ctx);
+    jc_constant_pool_start(ctx);
+    jc_constant_pool_copy(ctx, &reader);
+    jc_method_copy(ctx, &reader, reader.methods_count);
+    CHECK_INT(jc_error(ctx), JCLASS_ERR_RANGE);
+    jc_ctx_free(ctx);
+    jc_reader_close(&reader);
+}
+
+int main(void) {
+    size_t length;
+    uint8_t *data = build_class(&length);
+    CHECK(data != NULL);
+    if (!data) {
+        return test_result("reader");
+    }
+    CHECK_INT(open_copy(data, length, 0, NULL, 0), JCLASS_OK);
+    test_copy(data, length);
+
+    jclass_reader reader;
+    jclass_member field, method;
+    jclass_attribute code;
+    CHECK_INT(jc_reader_open_memory(&reader, data, length), JCLASS_OK);
+    CHECK_INT(jc_reader_field(&reader, 0, &field), JCLASS_OK);
+    CHECK_INT(jc_reader_method(&reader, 0, &method), JCLASS_OK);
+    CHECK(jc_reader_find_attribute(&reader, method.attributes_offset, method.attributes_count, "Code", &code));
+    size_t class_attribute = reader.attributes_offset;
+    size_t field_attribute = field.attributes_offset;
+    size_t code_attribute = code.offset;
+    jc_reader_close(&reader);
+
+    // every truncation
+    for (size_t i = 0; i < length; i++) {
+        if (open_copy(data, i, 0, NULL, 0) != JCLASS_ERR_FORMAT) {
+            fprintf(stderr, "truncated to %zu bytes: not JCLASS_ERR_FORMAT\n", i);
+            test_failures++;
+        }
+    }
+
+    // bytes after the end of the class
+    uint8_t *longer = malloc(length + 1);
+    if (longer) {
+        memcpy(longer, data, length);
+        longer[length] = 0;
+        CHECK_INT(open_copy(longer, length + 1, 0, NULL, 0), JCLASS_ERR_FORMAT);
+        free(longer);
+    }
+
+    // constant pool tags that do not exist, in place of the first constant
+    static const uint8_t bad_tags[] = { 0, 2, 13, 14, 21, 0xFF };
+    for (size_t i = 0; i < sizeof(bad_tags); i++) {
+        CHECK_INT(open_copy(data, length, 10, &bad_tags[i], 1), JCLASS_ERR_FORMAT);
+    }
+    // a Utf8 constant longer than the class
+    CHECK_INT(open_copy(data, length, 11, (const uint8_t[]){ 0xFF, 0xFF }, 2), JCLASS_ERR_FORMAT);
+    // more constants than the class holds
+    CHECK_INT(open_copy(data, length, 8, (const uint8_t[]){ 0xFF, 0xFF }, 2), JCLASS_ERR_FORMAT);
+
+    // attribute lengths past the end of the class, including ones that overflow a 32 bit offset
+    static const uint8_t too_long[][4] = { { 0xFF, 0xFF, 0xFF, 0xFF }, { 0x00, 0x00, 0x10, 0x00 }, { 0x80, 0x00, 0x00, 0x00 } };
+    for (size_t i = 0; i < sizeof(too_long) / sizeof(too_long[0]); i++) {
+        CHECK_INT(open_copy(data, length, class_attribute + 2, too_long[i], 4), JCLASS_ERR_FORMAT);
+        CHECK_INT(open_copy(data, length, field_attribute + 2, too_long[i], 4), JCLASS_ERR_FORMAT);
+        CHECK_INT(open_copy(data, length, code_attribute + 2, too_long[i], 4), JCLASS_ERR_FORMAT);
+    }
+    uint8_t one_more[4];
+    jc_store_u4(one_more, 3);   // the SourceFile attribute holds 2 bytes
+    CHECK_INT(open_copy(data, length, class_attribute + 2, one_more, 4), JCLASS_ERR_FORMAT);
+    // more attributes than the class has
+    CHECK_INT(open_copy(data, length, class_attribute - 2, (const uint8_t[]){ 0x00, 0x02 }, 2), JCLASS_ERR_FORMAT);
+
+    // a code_length past the end of the Code attribute is found when the Code attribute is read
+    uint8_t *bad_code = malloc(length);
+    if (bad_code) {
+        memcpy(bad_code, data, length);
+        jc_store_u4(bad_code + code_attribute + 10, 0x7FFFFFFF);
+        CHECK_INT(jc_reader_open_memory(&reader, bad_code, length), JCLASS_OK);
+        jclass_code parts;
+        code.data = bad_code + code_attribute + 6;
+        CHECK_INT(jc_reader_code(&reader, &code, &parts), JCLASS_ERR_FORMAT);
+        jc_reader_close(&reader);
+        free(bad_code);
+    }
+
+    // every byte changed to a few values either opens and reads inside the class, or is JCLASS_ERR_FORMAT
+    static const uint8_t values[] = { 0x00, 0x01, 0x7F, 0x80, 0xFF };
+    for (size_t i = 0; i < length; i++) {
+        for (size_t v = 0; v < sizeof(values); v++) {
+            int result = open_copy(data, length, i, &values[v], 1);
+            if (result != JCLASS_OK && result != JCLASS_ERR_FORMAT) {
+                fprintf(stderr, "byte %zu set to %02x: error %d\n", i, values[v], result);
+                test_failures++;
+            }
+        }
+    }
+
+    free(data);
+    return test_result("reader");
+}
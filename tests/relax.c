@@ -0,0 +1,72 @@
+/**
+    @brief Builds branches out of the reach of a short branch and checks they are relaxed to goto_w and
+    inverted conditional branches over a goto_w, with the frames found where the labels ended up
+
+*/
+#include "test.h"
+
+/** @brief Number of nops between a branch and its label, past the reach of a short branch */
+#define FAR_NOPS 40000
+
+static void emit_far_goto(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label far = jc_label_new(ctx);
+    jc_goto_label(ctx, far);
+    for (int i = 0; i < FAR_NOPS; i++) {
+        jc_nop(ctx);
+    }
+    jc_label_bind(ctx, far);
+    jc_return_inst(ctx);
+}
+
+static void emit_far_ifeq(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label far = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, far);
+    for (int i = 0; i < FAR_NOPS; i++) {
+        jc_nop(ctx);
+    }
+    jc_label_bind(ctx, far);
+    jc_return_inst(ctx);
+}
+
+static void test_relaxation(void) {
+    test_method m;
+    uint8_t *want = calloc(FAR_NOPS + 16, 1);
+    if (!want) {
+        CHECK(!"out of memory");
+        return;
+    }
+
+    // goto becomes goto_w
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, JCLASS_JAVA_6, "(I)V", emit_far_goto, NULL), JCLASS_OK);
+    memcpy(want, (const uint8_t[]){ 0xc8, 0x00, 0x00, 0x9c, 0x45 }, 5); // goto_w +40005
+    want[5 + FAR_NOPS] = 0xb1;
+    check_code("goto_w", &m, 0, 1, want, 6 + FAR_NOPS);
+    test_free(&m);
+
+    // ifeq becomes ifne over a goto_w
+    memset(want, 0, FAR_NOPS + 16);
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_MAXS, JCLASS_JAVA_6, "(I)V", emit_far_ifeq, NULL), JCLASS_OK);
+    memcpy(want, (const uint8_t[]){ 0x1a, 0x9a, 0x00, 0x08, 0xc8, 0x00, 0x00, 0x9c, 0x45 }, 9); // iload_0; ifne +8; goto_w +40005
+    want[9 + FAR_NOPS] = 0xb1;
+    check_code("inverted ifeq", &m, 1, 1, want, 10 + FAR_NOPS);
+    test_free(&m);
+
+    // the frame after the trampoline is found where the label ended up
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, 0, "(I)V", emit_far_ifeq, NULL), JCLASS_OK);
+    check_code("inverted ifeq with frames", &m, 1, 1, want, 10 + FAR_NOPS);
+    check_stackmap("inverted ifeq frames", &m, (const uint8_t[]){
+        0x00, 0x02,
+        0x09,                           // same_frame at 9, after the goto_w
+        0xfb, 0x9c, 0x3f                // same_frame_extended at 40009
+    }, 6);
+    test_free(&m);
+    free(want);
+}
+
+int main(void) {
+    test_relaxation();
+    return test_result("relax");
+}
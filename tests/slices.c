@@ -0,0 +1,130 @@
+/**
+    @brief Checks jc_finish_slices and jc_write_sink give the bytes jc_finish gives, before the constant
+    pool is moved into the output and after, and that a sink stopping is reported
+
+*/
+#include "test.h"
+
+static void emit_code(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_ldc(ctx, jc_cp_string(ctx, "slices"));
+    jc_areturn(ctx);
+}
+
+static void emit_methods(jclass_ctx *ctx, void *user) {
+    test_code_method(ctx, "m", "()Ljava/lang/String;", 1, 0, emit_code, user);
+}
+
+/**
+ * @brief Bytes joined by collect
+ *
+ */
+typedef struct joined {
+    uint8_t data[4096];     // the bytes
+    size_t length;          // number of bytes in data
+    size_t calls;           // number of times collect was called
+    size_t stop_at;         // call that returns nonzero, 0 for none
+} joined;
+
+static int collect(void *user, const uint8_t *data, size_t length) {
+    joined *out = user;
+    out->calls++;
+    if (out->calls == out->stop_at) {
+        return 1;
+    }
+    if (out->length + length <= sizeof(out->data)) {
+        memcpy(out->data + out->length, data, length);
+    }
+    out->length += length;
+    return 0;
+}
+
+/**
+    @brief Joins the slices of the class built with ctx
+    @return The number of slices
+
+*/
+static size_t join_slices(jclass_ctx *ctx, joined *out) {
+    jclass_slice slices[4];
+    size_t count = 0;
+    memset(out, 0, sizeof(*out));
+    CHECK_INT(jc_finish_slices(ctx, slices, &count), JCLASS_OK);
+    for (size_t i = 0; i < count; i++) {
+        collect(out, slices[i].data, slices[i].length);
+    }
+    return count;
+}
+
+/**
+    @brief Checks the slices and the sink give what jc_finish gives, before and after it moves the pool
+    @param count Number of slices before the pool is moved
+
+*/
+static void check_class(const char *what, const test_parts *parts, size_t count) {
+    joined before, sunk, after;
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "S", parts);
+    CHECK_INT(join_slices(ctx, &before), count);
+    memset(&sunk, 0, sizeof(sunk));
+    CHECK_INT(jc_write_sink(ctx, collect, &sunk), JCLASS_OK);
+    CHECK_INT(sunk.calls, count);
+
+    const uint8_t *data = NULL;
+    size_t length = 0;
+    CHECK_INT(jc_finish(ctx, &data, &length), JCLASS_OK);
+    check_bytes(what, before.data, before.length, data, length);
+    check_bytes(what, sunk.data, sunk.length, data, length);
+
+    // once jc_finish has moved the pool, the whole class is one slice
+    CHECK_INT(join_slices(ctx, &after), 1);
+    check_bytes(what, after.data, after.length, data, length);
+    memset(&sunk, 0, sizeof(sunk));
+    CHECK_INT(jc_write_sink(ctx, collect, &sunk), JCLASS_OK);
+    CHECK_INT(sunk.calls, 1);
+    check_bytes(what, sunk.data, sunk.length, data, length);
+    jc_ctx_free(ctx);
+}
+
+static void test_sink_errors(void) {
+    joined out;
+    jclass_slice slices[4];
+    size_t count = 1;
+    jclass_ctx *ctx = jc_ctx_new();
+    test_class(ctx, "S", NULL);
+    // a sink that stops is not called again
+    memset(&out, 0, sizeof(out));
+    out.stop_at = 2;
+    CHECK_INT(jc_write_sink(ctx, collect, &out), JCLASS_ERR_IO);
+    CHECK_INT(out.calls, 2);
+    memset(&out, 0, sizeof(out));
+    out.stop_at = 1;
+    CHECK_INT(jc_write_sink(ctx, collect, &out), JCLASS_ERR_IO);
+    CHECK_INT(out.calls, 1);
+    jc_ctx_free(ctx);
+
+    // an unfinished class has no slices and is not given to the sink
+    ctx = jc_ctx_new();
+    jc_emit_class_header(ctx);
+    jc_constant_pool_start(ctx);
+    jc_interfaces_start(ctx);
+    CHECK_INT(jc_finish_slices(ctx, slices, &count), JCLASS_ERR_STATE);
+    CHECK_INT(count, 0);
+    memset(&out, 0, sizeof(out));
+    CHECK_INT(jc_write_sink(ctx, collect, &out), JCLASS_ERR_STATE);
+    CHECK_INT(out.calls, 0);
+    jc_ctx_free(ctx);
+
+    // nor is one whose pool was never started
+    ctx = jc_ctx_new();
+    jc_emit_class_header(ctx);
+    CHECK_INT(jc_finish_slices(ctx, slices, &count), JCLASS_ERR_STATE);
+    jc_ctx_free(ctx);
+}
+
+int main(void) {
+    test_parts methods = { NULL, NULL, NULL, emit_methods, NULL, NULL };
+    check_class("empty class", NULL, 4);
+    check_class("class with a method", &methods, 4);
+    test_sink_errors();
+    return test_result("slices");
+}
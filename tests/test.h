@@ -0,0 +1,241 @@
+/**
+    @brief Checks shared by the tests. Every test includes jclass.c through this file, so the static
+    functions can be tested too
+
+*/
+#include "../src/jclass.c"
+
+/** @brief Number of checks that failed */
+static int test_failures;
+
+#define CHECK(cond) do { \
+        if (!(cond)) { \
+            fprintf(stderr, "%s:%d: %s\n", __FILE__, __LINE__, #cond); \
+            test_failures++; \
+        } \
+    } while (0)
+
+#define CHECK_INT(got, want) do { \
+        long long got_ = (long long)(got), want_ = (long long)(want); \
+        if (got_ != want_) { \
+            fprintf(stderr, "%s:%d: %s is %lld, not %lld\n", __FILE__, __LINE__, #got, got_, want_); \
+            test_failures++; \
+        } \
+    } while (0)
+
+/**
+    @brief Checks got holds the same bytes as want, printing where they first differ
+    @param what Name of the bytes for the message
+
+*/
+static inline void check_bytes(const char *what, const uint8_t *got, size_t got_length, const uint8_t *want, size_t want_length) {
+    size_t i = 0;
+    while (i < got_length && i < want_length && got[i] == want[i]) {
+        i++;
+    }
+    if (i == got_length && i == want_length) {
+        return;
+    }
+    fprintf(stderr, "%s: %zu bytes, expected %zu, first difference at %zu:", what, got_length, want_length, i);
+    for (size_t j = i; j < got_length && j < i + 8; j++) {
+        fprintf(stderr, " %02x", got[j]);
+    }
+    fprintf(stderr, " instead of");
+    for (size_t j = i; j < want_length && j < i + 8; j++) {
+        fprintf(stderr, " %02x", want[j]);
+    }
+    fprintf(stderr, "\n");
+    test_failures++;
+}
+
+/**
+ * @brief Emits part of a test class, with the section it goes in started
+ *
+ */
+typedef void (*test_emit)(jclass_ctx *ctx, void *user);
+
+/**
+ * @brief The parts of a class test_class emits, the ones left NULL stay empty
+ *
+ */
+typedef struct test_parts {
+    test_emit pool;         // constants added, or a pool copied, before the ones of the class
+    test_emit interfaces;   // interface entries
+    test_emit fields;       // field_info entries
+    test_emit methods;      // method_info entries
+    test_emit attributes;   // attributes of the class
+    void *user;             // passed to every part as it is
+} test_parts;
+
+/**
+    @brief Emits a public class extending java/lang/Object, ready for jc_finish
+    @param name Name of the class
+    @param parts Parts of the class, NULL for a class without members
+
+*/
+static inline void test_class(jclass_ctx *ctx, const char *name, const test_parts *parts) {
+    static const test_parts empty;
+    if (!parts) {
+        parts = &empty;
+    }
+    jc_emit_class_header(ctx);
+    jc_constant_pool_start(ctx);
+    if (parts->pool) {
+        parts->pool(ctx, parts->user);
+    }
+    jc_emit_class_footer(ctx, jc_cp_class(ctx, name), ACC_PUBLIC, jc_cp_class(ctx, "java/lang/Object"));
+    jc_interfaces_start(ctx);
+    if (parts->interfaces) {
+        parts->interfaces(ctx, parts->user);
+    }
+    jc_interfaces_end(ctx);
+    jc_fields_start(ctx);
+    if (parts->fields) {
+        parts->fields(ctx, parts->user);
+    }
+    jc_fields_end(ctx);
+    jc_methods_start(ctx);
+    if (parts->methods) {
+        parts->methods(ctx, parts->user);
+    }
+    jc_methods_end(ctx);
+    jc_attributes_start(ctx);
+    if (parts->attributes) {
+        parts->attributes(ctx, parts->user);
+    }
+    jc_attributes_end(ctx);
+}
+
+/**
+    @brief Emits a public static method with a Code attribute, between jc_methods_start and jc_methods_end
+    @param emit Emits the code, with the Code attribute started
+    @param user Passed to emit as it is
+
+*/
+static inline void test_code_method(jclass_ctx *ctx, const char *name, const char *descriptor, uint16_t max_stack, uint16_t max_locals, test_emit emit, void *user) {
+    jc_method_info(ctx, ACC_PUBLIC | ACC_STATIC, jc_cp_utf8(ctx, name), jc_cp_utf8(ctx, descriptor));
+    jc_code_attribute_start(ctx, jc_cp_utf8(ctx, "Code"), max_stack, max_locals);
+    emit(ctx, user);
+    jc_code_attribute_end(ctx);
+    jc_end_method_info(ctx);
+}
+
+/**
+ * @brief A class of one static method m, read back
+ *
+ */
+typedef struct test_method {
+    uint8_t *data;              // the class file
+    size_t length;              // size of data
+    jclass_reader reader;       // reads data
+    jclass_code code;           // the Code attribute of m
+    jclass_attribute stackmap;  // its StackMapTable, if has_stackmap
+    int has_stackmap;           // 1 if the Code attribute has a StackMapTable
+} test_method;
+
+/**
+ * @brief The method test_build emits
+ *
+ */
+typedef struct test_method_code {
+    const char *descriptor;     // descriptor of m
+    test_emit emit;             // emits the code of m
+    void *user;                 // passed to emit as it is
+} test_method_code;
+
+static inline void test_method_part(jclass_ctx *ctx, void *user) {
+    const test_method_code *method = user;
+    test_code_method(ctx, "m", method->descriptor, 0, 0, method->emit, method->user);
+}
+
+/**
+    @brief Reads the Code attribute of method i of a class, checking it is there
+    @return JCLASS_OK, or the error reading it gave
+
+*/
+static inline int test_read_code(const jclass_reader *reader, uint16_t i, jclass_code *code) {
+    jclass_member member;
+    jclass_attribute attribute;
+    int result = jc_reader_method(reader, i, &member);
+    if (result == JCLASS_OK) {
+        result = jc_reader_find_attribute(reader, member.attributes_offset, member.attributes_count, "Code", &attribute) ?
+            jc_reader_code(reader, &attribute, code) : JCLASS_ERR_FORMAT;
+    }
+    CHECK_INT(result, JCLASS_OK);
+    return result;
+}
+
+/**
+    @brief Builds a class T with the static method m and reads it back
+    @param flags JCLASS_* flags of the context
+    @param version Class file version, 0 for the default
+    @param descriptor Descriptor of m
+    @param emit Emits the code of m
+    @param user Passed to emit as it is
+    @return JCLASS_OK, or the error building the class reported
+
+*/
+static inline int test_build(test_method *m, uint32_t flags, uint16_t version, const char *descriptor, test_emit emit, void *user) {
+    memset(m, 0, sizeof(*m));
+    jclass_ctx *ctx = jc_ctx_new();
+    jc_set_flags(ctx, flags);
+    if (version) {
+        jc_set_version(ctx, version, 0);
+    }
+    test_method_code method = { descriptor, emit, user };
+    test_parts parts = { NULL, NULL, NULL, test_method_part, NULL, &method };
+    test_class(ctx, "T", &parts);
+    int result = jc_finish_take(ctx, &m->data, &m->length);
+    jc_ctx_free(ctx);
+    if (result != JCLASS_OK) {
+        return result;
+    }
+    CHECK_INT(jc_reader_open_memory(&m->reader, m->data, m->length), JCLASS_OK);
+    test_read_code(&m->reader, 0, &m->code);
+    m->has_stackmap = jc_reader_find_attribute(&m->reader, m->code.attributes_offset, m->code.attributes_count, "StackMapTable", &m->stackmap);
+    return JCLASS_OK;
+}
+
+/**
+    @brief Frees what test_build allocated
+
+*/
+static inline void test_free(test_method *m) {
+    jc_reader_close(&m->reader);
+    free(m->data);
+}
+
+/**
+    @brief Checks the code and maxs of a method
+
+*/
+static inline void check_code(const char *what, const test_method *m, uint16_t max_stack, uint16_t max_locals, const uint8_t *code, size_t length) {
+    CHECK_INT(m->code.max_stack, max_stack);
+    CHECK_INT(m->code.max_locals, max_locals);
+    check_bytes(what, m->code.code, m->code.code_length, code, length);
+}
+
+/**
+    @brief Checks the StackMapTable of a method, frames starts with the number of frames
+
+*/
+static inline void check_stackmap(const char *what, const test_method *m, const uint8_t *frames, size_t length) {
+    CHECK(m->has_stackmap);
+    if (m->has_stackmap) {
+        check_bytes(what, m->stackmap.data, m->stackmap.length, frames, length);
+    }
+}
+
+/**
+    @brief Ends a test
+    @return The exit status of the test
+
+*/
+static inline int test_result(const char *name) {
+    if (test_failures) {
+        fprintf(stderr, "%s: %d checks failed\n", name, test_failures);
+        return 1;
+    }
+    printf("%s: ok\n", name);
+    return 0;
+}
@@ -0,0 +1,113 @@
+/**
+    @brief Builds classes for several class file versions and checks the version is written, and that
+    features a version does not have are refused with JCLASS_ERR_STATE
+
+*/
+#include "test.h"
+
+static void emit_return(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_return_inst(ctx);
+}
+
+static void emit_own_stackmap(jclass_ctx *ctx, void *user) {
+    jclass_label l = jc_label_new(ctx);
+    jc_iload(ctx, 0);
+    jc_ifeq_label(ctx, l);
+    jc_label_bind(ctx, l);
+    jc_return_inst(ctx);
+    if (user) {
+        jc_code_attributes_start(ctx);
+        jc_attribute_start(ctx, jc_cp_utf8(ctx, "StackMapTable"));
+        jc_emit_u2(ctx, 1);
+        jc_emit_u1(ctx, 4); // same_frame at 4
+        jc_attribute_end(ctx);
+    }
+}
+
+static void emit_invokedynamic(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jc_invokedynamic(ctx, jc_cp_utf8(ctx, "not checked"));
+    jc_return_inst(ctx);
+}
+
+static void emit_jsr(jclass_ctx *ctx, void *user) {
+    (void)user;
+    jclass_label subroutine = jc_label_new(ctx);
+    jc_jsr_label(ctx, subroutine);
+    jc_return_inst(ctx);
+    jc_label_bind(ctx, subroutine);
+    jc_astore(ctx, 0);
+    jc_ret_inst(ctx, 0);
+}
+
+static void test_versions(void) {
+    test_method m;
+
+    // the default, and a version set before the header
+    CHECK_INT(test_build(&m, 0, 0, "()V", emit_return, NULL), JCLASS_OK);
+    CHECK_INT(m.reader.major_version, JCLASS_JAVA_8);
+    CHECK_INT(m.reader.minor_version, 0);
+    test_free(&m);
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_5, "()V", emit_return, NULL), JCLASS_OK);
+    CHECK_INT(m.reader.major_version, JCLASS_JAVA_5);
+    test_free(&m);
+
+    jclass_ctx *ctx = jc_ctx_new();
+    jc_set_version(ctx, JCLASS_JAVA_17, 0xFFFF); // preview features
+    test_class(ctx, "T", NULL);
+    const uint8_t *data = NULL;
+    size_t length = 0;
+    CHECK_INT(jc_finish(ctx, &data, &length), JCLASS_OK);
+    CHECK(length > 8);
+    if (length > 8) {
+        check_bytes("preview version", data + 4, 4, (const uint8_t[]){ 0xff, 0xff, 0x00, JCLASS_JAVA_17 }, 4);
+    }
+    jc_ctx_free(ctx);
+
+    // after the header, too old, and a minor version Java 12 on does not have
+    ctx = jc_ctx_new();
+    jc_emit_class_header(ctx);
+    jc_set_version(ctx, JCLASS_JAVA_6, 0);
+    CHECK_INT(jc_error(ctx), JCLASS_ERR_STATE);
+    jc_ctx_free(ctx);
+    ctx = jc_ctx_new();
+    jc_set_version(ctx, 44, 0);
+    CHECK_INT(jc_error(ctx), JCLASS_ERR_RANGE);
+    jc_ctx_free(ctx);
+    ctx = jc_ctx_new();
+    jc_set_version(ctx, JCLASS_JAVA_17, 1);
+    CHECK_INT(jc_error(ctx), JCLASS_ERR_RANGE);
+    jc_ctx_free(ctx);
+}
+
+static void test_features(void) {
+    test_method m;
+
+    // invokedynamic from Java 7 on, jsr and ret before it
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_6, "()V", emit_invokedynamic, NULL), JCLASS_ERR_STATE);
+    test_free(&m);
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_6, "()V", emit_jsr, NULL), JCLASS_OK);
+    test_free(&m);
+    CHECK_INT(test_build(&m, JCLASS_COMPUTE_FRAMES, JCLASS_JAVA_8, "()V", emit_jsr, NULL), JCLASS_ERR_STATE);
+    test_free(&m);
+
+    // from Java 7 on, branches need frames, computed or written by the caller
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_8, "(I)V", emit_own_stackmap, "own"), JCLASS_OK);
+    check_stackmap("own frames", &m, (const uint8_t[]){ 0x00, 0x01, 0x04 }, 3);
+    test_free(&m);
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_8, "(I)V", emit_own_stackmap, NULL), JCLASS_ERR_STATE);
+    test_free(&m);
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_6, "(I)V", emit_own_stackmap, NULL), JCLASS_OK);
+    CHECK(!m.has_stackmap);
+    test_free(&m);
+    // nor does Java 5 have a StackMapTable to write
+    CHECK_INT(test_build(&m, 0, JCLASS_JAVA_5, "(I)V", emit_own_stackmap, "own"), JCLASS_ERR_STATE);
+    test_free(&m);
+}
+
+int main(void) {
+    test_versions();
+    test_features();
+    return test_result("version");
+}
@@ -0,0 +1,173 @@
+/**
+    @brief Writes classes with a jclass_writer while building more, and checks every file, the result of
+    each ticket, the errors flush returns and the limit on queued bytes. Built once with the writing thread
+    and once with JCLASS_NO_THREADS, where files are written by jc_writer_submit
+
+*/
+#include "test.h"
+
+/** @brief Number of classes of the main run, more than the writer first allocates results for */
+#define FILES 200
+
+static void emit_field(jclass_ctx *ctx, void *user) {
+    unsigned n = *(const unsigned *)user;
+    for (unsigned i = 0; i < n % 7; i++) {
+        char name[16];
+        snprintf(name, sizeof(name), "f%u", i);
+        jc_field_info(ctx, ACC_PUBLIC, jc_cp_utf8(ctx, name), jc_cp_utf8(ctx, "I"));
+        jc_end_field_info(ctx);
+    }
+}
+
+/**
+    @brief Builds the class W<n> with ctx, with n % 7 fields
+
+*/
+static void build_numbered(jclass_ctx *ctx, unsigned n) {
+    char name[16];
+    snprintf(name, sizeof(name), "W%u", n);
+    test_parts parts = { NULL, NULL, emit_field, NULL, NULL, &n };
+    jc_ctx_reset(ctx);
+    test_class(ctx, name, &parts);
+}
+
+static void file_name(char *path, size_t size, unsigned n) {
+    snprintf(path, size, "writer_%u.class", n);
+}
+
+/**
+    @brief Checks a written file holds the class W<n>, and removes it
+
+*/
+static void check_file(unsigned n) {
+    char path[32];
+    file_name(path, sizeof(path), n);
+    jclass_ctx *ctx = jc_ctx_new();
+    const uint8_t *want = NULL;
+    size_t want_length = 0;
+    build_numbered(ctx, n);
+    CHECK_INT(jc_finish(ctx, &want, &want_length), JCLASS_OK);
+    jclass_reader reader;
+    if (jc_reader_open(&reader, path) == JCLASS_OK) {
+        check_bytes(path, reader.data, reader.length, want, want_length);
+        jc_reader_close(&reader);
+    } else {
+        fprintf(stderr, "%s was not written\n", path);
+        test_failures++;
+    }
+    jc_ctx_free(ctx);
+    remove(path);
+}
+
+/**
+    @brief Checks the queued bytes stay under the limit, unless one file is larger than it
+
+*/
+static void check_queued(jclass_writer *writer, size_t length) {
+#ifdef JCLASS_THREADS
+    mtx_lock(&writer->lock);
+#endif
+    CHECK(writer->queued_bytes <= writer->max_queued_bytes || writer->queued_bytes == length);
+#ifdef JCLASS_THREADS
+    mtx_unlock(&writer->lock);
+#endif
+}
+
+static void test_many(size_t max_queued_bytes) {
+    jclass_writer writer;
+    jclass_ctx *ctx = jc_ctx_new();
+    size_t tickets[FILES];
+    CHECK_INT(jc_writer_open(&writer, max_queued_bytes), JCLASS_OK);
+    for (unsigned n = 0; n < FILES; n++) {
+        char path[32];
+        file_name(path, sizeof(path), n);
+        build_numbered(ctx, n);
+        const uint8_t *data;
+        size_t length = 0;
+        jc_finish(ctx, &data, &length);
+        CHECK_INT(jc_writer_submit_class(&writer, ctx, path, &tickets[n]), JCLASS_OK);
+        CHECK_INT(tickets[n], n);
+        if (max_queued_bytes) {
+            check_queued(&writer, length);
+        }
+#ifndef JCLASS_THREADS
+        // written before submit returns
+        CHECK_INT(jc_writer_result(&writer, tickets[n]), JCLASS_OK);
+#endif
+    }
+    CHECK_INT(jc_writer_flush(&writer), JCLASS_OK);
+    for (unsigned n = 0; n < FILES; n++) {
+        CHECK_INT(jc_writer_result(&writer, tickets[n]), JCLASS_OK);
+        check_file(n);
+    }
+    CHECK_INT(jc_writer_result(&writer, FILES), JCLASS_ERR_RANGE);
+    CHECK_INT(jc_writer_close(&writer), JCLASS_OK);
+    jc_ctx_free(ctx);
+}
+
+static void test_errors(void) {
+    jclass_writer writer;
+    size_t good, bad, after = 0;
+    CHECK_INT(jc_writer_open(&writer, 0), JCLASS_OK);
+    uint8_t *data = malloc(4);
+    if (!data) {
+        CHECK(!"out of memory");
+        return;
+    }
+    memcpy(data, "data", 4);
+    CHECK_INT(jc_writer_submit(&writer, "writer_good.bin", data, 4, &good), JCLASS_OK);
+    data = malloc(4);
+    if (!data) {
+        CHECK(!"out of memory");
+        return;
+    }
+    memcpy(data, "lost", 4);
+    CHECK_INT(jc_writer_submit(&writer, "writer_no_such_directory/file.bin", data, 4, &bad), JCLASS_OK);
+    CHECK_INT(jc_writer_flush(&writer), JCLASS_ERR_IO);
+    CHECK_INT(jc_writer_result(&writer, good), JCLASS_OK);
+    CHECK_INT(jc_writer_result(&writer, bad), JCLASS_ERR_IO);
+
+    // the error is reported by one flush, the result of its file stays
+    CHECK_INT(jc_writer_flush(&writer), JCLASS_OK);
+    CHECK_INT(jc_writer_result(&writer, bad), JCLASS_ERR_IO);
+    data = malloc(1);
+    if (data) {
+        data[0] = 1;
+        CHECK_INT(jc_writer_submit(&writer, "writer_after.bin", data, 1, &after), JCLASS_OK);
+        CHECK_INT(after, bad + 1);
+    }
+    CHECK_INT(jc_writer_flush(&writer), JCLASS_OK);
+    CHECK_INT(jc_writer_result(&writer, after), JCLASS_OK);
+    CHECK_INT(jc_writer_close(&writer), JCLASS_OK);
+
+    char written[8] = { 0 };
+    FILE *file = fopen("writer_good.bin", "rb");
+    CHECK(file && fread(written, 1, sizeof(written), file) == 4 && memcmp(written, "data", 4) == 0);
+    if (file) {
+        fclose(file);
+    }
+    remove("writer_good.bin");
+    remove("writer_after.bin");
+
+    // a class that failed is not submitted
+    jclass_ctx *ctx = jc_ctx_new();
+    CHECK_INT(jc_writer_open(&writer, 0), JCLASS_OK);
+    jc_emit_class_header(ctx);
+    CHECK_INT(jc_writer_submit_class(&writer, ctx, "writer_unfinished.class", NULL), JCLASS_ERR_STATE);
+    CHECK_INT(jc_writer_result(&writer, 0), JCLASS_ERR_RANGE);
+    CHECK_INT(jc_writer_close(&writer), JCLASS_OK);
+    jc_ctx_free(ctx);
+}
+
+int main(void) {
+    test_many(0);
+    // small enough that most submits wait for the writer
+    test_many(1000);
+    test_many(1);
+    test_errors();
+#ifdef JCLASS_THREADS
+    return test_result("writer");
+#else
+    return test_result("writer without threads");
+#endif
+}